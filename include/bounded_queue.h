@@ -0,0 +1,62 @@
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// FIFO between the threads of two stages: push() waits while nCapacity items are
+// queued, pop() waits for an item. After close() pushes are refused and pop()
+// returns the remaining items then false.
+template<typename T>
+class BoundedQueue {
+    std::deque<T> _aItems;
+    size_t _nCapacity;
+    bool _bClosed = false;
+    std::mutex _oMutex;
+    std::condition_variable _oNotEmpty;
+    std::condition_variable _oNotFull;
+public:
+    explicit BoundedQueue(size_t nCapacity) : _nCapacity(nCapacity ? nCapacity : 1) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> oLock(_oMutex);
+        _oNotFull.wait(oLock, [this] { return _bClosed || _aItems.size() < _nCapacity; });
+        if (_bClosed)
+        {
+            return false;
+        }
+        _aItems.push_back(std::move(item));
+        _oNotEmpty.notify_one();
+        return true;
+    }
+
+    bool pop(T& rItem)
+    {
+        std::unique_lock<std::mutex> oLock(_oMutex);
+        _oNotEmpty.wait(oLock, [this] { return _bClosed || !_aItems.empty(); });
+        if (_aItems.empty())
+        {
+            return false;
+        }
+        rItem = std::move(_aItems.front());
+        _aItems.pop_front();
+        _oNotFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> oLock(_oMutex);
+        _bClosed = true;
+        _oNotEmpty.notify_all();
+        _oNotFull.notify_all();
+    }
+};
+
+#endif // BOUNDED_QUEUE_H_
\ No newline at end of file
@@ -0,0 +1,87 @@
+#ifndef FILTER_PLAN_H
+#define FILTER_PLAN_H
+#pragma once
+#include "parameter_helpers.h"
+#include "filters.h"
+#include "filters_cpu.h"
+#include <ImagesNPP.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace filters
+{
+    // A --filter list or a --pipeline resolved once for an image size, depth and backend:
+    // the Parameters of each filter or stage with their NPP function on the device, or the cpu
+    // plans with their kernels, row bands or fused tiles and scratch buffers on the host.
+    // It then filters any number of images of the same key without looking up or allocating
+    class Plan
+    {
+    public:
+        // parameters gives the filters and the geometry, nDepth the bits of a sample (8, 16 or 32 for float)
+        Plan(const Parameters& parameters, int nDepth, bool bDevice);
+        ~Plan();
+
+        Plan(const Plan&) = delete;
+        Plan& operator=(const Plan&) = delete;
+
+        // Every setting a plan depends on: filters or stages with their mask, anchor, noise and border,
+        // source size, offset and ROI, depth, fusion, backend and thread pool
+        static std::string getKey(const Parameters& parameters, int nDepth, bool bDevice);
+        const std::string& getKey() const { return _sKey; }
+
+        bool isDevice() const { return _bDevice; }
+        // filters of the list or stages of the pipeline
+        size_t size() const { return _aParameters.size(); }
+        const Parameters& getParameters(size_t i) const { return _aParameters[i]; }
+
+        // Device: filter or stage i queued on the stream of oContext
+        void execute(size_t i, const NppStreamContext& oContext, const npp::ImageNPP_8u_C3& oDeviceSrc, npp::ImageNPP_8u_C3& oDeviceDst);
+
+        // Host: filter i writes apDst[i], a pipeline writes apDst[0] (fused unless --no-fusion,
+        // which runs executeStage() instead). Implemented for Npp8u, Npp16u and Npp32f
+        template<typename D>
+        void execute(const D* pSrc, int nSrcStep, D* const* apDst, int nDstStep);
+        // Host --no-fusion pipeline: stage i alone over the whole image
+        template<typename D>
+        void executeStage(size_t i, const D* pSrc, int nSrcStep, D* pDst, int nDstStep);
+
+        // Bytes of the host scratch buffers and fused windows
+        size_t getScratchBytes() const;
+    private:
+        std::string _sKey;
+        bool _bDevice;
+        bool _bFused;
+        std::vector<Parameters> _aParameters;
+        std::vector<Kernel> _aDeviceKernels;
+        // one plan for a list or a fused pipeline, one per stage without fusion, of the image depth only
+        std::vector<std::unique_ptr<cpu::Plan<Npp8u> > > _aHost8u;
+        std::vector<std::unique_ptr<cpu::Plan<Npp16u> > > _aHost16u;
+        std::vector<std::unique_ptr<cpu::Plan<Npp32f> > > _aHost32f;
+
+        template<typename D>
+        std::vector<std::unique_ptr<cpu::Plan<D> > >& host();
+        template<typename D>
+        void planHost();
+    };
+
+    // Plans of the images filtered by one owner: the command line run, the batch filter stage or
+    // a daemon job slot. The least recently used plan is dropped beyond nCapacity keys.
+    // Used by one thread at a time, like the plans
+    class PlanCache
+    {
+        size_t _nCapacity;
+        std::list<std::unique_ptr<Plan> > _aPlans;
+    public:
+        explicit PlanCache(size_t nCapacity = 8) : _nCapacity(nCapacity)
+        {
+            ;
+        }
+
+        // Plan of the key of these settings, made on first use
+        Plan& get(const Parameters& parameters, int nDepth, bool bDevice);
+    };
+}
+
+#endif // FILTER_PLAN_H
\ No newline at end of file
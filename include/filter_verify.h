@@ -0,0 +1,24 @@
+#ifndef FILTER_VERIFY_H
+#define FILTER_VERIFY_H
+#pragma once
+#include <npp.h>
+
+// npp-filters-bench --verify: differential check of the optimized cpu kernels. Random cases
+// (depth, pattern, image size down to 1xN and Nx1, ROI offset, row pitches, filters, borders,
+// mask sizes, anchors and noise levels) are filtered by a scalar reference reading every mask
+// tap, then by each variant: one plan on a single thread, row bands over the pool, a --filter
+// list, a fused --pipeline against the reference stages one after the other and the --sweep
+// summed-area tables. Results must be bit-exact and the pitch padding untouched, except float
+// sweeps whose sums are not made in mask order (see nSweepTolerance).
+// --golden=FILE then compares the hashes of the cpu and npp results of a fixed image with FILE,
+// written on its first run, so the results of two machines or builds can be compared
+namespace verify
+{
+    // Largest difference of a float sweep sample, relative to the [0, 1] range
+    const double nSweepTolerance = 1e-6;
+
+    // Options of the command line, EXIT_SUCCESS when every variant and golden hash matches
+    int run(int argc, char* argv[], bool bDevice, const NppStreamContext& oContext);
+}
+
+#endif // FILTER_VERIFY_H
\ No newline at end of file
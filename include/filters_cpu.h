@@ -0,0 +1,123 @@
+#ifndef FILTERS_CPU_H
+#define FILTERS_CPU_H
+#pragma once
+#include "parameter_helpers.h"
+#include <ImagesCPU.h>
+#include <vector>
+#include <memory>
+#include <type_traits>
+
+namespace filters
+{
+    // Host implementation of the filters for 8u, 16u and 32f RGB images.
+    // Kernels use the NPP masks, integer results are rounded to nearest and saturated,
+    // wiener noise levels are relative to the sample range (1.0 for 32f).
+    // Out of image pixels are always replicated from the border: the host path has no
+    // unchecked reads, so border type none behaves as replicate.
+    namespace cpu
+    {
+        // Same conventions as the NPP border functions: pSrc points to the pixel at
+        // getSrcOffset() inside a getSrcSize() image, getSizeROI() pixels are written to pDst.
+        // Row bands run on getThreadPool() when there is one.
+        // Implemented for Npp8u, Npp16u and Npp32f.
+        template<typename D>
+        void execute(const Parameters& parameters, const D* pSrc, int nSrcStep, D* pDst, int nDstStep);
+
+        // nFilters filters of the same source, pParameters[i] writes apDst[i].
+        // All filters use the geometry and the thread pool of pParameters[0]
+        template<typename D>
+        void execute(const Parameters* pParameters, int nFilters, const D* pSrc, int nSrcStep, D* const* apDst, int nDstStep);
+
+        // nStages filters applied one after the other (a --pipeline), pStages[0] gives the geometry.
+        // Consecutive stages are fused by row tiles so intermediate rows stay in cache,
+        // the result is identical to running the stages one by one
+        template<typename D>
+        void executeFused(const Parameters* pStages, int nStages, const D* pSrc, int nSrcStep, D* pDst, int nDstStep);
+
+        // Filters of one source, or the stages of a pipeline, resolved once for the geometry and the
+        // thread pool of pFilters[0]: kernel functions, mask taps and column tables, the row bands or
+        // fused tiles given to the pool threads and the scratch buffers of each of them.
+        // execute() allocates no buffer and gives the results of execute() and executeFused() above.
+        // A plan runs one execution at a time. Implemented for Npp8u, Npp16u and Npp32f
+        template<typename D>
+        class Plan
+        {
+        public:
+            Plan(const Parameters* pFilters, int nFilters, bool bPipeline);
+            ~Plan();
+
+            Plan(const Plan&) = delete;
+            Plan& operator=(const Plan&) = delete;
+
+            // filter i writes apDst[i], a pipeline writes apDst[0]
+            void execute(const D* pSrc, int nSrcStep, D* const* apDst, int nDstStep);
+
+            // Bytes of the scratch buffers and of the fused windows
+            size_t getScratchBytes() const;
+        private:
+            struct Stages;
+            std::unique_ptr<Stages> _pStages;
+        };
+
+        // Source rows read above and below each destination row by the selected filter
+        void getHalo(const Parameters& parameters, int& nTop, int& nBottom);
+        // Largest halo of several filters
+        void getHalo(const std::vector<Parameters>& aParameters, int& nTop, int& nBottom);
+
+        // Relative cost of a pixel with an nMaskSize mask (3, or 5 and 0 for the default):
+        // the kernel taps, box and wiener keep running sums whatever the mask size
+        double getCost(const std::string& sFilterType, int nMaskSize);
+
+        // Summed-area tables of the samples and of their squares, built once per source for
+        // the --sweep mode. The source is padded by nRadius replicated pixels on every side, so
+        // box and wiener sums of any mask up to 2 * nRadius + 1 take four lookups per sample.
+        // Integer sums are exact and give the results of execute(), float results may differ
+        // in the last bits since the sums are no longer made in mask order
+        template<typename D>
+        class SummedAreaTables
+        {
+        public:
+            typedef std::conditional_t<std::is_floating_point_v<D>, Npp64f, Npp64s> tSum;
+
+            SummedAreaTables(const D* pSrc, int nSrcStep, NppiSize oSize, int nRadius, bool bSquares, ThreadPool* pPool);
+
+            const D* source(int y) const { return (const D*)(_pSrc + (ptrdiff_t)y * _nSrcStep); }
+            NppiSize size() const { return _oSize; }
+            int radius() const { return _nRadius; }
+            bool hasSquares() const { return !_aSquares.empty(); }
+
+            // sums of the nWidth x nHeight samples from source column x and row y (may be
+            // negative down to -radius()), three channels each
+            void sum(int x, int y, int nWidth, int nHeight, tSum* pSum, tSum* pSquares) const;
+        private:
+            const unsigned char* _pSrc;
+            int _nSrcStep;
+            NppiSize _oSize;
+            int _nRadius;
+            size_t _nStride;
+            std::vector<tSum> _aSums;
+            std::vector<tSum> _aSquares;
+        };
+
+        // One mask size of a --sweep: pPoints[i] gives the box or wiener filter and the noise
+        // levels of apDst[i], all of them use the mask and the thread pool of pPoints[0].
+        // The window sums of a sample are read once for all the points
+        template<typename D>
+        void sweep(const SummedAreaTables<D>& rTables, const Parameters* pPoints, int nPoints, D* const* apDst, int nDstStep);
+
+        void execute(const Parameters& parameters, const npp::ImageCPU_8u_C3& oHostSrc, npp::ImageCPU_8u_C3& oHostDst);
+        void execute(const Parameters& parameters, const npp::ImageCPU_16u_C3& oHostSrc, npp::ImageCPU_16u_C3& oHostDst);
+        void execute(const Parameters& parameters, const npp::ImageCPU_32f_C3& oHostSrc, npp::ImageCPU_32f_C3& oHostDst);
+
+        // One result image per parameters, all of them the size of the source
+        void execute(const std::vector<Parameters>& aParameters, const npp::ImageCPU_8u_C3& oHostSrc, std::vector<npp::ImageCPU_8u_C3>& aHostDst);
+        void execute(const std::vector<Parameters>& aParameters, const npp::ImageCPU_16u_C3& oHostSrc, std::vector<npp::ImageCPU_16u_C3>& aHostDst);
+        void execute(const std::vector<Parameters>& aParameters, const npp::ImageCPU_32f_C3& oHostSrc, std::vector<npp::ImageCPU_32f_C3>& aHostDst);
+
+        void executeFused(const std::vector<Parameters>& aStages, const npp::ImageCPU_8u_C3& oHostSrc, npp::ImageCPU_8u_C3& oHostDst);
+        void executeFused(const std::vector<Parameters>& aStages, const npp::ImageCPU_16u_C3& oHostSrc, npp::ImageCPU_16u_C3& oHostDst);
+        void executeFused(const std::vector<Parameters>& aStages, const npp::ImageCPU_32f_C3& oHostSrc, npp::ImageCPU_32f_C3& oHostDst);
+    }
+}
+
+#endif // FILTERS_CPU_H
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef HOST_INFO_H_
+#define HOST_INFO_H_
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstddef>
+
+// Description of the machine a benchmark ran on, written along its results so that
+// runs of different hosts are not compared by mistake
+struct HostInfo
+{
+    struct Cache
+    {
+        int nLevel = 0;
+        // Data, Instruction or Unified
+        std::string sType;
+        size_t nBytes = 0;
+    };
+
+    std::string sCpu;
+    // instruction set extensions the cpu reports: sse2, sse4.1, sse4.2, avx, fma, avx2, avx512f, avx512bw, neon
+    std::vector<std::string> aIsa;
+    std::vector<Cache> aCaches;
+    unsigned int nThreads = 0;
+    std::string sOperatingSystem;
+    std::string sCompiler;
+};
+
+// cpuid on x86, /proc/cpuinfo and /sys/devices/system/cpu on Linux, GetLogicalProcessorInformation
+// on Windows. Unknown fields are left empty
+HostInfo getHostInfo();
+
+// JSON object of the fields
+void writeHostInfoJson(std::ostream& rStream, const HostInfo& rHost);
+
+#endif // HOST_INFO_H_
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef JOB_SERVER_H_
+#define JOB_SERVER_H_
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+
+// --serve daemon and --client: jobs are JSON objects exchanged over a Unix domain
+// socket, each message is preceded by its length as a 4 bytes big endian integer.
+//   {"input": "/data/a.png", "output": "/data/b.png", "filter": "gauss", "border": "replicate",
+//    "params": {"backend": "cpu", "pipeline": "gauss:5|sharpen"}}
+// The fields and params become the --name=value arguments of the job, a "command" field
+// of "ping" or "shutdown" controls the daemon instead.
+// "priority" (higher first, 0 by default) and "deadline" (milliseconds from its arrival) order
+// the waiting jobs, see run(). A "shared" job sends two descriptors (memfd or POSIX shm) with its request as SCM_RIGHTS
+// ancillary data: the raw source image and the buffer its result is written to.
+namespace serve
+{
+    struct Job
+    {
+        std::string sCommand = "filter";
+        std::vector<std::pair<std::string, std::string> > aArguments;
+        // descriptors received with the request, closed once the job is replied
+        std::vector<int> aFiles;
+        int nPriority = 0;
+        // milliseconds after its arrival the job is no longer worth running, 0 for none
+        double nDeadline = 0.0;
+        // time spent waiting for its turn, set when the job starts
+        double nQueueMilliseconds = 0.0;
+    };
+
+    // Runs a job and returns its JSON reply. A long job calls fYield between two parts of its work
+    // (tiles of rows), which runs the waiting jobs ranked before it on the calling thread
+    typedef std::function<std::string(const Job&, const std::function<void()>& fYield)> JobHandler;
+    // Estimated cost of a job (pixels times filter cost), cheaper jobs go first
+    typedef std::function<double(const Job&)> JobEstimator;
+
+    // Flat JSON object with an optional "params" object, arrays of values are comma separated
+    // lists ("roi": [0, 0, 256, 256] is --roi=0,0,256,256), false with rError set when malformed
+    bool parseJob(const std::string& rJson, Job& rJob, std::string& rError);
+
+    // Job request of --client: its own --name=value arguments, file names made absolute
+    // since the daemon doesn't share the client working directory
+    std::string buildRequest(int argc, char* argv[]);
+
+    // Descriptors passed along a message are stored in pFiles, or closed when it is null
+    bool readMessage(int nSocket, std::string& rMessage, std::vector<int>* pFiles = nullptr);
+    bool writeMessage(int nSocket, const std::string& rMessage, const std::vector<int>& aFiles = {});
+
+    // Listen on rSocketPath until a shutdown job. Each connection has its own thread, jobs are
+    // handled one at a time by fHandle. The next job is the waiting one with the highest priority,
+    // then the earliest deadline, then the lowest fEstimate cost, then the first arrived. A job
+    // whose deadline passed before it could start is answered with an error instead of running
+    int run(const std::string& rSocketPath, const JobHandler& fHandle, const JobEstimator& fEstimate);
+
+    // Send one request and print the reply, EXIT_SUCCESS when its status is ok
+    int client(const std::string& rSocketPath, const std::string& rRequest);
+}
+
+#endif // JOB_SERVER_H_
\ No newline at end of file
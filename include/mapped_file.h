@@ -0,0 +1,44 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole input file.
+// The file is opened once, mapped with a sequential-access hint and
+// kept mapped until close(): validation, header probing and decoding
+// all read from the same mapping.
+class MappedFile {
+    std::string _sFileName;
+    const unsigned char* _pData = nullptr;
+    size_t _nSize = 0;
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+    void* _hFile = nullptr;
+    void* _hMapping = nullptr;
+#else
+    int _nFile = -1;
+#endif
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map rFileName, returns false if the file can't be opened or is empty
+    bool open(const std::string& rFileName);
+    void close();
+
+    bool isOpen() const { return _pData != nullptr; }
+
+    const std::string& fileName() const { return _sFileName; }
+    const unsigned char* data() const { return _pData; }
+    size_t size() const { return _nSize; }
+
+    // Hint that the bytes before nEnd won't be read again so their pages
+    // can be dropped, keeps a front to back reader's footprint bounded
+    void discard(size_t nEnd) const;
+};
+
+#endif // MAPPED_FILE_H_
\ No newline at end of file
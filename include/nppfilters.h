@@ -0,0 +1,84 @@
+#ifndef NPPFILTERS_H_
+#define NPPFILTERS_H_
+
+// libnppfilters: the filters of npp-filters on caller owned buffers, with no file I/O.
+// Images are interleaved RGB, 3 samples per pixel of 8 or 16 bits unsigned or 32 bits float,
+// rows nPitch bytes apart. A context holds the backend, the cpu worker threads and the CUDA
+// stream, a plan one filter (or pipeline) for one image size and depth, created once and
+// executed on any number of images. The API is C so it can be called from C, C++, Go (cgo)...
+
+#include <stddef.h>
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#if defined(NPPFILTERS_EXPORTS)
+#define NPPF_API __declspec(dllexport)
+#elif defined(NPPFILTERS_DLL)
+#define NPPF_API __declspec(dllimport)
+#else
+#define NPPF_API
+#endif
+#else
+#define NPPF_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NPPF_VERSION_MAJOR 1
+#define NPPF_VERSION_MINOR 0
+
+typedef enum nppf_status
+{
+    NPPF_SUCCESS = 0,
+    NPPF_ERROR_INVALID_ARGUMENT = -1,
+    NPPF_ERROR_OUT_OF_MEMORY = -2,
+    NPPF_ERROR_DEVICE = -3,
+    NPPF_ERROR_INTERNAL = -4
+} nppf_status;
+
+typedef enum nppf_backend
+{
+    // NPP on the CUDA device for 8 bits images, 16 bits and float images run on the cpu
+    NPPF_BACKEND_NPP = 0,
+    NPPF_BACKEND_CPU = 1
+} nppf_backend;
+
+typedef enum nppf_border
+{
+    NPPF_BORDER_NONE = 0,
+    NPPF_BORDER_REPLICATE = 1
+} nppf_border;
+
+typedef struct nppf_context nppf_context;
+typedef struct nppf_plan nppf_plan;
+
+// (major << 16) | minor of the library, compare with NPPF_VERSION_MAJOR to detect a mismatch
+NPPF_API unsigned int nppf_version(void);
+
+// Description of a status code
+NPPF_API const char* nppf_status_string(nppf_status eStatus);
+
+// Backend and nThreads cpu workers (0 for every hardware thread).
+// The npp backend needs a CUDA device and fails with NPPF_ERROR_DEVICE without one
+NPPF_API nppf_status nppf_context_create(nppf_backend eBackend, int nThreads, nppf_context** ppContext);
+// The plans of the context must be destroyed first
+NPPF_API void nppf_context_destroy(nppf_context* pContext);
+
+// Plan sFilter on nWidth x nHeight images of nDepth bits (8, 16 or 32 for float).
+// sFilter is a filter name ("gauss") or a pipeline with optional mask sizes ("gauss:5|sharpen|sobel_h"),
+// the names of the --filter option. Nothing is printed, an unknown name or mask size is an invalid argument
+NPPF_API nppf_status nppf_plan_create(nppf_context* pContext, const char* sFilter, nppf_border eBorder,
+    int nDepth, int nWidth, int nHeight, nppf_plan** ppPlan);
+NPPF_API void nppf_plan_destroy(nppf_plan* pPlan);
+
+// Filter pSrc into pDst, both of the plan size and depth. The buffers must not overlap and the
+// pitches hold a row and are multiples of the sample size. A plan runs on one thread at a time,
+// the plans of a context may run concurrently
+NPPF_API nppf_status nppf_plan_execute(nppf_plan* pPlan, const void* pSrc, size_t nSrcPitch, void* pDst, size_t nDstPitch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NPPFILTERS_H_
\ No newline at end of file
@@ -1,56 +1,260 @@
-#ifndef PARAMETER_HELPERS_H
-#define PARAMETER_HELPERS_H
-#pragma once
-#include <string>
-#include <npp.h>
-
-class Parameters {
-    std::string _sInputFile;
-    std::string _sOutputFile;
-    std::string _sFilterType;
-    std::string _sBorderType;
-    NppiBorderType _eBorderType;
-
-    NppiSize _oSrcSize;
-
-    // TODO: add command line parameters
-    NppiPoint _oSrcOffset = { 0, 0 };
-    NppiSize _oSizeROI;
-    NppiSize _oMaskSize = { 5, 5 };
-    NppiPoint _oAnchor = { 5 / 2, 5 / 2 };
-    NppiMaskSize _eNppiMaskSize = NPP_MASK_SIZE_5_X_5;
-    Npp32f _aNoise[3] = { 0.5f, 0.47f, 0.53f };
-public:
-    int parseCmdLine(int argc, char* argv[]);
-
-    const std::string& getInputFilename() const { return _sInputFile; }
-    const std::string& getOutputFilename() const { return _sOutputFile; }
-
-    const std::string& getFilterType() const { return _sFilterType; }
-
-    const NppiBorderType getBorderType() const { return _eBorderType; }
-
-    const NppiSize& getSrcSize() const { return _oSrcSize; }
-
-    const NppiPoint& getSrcOffset() const { return _oSrcOffset; }
-
-    const NppiSize& getSizeROI() const { return _oSizeROI; }
-
-    const NppiSize& getMaskSize() const { return _oMaskSize; }
-
-    const NppiPoint& getAnchor() const { return _oAnchor; }
-
-    const NppiMaskSize getNppiMaskSize() const { return _eNppiMaskSize; }
-
-    const Npp32f* getNoise() const { return _aNoise; }
-
-    void setSrcSize(const NppiSize& oSize);
-    void setSizeROI(const NppiSize& oSize);
-
-private:
-    bool isFilterBorderCompatible() const;
-    bool isValidInputFilename() const;
-    std::string buildOutputFilename() const;
-};
-
+#ifndef PARAMETER_HELPERS_H
+#define PARAMETER_HELPERS_H
+#pragma once
+#include <string>
+#include <memory>
+#include <iostream>
+#include <npp.h>
+#include <vector>
+#include "mapped_file.h"
+#include "stb_image_io.h"
+#include "synthetic_image.h"
+
+class ThreadPool;
+class ResultCache;
+class StageTimings;
+
+// Value of --name=value or --name value, the name must match exactly, the last one wins
+const char* getCmdLineValue(int argc, char* argv[], const char* name);
+
+// Integer value of --name=N or --name N, nDefault when the option isn't given
+int getCmdLineInt(int argc, char* argv[], const char* name, int nDefault);
+
+// An argument following --name is its value unless it's another option, "-" is stdin or stdout
+bool isCmdLineValue(const char* arg);
+
+// True for the npp-filters options taking a value, the argument after them in the --name value
+// form is theirs. The other options are flags
+bool takesCmdLineValue(const std::string& rName);
+
+// Names of the filters, in the order of the --filter help
+const std::vector<std::string>& getFilterNames();
+
+// Items of a cSeparator separated list, empty items included
+std::vector<std::string> splitList(const std::string& rList, char cSeparator);
+
+// NPP border of a --border name, none for the names it doesn't know
+NppiBorderType sBorderTypeToEnum(const std::string& sBorderType);
+
+// Files given to --probe: positional arguments and --input
+std::vector<std::string> getProbeFilenames(int argc, char* argv[]);
+
+// Inputs of a batch run: the lines of --input-list (- for stdin), the images of --input-dir
+// and the files matching the '*' and '?' wildcards of --input. Empty for a single image,
+// return false, with the reason on rOutput, when a list or directory can't be read
+bool getBatchFilenames(int argc, char* argv[], std::vector<std::string>& rFiles, std::ostream& rOutput);
+
+// True when the image is written to the standard output: --output=- or a stdin input without --output
+bool writesToStandardOutput(int argc, char* argv[]);
+
+// --threads of the cpu filters, 0 (Default) for every hardware thread
+int getThreads(int argc, char* argv[]);
+
+// Result cache of --cache-dir, limited to --cache-size MB (Default 1024), null without --cache-dir
+std::shared_ptr<ResultCache> getResultCache(int argc, char* argv[]);
+
+// Step timings of --timings, also written to the file of --timings-json (timings.json when it has no value),
+// null without either option
+std::shared_ptr<StageTimings> getStageTimings(int argc, char* argv[]);
+
+// Filter backend: npp(Default) or cpu. 16 bits and float images always run on the cpu backend
+std::string getBackend(int argc, char* argv[]);
+
+// One --pipeline stage, nMaskSize is 3, 5 or 0 for the default mask
+struct PipelineStage
+{
+    std::string sFilterType;
+    int nMaskSize = 0;
+};
+
+// Stages of a "gauss:5|sharpen|sobel_h" pipeline, each with an optional 3 or 5 mask size.
+// Return the first stage naming an unknown filter or mask size, empty when all are valid
+std::string parsePipeline(const std::string& rList, std::vector<PipelineStage>& rStages);
+
+class Parameters {
+    std::string _sInputFile;
+    std::shared_ptr<MappedFile> _pInputFile;
+    std::shared_ptr<stb::StreamReader> _pInputStream;
+    stb::ImageInfo _oInputInfo;
+    size_t _nMaxPixels = 0;
+    stb::ImageFormat _eOutputFormat = stb::ImageFormat::png;
+    bool _bOutputFormat = false;
+    int _nJpegQuality = 85;
+    std::string _sOutputFile;
+    std::string _sOutputArgument;
+    std::string _sOutputDir;
+    std::vector<std::string> _aInputFiles;
+    std::shared_ptr<ThreadPool> _pThreadPool;
+    std::shared_ptr<ResultCache> _pResultCache;
+    std::shared_ptr<StageTimings> _pStageTimings;
+    std::string _sFilterType;
+    std::vector<std::string> _aFilterTypes;
+    std::vector<std::string> _aOutputFiles;
+    std::vector<PipelineStage> _aPipeline;
+    bool _bFusion = true;
+    std::string _sBorderType;
+    std::string _sBackend;
+    bool _bStream = false;
+    bool _bSharedInput = false;
+    bool _bSyntheticInput = false;
+    synthetic::Pattern _eSyntheticPattern = synthetic::Pattern::noise;
+    bool _bSweep = false;
+    bool _bSweepStatistics = false;
+    std::vector<int> _aSweepMasks;
+    std::vector<Npp32f> _aSweepNoises;
+    int _nStripRows = 64;
+    int _nDecodeThreads = 2;
+    int _nEncodeThreads = 2;
+    int _nQueueDepth = 2;
+    NppiBorderType _eBorderType;
+
+    NppiSize _oSrcSize;
+
+    // --roi rectangle, 0 x 0 for the whole image
+    NppiPoint _oROIOffset = { 0, 0 };
+    NppiSize _oROISize = { 0, 0 };
+    NppiPoint _oSrcOffset = { 0, 0 };
+    NppiSize _oSizeROI;
+    NppiSize _oMaskSize = { 5, 5 };
+    NppiPoint _oAnchor = { 5 / 2, 5 / 2 };
+    NppiMaskSize _eNppiMaskSize = NPP_MASK_SIZE_5_X_5;
+    Npp32f _aNoise[3] = { 0.5f, 0.47f, 0.53f };
+    NppStreamContext _oStreamContext = {};
+    std::ostream* _pOutput = &std::cout;
+public:
+    int parseCmdLine(int argc, char* argv[]);
+
+    // Set up without a command line, for the library: rPipeline filters nWidth x nHeight shared
+    // pixels of nBitsPerChannel bits. Nothing is printed, false on an invalid argument
+    bool setSharedPipeline(const std::string& rPipeline, const std::string& rBorderType, const std::string& rBackend,
+        int nWidth, int nHeight, int nBitsPerChannel);
+
+    // Open, probe and name the output of the next image, same status codes as parseCmdLine
+    int openInput(const std::string& rFileName);
+
+    // Release the input mapping or stream, for copies kept once the image is filtered
+    void closeInput();
+
+    // Batch inputs, empty when a single image is filtered
+    const std::vector<std::string>& getInputFiles() const { return _aInputFiles; }
+
+    // Worker threads of the cpu filters
+    ThreadPool* getThreadPool() const { return _pThreadPool.get(); }
+    // Share a pool created before parseCmdLine, which then keeps it whatever --threads says
+    void setThreadPool(const std::shared_ptr<ThreadPool>& pThreadPool) { _pThreadPool = pThreadPool; }
+
+    // --cache-dir results of earlier runs, null without a cache
+    ResultCache* getResultCache() const { return _pResultCache.get(); }
+    // Share a cache opened before parseCmdLine, which then keeps it
+    void setResultCache(const std::shared_ptr<ResultCache>& pResultCache) { _pResultCache = pResultCache; }
+
+    // --timings of the steps of every image, null when they are not measured
+    StageTimings* getStageTimings() const { return _pStageTimings.get(); }
+    // Share timings created before parseCmdLine, which then keeps them
+    void setStageTimings(const std::shared_ptr<StageTimings>& pStageTimings) { _pStageTimings = pStageTimings; }
+
+    // Batch executor: threads of the decode and encode stages and capacity of the queues between stages
+    int getDecodeThreads() const { return _nDecodeThreads; }
+    int getEncodeThreads() const { return _nEncodeThreads; }
+    int getQueueDepth() const { return _nQueueDepth; }
+
+    const std::string& getInputFilename() const { return _sInputFile; }
+    const MappedFile& getInputFile() const { return *_pInputFile; }
+    // "-" input: stdin is decoded through stb callbacks instead of a mapping
+    bool isInputStream() const { return _pInputStream != nullptr; }
+    stb::StreamReader& getInputStream() const { return *_pInputStream; }
+    // header descriptor of the input file, available before decoding
+    const stb::ImageInfo& getInputInfo() const { return _oInputInfo; }
+    // --shared: raw pixels a --serve client passed in shared memory, getInputInfo() gives their
+    // size and depth, the result goes back to the client instead of an output file
+    bool isSharedInput() const { return _bSharedInput; }
+    // --synthetic: image generated in memory with this pattern, getInputInfo() gives its size and depth
+    bool isSyntheticInput() const { return _bSyntheticInput; }
+    synthetic::Pattern getSyntheticPattern() const { return _eSyntheticPattern; }
+    const std::string& getOutputFilename() const { return _sOutputFile; }
+    // encoder selected by --output-format or from the output file extension
+    stb::ImageFormat getOutputFormat() const { return _eOutputFormat; }
+    int getJpegQuality() const { return _nJpegQuality; }
+
+    const std::string& getFilterType() const { return _sFilterType; }
+
+    // --filter list, all of them are applied to the same source image
+    const std::vector<std::string>& getFilterTypes() const { return _aFilterTypes; }
+    // Copy running the iFilter-th filter of the list and writing its own output file
+    Parameters forFilter(size_t iFilter) const;
+
+    // --pipeline stages, run one after the other on the host or the device
+    bool isPipeline() const { return !_aPipeline.empty(); }
+    const std::vector<PipelineStage>& getPipeline() const { return _aPipeline; }
+    // cpu pipelines run the stages fused by cache tiles, --no-fusion times each stage alone
+    bool isFusion() const { return _bFusion; }
+    // Copy running the iStage-th stage with its mask size
+    Parameters forStage(size_t iStage) const;
+    // gauss5-sharpen-sobel_h, used in the output file name
+    std::string getPipelineName() const;
+
+    // --sweep: every --filter with every mask size and noise level of the grid, from one decoded image
+    bool isSweep() const { return _bSweep; }
+    const std::vector<int>& getSweepMasks() const { return _aSweepMasks; }
+    // empty when the noise is not swept, the wiener filters then keep the default levels
+    const std::vector<Npp32f>& getSweepNoises() const { return _aSweepNoises; }
+    // --sweep-stats: print the statistics of each point without writing its image
+    bool isSweepStatistics() const { return _bSweepStatistics; }
+    // Copy running the iFilter-th filter with an nMaskSize square mask and, unless pNoise is null,
+    // the pNoise levels, writing a file named after them
+    Parameters forSweep(size_t iFilter, int nMaskSize, const Npp32f* pNoise) const;
+
+    const std::string& getBackend() const { return _sBackend; }
+
+    // --stream: decode, filter and encode by strips of getStripRows() rows
+    bool isStream() const { return _bStream; }
+    int getStripRows() const { return _nStripRows; }
+
+    const NppiBorderType getBorderType() const { return _eBorderType; }
+
+    const NppiSize& getSrcSize() const { return _oSrcSize; }
+
+    const NppiPoint& getSrcOffset() const { return _oSrcOffset; }
+
+    const NppiSize& getSizeROI() const { return _oSizeROI; }
+
+    const NppiSize& getMaskSize() const { return _oMaskSize; }
+
+    const NppiPoint& getAnchor() const { return _oAnchor; }
+
+    const NppiMaskSize getNppiMaskSize() const { return _eNppiMaskSize; }
+
+    const Npp32f* getNoise() const { return _aNoise; }
+
+    // Messages of the run: invalid options, opened and saved images. The standard output unless
+    // a served job sends them back in its reply, the stream must outlive the run
+    std::ostream& getOutput() const { return *_pOutput; }
+    // Set before parseCmdLine to get its messages too
+    void setOutput(std::ostream& rOutput) { _pOutput = &rOutput; }
+
+    // Device and CUDA stream the NPP filters are queued on
+    const NppStreamContext& getStreamContext() const { return _oStreamContext; }
+
+    // --roi rectangle, the whole image without it
+    bool hasROI() const { return _oROISize.width > 0; }
+    // Size of the opened or decoded image: the source size, offset and ROI follow from --roi.
+    // False when the --roi rectangle isn't inside the image
+    bool setImageSize(const NppiSize& oSize);
+
+    void setSrcSize(const NppiSize& oSize);
+    void setSizeROI(const NppiSize& oSize);
+    void setSrcOffset(const NppiPoint& oOffset);
+    void setStreamContext(const NppStreamContext& oContext);
+
+private:
+    // bVerbose prints the filters not supporting the border
+    bool isFilterBorderCompatible(bool bVerbose) const;
+    bool openInputFile();
+    int openSharedInput(int argc, char* argv[]);
+    int openSyntheticInput(const char* sSpec, int argc, char* argv[]);
+    // ROI check and output names of the opened input, same status codes as parseCmdLine
+    int nameOutputs();
+    std::string buildOutputFilename(const std::string& sFilterType) const;
+};
+
 #endif // PARAMETER_HELPERS_H
\ No newline at end of file
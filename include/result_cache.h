@@ -0,0 +1,59 @@
+#ifndef RESULT_CACHE_H_
+#define RESULT_CACHE_H_
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+class Parameters;
+
+// --cache-dir: encoded results kept on disk, named after a hash of the input file bytes
+// and of every setting the result depends on. A hit copies the cached file to the output
+// without decoding, filtering or encoding. The least recently used entries are evicted
+// when the directory grows over its size limit; the index is scanned once when opened.
+class ResultCache {
+    struct Entry
+    {
+        size_t nSize = 0;
+        long long nLastUse = 0;
+    };
+
+    std::string _sDirectory;
+    size_t _nMaxBytes;
+    size_t _nBytes = 0;
+    std::map<std::string, Entry> _aEntries;
+    mutable std::mutex _oMutex;
+    size_t _nHits = 0;
+    size_t _nMisses = 0;
+    size_t _nStores = 0;
+    size_t _nEvictions = 0;
+
+    std::string path(const std::string& rKey) const;
+    void evict();
+public:
+    ResultCache(const std::string& rDirectory, size_t nMaxBytes);
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // 64 bits hash of a buffer, four multiply-rotate lanes over 32 bytes blocks
+    static uint64_t hash(const void* pData, size_t nSize, uint64_t nSeed = 0);
+
+    // One key per output of the opened input, empty when the image can't be cached:
+    // standard streams, shared memory and synthetic images
+    static std::vector<std::string> keys(const Parameters& parameters);
+
+    // Copy the cached result of rKey to rOutputFile, false on a miss
+    bool restore(const std::string& rKey, const std::string& rOutputFile);
+    // Add the written rOutputFile as the result of rKey
+    void store(const std::string& rKey, const std::string& rOutputFile);
+
+    // Hits, misses and the cache size
+    void printStatistics() const;
+};
+
+#endif // RESULT_CACHE_H_
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef SHARED_IMAGE_H_
+#define SHARED_IMAGE_H_
+#pragma once
+
+#include <cstddef>
+#include <npp.h>
+#include <Image.h>
+#include <Pixel.h>
+
+// Mapping of a shared memory descriptor (memfd sealed with F_SEAL_SHRINK) received from a --serve
+// client. The descriptor stays owned by the caller, the mapping is kept until close()
+class SharedMemory {
+    unsigned char* _pData = nullptr;
+    size_t _nSize = 0;
+public:
+    SharedMemory() = default;
+    ~SharedMemory();
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    // Map the first nSize bytes of nFile, read only unless bWritable. Returns false when the object
+    // is smaller than nSize, can be shrunk (no F_SEAL_SHRINK seal) or can't be mapped
+    bool open(int nFile, size_t nSize, bool bWritable);
+    void close();
+
+    bool isOpen() const { return _pData != nullptr; }
+
+    // True when both descriptors refer to the same memory object
+    static bool isSameObject(int nFile1, int nFile2);
+
+    unsigned char* data() const { return _pData; }
+    size_t size() const { return _nSize; }
+};
+
+// Packed image in memory owned by someone else, a shared buffer or a mapping.
+// It has the accessors of npp::ImageCPU so the filters read and write the pixels in place
+template<typename D, unsigned int N>
+class ImageView {
+    D* _pData = nullptr;
+    unsigned int _nWidth = 0;
+    unsigned int _nHeight = 0;
+    unsigned int _nPitch = 0;
+public:
+    typedef npp::Pixel<D, N> tPixel;
+    typedef D tData;
+
+    ImageView() = default;
+    ImageView(void* pData, unsigned int nWidth, unsigned int nHeight, unsigned int nPitch)
+        : _pData(static_cast<D*>(pData)), _nWidth(nWidth), _nHeight(nHeight), _nPitch(nPitch)
+    {
+    }
+
+    unsigned int width() const { return _nWidth; }
+    unsigned int height() const { return _nHeight; }
+    npp::Image::Size size() const { return npp::Image::Size(_nWidth, _nHeight); }
+    // bytes from one row to the next
+    unsigned int pitch() const { return _nPitch; }
+
+    tPixel* pixels(int nX = 0, int nY = 0) const
+    {
+        return reinterpret_cast<tPixel*>(reinterpret_cast<unsigned char*>(_pData) + (ptrdiff_t)nY * _nPitch + (ptrdiff_t)nX * N * sizeof(D));
+    }
+
+    D* data(int nX = 0, int nY = 0) const
+    {
+        return reinterpret_cast<D*>(pixels(nX, nY));
+    }
+};
+
+typedef ImageView<Npp8u, 3> ImageView_8u_C3;
+typedef ImageView<Npp16u, 3> ImageView_16u_C3;
+typedef ImageView<Npp32f, 3> ImageView_32f_C3;
+
+#endif // SHARED_IMAGE_H_
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef STAGE_TIMINGS_H_
+#define STAGE_TIMINGS_H_
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <ostream>
+
+// Steps an image goes through, in the order of the --timings table
+enum class Stage { decode, convert, upload, filter, download, encode, write };
+
+// --timings: time of each step summed over the images of a run. The stage threads of the
+// batch executor add to the same timings, the table gives the count, total, mean, min and max
+// of every step. A run without --timings has no StageTimings and makes no clock call
+class StageTimings {
+    struct Step
+    {
+        size_t nCount = 0;
+        double nTotal = 0.0;
+        double nMin = 0.0;
+        double nMax = 0.0;
+    };
+
+    static const int nSteps = (int)Stage::write + 1;
+    Step _aSteps[nSteps];
+    size_t _nImages = 0;
+    std::chrono::steady_clock::time_point _oStart;
+    std::string _sJsonFile;
+    mutable std::mutex _oMutex;
+
+    // called with the lock held
+    void writeJson(std::ostream& rStream) const;
+public:
+    // rJsonFile, when not empty, gets the timings as JSON once the run is over
+    explicit StageTimings(const std::string& rJsonFile);
+
+    StageTimings(const StageTimings&) = delete;
+    StageTimings& operator=(const StageTimings&) = delete;
+
+    static const char* name(Stage eStage);
+
+    void add(Stage eStage, double nMilliseconds);
+    // one more image went through the steps
+    void addImage();
+
+    // Breakdown table on the standard output, and the --timings-json file
+    void printStatistics() const;
+};
+
+// Time of the enclosing scope added to a stage, nothing is measured when pTimings is null
+class StageTimer {
+    StageTimings* _pTimings;
+    Stage _eStage;
+    std::chrono::steady_clock::time_point _oStart;
+public:
+    StageTimer(StageTimings* pTimings, Stage eStage) : _pTimings(pTimings), _eStage(eStage)
+    {
+        if (_pTimings)
+        {
+            _oStart = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~StageTimer()
+    {
+        if (_pTimings)
+        {
+            _pTimings->add(_eStage, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _oStart).count());
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+#endif // STAGE_TIMINGS_H_
\ No newline at end of file
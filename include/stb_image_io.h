@@ -1,16 +1,171 @@
-#ifndef STB_IMAGE_IO_H_
-#define STB_IMAGE_IO_H_
-#pragma once
-
-#include <ImagesCPU.h>
-
-namespace stb {
-
-    // Load 8,24,32 bits image using stb_image
-    // and return an npp::ImageCPU_8u_C3
-    void loadImage(const std::string& rFileName, npp::ImageCPU_8u_C3& rImage);
-
-    void saveImage(const std::string& rFileName, const npp::ImageCPU_8u_C3& rImage);
-}
-
+#ifndef STB_IMAGE_IO_H_
+#define STB_IMAGE_IO_H_
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdio>
+#include <climits>
+#include <memory>
+#include <ImagesCPU.h>
+#include "mapped_file.h"
+
+namespace stb {
+
+    // Output encoders, stb_image_write ones plus 16 bits png and binary ppm
+    enum class ImageFormat { png, jpeg, bmp, tga, hdr, pnm };
+
+    // Encoder matching a format name (png, jpg/jpeg, bmp, tga, hdr, ppm/pnm, case insensitive),
+    // return false when the name has no encoder
+    bool formatFromName(const std::string& rName, ImageFormat& rFormat);
+
+    // Encoder matching the file extension (.png, .jpg/.jpeg, .bmp, .tga, .hdr, .ppm/.pnm),
+    // return false when the extension has no encoder
+    bool formatFromFilename(const std::string& rFileName, ImageFormat& rFormat);
+
+    // Sequential reader over a non seekable stream (stdin) for the stbi_*_from_callbacks decoders.
+    // Every stbi call restarts from the first byte: the bytes read while probing the header
+    // are recorded and replayed to the decoder, the rest of the stream is read once and never stored
+    class StreamReader
+    {
+        FILE* _pFile;
+        std::string _sName;
+        std::vector<unsigned char> _oRecord;
+        size_t _nPosition = 0;
+        bool _bRecording = true;
+    public:
+        StreamReader(FILE* pFile, const std::string& rName) : _pFile(pFile), _sName(rName) {}
+
+        StreamReader(const StreamReader&) = delete;
+        StreamReader& operator=(const StreamReader&) = delete;
+
+        const std::string& fileName() const { return _sName; }
+
+        // first bytes of the stream, as read so far
+        const std::vector<unsigned char>& header() const { return _oRecord; }
+
+        // next read starts again at the first byte, only valid while recording
+        void rewind() { _nPosition = 0; }
+        // last pass over the stream, the bytes past the recorded header are not kept
+        void stopRecording() { _bRecording = false; }
+
+        int read(char* pData, int nSize);
+        void skip(int nSize);
+        bool eof();
+    };
+
+    // Lightweight image descriptor filled from the file header only
+    struct ImageInfo
+    {
+        std::string sFileName;
+        std::string sFormat;        // png, jpeg, bmp, gif, psd, hdr, pnm, pic, tga
+        size_t nFileSize = 0;
+        int nWidth = 0;
+        int nHeight = 0;
+        int nChannels = 0;          // channels stored in the file
+        int nBitsPerChannel = 0;    // 8, 16 or 32 (float)
+
+        size_t pixels() const { return (size_t)nWidth * (size_t)nHeight; }
+    };
+
+    // stb_image takes int lengths: larger files can only be binary pnm read by PnmRowReader
+    const size_t nMaxDecodeSize = INT_MAX;
+
+    // Read the header of a mapped file without decoding the pixels,
+    // return false if stb_image can't decode it. Files over nMaxDecodeSize are
+    // probed by their pnm header, other formats are rejected
+    bool probeImage(const MappedFile& rFile, ImageInfo& rInfo);
+
+    // Same as above reading the header from a stream, the file size is left to 0
+    bool probeImage(StreamReader& rStream, ImageInfo& rInfo);
+
+    // Quoted and escaped JSON string
+    void writeJsonString(std::ostream& rStream, const std::string& rString);
+
+    // Write descriptors as a JSON array, failed probes carry an "error" field
+    void writeImageInfoJson(std::ostream& rStream, const std::vector<ImageInfo>& rInfos, const std::vector<bool>& rValid);
+
+    // Parts of the time of loadImage and saveImage, added to when given:
+    // the copy of the decoded samples to 3 channels, and the writes of the encoded bytes
+    struct IoTimes
+    {
+        double nConvertMilliseconds = 0.0;
+        double nWriteMilliseconds = 0.0;
+    };
+
+    // Load 8,24,32 bits image using stb_image
+    // and return an npp::ImageCPU_8u_C3.
+    // rImage buffer is reused when it already has the image size (pre-sized from probeImage)
+    void loadImage(const std::string& rFileName, npp::ImageCPU_8u_C3& rImage);
+
+    // Same as above, decoding straight from an already mapped file
+    void loadImage(const MappedFile& rFile, npp::ImageCPU_8u_C3& rImage, IoTimes* pTimes = nullptr);
+
+    // Native precision loads: stbi_load_16 (8 bits files are widened by stb)
+    // and stbi_loadf (LDR files are linearised by stb)
+    void loadImage(const MappedFile& rFile, npp::ImageCPU_16u_C3& rImage, IoTimes* pTimes = nullptr);
+    void loadImage(const MappedFile& rFile, npp::ImageCPU_32f_C3& rImage, IoTimes* pTimes = nullptr);
+
+    // Decode with stbi_load_from_callbacks from a stream probed by probeImage
+    void loadImage(StreamReader& rStream, npp::ImageCPU_8u_C3& rImage, IoTimes* pTimes = nullptr);
+    void loadImage(StreamReader& rStream, npp::ImageCPU_16u_C3& rImage, IoTimes* pTimes = nullptr);
+    void loadImage(StreamReader& rStream, npp::ImageCPU_32f_C3& rImage, IoTimes* pTimes = nullptr);
+
+    // Row by row decoder of binary pnm files (P5/P6, 8 or 16 bits samples) for the strip
+    // streaming mode, stb_image only decodes whole images. Grey rows are expanded to RGB
+    class PnmRowReader
+    {
+        const MappedFile* _pFile = nullptr;
+        StreamReader* _pStream = nullptr;
+        size_t _nOffset = 0;
+        int _nWidth = 0;
+        int _nChannels = 0;
+        int _nBytes = 0;
+        std::vector<unsigned char> _oLine;
+
+        int nextByte();
+        bool readHeader();
+        void readLine();
+    public:
+        // Parse the header, return false when the input isn't a binary pnm
+        bool open(const MappedFile& rFile);
+        bool open(StreamReader& rStream);
+
+        void readRows(Npp8u* pRows, int nStep, int nRows);
+        void readRows(Npp16u* pRows, int nStep, int nRows);
+    };
+
+    // Incremental png or pnm encoder for images produced in row strips:
+    // open() writes the header, rows are appended top to bottom and only
+    // the current strip is buffered (png scanlines go through a streaming deflate)
+    class StripWriter
+    {
+        struct State;
+        std::unique_ptr<State> _pState;
+    public:
+        StripWriter();
+        ~StripWriter();
+
+        // "-" writes to the standard output, other formats than png and pnm are rejected
+        void open(const std::string& rFileName, ImageFormat eFormat, int nWidth, int nHeight, int nBitsPerChannel);
+        void writeRows(const Npp8u* pRows, int nStep, int nRows);
+        void writeRows(const Npp16u* pRows, int nStep, int nRows);
+        void close();
+    };
+
+    // Stream receiving the images saved to "-", stdout unless changed here
+    void setStandardOutput(FILE* pFile);
+
+    // Save with the encoder selected by eFormat, "-" writes to the standard output, nJpegQuality (1-100) is used by the jpeg encoder only.
+    // 16 bits images are written natively to png and pnm, float images to hdr;
+    // other formats get a converted copy (floats are clamped to [0, 1])
+    void saveImage(const std::string& rFileName, const npp::ImageCPU_8u_C3& rImage, ImageFormat eFormat, int nJpegQuality = 85, IoTimes* pTimes = nullptr);
+    void saveImage(const std::string& rFileName, const npp::ImageCPU_16u_C3& rImage, ImageFormat eFormat, int nJpegQuality = 85, IoTimes* pTimes = nullptr);
+    void saveImage(const std::string& rFileName, const npp::ImageCPU_32f_C3& rImage, ImageFormat eFormat, int nJpegQuality = 85, IoTimes* pTimes = nullptr);
+
+    // Save with the encoder selected by the file extension, png when unknown
+    void saveImage(const std::string& rFileName, const npp::ImageCPU_8u_C3& rImage);
+}
+
 #endif //STB_IMAGE_IO_H_
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef SYNTHETIC_IMAGE_H_
+#define SYNTHETIC_IMAGE_H_
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <npp.h>
+
+class ThreadPool;
+
+// --synthetic: RGB test images generated in memory, of any size up to nMaxSize x nMaxSize,
+// for benchmarks and stress runs without decoding files. The pixels only depend on the
+// pattern, the size and the seed, not on the threads generating them
+namespace synthetic {
+
+    // noise: uniform white noise of every sample
+    // gradient: red along x, green along y, blue along the diagonal
+    // checkerboard: black and white squares of nSquareSize pixels
+    // constant: mid grey
+    // natural: 1/f amplitude spectrum noise, smooth areas and edges at every scale like a photograph
+    enum class Pattern { noise, gradient, checkerboard, constant, natural };
+
+    const int nMaxSize = 65536;
+    const int nSquareSize = 64;
+
+    struct Spec
+    {
+        int nWidth = 0;
+        int nHeight = 0;
+        Pattern ePattern = Pattern::noise;
+    };
+
+    // "WxH:pattern", the pattern defaults to noise and "1/f" is natural.
+    // Return false when the size or the pattern is invalid
+    bool parseSpec(const std::string& rText, Spec& rSpec);
+
+    const char* name(Pattern ePattern);
+
+    // Fill nHeight rows of nWidth RGB pixels nStep bytes apart, samples over their whole range
+    // ([0, 1] for floats). The rows are split over pPool when given
+    void generate(Pattern ePattern, Npp8u* pData, int nStep, int nWidth, int nHeight, ThreadPool* pPool, uint32_t nSeed = 1);
+    void generate(Pattern ePattern, Npp16u* pData, int nStep, int nWidth, int nHeight, ThreadPool* pPool, uint32_t nSeed = 1);
+    void generate(Pattern ePattern, Npp32f* pData, int nStep, int nWidth, int nHeight, ThreadPool* pPool, uint32_t nSeed = 1);
+}
+
+#endif // SYNTHETIC_IMAGE_H_
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+
+// Fixed set of worker threads created once and reused for every image.
+// parallelFor() hands out task indices to the workers and to the calling
+// thread; calls made while the pool is busy (or from a task) run inline.
+class ThreadPool {
+    std::vector<std::thread> _aWorkers;
+    std::mutex _oMutex;
+    std::condition_variable _oWake;
+    std::condition_variable _oDone;
+    std::mutex _oCallMutex;
+
+    const std::function<void(int)>* _pTask = nullptr;
+    int _nTasks = 0;
+    std::atomic<int> _nNext{ 0 };
+    int _nActive = 0;
+    unsigned long long _nGeneration = 0;
+    bool _bStop = false;
+    std::exception_ptr _pError;
+
+    void work(int nWorker);
+    void runTasks();
+public:
+    // nThreads counts the calling thread, 0 uses every hardware thread
+    explicit ThreadPool(int nThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return (int)_aWorkers.size() + 1; }
+
+    // Run fTask(0) .. fTask(nTasks - 1) and wait for all of them,
+    // the first exception thrown by a task is rethrown here
+    void parallelFor(int nTasks, const std::function<void(int)>& fTask);
+};
+
+#endif // THREAD_POOL_H_
\ No newline at end of file
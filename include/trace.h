@@ -0,0 +1,85 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+// --trace: zones of the threads written in the Chrome trace event format, opened with
+// ui.perfetto.dev or chrome://tracing to see the steps of the images overlap and the tiles
+// spread over the workers. Each thread records its zones in its own ring buffer without
+// locking, the oldest zones of a thread are overwritten past nZonesPerThread. The buffers of
+// finished threads are kept for the trace up to nFinishedThreads, past that the oldest is
+// reused by the next thread, so a daemon starting a thread per connection stays bounded.
+// Built without NPP_FILTERS_TRACE the TRACE_ macros compile to nothing
+namespace trace {
+
+    const size_t nZonesPerThread = 1 << 16;
+    const size_t nFinishedThreads = 64;
+
+    extern std::atomic<bool> bEnabled;
+
+    inline bool isEnabled()
+    {
+        return bEnabled.load(std::memory_order_relaxed);
+    }
+
+    // Start recording, the timestamps of the trace start here
+    void enable();
+
+    // Name of the calling thread in the trace
+    void setThreadName(const std::string& rName);
+
+    // Nanoseconds of the steady clock
+    uint64_t now();
+
+    // Add a zone of the calling thread, sName must be a literal (only the pointer is kept).
+    // nIndex (image, tile, band...) is shown in the zone arguments unless negative
+    void record(const char* sName, long long nIndex, uint64_t nBegin, uint64_t nEnd);
+
+    // Write the zones recorded so far, false when the file can't be written.
+    // The zones still open, and those recorded while writing, may be missing.
+    // The buffers of the finished threads are released once written
+    bool write(const std::string& rFileName);
+
+    // Time of the enclosing scope, nothing is read when recording is off
+    class Zone {
+        const char* _sName;
+        long long _nIndex;
+        uint64_t _nBegin = 0;
+    public:
+        explicit Zone(const char* sName, long long nIndex = -1) : _sName(sName), _nIndex(nIndex)
+        {
+            if (isEnabled())
+            {
+                _nBegin = now();
+            }
+        }
+
+        ~Zone()
+        {
+            if (_nBegin)
+            {
+                record(_sName, _nIndex, _nBegin, now());
+            }
+        }
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+    };
+}
+
+#ifdef NPP_FILTERS_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(sName) trace::Zone TRACE_CONCAT(oTraceZone, __LINE__)(sName)
+#define TRACE_ZONE_INDEX(sName, nIndex) trace::Zone TRACE_CONCAT(oTraceZone, __LINE__)(sName, nIndex)
+#define TRACE_THREAD(sName) trace::setThreadName(sName)
+#else
+#define TRACE_ZONE(sName) ((void)0)
+#define TRACE_ZONE_INDEX(sName, nIndex) ((void)0)
+#define TRACE_THREAD(sName) ((void)0)
+#endif
+
+#endif // TRACE_H_
\ No newline at end of file
@@ -0,0 +1,797 @@
+// npp-filters-bench: latency and throughput of the filters over a matrix of filter, border,
+// mask size, image size, sample depth and backend. Each case is planned once like a batch image,
+// run --warmup times untimed then --repeat times. The median, p10 and p99 latencies, the MP/s and
+// the GB/s (source read once, result written once) are printed and written as JSON along with
+// the description of the host. Images are generated in memory (--pattern of --synthetic), no file is decoded.
+// --verify checks the optimized cpu kernels against a scalar reference instead, see filter_verify.h.
+// --compare reruns the cases of an earlier JSON and fails on the cases slower by more than --threshold.
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#define WINDOWS_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#pragma warning(disable : 4819)
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <cuda_runtime.h>
+#include <npp.h>
+
+#include <helper_cuda.h>
+#include <helper_string.h>
+#include <ImagesNPP.h>
+#include <Exceptions.h>
+
+#include "parameter_helpers.h"
+#include "filter_plan.h"
+#include "filter_verify.h"
+#include "thread_pool.h"
+#include "host_info.h"
+#include "stb_image_io.h"
+#include "synthetic_image.h"
+#include "job_server.h"
+
+namespace
+{
+    // One point of the matrix, nMask is 0 for the filters without a mask size
+    struct BenchCase
+    {
+        std::string sFilter;
+        std::string sBorder;
+        int nMask = 0;
+        int nWidth = 0;
+        int nHeight = 0;
+        int nDepth = 8;
+        std::string sBackend;
+    };
+
+    struct BenchResult
+    {
+        BenchCase oCase;
+        int nRuns = 0;
+        double nMedian = 0.0;
+        double nP10 = 0.0;
+        double nP99 = 0.0;
+        double nMegaPixelsPerSecond = 0.0;
+        double nGigaBytesPerSecond = 0.0;
+        // median of the round medians over the fastest one, minus 1
+        double nSpread = 0.0;
+    };
+
+    struct BenchOptions
+    {
+        std::vector<std::string> aFilters;
+        std::vector<std::string> aBorders = { "none", "replicate" };
+        std::vector<int> aMasks = { 3, 5, 9, 15 };
+        std::vector<double> aMegaPixels = { 0.25, 1.0, 4.0, 16.0, 100.0 };
+        std::vector<int> aDepths = { 8 };
+        std::vector<std::string> aBackends;
+        int nWarmup = 2;
+        int nRepeat = 15;
+        // the fastest median of nRounds rounds of warm-up and timed runs is kept
+        int nRounds = 1;
+        synthetic::Pattern ePattern = synthetic::Pattern::noise;
+        std::string sOutput = "bench.json";
+        // --compare: results of an earlier run, regression beyond nThreshold percent slower
+        std::string sBaseline;
+        double nThreshold = 10.0;
+    };
+
+    // Mask sizes a filter depends on: any for box and wiener, 3 or 5 for the fixed mask filters,
+    // a single case without --mask for the others
+    std::vector<int> getMasks(const std::string& sFilter, const std::vector<int>& aMasks)
+    {
+        if (sFilter == "box" || sFilter == "wiener")
+        {
+            return aMasks;
+        }
+        if (sFilter == "laplace" || sFilter == "gauss" || sFilter == "highpass" || sFilter == "lowpass")
+        {
+            std::vector<int> aFixed;
+            std::copy_if(aMasks.begin(), aMasks.end(), std::back_inserter(aFixed), [](int n) { return n == 3 || n == 5; });
+            return aFixed;
+        }
+        return { 0 };
+    }
+
+    template<typename T>
+    bool getList(int argc, char* argv[], const char* sName, std::vector<T>& rValues, T nMin, T nMax)
+    {
+        const char* arg = getCmdLineValue(argc, argv, sName);
+        if (!arg)
+        {
+            return true;
+        }
+        rValues.clear();
+        for (const std::string& sItem : splitList(arg, ','))
+        {
+            char* end = nullptr;
+            const double nValue = strtod(sItem.c_str(), &end);
+            if (sItem.empty() || *end != 0 || nValue < nMin || nValue > nMax)
+            {
+                std::cout << "npp-filters-bench --" << sName << " takes a list of values from " << nMin << " to " << nMax << ": <" << arg << ">" << std::endl;
+                return false;
+            }
+            rValues.push_back((T)nValue);
+        }
+        return true;
+    }
+
+    bool getNames(int argc, char* argv[], const char* sName, std::vector<std::string>& rNames, const std::vector<std::string>& rValid)
+    {
+        if (const char* arg = getCmdLineValue(argc, argv, sName))
+        {
+            rNames = splitList(arg, ',');
+        }
+        for (const std::string& sItem : rNames)
+        {
+            if (std::find(rValid.begin(), rValid.end(), sItem) == rValid.end())
+            {
+                std::cout << "npp-filters-bench unknown --" << sName << " value: <" << sItem << ">" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool getPattern(const std::string& rName, synthetic::Pattern& rPattern)
+    {
+        synthetic::Spec oSpec;
+        if (!synthetic::parseSpec("1x1:" + rName, oSpec))
+        {
+            return false;
+        }
+        rPattern = oSpec.ePattern;
+        return true;
+    }
+
+    // -1 to exit with success (--help), -2 on an invalid option
+    int parseOptions(int argc, char* argv[], bool bDevice, BenchOptions& rOptions)
+    {
+        if (checkCmdLineFlag(argc, (const char**)argv, "help"))
+        {
+            std::cout << "npp-filters-bench [--filters=box,gauss] [--borders=none,replicate] [--masks=3,5,9,15]\n"
+                "    [--sizes=0.25,1,4,16,100 (MP)] [--depths=8,16,32] [--backends=cpu,npp] [--threads=N]\n"
+                "    [--warmup=2] [--repeat=15] [--rounds=1] [--pattern=noise] [--output=bench.json]\n"
+                "npp-filters-bench --compare=bench.json [--threshold=10 (%)] [--rounds=5] [--threads=N] [--warmup=2] [--repeat=15] [--output=FILE]\n"
+                "npp-filters-bench --verify [--cases=300] [--seed=1] [--case=N] [--golden=golden.jsonl]" << std::endl;
+            return -1;
+        }
+        rOptions.aFilters = getFilterNames();
+        rOptions.aBackends = bDevice ? std::vector<std::string>{ "cpu", "npp" } : std::vector<std::string>{ "cpu" };
+        if (!getNames(argc, argv, "filters", rOptions.aFilters, getFilterNames())
+            || !getNames(argc, argv, "borders", rOptions.aBorders, { "none", "replicate" })
+            || !getNames(argc, argv, "backends", rOptions.aBackends, { "cpu", "npp" })
+            || !getList(argc, argv, "masks", rOptions.aMasks, 1, 255)
+            || !getList(argc, argv, "sizes", rOptions.aMegaPixels, 0.0001, 4096.0)
+            || !getList(argc, argv, "depths", rOptions.aDepths, 8, 32))
+        {
+            return -2;
+        }
+        if (std::any_of(rOptions.aDepths.begin(), rOptions.aDepths.end(), [](int n) { return n != 8 && n != 16 && n != 32; }))
+        {
+            std::cout << "npp-filters-bench --depths are 8, 16 or 32 (float) bits" << std::endl;
+            return -2;
+        }
+        if (!bDevice && std::find(rOptions.aBackends.begin(), rOptions.aBackends.end(), "npp") != rOptions.aBackends.end())
+        {
+            std::cout << "npp-filters-bench the npp backend needs a CUDA device" << std::endl;
+            return -2;
+        }
+        rOptions.nWarmup = std::max(getCmdLineInt(argc, argv, "warmup", rOptions.nWarmup), 0);
+        rOptions.nRepeat = std::max(getCmdLineInt(argc, argv, "repeat", rOptions.nRepeat), 1);
+        if (const char* pattern = getCmdLineValue(argc, argv, "pattern"))
+        {
+            if (!getPattern(pattern, rOptions.ePattern))
+            {
+                std::cout << "npp-filters-bench --pattern is noise, gradient, checkerboard, constant or natural: <" << pattern << ">" << std::endl;
+                return -2;
+            }
+        }
+        if (const char* baseline = getCmdLineValue(argc, argv, "compare"))
+        {
+            // a few rounds by default, the slowest rounds are the noisy ones
+            rOptions.sBaseline = baseline;
+            rOptions.nRounds = 5;
+            rOptions.sOutput.clear();
+        }
+        rOptions.nRounds = std::max(getCmdLineInt(argc, argv, "rounds", rOptions.nRounds), 1);
+        if (const char* threshold = getCmdLineValue(argc, argv, "threshold"))
+        {
+            char* end = nullptr;
+            rOptions.nThreshold = strtod(threshold, &end);
+            if (end == threshold || *end != 0 || rOptions.nThreshold < 0.0)
+            {
+                std::cout << "npp-filters-bench --threshold takes a positive percentage: <" << threshold << ">" << std::endl;
+                return -2;
+            }
+        }
+        if (const char* output = getCmdLineValue(argc, argv, "output"))
+        {
+            rOptions.sOutput = output;
+        }
+        return 0;
+    }
+
+    // Width and height of a square image of about nMegaPixels
+    NppiSize getImageSize(double nMegaPixels)
+    {
+        const int nSide = std::max((int)std::lround(std::sqrt(nMegaPixels * 1e6)), 1);
+        return { nSide, nSide };
+    }
+
+    // Same options as a --shared job of the daemon: raw pixels of the case size, no file
+    bool getCaseParameters(const BenchCase& rCase, const std::shared_ptr<ThreadPool>& pThreadPool, const NppStreamContext& oContext, Parameters& rParameters)
+    {
+        std::vector<std::string> aArguments = {
+            "npp-filters-bench",
+            "--shared",
+            "--filter=" + rCase.sFilter,
+            "--border=" + rCase.sBorder,
+            "--backend=" + rCase.sBackend,
+            "--width=" + std::to_string(rCase.nWidth),
+            "--height=" + std::to_string(rCase.nHeight),
+            "--depth=" + std::to_string(rCase.nDepth),
+        };
+        if (rCase.nMask)
+        {
+            aArguments.push_back("--mask=" + std::to_string(rCase.nMask));
+        }
+        std::vector<char*> argv;
+        for (std::string& rArgument : aArguments)
+        {
+            argv.push_back(rArgument.data());
+        }
+        rParameters.setThreadPool(pThreadPool);
+        rParameters.setStreamContext(oContext);
+        return rParameters.parseCmdLine((int)argv.size(), argv.data()) == 0;
+    }
+
+    // Source and result of the cases of one size and depth
+    struct HostImages
+    {
+        std::vector<Npp8u> aSrc8u, aDst8u;
+        std::vector<Npp16u> aSrc16u, aDst16u;
+        std::vector<Npp32f> aSrc32f, aDst32f;
+
+        template<typename D>
+        std::vector<D>& src();
+        template<typename D>
+        std::vector<D>& dst();
+
+        // the source pixels are the same for every run
+        template<typename D>
+        void allocate(NppiSize oSize, synthetic::Pattern ePattern, ThreadPool* pPool)
+        {
+            src<D>().assign((size_t)oSize.width * oSize.height * 3, D());
+            dst<D>().assign(src<D>().size(), D());
+            synthetic::generate(ePattern, src<D>().data(), oSize.width * 3 * (int)sizeof(D), oSize.width, oSize.height, pPool);
+        }
+    };
+
+    template<> std::vector<Npp8u>& HostImages::src<Npp8u>() { return aSrc8u; }
+    template<> std::vector<Npp8u>& HostImages::dst<Npp8u>() { return aDst8u; }
+    template<> std::vector<Npp16u>& HostImages::src<Npp16u>() { return aSrc16u; }
+    template<> std::vector<Npp16u>& HostImages::dst<Npp16u>() { return aDst16u; }
+    template<> std::vector<Npp32f>& HostImages::src<Npp32f>() { return aSrc32f; }
+    template<> std::vector<Npp32f>& HostImages::dst<Npp32f>() { return aDst32f; }
+
+    // Linear interpolation between the two closest ranks of the sorted samples
+    double getPercentile(const std::vector<double>& rSorted, double nFraction)
+    {
+        const double nRank = nFraction * (rSorted.size() - 1);
+        const size_t nLow = (size_t)nRank;
+        const size_t nHigh = std::min(nLow + 1, rSorted.size() - 1);
+        return rSorted[nLow] + (rSorted[nHigh] - rSorted[nLow]) * (nRank - nLow);
+    }
+
+    // Rounds of warm-up then timed runs of fRun, one image each. Other processes and frequency changes
+    // only ever slow a round down, so the round with the fastest median is kept
+    template<typename F>
+    BenchResult measure(const BenchCase& rCase, const BenchOptions& rOptions, F fRun)
+    {
+        BenchResult oResult;
+        oResult.oCase = rCase;
+        std::vector<double> aMedians;
+        for (int iRound = 0; iRound < rOptions.nRounds; ++iRound)
+        {
+            for (int i = 0; i < rOptions.nWarmup; ++i)
+            {
+                fRun();
+            }
+            std::vector<double> aMilliseconds;
+            for (int i = 0; i < rOptions.nRepeat; ++i)
+            {
+                const auto oStart = std::chrono::steady_clock::now();
+                fRun();
+                aMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oStart).count());
+            }
+            std::sort(aMilliseconds.begin(), aMilliseconds.end());
+
+            aMedians.push_back(getPercentile(aMilliseconds, 0.5));
+            if (!iRound || aMedians.back() < oResult.nMedian)
+            {
+                oResult.nRuns = (int)aMilliseconds.size();
+                oResult.nMedian = aMedians.back();
+                oResult.nP10 = getPercentile(aMilliseconds, 0.1);
+                oResult.nP99 = getPercentile(aMilliseconds, 0.99);
+            }
+        }
+        std::sort(aMedians.begin(), aMedians.end());
+        oResult.nSpread = oResult.nMedian > 0 ? getPercentile(aMedians, 0.5) / oResult.nMedian - 1.0 : 0.0;
+        const double nPixels = (double)rCase.nWidth * rCase.nHeight;
+        const double nBytes = 2.0 * nPixels * 3 * (rCase.nDepth / 8);
+        oResult.nMegaPixelsPerSecond = oResult.nMedian > 0 ? nPixels / 1e3 / oResult.nMedian : 0.0;
+        oResult.nGigaBytesPerSecond = oResult.nMedian > 0 ? nBytes / 1e6 / oResult.nMedian : 0.0;
+        return oResult;
+    }
+
+    template<typename D>
+    BenchResult measureHost(const BenchCase& rCase, const BenchOptions& rOptions, filters::Plan& rPlan, HostImages& rImages)
+    {
+        const int nStep = rCase.nWidth * 3 * (int)sizeof(D);
+        const D* pSrc = rImages.src<D>().data();
+        D* pDst = rImages.dst<D>().data();
+        return measure(rCase, rOptions, [&]() { rPlan.execute(pSrc, nStep, &pDst, nStep); });
+    }
+
+    // Kernel time on the device: the source is uploaded once, each run waits for its stream
+    BenchResult measureDevice(const BenchCase& rCase, const BenchOptions& rOptions, filters::Plan& rPlan, NppStreamContext oContext,
+        const npp::ImageNPP_8u_C3& oDeviceSrc, npp::ImageNPP_8u_C3& oDeviceDst)
+    {
+        return measure(rCase, rOptions, [&]() {
+            rPlan.execute(0, oContext, oDeviceSrc, oDeviceDst);
+            checkCudaErrors(cudaStreamSynchronize(oContext.hStream));
+        });
+    }
+
+    // Attributes of the current device and a non blocking stream of its own
+    NppStreamContext createStreamContext()
+    {
+        NppStreamContext oContext = {};
+        NPP_CHECK_NPP(nppGetStreamContext(&oContext));
+        checkCudaErrors(cudaStreamCreateWithFlags(&oContext.hStream, cudaStreamNonBlocking));
+        oContext.nStreamFlags = cudaStreamNonBlocking;
+        return oContext;
+    }
+
+    void printResult(const BenchResult& rResult)
+    {
+        const BenchCase& rCase = rResult.oCase;
+        const std::string sMask = rCase.nMask ? std::to_string(rCase.nMask) + "x" + std::to_string(rCase.nMask) : "-";
+        const std::string sSize = std::to_string(rCase.nWidth) + "x" + std::to_string(rCase.nHeight);
+        printf("%-12s %-9s %-7s %11s %3s %-3s %10.3f %10.3f %10.3f %10.1f %8.2f\n", rCase.sFilter.c_str(), rCase.sBorder.c_str(), sMask.c_str(),
+            sSize.c_str(), rCase.nDepth == 32 ? "32f" : rCase.nDepth == 16 ? "16u" : "8u", rCase.sBackend.c_str(),
+            rResult.nMedian, rResult.nP10, rResult.nP99, rResult.nMegaPixelsPerSecond, rResult.nGigaBytesPerSecond);
+        fflush(stdout);
+    }
+
+    // Source and destination images of one size and depth, shared by all their cases
+    struct CaseImages
+    {
+        HostImages oHost;
+        npp::ImageNPP_8u_C3 oDeviceSrc, oDeviceDst;
+    };
+
+    // false when the images don't fit in memory
+    bool allocateImages(const NppiSize& oSize, int nDepth, bool bNpp, const BenchOptions& rOptions, ThreadPool* pPool, CaseImages& rImages)
+    {
+        try
+        {
+            if (nDepth == 16)
+            {
+                rImages.oHost.allocate<Npp16u>(oSize, rOptions.ePattern, pPool);
+            }
+            else if (nDepth == 32)
+            {
+                rImages.oHost.allocate<Npp32f>(oSize, rOptions.ePattern, pPool);
+            }
+            else
+            {
+                rImages.oHost.allocate<Npp8u>(oSize, rOptions.ePattern, pPool);
+            }
+            if (bNpp && nDepth == 8)
+            {
+                npp::ImageNPP_8u_C3(oSize.width, oSize.height).swap(rImages.oDeviceSrc);
+                npp::ImageNPP_8u_C3(oSize.width, oSize.height).swap(rImages.oDeviceDst);
+                checkCudaErrors(cudaMemcpy2D(rImages.oDeviceSrc.data(), rImages.oDeviceSrc.pitch(), rImages.oHost.aSrc8u.data(), oSize.width * 3,
+                    oSize.width * 3, oSize.height, cudaMemcpyHostToDevice));
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // false when the case has no valid parameters
+    bool runCase(const BenchCase& rCase, const BenchOptions& rOptions, const std::shared_ptr<ThreadPool>& pThreadPool, const NppStreamContext& oContext,
+        CaseImages& rImages, BenchResult& rResult)
+    {
+        Parameters parameters;
+        if (!getCaseParameters(rCase, pThreadPool, oContext, parameters))
+        {
+            return false;
+        }
+        filters::Plan oPlan(parameters, rCase.nDepth, rCase.sBackend == "npp");
+        if (rCase.sBackend == "npp")
+        {
+            rResult = measureDevice(rCase, rOptions, oPlan, oContext, rImages.oDeviceSrc, rImages.oDeviceDst);
+        }
+        else if (rCase.nDepth == 16)
+        {
+            rResult = measureHost<Npp16u>(rCase, rOptions, oPlan, rImages.oHost);
+        }
+        else if (rCase.nDepth == 32)
+        {
+            rResult = measureHost<Npp32f>(rCase, rOptions, oPlan, rImages.oHost);
+        }
+        else
+        {
+            rResult = measureHost<Npp8u>(rCase, rOptions, oPlan, rImages.oHost);
+        }
+        return true;
+    }
+
+    void writeResultsJson(std::ostream& rStream, const HostInfo& rHost, const std::string& sDevice, int nPoolThreads,
+        const BenchOptions& rOptions, const std::vector<BenchResult>& rResults)
+    {
+        char aDate[32];
+        const std::time_t nNow = std::time(nullptr);
+        std::strftime(aDate, sizeof(aDate), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&nNow));
+
+        rStream << "{\n  \"date\": \"" << aDate << "\",\n  \"host\": ";
+        writeHostInfoJson(rStream, rHost);
+        rStream << ",\n  \"device\": ";
+        stb::writeJsonString(rStream, sDevice);
+        rStream << ",\n  \"pool_threads\": " << nPoolThreads << ", \"warmup\": " << rOptions.nWarmup << ", \"repeat\": " << rOptions.nRepeat
+            << ", \"rounds\": " << rOptions.nRounds << ", \"pattern\": \"" << synthetic::name(rOptions.ePattern) << "\",\n  \"results\": [";
+        for (size_t i = 0; i < rResults.size(); ++i)
+        {
+            const BenchResult& r = rResults[i];
+            char aNumbers[256];
+            snprintf(aNumbers, sizeof(aNumbers), "\"runs\": %d, \"median_ms\": %.6f, \"p10_ms\": %.6f, \"p99_ms\": %.6f, \"mpix_per_s\": %.3f, \"gb_per_s\": %.4f",
+                r.nRuns, r.nMedian, r.nP10, r.nP99, r.nMegaPixelsPerSecond, r.nGigaBytesPerSecond);
+            rStream << (i ? "," : "") << "\n    {\"filter\": \"" << r.oCase.sFilter << "\", \"border\": \"" << r.oCase.sBorder << "\", \"mask\": " << r.oCase.nMask
+                << ", \"width\": " << r.oCase.nWidth << ", \"height\": " << r.oCase.nHeight << ", \"depth\": " << r.oCase.nDepth
+                << ", \"backend\": \"" << r.oCase.sBackend << "\", " << aNumbers << "}";
+        }
+        rStream << "\n  ]\n}\n";
+    }
+
+    // Header and results of a writeResultsJson file, one result per line. The warm-up, repeat,
+    // thread and pattern settings of the file are kept unless given on the command line
+    bool readResultsJson(const std::string& rFile, int argc, char* argv[], BenchOptions& rOptions, int& rThreads, std::vector<BenchResult>& rResults)
+    {
+        std::ifstream oFile(rFile);
+        if (!oFile)
+        {
+            std::cout << "npp-filters-bench can't read <" << rFile << ">" << std::endl;
+            return false;
+        }
+        std::string sLine;
+        int nLine = 0;
+        while (std::getline(oFile, sLine))
+        {
+            ++nLine;
+            sLine.erase(0, sLine.find_first_not_of(" \t"));
+            while (!sLine.empty() && (sLine.back() == ',' || sLine.back() == '\r'))
+            {
+                sLine.pop_back();
+            }
+            const bool bResult = sLine.rfind("{\"filter\"", 0) == 0;
+            if (!bResult && sLine.rfind("\"pool_threads\"", 0) != 0)
+            {
+                continue;
+            }
+            serve::Job oJob;
+            std::string sError;
+            if (!serve::parseJob(bResult ? sLine : "{" + sLine + "}", oJob, sError))
+            {
+                std::cout << "npp-filters-bench " << rFile << " line " << nLine << ": " << sError << std::endl;
+                return false;
+            }
+            std::map<std::string, std::string> aFields(oJob.aArguments.begin(), oJob.aArguments.end());
+            if (!bResult)
+            {
+                if (!checkCmdLineFlag(argc, (const char**)argv, "threads"))
+                {
+                    rThreads = atoi(aFields["pool_threads"].c_str());
+                }
+                if (!checkCmdLineFlag(argc, (const char**)argv, "warmup") && aFields.count("warmup"))
+                {
+                    rOptions.nWarmup = std::max(atoi(aFields["warmup"].c_str()), 0);
+                }
+                if (!checkCmdLineFlag(argc, (const char**)argv, "repeat") && aFields.count("repeat"))
+                {
+                    rOptions.nRepeat = std::max(atoi(aFields["repeat"].c_str()), 1);
+                }
+                if (!getCmdLineValue(argc, argv, "pattern") && aFields.count("pattern") && !getPattern(aFields["pattern"], rOptions.ePattern))
+                {
+                    std::cout << "npp-filters-bench " << rFile << " line " << nLine << ": unknown pattern <" << aFields["pattern"] << ">" << std::endl;
+                    return false;
+                }
+                continue;
+            }
+
+            BenchResult oResult;
+            oResult.oCase = { aFields["filter"], aFields["border"], atoi(aFields["mask"].c_str()), atoi(aFields["width"].c_str()),
+                atoi(aFields["height"].c_str()), atoi(aFields["depth"].c_str()), aFields["backend"] };
+            oResult.nRuns = atoi(aFields["runs"].c_str());
+            oResult.nMedian = atof(aFields["median_ms"].c_str());
+            oResult.nP10 = atof(aFields["p10_ms"].c_str());
+            oResult.nP99 = atof(aFields["p99_ms"].c_str());
+            const BenchCase& rCase = oResult.oCase;
+            if (rCase.nWidth < 1 || rCase.nHeight < 1 || (rCase.nDepth != 8 && rCase.nDepth != 16 && rCase.nDepth != 32) || oResult.nMedian <= 0.0
+                || (rCase.sBackend != "cpu" && rCase.sBackend != "npp"))
+            {
+                std::cout << "npp-filters-bench " << rFile << " line " << nLine << ": invalid result" << std::endl;
+                return false;
+            }
+            rResults.push_back(oResult);
+        }
+        if (rResults.empty())
+        {
+            std::cout << "npp-filters-bench " << rFile << " has no results" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Difference of the new median to the baseline one, +5.0 for 5% slower
+    double getChange(const BenchResult& rBaseline, const BenchResult& rResult)
+    {
+        return 100.0 * (rResult.nMedian / rBaseline.nMedian - 1.0);
+    }
+
+    void printComparison(const BenchResult& rBaseline, const BenchResult* pResult, const char* sStatus)
+    {
+        const BenchCase& rCase = rBaseline.oCase;
+        const std::string sMask = rCase.nMask ? std::to_string(rCase.nMask) + "x" + std::to_string(rCase.nMask) : "-";
+        const std::string sSize = std::to_string(rCase.nWidth) + "x" + std::to_string(rCase.nHeight);
+        printf("%-12s %-9s %-7s %11s %3s %-3s %10.3f", rCase.sFilter.c_str(), rCase.sBorder.c_str(), sMask.c_str(),
+            sSize.c_str(), rCase.nDepth == 32 ? "32f" : rCase.nDepth == 16 ? "16u" : "8u", rCase.sBackend.c_str(), rBaseline.nMedian);
+        if (pResult)
+        {
+            printf(" %10.3f %+8.1f%% %7.1f%%", pResult->nMedian, getChange(rBaseline, *pResult), 100.0 * pResult->nSpread);
+        }
+        else
+        {
+            printf(" %10s %9s %8s", "-", "-", "-");
+        }
+        printf("  %s\n", sStatus);
+        fflush(stdout);
+    }
+
+    // --compare: reruns the cases of the baseline file in its order, one allocation per run of cases
+    // of the same size and depth. A case slower than the threshold is measured once more and its
+    // fastest median kept, so a single disturbed case doesn't fail the comparison.
+    // EXIT_FAILURE when a case is still slower
+    int compare(int argc, char* argv[], bool bDevice, BenchOptions& rOptions)
+    {
+        int nThreads = getThreads(argc, argv);
+        std::vector<BenchResult> aBaseline;
+        if (!readResultsJson(rOptions.sBaseline, argc, argv, rOptions, nThreads, aBaseline))
+        {
+            return EXIT_FAILURE;
+        }
+
+        NppStreamContext oContext = {};
+        std::string sDevice;
+        const bool bNpp = bDevice && std::any_of(aBaseline.begin(), aBaseline.end(), [](const BenchResult& r) { return r.oCase.sBackend == "npp"; });
+        if (bNpp)
+        {
+            oContext = createStreamContext();
+            sDevice = nppGetGpuName();
+        }
+        auto pThreadPool = std::make_shared<ThreadPool>(nThreads);
+        const HostInfo oHost = getHostInfo();
+
+        printf("npp-filters-bench --compare=%s on %s, %d threads%s%s, %d rounds of %d warm-up and %d timed runs per case, %s images, threshold %.1f%%\n\n",
+            rOptions.sBaseline.c_str(), oHost.sCpu.c_str(), pThreadPool->size(), bNpp ? ", " : "", sDevice.c_str(), rOptions.nRounds, rOptions.nWarmup,
+            rOptions.nRepeat, synthetic::name(rOptions.ePattern), rOptions.nThreshold);
+        printf("%-12s %-9s %-7s %11s %3s %-3s %10s %10s %9s %8s  %s\n", "filter", "border", "mask", "size", "", "", "base ms", "new ms", "change", "spread", "status");
+
+        std::vector<BenchResult> aResults;
+        int nSlower = 0, nFaster = 0, nSkipped = 0;
+        std::unique_ptr<CaseImages> pImages;
+        bool bAllocated = false;
+        for (size_t i = 0; i < aBaseline.size(); ++i)
+        {
+            const BenchCase& rCase = aBaseline[i].oCase;
+            if (!i || rCase.nWidth != aBaseline[i - 1].oCase.nWidth || rCase.nHeight != aBaseline[i - 1].oCase.nHeight
+                || rCase.nDepth != aBaseline[i - 1].oCase.nDepth)
+            {
+                // the previous images are freed before the next are allocated
+                pImages.reset();
+                pImages.reset(new CaseImages);
+                bAllocated = allocateImages({ rCase.nWidth, rCase.nHeight }, rCase.nDepth, bNpp, rOptions, pThreadPool.get(), *pImages);
+            }
+            if (!bAllocated || (rCase.sBackend == "npp" && (!bNpp || rCase.nDepth != 8)))
+            {
+                printComparison(aBaseline[i], nullptr, bAllocated ? "skipped: no device" : "skipped: out of memory");
+                ++nSkipped;
+                continue;
+            }
+
+            BenchResult oResult;
+            if (!runCase(rCase, rOptions, pThreadPool, oContext, *pImages, oResult))
+            {
+                return EXIT_FAILURE;
+            }
+            if (getChange(aBaseline[i], oResult) > rOptions.nThreshold)
+            {
+                BenchResult oRetry;
+                runCase(rCase, rOptions, pThreadPool, oContext, *pImages, oRetry);
+                if (oRetry.nMedian < oResult.nMedian)
+                {
+                    oResult = oRetry;
+                }
+            }
+            const double nChange = getChange(aBaseline[i], oResult);
+            const char* sStatus = "ok";
+            if (nChange > rOptions.nThreshold)
+            {
+                sStatus = "SLOWER";
+                ++nSlower;
+            }
+            else if (nChange < -rOptions.nThreshold)
+            {
+                sStatus = "faster";
+                ++nFaster;
+            }
+            printComparison(aBaseline[i], &oResult, sStatus);
+            aResults.push_back(oResult);
+        }
+        pImages.reset();
+
+        printf("\n%zu cases: %d slower, %d faster, %d skipped, threshold %.1f%%\n", aBaseline.size(), nSlower, nFaster, nSkipped, rOptions.nThreshold);
+        if (!rOptions.sOutput.empty())
+        {
+            std::ofstream oOutput(rOptions.sOutput);
+            writeResultsJson(oOutput, oHost, sDevice, pThreadPool->size(), rOptions, aResults);
+            if (!oOutput)
+            {
+                std::cout << "npp-filters-bench can't write <" << rOptions.sOutput << ">" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if (oContext.hStream)
+        {
+            cudaStreamDestroy(oContext.hStream);
+        }
+        return nSlower ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        int nDevices = 0;
+        const bool bDevice = cudaGetDeviceCount(&nDevices) == cudaSuccess && nDevices > 0;
+
+        // differential check of the cpu kernels and golden hashes instead of timings
+        if (checkCmdLineFlag(argc, (const char**)argv, "verify"))
+        {
+            const NppStreamContext oContext = bDevice ? createStreamContext() : NppStreamContext{};
+            const int nResult = verify::run(argc, argv, bDevice, oContext);
+            if (oContext.hStream)
+            {
+                cudaStreamDestroy(oContext.hStream);
+            }
+            return nResult;
+        }
+
+        BenchOptions oOptions;
+        const int status = parseOptions(argc, argv, bDevice, oOptions);
+        if (status != 0)
+        {
+            return status == -1 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (!oOptions.sBaseline.empty())
+        {
+            return compare(argc, argv, bDevice, oOptions);
+        }
+
+        // the device attributes and stream of the npp cases
+        NppStreamContext oContext = {};
+        std::string sDevice;
+        const bool bNpp = std::find(oOptions.aBackends.begin(), oOptions.aBackends.end(), "npp") != oOptions.aBackends.end();
+        if (bNpp)
+        {
+            oContext = createStreamContext();
+            sDevice = nppGetGpuName();
+        }
+        auto pThreadPool = std::make_shared<ThreadPool>(getThreads(argc, argv));
+        const HostInfo oHost = getHostInfo();
+
+        printf("npp-filters-bench on %s, %d threads%s%s, %d warm-up and %d timed runs per case, %s images\n\n", oHost.sCpu.c_str(), pThreadPool->size(),
+            bNpp ? ", " : "", sDevice.c_str(), oOptions.nWarmup, oOptions.nRepeat, synthetic::name(oOptions.ePattern));
+        printf("%-12s %-9s %-7s %11s %3s %-3s %10s %10s %10s %10s %8s\n", "filter", "border", "mask", "size", "", "", "median ms", "p10 ms", "p99 ms", "MP/s", "GB/s");
+
+        std::vector<BenchResult> aResults;
+        for (double nMegaPixels : oOptions.aMegaPixels)
+        {
+            const NppiSize oSize = getImageSize(nMegaPixels);
+            for (int nDepth : oOptions.aDepths)
+            {
+                // the images of the size and depth are allocated once for all their cases
+                CaseImages oImages;
+                if (!allocateImages(oSize, nDepth, bNpp, oOptions, pThreadPool.get(), oImages))
+                {
+                    printf("Skipped %dx%d %d bits images: out of memory\n", oSize.width, oSize.height, nDepth);
+                    continue;
+                }
+
+                for (const std::string& sBackend : oOptions.aBackends)
+                {
+                    // 16 bits and float images always run on the cpu
+                    if (sBackend == "npp" && nDepth != 8)
+                    {
+                        continue;
+                    }
+                    for (const std::string& sFilter : oOptions.aFilters)
+                    {
+                        for (const std::string& sBorder : oOptions.aBorders)
+                        {
+                            // wiener has a replicate border only
+                            if (sFilter == "wiener" && sBorder != "replicate")
+                            {
+                                continue;
+                            }
+                            for (int nMask : getMasks(sFilter, oOptions.aMasks))
+                            {
+                                BenchCase oCase{ sFilter, sBorder, nMask, oSize.width, oSize.height, nDepth, sBackend };
+                                BenchResult oResult;
+                                if (!runCase(oCase, oOptions, pThreadPool, oContext, oImages, oResult))
+                                {
+                                    return EXIT_FAILURE;
+                                }
+                                printResult(oResult);
+                                aResults.push_back(oResult);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        std::ofstream oOutput(oOptions.sOutput);
+        writeResultsJson(oOutput, oHost, sDevice, pThreadPool->size(), oOptions, aResults);
+        if (!oOutput)
+        {
+            std::cout << "npp-filters-bench can't write <" << oOptions.sOutput << ">" << std::endl;
+            return EXIT_FAILURE;
+        }
+        printf("\n%zu cases written to %s\n", aResults.size(), oOptions.sOutput.c_str());
+        if (oContext.hStream)
+        {
+            cudaStreamDestroy(oContext.hStream);
+        }
+        return EXIT_SUCCESS;
+    }
+    catch (npp::Exception& rException)
+    {
+        std::cerr << "Program error! The following exception occurred: \n";
+        std::cerr << rException << std::endl;
+        std::cerr << "Aborting." << std::endl;
+        return EXIT_FAILURE;
+    }
+}
\ No newline at end of file
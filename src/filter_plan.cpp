@@ -0,0 +1,174 @@
+#include "filter_plan.h"
+#include <cstdio>
+#include <Exceptions.h>
+
+namespace filters
+{
+    Plan::Plan(const Parameters& parameters, int nDepth, bool bDevice)
+        : _sKey(getKey(parameters, nDepth, bDevice))
+        , _bDevice(bDevice)
+        , _bFused(parameters.isPipeline() && parameters.isFusion())
+    {
+        const size_t nFilters = parameters.isPipeline() ? parameters.getPipeline().size() : parameters.getFilterTypes().size();
+        for (size_t i = 0; i < nFilters; ++i)
+        {
+            // a plan outlives the image it was made for
+            _aParameters.push_back(parameters.isPipeline() ? parameters.forStage(i) : parameters.forFilter(i));
+            _aParameters.back().closeInput();
+        }
+
+        if (bDevice)
+        {
+            for (const Parameters& rParameters : _aParameters)
+            {
+                _aDeviceKernels.push_back(getKernel(rParameters.getFilterType()));
+            }
+        }
+        else if (nDepth == 16)
+        {
+            planHost<Npp16u>();
+        }
+        else if (nDepth == 32)
+        {
+            planHost<Npp32f>();
+        }
+        else
+        {
+            planHost<Npp8u>();
+        }
+    }
+
+    Plan::~Plan() = default;
+
+    std::string Plan::getKey(const Parameters& parameters, int nDepth, bool bDevice)
+    {
+        const NppiSize& rSize = parameters.getSrcSize();
+        const NppiPoint& rOffset = parameters.getSrcOffset();
+        const NppiSize& rROI = parameters.getSizeROI();
+        char aGeometry[160];
+        snprintf(aGeometry, sizeof(aGeometry), "%dx%d+%d+%d:%dx%d|%d|%d|%d|%p", rSize.width, rSize.height, rOffset.x, rOffset.y,
+            rROI.width, rROI.height, nDepth, (int)bDevice, (int)parameters.isFusion(), (const void*)parameters.getThreadPool());
+        std::string sKey = std::string(aGeometry) + "|" + parameters.getBackend() + (parameters.isPipeline() ? "|pipeline" : "|filters");
+
+        const size_t nFilters = parameters.isPipeline() ? parameters.getPipeline().size() : parameters.getFilterTypes().size();
+        for (size_t i = 0; i < nFilters; ++i)
+        {
+            const Parameters oFilter = parameters.isPipeline() ? parameters.forStage(i) : parameters.forFilter(i);
+            const NppiSize& rMask = oFilter.getMaskSize();
+            const NppiPoint& rAnchor = oFilter.getAnchor();
+            const Npp32f* pNoise = oFilter.getNoise();
+            char aSettings[160];
+            snprintf(aSettings, sizeof(aSettings), "|%d|%dx%d|%d,%d|%d|%.9g,%.9g,%.9g", (int)oFilter.getBorderType(), rMask.width, rMask.height,
+                rAnchor.x, rAnchor.y, (int)oFilter.getNppiMaskSize(), pNoise[0], pNoise[1], pNoise[2]);
+            sKey += "|" + oFilter.getFilterType() + aSettings;
+        }
+        return sKey;
+    }
+
+    template<>
+    std::vector<std::unique_ptr<cpu::Plan<Npp8u> > >& Plan::host<Npp8u>()
+    {
+        return _aHost8u;
+    }
+
+    template<>
+    std::vector<std::unique_ptr<cpu::Plan<Npp16u> > >& Plan::host<Npp16u>()
+    {
+        return _aHost16u;
+    }
+
+    template<>
+    std::vector<std::unique_ptr<cpu::Plan<Npp32f> > >& Plan::host<Npp32f>()
+    {
+        return _aHost32f;
+    }
+
+    template<typename D>
+    void Plan::planHost()
+    {
+        std::vector<std::unique_ptr<cpu::Plan<D> > >& aHost = host<D>();
+        const bool bPipeline = _aParameters[0].isPipeline();
+        if (bPipeline && !_bFused)
+        {
+            for (const Parameters& rStage : _aParameters)
+            {
+                aHost.emplace_back(new cpu::Plan<D>(&rStage, 1, false));
+            }
+        }
+        else
+        {
+            aHost.emplace_back(new cpu::Plan<D>(_aParameters.data(), (int)_aParameters.size(), bPipeline));
+        }
+    }
+
+    void Plan::execute(size_t i, const NppStreamContext& oContext, const npp::ImageNPP_8u_C3& oDeviceSrc, npp::ImageNPP_8u_C3& oDeviceDst)
+    {
+        NPP_ASSERT_MSG(_bDevice, "host plan executed on device images");
+        _aParameters[i].setStreamContext(oContext);
+        if (_aDeviceKernels[i])
+        {
+            _aDeviceKernels[i](_aParameters[i], oDeviceSrc, oDeviceDst);
+        }
+    }
+
+    template<typename D>
+    void Plan::execute(const D* pSrc, int nSrcStep, D* const* apDst, int nDstStep)
+    {
+        std::vector<std::unique_ptr<cpu::Plan<D> > >& aHost = host<D>();
+        NPP_ASSERT_MSG(aHost.size() == 1, "plan of another depth, or a pipeline run by stages");
+        aHost[0]->execute(pSrc, nSrcStep, apDst, nDstStep);
+    }
+
+    template<typename D>
+    void Plan::executeStage(size_t i, const D* pSrc, int nSrcStep, D* pDst, int nDstStep)
+    {
+        std::vector<std::unique_ptr<cpu::Plan<D> > >& aHost = host<D>();
+        NPP_ASSERT_MSG(i < aHost.size() && aHost.size() == _aParameters.size(), "plan of another depth, or a fused pipeline");
+        aHost[i]->execute(pSrc, nSrcStep, &pDst, nDstStep);
+    }
+
+    size_t Plan::getScratchBytes() const
+    {
+        size_t nBytes = 0;
+        for (const auto& rPlan : _aHost8u)
+        {
+            nBytes += rPlan->getScratchBytes();
+        }
+        for (const auto& rPlan : _aHost16u)
+        {
+            nBytes += rPlan->getScratchBytes();
+        }
+        for (const auto& rPlan : _aHost32f)
+        {
+            nBytes += rPlan->getScratchBytes();
+        }
+        return nBytes;
+    }
+
+    template void Plan::execute<Npp8u>(const Npp8u*, int, Npp8u* const*, int);
+    template void Plan::execute<Npp16u>(const Npp16u*, int, Npp16u* const*, int);
+    template void Plan::execute<Npp32f>(const Npp32f*, int, Npp32f* const*, int);
+    template void Plan::executeStage<Npp8u>(size_t, const Npp8u*, int, Npp8u*, int);
+    template void Plan::executeStage<Npp16u>(size_t, const Npp16u*, int, Npp16u*, int);
+    template void Plan::executeStage<Npp32f>(size_t, const Npp32f*, int, Npp32f*, int);
+
+    Plan& PlanCache::get(const Parameters& parameters, int nDepth, bool bDevice)
+    {
+        const std::string sKey = Plan::getKey(parameters, nDepth, bDevice);
+        for (std::list<std::unique_ptr<Plan> >::iterator it = _aPlans.begin(); it != _aPlans.end(); ++it)
+        {
+            if ((*it)->getKey() == sKey)
+            {
+                // most recently used first
+                _aPlans.splice(_aPlans.begin(), _aPlans, it);
+                return *_aPlans.front();
+            }
+        }
+        _aPlans.emplace_front(new Plan(parameters, nDepth, bDevice));
+        if (_aPlans.size() > _nCapacity)
+        {
+            _aPlans.pop_back();
+        }
+        return *_aPlans.front();
+    }
+}
\ No newline at end of file
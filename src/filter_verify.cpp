@@ -0,0 +1,927 @@
+#include "filter_verify.h"
+#include "filters_cpu.h"
+#include "filter_plan.h"
+#include "job_server.h"
+#include "parameter_helpers.h"
+#include "result_cache.h"
+#include "synthetic_image.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <cuda_runtime.h>
+#include <helper_cuda.h>
+#include <helper_string.h>
+#include <ImagesNPP.h>
+#include <Exceptions.h>
+
+namespace verify
+{
+    namespace
+    {
+        // mt19937 draws the same numbers everywhere, unlike the std distributions,
+        // so a case is reproduced on any machine from its seed and index
+        class Random
+        {
+            std::mt19937 _oEngine;
+        public:
+            explicit Random(uint32_t nSeed) : _oEngine(nSeed)
+            {
+                ;
+            }
+
+            // in [nMin, nMax]
+            int range(int nMin, int nMax)
+            {
+                return nMin + (int)(_oEngine() % (uint32_t)(nMax - nMin + 1));
+            }
+
+            bool chance(int nPercent)
+            {
+                return range(0, 99) < nPercent;
+            }
+
+            uint32_t bits()
+            {
+                return _oEngine();
+            }
+        };
+
+        // One filter of a case with every setting of its command line
+        struct FilterSpec
+        {
+            std::string sFilter;
+            std::string sBorder;
+            NppiSize oMask = { 0, 0 };
+            NppiPoint oAnchor = { 0, 0 };
+            Npp32f aNoise[3] = { 0.0f, 0.0f, 0.0f };
+        };
+
+        // Source image, rectangle and filters, the pitches padded by a few samples
+        struct Case
+        {
+            int nIndex = 0;
+            int nDepth = 8;
+            synthetic::Pattern ePattern = synthetic::Pattern::noise;
+            uint32_t nPatternSeed = 1;
+            NppiSize oSize = { 0, 0 };
+            NppiPoint oOffset = { 0, 0 };
+            NppiSize oROI = { 0, 0 };
+            int nSrcPadding = 0;
+            int nDstPadding = 0;
+            std::vector<FilterSpec> aFilters;
+        };
+
+        struct Options
+        {
+            int nCases = 300;
+            int nCase = -1;
+            uint32_t nSeed = 1;
+            int nThreads = 4;
+            std::string sGolden;
+        };
+
+        // Mismatches of one variant over all the cases
+        struct Tally
+        {
+            const char* sVariant;
+            size_t nCases = 0;
+            size_t nSamples = 0;
+            size_t nMismatches = 0;
+            double nMaxDifference = 0.0;
+            double nTolerance = 0.0;
+        };
+
+        const int nMaxReports = 10;
+
+        std::string describe(const FilterSpec& rFilter)
+        {
+            std::ostringstream oText;
+            oText << rFilter.sFilter;
+            if (rFilter.oMask.width)
+            {
+                oText << " " << rFilter.oMask.width << "x" << rFilter.oMask.height;
+            }
+            if (rFilter.sFilter == "box" || rFilter.sFilter == "wiener")
+            {
+                oText << " anchor " << rFilter.oAnchor.x << "," << rFilter.oAnchor.y;
+            }
+            if (rFilter.sFilter == "wiener")
+            {
+                oText << " noise " << rFilter.aNoise[0] << "," << rFilter.aNoise[1] << "," << rFilter.aNoise[2];
+            }
+            oText << " " << rFilter.sBorder;
+            return oText.str();
+        }
+
+        std::string describe(const Case& rCase)
+        {
+            std::ostringstream oText;
+            oText << "case " << rCase.nIndex << ": " << (rCase.nDepth == 32 ? "32f" : rCase.nDepth == 16 ? "16u" : "8u") << " "
+                << synthetic::name(rCase.ePattern) << " " << rCase.oSize.width << "x" << rCase.oSize.height
+                << ", roi " << rCase.oOffset.x << "," << rCase.oOffset.y << "," << rCase.oROI.width << "," << rCase.oROI.height
+                << ", pitch +" << rCase.nSrcPadding << "/+" << rCase.nDstPadding << " samples:";
+            for (size_t i = 0; i < rCase.aFilters.size(); ++i)
+            {
+                oText << (i ? " |" : "") << " " << describe(rCase.aFilters[i]);
+            }
+            return oText.str();
+        }
+
+        // Case nIndex of the seed, drawn from its own generator
+        Case makeCase(uint32_t nSeed, int nIndex)
+        {
+            Random oRandom(nSeed * 1000003u + (uint32_t)nIndex);
+            Case oCase;
+            oCase.nIndex = nIndex;
+            const int aDepths[] = { 8, 16, 32 };
+            oCase.nDepth = aDepths[oRandom.range(0, 2)];
+            oCase.ePattern = (synthetic::Pattern)oRandom.range(0, (int)synthetic::Pattern::natural);
+            oCase.nPatternSeed = oRandom.bits();
+
+            // single columns and rows, small images, and large ones split in several bands and fused tiles
+            const int nShape = oRandom.range(0, 99);
+            const bool bLarge = nShape >= 92;
+            if (nShape < 10)
+            {
+                oCase.oSize = { 1, oRandom.range(1, 300) };
+            }
+            else if (nShape < 20)
+            {
+                oCase.oSize = { oRandom.range(1, 300), 1 };
+            }
+            else if (bLarge)
+            {
+                oCase.oSize = { oRandom.range(400, 900), oRandom.range(300, 700) };
+            }
+            else
+            {
+                oCase.oSize = { oRandom.range(1, 160), oRandom.range(1, 160) };
+            }
+            if (oRandom.chance(30))
+            {
+                oCase.oROI = oCase.oSize;
+            }
+            else
+            {
+                oCase.oOffset = { oRandom.range(0, oCase.oSize.width - 1), oRandom.range(0, oCase.oSize.height - 1) };
+                oCase.oROI = { oRandom.range(1, oCase.oSize.width - oCase.oOffset.x), oRandom.range(1, oCase.oSize.height - oCase.oOffset.y) };
+            }
+            oCase.nSrcPadding = oRandom.chance(50) ? 0 : oRandom.range(1, 7);
+            oCase.nDstPadding = oRandom.chance(50) ? 0 : oRandom.range(1, 7);
+
+            const std::vector<std::string>& rNames = getFilterNames();
+            const int nFilters = oRandom.range(1, 3);
+            for (int i = 0; i < nFilters; ++i)
+            {
+                FilterSpec oFilter;
+                oFilter.sFilter = rNames[oRandom.range(0, (int)rNames.size() - 1)];
+                oFilter.sBorder = oRandom.chance(50) || oFilter.sFilter == "wiener" ? "replicate" : "none";
+                if (oFilter.sFilter == "box" || oFilter.sFilter == "wiener")
+                {
+                    // mostly small masks, some larger than the image, any anchor inside the mask
+                    const int nMax = bLarge ? 9 : oRandom.chance(20) ? 33 : 11;
+                    oFilter.oMask = { oRandom.range(1, nMax), oRandom.range(1, nMax) };
+                    oFilter.oAnchor = { oRandom.range(0, oFilter.oMask.width - 1), oRandom.range(0, oFilter.oMask.height - 1) };
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        // a level of 0 over a flat area has no gain
+                        oFilter.aNoise[c] = (Npp32f)oRandom.range(1, 500) / 10000.0f;
+                    }
+                }
+                else if (oFilter.sFilter == "laplace" || oFilter.sFilter == "gauss" || oFilter.sFilter == "highpass" || oFilter.sFilter == "lowpass")
+                {
+                    const int nMask = oRandom.chance(50) ? 3 : 5;
+                    oFilter.oMask = { nMask, nMask };
+                }
+                oCase.aFilters.push_back(oFilter);
+            }
+            return oCase;
+        }
+
+        // Same options as a --shared job, then the geometry of the case
+        bool getParameters(const FilterSpec& rFilter, int nDepth, NppiSize oSize, NppiPoint oOffset, NppiSize oROI,
+            const std::shared_ptr<ThreadPool>& pThreadPool, Parameters& rParameters)
+        {
+            char aNoise[64];
+            snprintf(aNoise, sizeof(aNoise), "%.9g,%.9g,%.9g", rFilter.aNoise[0], rFilter.aNoise[1], rFilter.aNoise[2]);
+            std::vector<std::string> aArguments = {
+                "npp-filters-bench",
+                "--shared",
+                "--backend=cpu",
+                "--filter=" + rFilter.sFilter,
+                "--border=" + rFilter.sBorder,
+                "--width=" + std::to_string(oSize.width),
+                "--height=" + std::to_string(oSize.height),
+                "--depth=" + std::to_string(nDepth),
+            };
+            if (rFilter.oMask.width)
+            {
+                aArguments.push_back("--mask=" + std::to_string(rFilter.oMask.width) + "x" + std::to_string(rFilter.oMask.height));
+            }
+            if (rFilter.sFilter == "box" || rFilter.sFilter == "wiener")
+            {
+                aArguments.push_back("--anchor=" + std::to_string(rFilter.oAnchor.x) + "," + std::to_string(rFilter.oAnchor.y));
+                aArguments.push_back(std::string("--noise=") + aNoise);
+            }
+            std::vector<char*> argv;
+            for (std::string& rArgument : aArguments)
+            {
+                argv.push_back(rArgument.data());
+            }
+            rParameters.setThreadPool(pThreadPool);
+            if (rParameters.parseCmdLine((int)argv.size(), argv.data()) != 0)
+            {
+                return false;
+            }
+            rParameters.setSrcSize(oSize);
+            rParameters.setSrcOffset(oOffset);
+            rParameters.setSizeROI(oROI);
+            return true;
+        }
+
+        // Taps of the fixed coefficient filters in row order over their centered mask, and their divisor.
+        // Built from the filter definitions of the NPP documentation, not read from the cpu kernels, so a
+        // wrong table there fails the check. Empty for box and wiener
+        std::vector<int> getTaps(const Parameters& parameters, NppiSize& rMask, int& rDivisor)
+        {
+            const std::string& sFilter = parameters.getFilterType();
+            const bool bMask5 = parameters.getNppiMaskSize() == NPP_MASK_SIZE_5_X_5
+                && (sFilter == "laplace" || sFilter == "gauss" || sFilter == "highpass" || sFilter == "lowpass");
+            const int n = bMask5 ? 5 : 3;
+            const int r = n / 2;
+            rMask = { n, n };
+            rDivisor = 1;
+            std::vector<int> aTaps(n * n, 0);
+            // tap at x, y from the center
+            auto fTap = [&](int x, int y) -> int& { return aTaps[(y + r) * n + x + r]; };
+            // symmetric masks given by |x| and |y|
+            auto fSymmetric = [&](const int aByDistance[3][3]) {
+                for (int y = -r; y <= r; ++y)
+                {
+                    for (int x = -r; x <= r; ++x)
+                    {
+                        fTap(x, y) = aByDistance[std::abs(y)][std::abs(x)];
+                    }
+                }
+            };
+            const int aSmooth[] = { 1, 2, 1 };
+
+            if (sFilter == "sobel_h" || sFilter == "sobel_v")
+            {
+                // a [1 0 -1] derivative across the edges smoothed by [1 2 1] along them: sobel_h
+                // differentiates the rows top minus bottom, sobel_v the columns right minus left
+                for (int y = -1; y <= 1; ++y)
+                {
+                    for (int x = -1; x <= 1; ++x)
+                    {
+                        fTap(x, y) = sFilter == "sobel_h" ? -y * aSmooth[x + 1] : x * aSmooth[y + 1];
+                    }
+                }
+            }
+            else if (sFilter == "roberts_down" || sFilter == "roberts_up")
+            {
+                // the center minus its lower right (down) or lower left (up) neighbour
+                fTap(0, 0) = 1;
+                fTap(sFilter == "roberts_down" ? 1 : -1, 1) = -1;
+            }
+            else if (sFilter == "laplace" && bMask5)
+            {
+                const int aLaplace5[3][3] = { { 20, 6, -4 }, { 6, 0, -3 }, { -4, -3, -1 } };
+                fSymmetric(aLaplace5);
+            }
+            else if (sFilter == "laplace" || sFilter == "highpass" || sFilter == "sharpen")
+            {
+                // every neighbour -1, the center n^2 - 1 for laplace and highpass (zero sum), 16 for sharpen
+                std::fill(aTaps.begin(), aTaps.end(), -1);
+                fTap(0, 0) = sFilter == "sharpen" ? 16 : n * n - 1;
+            }
+            else if (sFilter == "lowpass")
+            {
+                std::fill(aTaps.begin(), aTaps.end(), 1);
+            }
+            else if (sFilter == "gauss" && bMask5)
+            {
+                const int aGauss5[3][3] = { { 127, 52, 12 }, { 52, 31, 7 }, { 12, 7, 2 } };
+                fSymmetric(aGauss5);
+            }
+            else if (sFilter == "gauss")
+            {
+                // binomial [1 2 1] by [1 2 1]
+                for (int y = -1; y <= 1; ++y)
+                {
+                    for (int x = -1; x <= 1; ++x)
+                    {
+                        fTap(x, y) = aSmooth[x + 1] * aSmooth[y + 1];
+                    }
+                }
+            }
+            else
+            {
+                rMask = { 0, 0 };
+                return {};
+            }
+            // smoothing and sharpening keep the mean level: their divisor is the sum of their taps
+            const int nSum = std::accumulate(aTaps.begin(), aTaps.end(), 0);
+            rDivisor = nSum > 0 ? nSum : 1;
+            return aTaps;
+        }
+
+        template<typename D>
+        D roundSample(long long nSum, long long nDivisor)
+        {
+            const long long nValue = nSum >= 0 ? (nSum + nDivisor / 2) / nDivisor : -((-nSum + nDivisor / 2) / nDivisor);
+            return (D)std::clamp<long long>(nValue, 0, std::is_same_v<D, Npp16u> ? 65535 : 255);
+        }
+
+        template<typename D>
+        D roundSample(double nValue)
+        {
+            if constexpr (std::is_floating_point_v<D>)
+            {
+                return (D)nValue;
+            }
+            else
+            {
+                return (D)std::clamp(std::floor(nValue + 0.5), 0.0, std::is_same_v<D, Npp16u> ? 65535.0 : 255.0);
+            }
+        }
+
+        // Scalar reference: each destination sample reads its whole mask, every tap clamped to the image.
+        // Integer sums are made in 64 bits; float sums in the order of the cpu kernels (stencil taps in row
+        // order in floats, box and wiener columns of the mask in doubles) so they round the same way.
+        // pImage is the image origin, not the ROI origin
+        template<typename D>
+        void reference(const Parameters& parameters, const D* pImage, int nSrcStep, D* pDst, int nDstStep)
+        {
+            const NppiSize oSize = parameters.getSrcSize();
+            const NppiPoint oOffset = parameters.getSrcOffset();
+            const NppiSize oROI = parameters.getSizeROI();
+            auto fPixel = [&](int x, int y) {
+                x = std::clamp(x, 0, oSize.width - 1);
+                y = std::clamp(y, 0, oSize.height - 1);
+                return (const D*)((const unsigned char*)pImage + (ptrdiff_t)y * nSrcStep) + 3 * x;
+            };
+
+            NppiSize oMask;
+            int nDivisor = 1;
+            const std::vector<int> aWeights = getTaps(parameters, oMask, nDivisor);
+            const bool bWiener = parameters.getFilterType() == "wiener";
+            const double nRange = std::is_same_v<D, Npp32f> ? 1.0 : std::is_same_v<D, Npp16u> ? 65535.0 : 255.0;
+            if (aWeights.empty())
+            {
+                oMask = parameters.getMaskSize();
+            }
+            const NppiPoint oAnchor = aWeights.empty() ? parameters.getAnchor() : NppiPoint{ oMask.width / 2, oMask.height / 2 };
+
+            for (int y = 0; y < oROI.height; ++y)
+            {
+                D* pLine = (D*)((unsigned char*)pDst + (ptrdiff_t)y * nDstStep);
+                const int sy = oOffset.y + y - oAnchor.y;
+                for (int x = 0; x < oROI.width; ++x)
+                {
+                    const int sx = oOffset.x + x - oAnchor.x;
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        D& rResult = pLine[3 * x + c];
+                        if (!aWeights.empty())
+                        {
+                            typedef std::conditional_t<std::is_floating_point_v<D>, Npp32f, long long> tSum;
+                            tSum nSum = 0;
+                            for (int j = 0; j < oMask.height; ++j)
+                            {
+                                for (int i = 0; i < oMask.width; ++i)
+                                {
+                                    if (const int w = aWeights[j * oMask.width + i])
+                                    {
+                                        nSum += (tSum)w * (tSum)fPixel(sx + i, sy + j)[c];
+                                    }
+                                }
+                            }
+                            if constexpr (std::is_floating_point_v<D>)
+                            {
+                                rResult = nSum / (Npp32f)nDivisor;
+                            }
+                            else
+                            {
+                                rResult = roundSample<D>(nSum, nDivisor);
+                            }
+                            continue;
+                        }
+                        if (parameters.getFilterType() != "box" && !bWiener)
+                        {
+                            continue;
+                        }
+
+                        typedef std::conditional_t<std::is_floating_point_v<D>, double, long long> tSum;
+                        tSum nSum = 0, nSquares = 0;
+                        for (int i = 0; i < oMask.width; ++i)
+                        {
+                            tSum nColumn = 0, nColumnSquares = 0;
+                            for (int j = 0; j < oMask.height; ++j)
+                            {
+                                const tSum v = (tSum)fPixel(sx + i, sy + j)[c];
+                                nColumn += v;
+                                nColumnSquares += v * v;
+                            }
+                            nSum += nColumn;
+                            nSquares += nColumnSquares;
+                        }
+                        if (!bWiener)
+                        {
+                            if constexpr (std::is_floating_point_v<D>)
+                            {
+                                rResult = (D)(nSum / ((double)oMask.width * oMask.height));
+                            }
+                            else
+                            {
+                                rResult = roundSample<D>(nSum, (long long)oMask.width * oMask.height);
+                            }
+                            continue;
+                        }
+                        const double nCount = (double)oMask.width * oMask.height;
+                        const double nNoise = parameters.getNoise()[c] * nRange * nRange;
+                        const double nMean = (double)nSum / nCount;
+                        const double nVariance = std::max((double)nSquares / nCount - nMean * nMean, 0.0);
+                        const double nGain = std::max(nVariance - nNoise, 0.0) / std::max(nVariance, nNoise);
+                        rResult = roundSample<D>(nMean + nGain * ((double)fPixel(oOffset.x + x, oOffset.y + y)[c] - nMean));
+                    }
+                }
+            }
+        }
+
+        // Samples of nWidth x nHeight pixels, rows nStep bytes apart, the padding filled with a marker
+        template<typename D>
+        struct Buffer
+        {
+            std::vector<D> aSamples;
+            int nWidth = 0;
+            int nHeight = 0;
+            int nStep = 0;
+
+            Buffer(int nWidth_, int nHeight_, int nPadding) : nWidth(nWidth_), nHeight(nHeight_)
+            {
+                const int nRowSamples = nWidth * 3 + nPadding;
+                nStep = nRowSamples * (int)sizeof(D);
+                aSamples.assign((size_t)nRowSamples * nHeight, marker());
+            }
+
+            static D marker()
+            {
+                return std::is_floating_point_v<D> ? (D)-7.0 : (D)0x5A;
+            }
+
+            D* row(int y) { return (D*)((unsigned char*)aSamples.data() + (ptrdiff_t)y * nStep); }
+            const D* row(int y) const { return (const D*)((const unsigned char*)aSamples.data() + (ptrdiff_t)y * nStep); }
+        };
+
+        // Differences of rResult with rExpected over their width, and any padding sample overwritten
+        template<typename D>
+        bool compare(const Buffer<D>& rResult, const Buffer<D>& rExpected, double nTolerance, const Case& rCase, Tally& rTally, int& nReports)
+        {
+            size_t nMismatches = 0;
+            std::string sFirst;
+            const int nRowSamples = rResult.nStep / (int)sizeof(D);
+            for (int y = 0; y < rResult.nHeight; ++y)
+            {
+                const D* pResult = rResult.row(y);
+                const D* pExpected = rExpected.row(y);
+                for (int i = 0; i < nRowSamples; ++i)
+                {
+                    const bool bPadding = i >= rResult.nWidth * 3;
+                    const double nDifference = bPadding ? (pResult[i] == Buffer<D>::marker() ? 0.0 : INFINITY)
+                        : std::fabs((double)pResult[i] - (double)pExpected[i]);
+                    const bool bSame = bPadding ? nDifference == 0.0 : (nTolerance > 0.0 ? nDifference <= nTolerance : pResult[i] == pExpected[i]);
+                    if (!bPadding && std::isfinite(nDifference))
+                    {
+                        rTally.nMaxDifference = std::max(rTally.nMaxDifference, nDifference);
+                    }
+                    if (bSame)
+                    {
+                        continue;
+                    }
+                    if (!nMismatches)
+                    {
+                        std::ostringstream oText;
+                        oText.precision(9);
+                        if (bPadding)
+                        {
+                            oText << "padding sample " << i << " of row " << y << " overwritten";
+                        }
+                        else
+                        {
+                            oText << "pixel " << i / 3 << "," << y << " channel " << i % 3 << ": " << (double)pResult[i] << " instead of " << (double)pExpected[i];
+                        }
+                        sFirst = oText.str();
+                    }
+                    ++nMismatches;
+                }
+            }
+            rTally.nSamples += (size_t)rResult.nWidth * 3 * rResult.nHeight;
+            rTally.nMismatches += nMismatches;
+            if (nMismatches && nReports++ < nMaxReports)
+            {
+                printf("FAIL %s, %s\n  %zu samples differ, first at %s\n", rTally.sVariant, describe(rCase).c_str(), nMismatches, sFirst.c_str());
+            }
+            return nMismatches == 0;
+        }
+
+        // Every variant of one case against the reference
+        template<typename D>
+        bool verifyCase(const Case& rCase, const std::shared_ptr<ThreadPool>& pSingle, const std::shared_ptr<ThreadPool>& pPool,
+            std::map<std::string, Tally>& rTallies, int& nReports)
+        {
+            Buffer<D> oSrc(rCase.oSize.width, rCase.oSize.height, rCase.nSrcPadding);
+            synthetic::generate(rCase.ePattern, oSrc.aSamples.data(), oSrc.nStep, rCase.oSize.width, rCase.oSize.height, pPool.get(), rCase.nPatternSeed);
+            const D* pROI = oSrc.row(rCase.oOffset.y) + 3 * rCase.oOffset.x;
+            const int nFilters = (int)rCase.aFilters.size();
+            bool bPassed = true;
+
+            // the filters of the case on one thread and on the pool, with their reference results
+            std::vector<Parameters> aSingle(nFilters), aPool(nFilters);
+            std::vector<Buffer<D> > aExpected;
+            for (int i = 0; i < nFilters; ++i)
+            {
+                if (!getParameters(rCase.aFilters[i], rCase.nDepth, rCase.oSize, rCase.oOffset, rCase.oROI, pSingle, aSingle[i])
+                    || !getParameters(rCase.aFilters[i], rCase.nDepth, rCase.oSize, rCase.oOffset, rCase.oROI, pPool, aPool[i]))
+                {
+                    printf("FAIL %s: invalid parameters\n", describe(rCase).c_str());
+                    return false;
+                }
+                aExpected.emplace_back(rCase.oROI.width, rCase.oROI.height, rCase.nDstPadding);
+                reference(aSingle[i], oSrc.aSamples.data(), oSrc.nStep, aExpected.back().aSamples.data(), aExpected.back().nStep);
+            }
+
+            auto fRun = [&](const char* sVariant, std::vector<Parameters>& rParameters) {
+                Tally& rTally = rTallies[sVariant];
+                ++rTally.nCases;
+                for (int i = 0; i < nFilters; ++i)
+                {
+                    Buffer<D> oDst(rCase.oROI.width, rCase.oROI.height, rCase.nDstPadding);
+                    D* pDst = oDst.aSamples.data();
+                    filters::cpu::Plan<D>(&rParameters[i], 1, false).execute(pROI, oSrc.nStep, &pDst, oDst.nStep);
+                    bPassed = compare(oDst, aExpected[i], 0.0, rCase, rTally, nReports) && bPassed;
+                }
+            };
+            fRun("plan", aSingle);
+            fRun("bands", aPool);
+
+            // every filter of one source in a single plan, (filter, band) tasks
+            if (nFilters > 1)
+            {
+                Tally& rTally = rTallies["list"];
+                ++rTally.nCases;
+                std::vector<Buffer<D> > aDst;
+                std::vector<D*> apDst;
+                for (int i = 0; i < nFilters; ++i)
+                {
+                    aDst.emplace_back(rCase.oROI.width, rCase.oROI.height, rCase.nDstPadding);
+                }
+                for (Buffer<D>& rDst : aDst)
+                {
+                    apDst.push_back(rDst.aSamples.data());
+                }
+                filters::cpu::Plan<D>(aPool.data(), nFilters, false).execute(pROI, oSrc.nStep, apDst.data(), aDst[0].nStep);
+                for (int i = 0; i < nFilters; ++i)
+                {
+                    bPassed = compare(aDst[i], aExpected[i], 0.0, rCase, rTally, nReports) && bPassed;
+                }
+
+                // the filters as pipeline stages fused by tiles, against the reference of each stage in turn
+                // over the ROI sized result of the previous one
+                Tally& rFused = rTallies["fused"];
+                ++rFused.nCases;
+                Buffer<D> oFused(rCase.oROI.width, rCase.oROI.height, rCase.nDstPadding);
+                D* pFused = oFused.aSamples.data();
+                filters::cpu::Plan<D>(aPool.data(), nFilters, true).execute(pROI, oSrc.nStep, &pFused, oFused.nStep);
+                Buffer<D> oStage = aExpected[0];
+                for (int i = 1; i < nFilters; ++i)
+                {
+                    Parameters oStageParameters = aSingle[i];
+                    oStageParameters.setSrcSize(rCase.oROI);
+                    oStageParameters.setSrcOffset({ 0, 0 });
+                    Buffer<D> oNext(rCase.oROI.width, rCase.oROI.height, rCase.nDstPadding);
+                    reference(oStageParameters, oStage.aSamples.data(), oStage.nStep, oNext.aSamples.data(), oNext.nStep);
+                    oStage = oNext;
+                }
+                bPassed = compare(oFused, oStage, 0.0, rCase, rFused, nReports) && bPassed;
+            }
+
+            // summed-area tables of the ROI, a box and a wiener point of the first box or wiener mask
+            const FilterSpec& rFirst = rCase.aFilters[0];
+            if (rFirst.sFilter == "box" || rFirst.sFilter == "wiener")
+            {
+                Tally& rTally = rTallies["sweep"];
+                ++rTally.nCases;
+                rTally.nTolerance = nSweepTolerance;
+                const NppiSize oMask = rFirst.oMask;
+                const NppiPoint oAnchor = rFirst.oAnchor;
+                const int nRadius = std::max({ oAnchor.x, oAnchor.y, oMask.width - oAnchor.x - 1, oMask.height - oAnchor.y - 1 });
+                const filters::cpu::SummedAreaTables<D> oTables(pROI, oSrc.nStep, rCase.oROI, nRadius, true, pPool.get());
+
+                std::vector<Parameters> aPoints(2);
+                FilterSpec oOther = rFirst;
+                oOther.sFilter = rFirst.sFilter == "box" ? "wiener" : "box";
+                oOther.sBorder = "replicate";
+                std::vector<Buffer<D> > aDst, aSweepExpected;
+                std::vector<D*> apDst;
+                for (int i = 0; i < 2; ++i)
+                {
+                    getParameters(i ? oOther : rFirst, rCase.nDepth, rCase.oROI, { 0, 0 }, rCase.oROI, pPool, aPoints[i]);
+                    aDst.emplace_back(rCase.oROI.width, rCase.oROI.height, rCase.nDstPadding);
+                    aSweepExpected.emplace_back(rCase.oROI.width, rCase.oROI.height, rCase.nDstPadding);
+                    reference(aPoints[i], pROI, oSrc.nStep, aSweepExpected[i].aSamples.data(), aSweepExpected[i].nStep);
+                }
+                for (Buffer<D>& rDst : aDst)
+                {
+                    apDst.push_back(rDst.aSamples.data());
+                }
+                filters::cpu::sweep(oTables, aPoints.data(), 2, apDst.data(), aDst[0].nStep);
+                // integer sums are exact
+                const double nTolerance = std::is_floating_point_v<D> ? nSweepTolerance : 0.0;
+                for (int i = 0; i < 2; ++i)
+                {
+                    bPassed = compare(aDst[i], aSweepExpected[i], nTolerance, rCase, rTally, nReports) && bPassed;
+                }
+            }
+            return bPassed;
+        }
+
+        // Settings of a golden hash, the JSON line without its hash
+        struct GoldenEntry
+        {
+            std::string sKey;
+            std::string sHash;
+        };
+
+        std::string formatHash(uint64_t nHash)
+        {
+            char aHash[20];
+            snprintf(aHash, sizeof(aHash), "%016llx", (unsigned long long)nHash);
+            return aHash;
+        }
+
+        std::string goldenKey(const std::string& sBackend, const std::string& sFilter, const std::string& sBorder, int nMask, int nDepth, NppiSize oSize)
+        {
+            std::ostringstream oKey;
+            oKey << "{\"backend\": \"" << sBackend << "\", \"filter\": \"" << sFilter << "\", \"border\": \"" << sBorder << "\", \"mask\": " << nMask
+                << ", \"depth\": " << nDepth << ", \"size\": \"" << oSize.width << "x" << oSize.height << "\"";
+            return oKey.str();
+        }
+
+        // Hash of the cpu result of a golden case, the oROI at oOffset in an oSize image
+        template<typename D>
+        std::string hashHost(const Parameters& parameters, int nDepth, NppiSize oSize, NppiPoint oOffset, NppiSize oROI, ThreadPool* pPool)
+        {
+            const int nStep = oSize.width * 3 * (int)sizeof(D);
+            const int nDstStep = oROI.width * 3 * (int)sizeof(D);
+            std::vector<D> aSrc((size_t)oSize.width * oSize.height * 3), aDst((size_t)oROI.width * oROI.height * 3);
+            synthetic::generate(synthetic::Pattern::natural, aSrc.data(), nStep, oSize.width, oSize.height, pPool);
+            D* pDst = aDst.data();
+            const D* pSrc = (const D*)((const unsigned char*)aSrc.data() + (ptrdiff_t)oOffset.y * nStep) + 3 * oOffset.x;
+            filters::Plan(parameters, nDepth, false).execute(pSrc, nStep, &pDst, nDstStep);
+            return formatHash(ResultCache::hash(aDst.data(), aDst.size() * sizeof(D)));
+        }
+
+        // Hashes of every filter, border and mask of a natural image: 8, 16 and 32 bits on the cpu,
+        // 8 bits on the npp backend with a device. The npp kernels without a border read the mask
+        // halo around the ROI, so with none the ROI is inset by the mask radius to read pixels of the image
+        std::vector<GoldenEntry> hashGolden(bool bDevice, const NppStreamContext& oContext, const std::shared_ptr<ThreadPool>& pPool)
+        {
+            const NppiSize oSize = { 317, 211 };
+            std::vector<GoldenEntry> aEntries;
+            std::vector<Npp8u> aSrc((size_t)oSize.width * oSize.height * 3), aDst(aSrc.size());
+            synthetic::generate(synthetic::Pattern::natural, aSrc.data(), oSize.width * 3, oSize.width, oSize.height, pPool.get());
+            npp::ImageNPP_8u_C3 oDeviceSrc, oDeviceDst;
+            if (bDevice)
+            {
+                npp::ImageNPP_8u_C3(oSize.width, oSize.height).swap(oDeviceSrc);
+                npp::ImageNPP_8u_C3(oSize.width, oSize.height).swap(oDeviceDst);
+                checkCudaErrors(cudaMemcpy2D(oDeviceSrc.data(), oDeviceSrc.pitch(), aSrc.data(), oSize.width * 3,
+                    oSize.width * 3, oSize.height, cudaMemcpyHostToDevice));
+            }
+
+            for (const std::string& sFilter : getFilterNames())
+            {
+                std::vector<int> aMasks = { 0 };
+                if (sFilter == "box" || sFilter == "wiener")
+                {
+                    aMasks = { 3, 5, 9 };
+                }
+                else if (sFilter == "laplace" || sFilter == "gauss" || sFilter == "highpass" || sFilter == "lowpass")
+                {
+                    aMasks = { 3, 5 };
+                }
+                for (const char* sBorder : { "none", "replicate" })
+                {
+                    if (sFilter == "wiener" && std::string(sBorder) != "replicate")
+                    {
+                        continue;
+                    }
+                    for (int nMask : aMasks)
+                    {
+                        FilterSpec oFilter;
+                        oFilter.sFilter = sFilter;
+                        oFilter.sBorder = sBorder;
+                        oFilter.oMask = { nMask, nMask };
+                        oFilter.oAnchor = { nMask / 2, nMask / 2 };
+                        std::fill(std::begin(oFilter.aNoise), std::end(oFilter.aNoise), 0.01f);
+                        const int nRadius = std::string(sBorder) == "none" ? std::max(nMask, 3) / 2 : 0;
+                        const NppiPoint oOffset = { nRadius, nRadius };
+                        const NppiSize oROI = { oSize.width - 2 * nRadius, oSize.height - 2 * nRadius };
+                        for (int nDepth : { 8, 16, 32 })
+                        {
+                            Parameters parameters;
+                            getParameters(oFilter, nDepth, oSize, oOffset, oROI, pPool, parameters);
+                            const std::string sHash = nDepth == 16 ? hashHost<Npp16u>(parameters, nDepth, oSize, oOffset, oROI, pPool.get())
+                                : nDepth == 32 ? hashHost<Npp32f>(parameters, nDepth, oSize, oOffset, oROI, pPool.get())
+                                : hashHost<Npp8u>(parameters, nDepth, oSize, oOffset, oROI, pPool.get());
+                            aEntries.push_back({ goldenKey("cpu", sFilter, sBorder, nMask, nDepth, oSize), sHash });
+                        }
+                        if (bDevice)
+                        {
+                            Parameters parameters;
+                            getParameters(oFilter, 8, oSize, oOffset, oROI, pPool, parameters);
+                            parameters.setStreamContext(oContext);
+                            filters::Plan(parameters, 8, true).execute(0, oContext, oDeviceSrc, oDeviceDst);
+                            checkCudaErrors(cudaStreamSynchronize(oContext.hStream));
+                            checkCudaErrors(cudaMemcpy2D(aDst.data(), oROI.width * 3, oDeviceDst.data(), oDeviceDst.pitch(),
+                                oROI.width * 3, oROI.height, cudaMemcpyDeviceToHost));
+                            aEntries.push_back({ goldenKey("npp", sFilter, sBorder, nMask, 8, oSize),
+                                formatHash(ResultCache::hash(aDst.data(), (size_t)oROI.width * oROI.height * 3)) });
+                        }
+                    }
+                }
+            }
+            return aEntries;
+        }
+
+        // Compare with the JSON lines of rFile, or write them when it doesn't exist yet
+        bool checkGolden(const std::string& rFile, const std::vector<GoldenEntry>& rEntries)
+        {
+            std::ifstream oFile(rFile);
+            if (!oFile)
+            {
+                std::ofstream oOutput(rFile);
+                for (const GoldenEntry& rEntry : rEntries)
+                {
+                    oOutput << rEntry.sKey << ", \"hash\": \"" << rEntry.sHash << "\"}\n";
+                }
+                if (!oOutput)
+                {
+                    printf("Error: Can't write %s\n", rFile.c_str());
+                    return false;
+                }
+                printf("Golden: %zu hashes written to %s\n", rEntries.size(), rFile.c_str());
+                return true;
+            }
+
+            // the settings of a line, in the order written, give its key
+            std::map<std::string, std::string> aGolden;
+            std::string sLine;
+            int nLine = 0;
+            while (std::getline(oFile, sLine))
+            {
+                ++nLine;
+                if (sLine.empty() || sLine[0] == '#')
+                {
+                    continue;
+                }
+                serve::Job oJob;
+                std::string sError;
+                if (!serve::parseJob(sLine, oJob, sError))
+                {
+                    printf("Error: %s line %d: %s\n", rFile.c_str(), nLine, sError.c_str());
+                    return false;
+                }
+                std::map<std::string, std::string> aFields(oJob.aArguments.begin(), oJob.aArguments.end());
+                aGolden[goldenKey(aFields["backend"], aFields["filter"], aFields["border"], atoi(aFields["mask"].c_str()), atoi(aFields["depth"].c_str()),
+                    { atoi(aFields["size"].c_str()), atoi(aFields["size"].c_str() + aFields["size"].find('x') + 1) })] = aFields["hash"];
+            }
+
+            size_t nMatched = 0, nDifferent = 0, nNew = 0;
+            for (const GoldenEntry& rEntry : rEntries)
+            {
+                const auto it = aGolden.find(rEntry.sKey);
+                if (it == aGolden.end())
+                {
+                    ++nNew;
+                }
+                else if (it->second == rEntry.sHash)
+                {
+                    ++nMatched;
+                }
+                else if (++nDifferent <= nMaxReports)
+                {
+                    printf("FAIL golden %s}: %s instead of %s\n", rEntry.sKey.c_str(), rEntry.sHash.c_str(), it->second.c_str());
+                }
+            }
+            printf("Golden: %zu hashes, %zu matched, %zu different, %zu not in %s\n", rEntries.size(), nMatched, nDifferent, nNew, rFile.c_str());
+            return nDifferent == 0;
+        }
+
+        bool getCount(const char* arg, int& rValue)
+        {
+            char* end = nullptr;
+            const long nValue = strtol(arg, &end, 10);
+            if (end == arg || *end != 0 || nValue < 0 || nValue > 1 << 30)
+            {
+                return false;
+            }
+            rValue = (int)nValue;
+            return true;
+        }
+
+        // -1 to exit with success (--help), -2 on an invalid option
+        int parseOptions(int argc, char* argv[], Options& rOptions)
+        {
+            if (checkCmdLineFlag(argc, (const char**)argv, "help"))
+            {
+                std::cout << "npp-filters-bench --verify [--cases=300] [--seed=1] [--case=N] [--threads=N] [--golden=golden.jsonl]" << std::endl;
+                return -1;
+            }
+            // --case is a prefix of --cases, the values are read by their exact name
+            const char* cases = getCmdLineValue(argc, argv, "cases");
+            const char* index = getCmdLineValue(argc, argv, "case");
+            const char* seed = getCmdLineValue(argc, argv, "seed");
+            if ((cases && !getCount(cases, rOptions.nCases)) || (index && !getCount(index, rOptions.nCase)))
+            {
+                std::cout << "npp-filters-bench --cases and --case take a count and an index from 0" << std::endl;
+                return -2;
+            }
+            if (seed)
+            {
+                rOptions.nSeed = (uint32_t)strtoul(seed, nullptr, 10);
+            }
+            // at least 4 threads, so the bands and tiles are split even on a small host
+            const int nThreads = getThreads(argc, argv);
+            rOptions.nThreads = std::max(nThreads ? nThreads : (int)std::thread::hardware_concurrency(), 4);
+            if (const char* golden = getCmdLineValue(argc, argv, "golden"))
+            {
+                rOptions.sGolden = golden;
+            }
+            return 0;
+        }
+    }
+
+    int run(int argc, char* argv[], bool bDevice, const NppStreamContext& oContext)
+    {
+        Options oOptions;
+        const int status = parseOptions(argc, argv, oOptions);
+        if (status != 0)
+        {
+            return status == -1 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        auto pSingle = std::make_shared<ThreadPool>(1);
+        auto pPool = std::make_shared<ThreadPool>(oOptions.nThreads);
+
+        const int nFirst = oOptions.nCase >= 0 ? oOptions.nCase : 0;
+        const int nLast = oOptions.nCase >= 0 ? oOptions.nCase + 1 : oOptions.nCases;
+        printf("npp-filters-bench --verify: %d random case%s from seed %u, %d threads\n\n", nLast - nFirst, nLast - nFirst == 1 ? "" : "s",
+            oOptions.nSeed, pPool->size());
+
+        std::map<std::string, Tally> aTallies;
+        for (const char* sVariant : { "plan", "bands", "list", "fused", "sweep" })
+        {
+            aTallies[sVariant].sVariant = sVariant;
+        }
+        int nReports = 0;
+        int nFailed = 0;
+        for (int i = nFirst; i < nLast; ++i)
+        {
+            const Case oCase = makeCase(oOptions.nSeed, i);
+            const bool bPassed = oCase.nDepth == 16 ? verifyCase<Npp16u>(oCase, pSingle, pPool, aTallies, nReports)
+                : oCase.nDepth == 32 ? verifyCase<Npp32f>(oCase, pSingle, pPool, aTallies, nReports)
+                : verifyCase<Npp8u>(oCase, pSingle, pPool, aTallies, nReports);
+            nFailed += bPassed ? 0 : 1;
+        }
+
+        printf("%s%-8s %7s %14s %11s %10s %10s\n", nReports ? "\n" : "", "variant", "cases", "samples", "mismatches", "max diff", "tolerance");
+        for (const char* sVariant : { "plan", "bands", "list", "fused", "sweep" })
+        {
+            const Tally& rTally = aTallies[sVariant];
+            printf("%-8s %7zu %14zu %11zu %10.3g %10.3g\n", sVariant, rTally.nCases, rTally.nSamples, rTally.nMismatches, rTally.nMaxDifference, rTally.nTolerance);
+        }
+        printf("\n%d of %d cases failed\n", nFailed, nLast - nFirst);
+
+        bool bGolden = true;
+        if (!oOptions.sGolden.empty())
+        {
+            bGolden = checkGolden(oOptions.sGolden, hashGolden(bDevice, oContext, pPool));
+        }
+        return nFailed == 0 && bGolden ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,1163 @@
+#include "filters_cpu.h"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <Exceptions.h>
+#include "thread_pool.h"
+#include "trace.h"
+
+namespace filters
+{
+    namespace cpu
+    {
+        // Accumulator and range of each sample type
+        template<typename D> struct SampleTraits;
+
+        template<> struct SampleTraits<Npp8u>
+        {
+            typedef Npp32s tAcc;
+            typedef Npp64s tSum;
+            static constexpr double nRange = 255.0;
+        };
+
+        template<> struct SampleTraits<Npp16u>
+        {
+            typedef Npp32s tAcc;
+            typedef Npp64s tSum;
+            static constexpr double nRange = 65535.0;
+        };
+
+        template<> struct SampleTraits<Npp32f>
+        {
+            typedef Npp32f tAcc;
+            typedef Npp64f tSum;
+            static constexpr double nRange = 1.0;
+        };
+
+        // Round to nearest (half away from zero) and saturate to the sample range
+        template<typename D, typename A>
+        inline D saturate(A nSum, A nDivisor)
+        {
+            if constexpr (std::is_floating_point_v<D>)
+            {
+                return (D)(nSum / nDivisor);
+            }
+            else
+            {
+                A nValue = nSum >= 0 ? (nSum + nDivisor / 2) / nDivisor : -((-nSum + nDivisor / 2) / nDivisor);
+                return (D)std::clamp<A>(nValue, 0, (A)SampleTraits<D>::nRange);
+            }
+        }
+
+        template<typename D>
+        inline D saturate(double nValue)
+        {
+            if constexpr (std::is_floating_point_v<D>)
+            {
+                return (D)nValue;
+            }
+            else
+            {
+                return (D)std::clamp(std::floor(nValue + 0.5), 0.0, SampleTraits<D>::nRange);
+            }
+        }
+
+        // Source and destination of one filter call, the source is addressed from the
+        // image origin so that any mask position can be clamped to the image
+        template<typename D>
+        struct Region
+        {
+            const unsigned char* pOrigin;
+            int nSrcStep;
+            NppiSize oSrcSize;
+            NppiPoint oSrcOffset;
+            unsigned char* pDst;
+            int nDstStep;
+            NppiSize oSizeROI;
+
+            Region(const Parameters& parameters, const D* pSrc, int nSrcStep_, D* pDst_, int nDstStep_)
+                : nSrcStep(nSrcStep_)
+                , oSrcSize(parameters.getSrcSize())
+                , oSrcOffset(parameters.getSrcOffset())
+                , pDst((unsigned char*)pDst_)
+                , nDstStep(nDstStep_)
+                , oSizeROI(parameters.getSizeROI())
+            {
+                pOrigin = (const unsigned char*)pSrc - (ptrdiff_t)oSrcOffset.y * nSrcStep - (ptrdiff_t)oSrcOffset.x * 3 * sizeof(D);
+            }
+
+            // Intermediate image of a fused stage, pOrigin_ is the address of its row 0
+            Region(const unsigned char* pOrigin_, int nSrcStep_, NppiSize oSrcSize_, NppiPoint oSrcOffset_, D* pDst_, int nDstStep_, NppiSize oSizeROI_)
+                : pOrigin(pOrigin_)
+                , nSrcStep(nSrcStep_)
+                , oSrcSize(oSrcSize_)
+                , oSrcOffset(oSrcOffset_)
+                , pDst((unsigned char*)pDst_)
+                , nDstStep(nDstStep_)
+                , oSizeROI(oSizeROI_)
+            {
+            }
+
+            // source line of image row y, replicated outside the image
+            const D* line(int y) const
+            {
+                y = std::clamp(y, 0, oSrcSize.height - 1);
+                return (const D*)(pOrigin + (ptrdiff_t)y * nSrcStep);
+            }
+
+            D* dstLine(int y) const
+            {
+                return (D*)(pDst + (ptrdiff_t)y * nDstStep);
+            }
+
+            // nRows ROI lines starting at ROI line y, the source addressing is unchanged
+            Region band(int y, int nRows) const
+            {
+                Region r = *this;
+                r.oSrcOffset.y += y;
+                r.oSizeROI.height = nRows;
+                r.pDst += (ptrdiff_t)y * nDstStep;
+                return r;
+            }
+
+            // sample index of the columns covered by a mask of nWidth with anchor nAnchor,
+            // entry x + i is the column under mask tap i for destination pixel x
+            std::vector<int> columns(int nWidth, int nAnchor) const
+            {
+                std::vector<int> aColumns(oSizeROI.width + nWidth - 1);
+                for (int i = 0; i < (int)aColumns.size(); ++i)
+                {
+                    aColumns[i] = std::clamp(oSrcOffset.x + i - nAnchor, 0, oSrcSize.width - 1) * 3;
+                }
+                return aColumns;
+            }
+        };
+
+        // Fixed coefficients mask, result is sum(weight * pixel) / divisor
+        struct Stencil
+        {
+            int nWidth;
+            int nHeight;
+            const int* pWeights;
+            int nDivisor;
+        };
+
+        static const int aSobelHoriz[] = { 1, 2, 1, 0, 0, 0, -1, -2, -1 };
+        static const int aSobelVert[] = { -1, 0, 1, -2, 0, 2, -1, 0, 1 };
+        static const int aRobertsDown[] = { 0, 0, 0, 0, 1, 0, 0, 0, -1 };
+        static const int aRobertsUp[] = { 0, 0, 0, 0, 1, 0, -1, 0, 0 };
+        static const int aSharpen[] = { -1, -1, -1, -1, 16, -1, -1, -1, -1 };
+        static const int aLaplace3[] = { -1, -1, -1, -1, 8, -1, -1, -1, -1 };
+        static const int aLaplace5[] = {
+            -1, -3, -4, -3, -1,
+            -3,  0,  6,  0, -3,
+            -4,  6, 20,  6, -4,
+            -3,  0,  6,  0, -3,
+            -1, -3, -4, -3, -1 };
+        static const int aGauss3[] = { 1, 2, 1, 2, 4, 2, 1, 2, 1 };
+        static const int aGauss5[] = {
+             2,  7,  12,  7,  2,
+             7, 31,  52, 31,  7,
+            12, 52, 127, 52, 12,
+             7, 31,  52, 31,  7,
+             2,  7,  12,  7,  2 };
+        static const int aHighPass3[] = { -1, -1, -1, -1, 8, -1, -1, -1, -1 };
+        static const int aHighPass5[] = {
+            -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1,
+            -1, -1, 24, -1, -1,
+            -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1 };
+        static const int aLowPass3[] = { 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+        static const int aLowPass5[] = {
+            1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1 };
+
+        Stencil maskStencil(const Parameters& parameters, const int* pWeights3, const int* pWeights5, int nDivisor3, int nDivisor5)
+        {
+            if (parameters.getNppiMaskSize() == NPP_MASK_SIZE_3_X_3)
+            {
+                return { 3, 3, pWeights3, nDivisor3 };
+            }
+            NPP_ASSERT_MSG(parameters.getNppiMaskSize() == NPP_MASK_SIZE_5_X_5, "only 3x3 and 5x5 masks are supported");
+            return { 5, 5, pWeights5, nDivisor5 };
+        }
+
+        template<typename D> struct Kernel;
+
+        // Line pointers and column sums of a kernel run, sized once by reserve()
+        template<typename D>
+        struct Scratch
+        {
+            typedef typename SampleTraits<D>::tSum tSum;
+
+            std::vector<const D*> aLines;
+            std::vector<tSum> aSum;
+            std::vector<tSum> aSquares;
+
+            void reserve(const Kernel<D>& k);
+
+            size_t bytes() const
+            {
+                return aLines.size() * sizeof(const D*) + (aSum.size() + aSquares.size()) * sizeof(tSum);
+            }
+        };
+
+        // A filter resolved for the columns of a region: its function, the non zero taps of a stencil
+        // in mask order or the box mask and noise levels, and the source column of every mask tap.
+        // It runs on any region with the same source width, column offset and ROI width, so on all
+        // the row bands of the region it was made for
+        template<typename D>
+        struct Kernel
+        {
+            typedef typename SampleTraits<D>::tAcc tAcc;
+            struct Tap { int j; int i; tAcc w; };
+
+            void (*fRun)(const Kernel& k, const Region<D>& r, Scratch<D>& s) = nullptr;
+            NppiSize oMask = { 1, 1 };
+            NppiPoint oAnchor = { 0, 0 };
+            std::vector<Tap> aTaps;
+            tAcc nDivisor = 1;
+            // wiener noise levels scaled to the sample range
+            double aNoise[3] = { 0.0, 0.0, 0.0 };
+            bool bSquares = false;
+            std::vector<int> aColumns;
+
+            Kernel(const Parameters& parameters, const Region<D>& r);
+
+            // nothing for an unknown filter name
+            void run(const Region<D>& r, Scratch<D>& s) const
+            {
+                if (fRun)
+                {
+                    fRun(*this, r, s);
+                }
+            }
+        };
+
+        template<typename D>
+        void Scratch<D>::reserve(const Kernel<D>& k)
+        {
+            aLines.resize(k.oMask.height);
+            aSum.resize(k.aColumns.size() * 3);
+            aSquares.resize(k.bSquares ? k.aColumns.size() * 3 : 0);
+        }
+
+        // Centered fixed mask filter
+        template<typename D>
+        void stencil(const Kernel<D>& k, const Region<D>& r, Scratch<D>& s)
+        {
+            typedef typename SampleTraits<D>::tAcc tAcc;
+            typedef typename Kernel<D>::Tap Tap;
+
+            std::vector<const D*>& aLines = s.aLines;
+            for (int y = 0; y < r.oSizeROI.height; ++y)
+            {
+                for (int j = 0; j < k.oMask.height; ++j)
+                {
+                    aLines[j] = r.line(r.oSrcOffset.y + y - k.oAnchor.y + j);
+                }
+
+                D* pDst = r.dstLine(y);
+                for (int x = 0; x < r.oSizeROI.width; ++x)
+                {
+                    const int* pColumns = &k.aColumns[x];
+                    tAcc aSum[3] = { 0, 0, 0 };
+                    for (const Tap& t : k.aTaps)
+                    {
+                        const D* pPixel = aLines[t.j] + pColumns[t.i];
+                        aSum[0] += t.w * (tAcc)pPixel[0];
+                        aSum[1] += t.w * (tAcc)pPixel[1];
+                        aSum[2] += t.w * (tAcc)pPixel[2];
+                    }
+                    pDst[3 * x + 0] = saturate<D>(aSum[0], k.nDivisor);
+                    pDst[3 * x + 1] = saturate<D>(aSum[1], k.nDivisor);
+                    pDst[3 * x + 2] = saturate<D>(aSum[2], k.nDivisor);
+                }
+            }
+        }
+
+        // Per column sums of the nHeight source lines, one entry per ROI column plus mask width,
+        // kept in the scratch buffers of the run (the squares when aSquares isn't empty).
+        // Integer sums are exact so they are kept running from one line to the next,
+        // float sums are recomputed in mask order so every pixel gets the same rounding.
+        template<typename D>
+        class ColumnSums
+        {
+            typedef typename SampleTraits<D>::tSum tSum;
+
+            const Region<D>& _r;
+            const std::vector<int>& _aColumns;
+            int _nHeight;
+            int _nAnchorY;
+            bool _bSquares;
+            int _nLine = -1;
+        public:
+            std::vector<tSum>& aSum;
+            std::vector<tSum>& aSquares;
+
+            ColumnSums(const Region<D>& r, const std::vector<int>& aColumns, int nHeight, int nAnchorY, std::vector<tSum>& aSum_, std::vector<tSum>& aSquares_)
+                : _r(r), _aColumns(aColumns), _nHeight(nHeight), _nAnchorY(nAnchorY), _bSquares(!aSquares_.empty())
+                , aSum(aSum_), aSquares(aSquares_)
+            {
+                ;
+            }
+
+            void accumulate(const D* pLine, tSum nSign)
+            {
+                for (size_t k = 0; k < _aColumns.size(); ++k)
+                {
+                    const D* pPixel = pLine + _aColumns[k];
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        const tSum v = (tSum)pPixel[c];
+                        aSum[3 * k + c] += nSign * v;
+                        if (_bSquares)
+                        {
+                            aSquares[3 * k + c] += nSign * v * v;
+                        }
+                    }
+                }
+            }
+
+            // move the sums to ROI line y
+            void seek(int y)
+            {
+                const int nTop = _r.oSrcOffset.y + y - _nAnchorY;
+                if (std::is_integral_v<tSum> && _nLine >= 0 && y == _nLine + 1)
+                {
+                    accumulate(_r.line(nTop - 1), -1);
+                    accumulate(_r.line(nTop + _nHeight - 1), 1);
+                }
+                else
+                {
+                    std::fill(aSum.begin(), aSum.end(), (tSum)0);
+                    std::fill(aSquares.begin(), aSquares.end(), (tSum)0);
+                    for (int j = 0; j < _nHeight; ++j)
+                    {
+                        accumulate(_r.line(nTop + j), 1);
+                    }
+                }
+                _nLine = y;
+            }
+        };
+
+        // Sum of nWidth column sums starting at column x, running for integers
+        template<typename T>
+        class WindowSum
+        {
+            int _nWidth;
+            int _nColumn = -1;
+            T _aSum[3] = { 0, 0, 0 };
+        public:
+            explicit WindowSum(int nWidth) : _nWidth(nWidth)
+            {
+                ;
+            }
+
+            const T* at(const std::vector<T>& aColumnSums, int x)
+            {
+                if (std::is_integral_v<T> && _nColumn >= 0 && x == _nColumn + 1)
+                {
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        _aSum[c] += aColumnSums[3 * (x + _nWidth - 1) + c] - aColumnSums[3 * (x - 1) + c];
+                    }
+                }
+                else
+                {
+                    _aSum[0] = _aSum[1] = _aSum[2] = 0;
+                    for (int i = 0; i < _nWidth; ++i)
+                    {
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            _aSum[c] += aColumnSums[3 * (x + i) + c];
+                        }
+                    }
+                }
+                _nColumn = x;
+                return _aSum;
+            }
+
+            void reset()
+            {
+                _nColumn = -1;
+            }
+        };
+
+
+        template<typename D>
+        void box(const Kernel<D>& k, const Region<D>& r, Scratch<D>& s)
+        {
+            typedef typename SampleTraits<D>::tSum tSum;
+            const tSum nCount = (tSum)k.oMask.width * k.oMask.height;
+
+            ColumnSums<D> oColumnSums(r, k.aColumns, k.oMask.height, k.oAnchor.y, s.aSum, s.aSquares);
+            WindowSum<tSum> oWindow(k.oMask.width);
+
+            for (int y = 0; y < r.oSizeROI.height; ++y)
+            {
+                oColumnSums.seek(y);
+                oWindow.reset();
+                D* pDst = r.dstLine(y);
+                for (int x = 0; x < r.oSizeROI.width; ++x)
+                {
+                    const tSum* pSum = oWindow.at(oColumnSums.aSum, x);
+                    pDst[3 * x + 0] = saturate<D>(pSum[0], nCount);
+                    pDst[3 * x + 1] = saturate<D>(pSum[1], nCount);
+                    pDst[3 * x + 2] = saturate<D>(pSum[2], nCount);
+                }
+            }
+        }
+
+        template<typename D>
+        void wiener(const Kernel<D>& k, const Region<D>& r, Scratch<D>& s)
+        {
+            typedef typename SampleTraits<D>::tSum tSum;
+            const double nCount = (double)k.oMask.width * k.oMask.height;
+
+            ColumnSums<D> oColumnSums(r, k.aColumns, k.oMask.height, k.oAnchor.y, s.aSum, s.aSquares);
+            WindowSum<tSum> oWindowSum(k.oMask.width);
+            WindowSum<tSum> oWindowSquares(k.oMask.width);
+
+            for (int y = 0; y < r.oSizeROI.height; ++y)
+            {
+                oColumnSums.seek(y);
+                oWindowSum.reset();
+                oWindowSquares.reset();
+                const D* pSrc = r.line(r.oSrcOffset.y + y) + 3 * r.oSrcOffset.x;
+                D* pDst = r.dstLine(y);
+                for (int x = 0; x < r.oSizeROI.width; ++x)
+                {
+                    const tSum* pSum = oWindowSum.at(oColumnSums.aSum, x);
+                    const tSum* pSquares = oWindowSquares.at(oColumnSums.aSquares, x);
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        const double nMean = (double)pSum[c] / nCount;
+                        const double nVariance = std::max((double)pSquares[c] / nCount - nMean * nMean, 0.0);
+                        const double nGain = std::max(nVariance - k.aNoise[c], 0.0) / std::max(nVariance, k.aNoise[c]);
+                        pDst[3 * x + c] = saturate<D>(nMean + nGain * ((double)pSrc[3 * x + c] - nMean));
+                    }
+                }
+            }
+        }
+
+        // Mask of a fixed coefficients filter, no weights for box, wiener and unknown names
+        Stencil getStencil(const Parameters& parameters)
+        {
+            const std::string& sFilterType = parameters.getFilterType();
+
+            if (sFilterType == "sobel_h")
+            {
+                return { 3, 3, aSobelHoriz, 1 };
+            }
+            if (sFilterType == "sobel_v")
+            {
+                return { 3, 3, aSobelVert, 1 };
+            }
+            if (sFilterType == "roberts_up")
+            {
+                return { 3, 3, aRobertsUp, 1 };
+            }
+            if (sFilterType == "roberts_down")
+            {
+                return { 3, 3, aRobertsDown, 1 };
+            }
+            if (sFilterType == "laplace")
+            {
+                return maskStencil(parameters, aLaplace3, aLaplace5, 1, 1);
+            }
+            if (sFilterType == "gauss")
+            {
+                return maskStencil(parameters, aGauss3, aGauss5, 16, 571);
+            }
+            if (sFilterType == "highpass")
+            {
+                return maskStencil(parameters, aHighPass3, aHighPass5, 1, 1);
+            }
+            if (sFilterType == "lowpass")
+            {
+                return maskStencil(parameters, aLowPass3, aLowPass5, 9, 25);
+            }
+            if (sFilterType == "sharpen")
+            {
+                return { 3, 3, aSharpen, 8 };
+            }
+            return { 0, 0, nullptr, 1 };
+        }
+
+        template<typename D>
+        Kernel<D>::Kernel(const Parameters& parameters, const Region<D>& r)
+        {
+            const std::string& sFilterType = parameters.getFilterType();
+            const Stencil k = getStencil(parameters);
+
+            if (k.pWeights)
+            {
+                fRun = stencil<D>;
+                oMask = { k.nWidth, k.nHeight };
+                oAnchor = { k.nWidth / 2, k.nHeight / 2 };
+                nDivisor = (tAcc)k.nDivisor;
+                for (int j = 0; j < k.nHeight; ++j)
+                {
+                    for (int i = 0; i < k.nWidth; ++i)
+                    {
+                        if (k.pWeights[j * k.nWidth + i])
+                        {
+                            aTaps.push_back({ j, i, (tAcc)k.pWeights[j * k.nWidth + i] });
+                        }
+                    }
+                }
+            }
+            else if (sFilterType == "box" || sFilterType == "wiener")
+            {
+                bSquares = sFilterType == "wiener";
+                fRun = bSquares ? wiener<D> : box<D>;
+                oMask = parameters.getMaskSize();
+                oAnchor = parameters.getAnchor();
+                // noise levels are given for samples in [0, 1]
+                for (int c = 0; c < 3; ++c)
+                {
+                    aNoise[c] = parameters.getNoise()[c] * SampleTraits<D>::nRange * SampleTraits<D>::nRange;
+                }
+            }
+            aColumns = r.columns(oMask.width, oAnchor.x);
+        }
+
+        void getHalo(const Parameters& parameters, int& nTop, int& nBottom)
+        {
+            const std::string& sFilterType = parameters.getFilterType();
+            if (sFilterType == "box" || sFilterType == "wiener")
+            {
+                nTop = parameters.getAnchor().y;
+                nBottom = parameters.getMaskSize().height - parameters.getAnchor().y - 1;
+            }
+            else if (sFilterType == "laplace" || sFilterType == "gauss" || sFilterType == "highpass" || sFilterType == "lowpass")
+            {
+                nTop = nBottom = parameters.getNppiMaskSize() == NPP_MASK_SIZE_3_X_3 ? 1 : 2;
+            }
+            else
+            {
+                nTop = nBottom = 1;
+            }
+        }
+
+        template<size_t N>
+        static int countTaps(const int (&aWeights)[N])
+        {
+            return (int)std::count_if(aWeights, aWeights + N, [](int n) { return n != 0; });
+        }
+
+        double getCost(const std::string& sFilterType, int nMaskSize)
+        {
+            const bool b3 = nMaskSize == 3;
+            if (sFilterType == "box")
+            {
+                // running column and window sums, whatever the mask size
+                return 4.0;
+            }
+            if (sFilterType == "wiener")
+            {
+                // sums of the samples and of their squares, then a gain per sample
+                return 12.0;
+            }
+            if (sFilterType == "sobel_h")
+            {
+                return countTaps(aSobelHoriz);
+            }
+            if (sFilterType == "sobel_v")
+            {
+                return countTaps(aSobelVert);
+            }
+            if (sFilterType == "roberts_up")
+            {
+                return countTaps(aRobertsUp);
+            }
+            if (sFilterType == "roberts_down")
+            {
+                return countTaps(aRobertsDown);
+            }
+            if (sFilterType == "sharpen")
+            {
+                return countTaps(aSharpen);
+            }
+            if (sFilterType == "laplace")
+            {
+                return b3 ? countTaps(aLaplace3) : countTaps(aLaplace5);
+            }
+            if (sFilterType == "gauss")
+            {
+                return b3 ? countTaps(aGauss3) : countTaps(aGauss5);
+            }
+            if (sFilterType == "highpass")
+            {
+                return b3 ? countTaps(aHighPass3) : countTaps(aHighPass5);
+            }
+            if (sFilterType == "lowpass")
+            {
+                return b3 ? countTaps(aLowPass3) : countTaps(aLowPass5);
+            }
+            return 1.0;
+        }
+
+        // Columns and rows of a filter call without its buffers, enough to resolve its kernel
+        template<typename D>
+        static Region<D> getGeometry(const Parameters& parameters)
+        {
+            return Region<D>(nullptr, 0, parameters.getSrcSize(), parameters.getSrcOffset(), nullptr, 0, parameters.getSizeROI());
+        }
+
+        // Rolling windows of the intermediate stages for a run of consecutive tiles,
+        // window k holds the result rows [aFirst[k], aLast[k]) of stage k
+        template<typename D>
+        struct FusedGroup
+        {
+            std::vector<std::vector<D> > aWindows;
+            std::vector<int> aFirst, aLast;
+            std::vector<int> aBegin, aEnd;
+            std::vector<Scratch<D> > aScratch;
+        };
+
+        template<typename D>
+        struct Plan<D>::Stages
+        {
+            std::vector<Parameters> aParameters;
+            std::vector<Kernel<D> > aKernels;
+            ThreadPool* pPool = nullptr;
+            NppiSize oSize = { 0, 0 };
+
+            // Filters of one source: bands of ROI lines are filtered by the pool threads, each band
+            // reads its own halo so results don't depend on the number of threads.
+            // Every (filter, band) pair is a task with its own scratch
+            int nBands = 1;
+            std::vector<Scratch<D> > aScratch;
+
+            // Fused pipeline: tiles of nTileRows result rows split in nGroups runs
+            bool bFused = false;
+            std::vector<int> aTop, aBottom;
+            int nRowBytes = 0;
+            int nTileRows = 0;
+            int nTiles = 0;
+            int nGroups = 1;
+            std::vector<FusedGroup<D> > aGroups;
+
+            void plan(const Parameters* pFilters, int nFilters);
+            void planFused(const Parameters* pStages, int nStages);
+            void execute(const D* pSrc, int nSrcStep, D* const* apDst, int nDstStep);
+            void executeFused(const D* pSrc, int nSrcStep, D* pDst, int nDstStep);
+            void executeGroup(FusedGroup<D>& rGroup, int iGroup, const Region<D>& rSrc, D* pDst, int nDstStep);
+        };
+
+        template<typename D>
+        void Plan<D>::Stages::plan(const Parameters* pFilters, int nFilters)
+        {
+            for (int i = 0; i < nFilters; ++i)
+            {
+                aKernels.emplace_back(pFilters[i], getGeometry<D>(pFilters[i]));
+            }
+            const int nMinBandRows = 16;
+            nBands = pPool ? std::clamp(oSize.height / nMinBandRows, 1, (pPool->size() + nFilters - 1) / nFilters) : 1;
+            aScratch.resize((size_t)nFilters * nBands);
+            for (size_t iTask = 0; iTask < aScratch.size(); ++iTask)
+            {
+                aScratch[iTask].reserve(aKernels[iTask / nBands]);
+            }
+        }
+
+        // Rows of the last result are computed by tiles: for each tile the previous stages
+        // compute only the rows the next stage reads (tile plus halos, clamped to the image).
+        // Each intermediate stage keeps a rolling window of its rows sized to stay in cache,
+        // the halo rows of a tile are kept for the next one instead of being computed again.
+        // Runs of consecutive tiles are split between the pool threads, each with its own windows
+        template<typename D>
+        void Plan<D>::Stages::planFused(const Parameters* pStages, int nStages)
+        {
+            bFused = true;
+            nRowBytes = oSize.width * 3 * (int)sizeof(D);
+
+            // the first stage reads the source, the others a window of the ROI sized result before them
+            const Region<D> oIntermediate(nullptr, nRowBytes, oSize, { 0, 0 }, nullptr, 0, oSize);
+            aTop.resize(nStages);
+            aBottom.resize(nStages);
+            int nHalo = 0;
+            for (int k = 0; k < nStages; ++k)
+            {
+                aKernels.emplace_back(pStages[k], k ? oIntermediate : getGeometry<D>(pStages[0]));
+                getHalo(pStages[k], aTop[k], aBottom[k]);
+                nHalo += k ? aTop[k] + aBottom[k] : 0;
+            }
+
+            // tile height keeping the intermediate windows of a thread within a typical L2
+            const size_t nCacheBytes = 1 << 20;
+            nTileRows = std::clamp((int)(nCacheBytes / (nStages - 1) / nRowBytes) - nHalo, 8, std::max(oSize.height, 8));
+            nTiles = (oSize.height + nTileRows - 1) / nTileRows;
+            const size_t nWindowRows = (size_t)std::min(nTileRows + nHalo, oSize.height);
+            nGroups = pPool ? std::clamp(nTiles, 1, pPool->size()) : 1;
+
+            aGroups.resize(nGroups);
+            for (FusedGroup<D>& rGroup : aGroups)
+            {
+                rGroup.aWindows.assign(nStages - 1, std::vector<D>(nWindowRows * oSize.width * 3));
+                rGroup.aFirst.resize(nStages);
+                rGroup.aLast.resize(nStages);
+                rGroup.aBegin.resize(nStages);
+                rGroup.aEnd.resize(nStages);
+                rGroup.aScratch.resize(nStages);
+                for (int k = 0; k < nStages; ++k)
+                {
+                    rGroup.aScratch[k].reserve(aKernels[k]);
+                }
+            }
+        }
+
+        template<typename D>
+        void Plan<D>::Stages::execute(const D* pSrc, int nSrcStep, D* const* apDst, int nDstStep)
+        {
+            const int nFilters = (int)aKernels.size();
+            auto fTask = [&](int iTask) {
+                TRACE_ZONE_INDEX("band", iTask);
+                const int iFilter = iTask / nBands;
+                const int iBand = iTask % nBands;
+                const int nBegin = (int)((long long)oSize.height * iBand / nBands);
+                const int nEnd = (int)((long long)oSize.height * (iBand + 1) / nBands);
+                const Region<D> r(aParameters[iFilter], pSrc, nSrcStep, apDst[iFilter], nDstStep);
+                aKernels[iFilter].run(r.band(nBegin, nEnd - nBegin), aScratch[iTask]);
+            };
+            if (pPool && nFilters * nBands > 1)
+            {
+                pPool->parallelFor(nFilters * nBands, fTask);
+            }
+            else
+            {
+                for (int iTask = 0; iTask < nFilters * nBands; ++iTask)
+                {
+                    fTask(iTask);
+                }
+            }
+        }
+
+        template<typename D>
+        void Plan<D>::Stages::executeGroup(FusedGroup<D>& rGroup, int iGroup, const Region<D>& rSrc, D* pDst, int nDstStep)
+        {
+            const int nStages = (int)aKernels.size();
+            std::vector<int>& aFirst = rGroup.aFirst;
+            std::vector<int>& aLast = rGroup.aLast;
+            std::vector<int>& aBegin = rGroup.aBegin;
+            std::vector<int>& aEnd = rGroup.aEnd;
+            std::fill(aFirst.begin(), aFirst.end(), 0);
+            std::fill(aLast.begin(), aLast.end(), 0);
+
+            for (int iTile = nTiles * iGroup / nGroups; iTile < nTiles * (iGroup + 1) / nGroups; ++iTile)
+            {
+                TRACE_ZONE_INDEX("fused tile", iTile);
+                // result rows of each stage needed by the tile
+                aBegin[nStages - 1] = iTile * nTileRows;
+                aEnd[nStages - 1] = std::min(aBegin[nStages - 1] + nTileRows, oSize.height);
+                for (int k = nStages - 1; k > 0; --k)
+                {
+                    aBegin[k - 1] = std::max(aBegin[k] - aTop[k], 0);
+                    aEnd[k - 1] = std::min(aEnd[k] + aBottom[k], oSize.height);
+                }
+
+                for (int k = 0; k < nStages; ++k)
+                {
+                    const bool bLast = k == nStages - 1;
+                    int nBegin = aBegin[k];
+                    D* pStageDst = nullptr;
+                    int nStageStep = nRowBytes;
+                    if (bLast)
+                    {
+                        pStageDst = (D*)((unsigned char*)pDst + (ptrdiff_t)nBegin * nDstStep);
+                        nStageStep = nDstStep;
+                    }
+                    else
+                    {
+                        // keep the rows still needed, compute the missing ones below them
+                        std::vector<D>& rWindow = rGroup.aWindows[k];
+                        if (aLast[k] <= aBegin[k])
+                        {
+                            aFirst[k] = aLast[k] = aBegin[k];
+                        }
+                        else if (aFirst[k] < aBegin[k])
+                        {
+                            memmove(rWindow.data(), (unsigned char*)rWindow.data() + (ptrdiff_t)(aBegin[k] - aFirst[k]) * nRowBytes, (size_t)(aLast[k] - aBegin[k]) * nRowBytes);
+                            aFirst[k] = aBegin[k];
+                        }
+                        nBegin = aLast[k];
+                        pStageDst = (D*)((unsigned char*)rWindow.data() + (ptrdiff_t)(nBegin - aFirst[k]) * nRowBytes);
+                        aLast[k] = aEnd[k];
+                    }
+                    const NppiSize oStageROI = { oSize.width, aEnd[k] - nBegin };
+                    if (oStageROI.height <= 0)
+                    {
+                        continue;
+                    }
+
+                    if (k == 0)
+                    {
+                        Region<D> r = rSrc.band(nBegin, oStageROI.height);
+                        r.pDst = (unsigned char*)pStageDst;
+                        r.nDstStep = nStageStep;
+                        aKernels[0].run(r, rGroup.aScratch[0]);
+                    }
+                    else
+                    {
+                        // the previous window holds rows [aFirst[k - 1], aLast[k - 1]) of a ROI sized image
+                        const unsigned char* pOrigin = (const unsigned char*)rGroup.aWindows[k - 1].data() - (ptrdiff_t)aFirst[k - 1] * nRowBytes;
+                        aKernels[k].run(Region<D>(pOrigin, nRowBytes, oSize, { 0, nBegin }, pStageDst, nStageStep, oStageROI), rGroup.aScratch[k]);
+                    }
+                }
+            }
+        }
+
+        template<typename D>
+        void Plan<D>::Stages::executeFused(const D* pSrc, int nSrcStep, D* pDst, int nDstStep)
+        {
+            const Region<D> rSrc(aParameters[0], pSrc, nSrcStep, pDst, nDstStep);
+            if (nGroups > 1)
+            {
+                pPool->parallelFor(nGroups, [&](int iGroup) { executeGroup(aGroups[iGroup], iGroup, rSrc, pDst, nDstStep); });
+            }
+            else
+            {
+                executeGroup(aGroups[0], 0, rSrc, pDst, nDstStep);
+            }
+        }
+
+        template<typename D>
+        Plan<D>::Plan(const Parameters* pFilters, int nFilters, bool bPipeline)
+            : _pStages(new Stages)
+        {
+            _pStages->aParameters.assign(pFilters, pFilters + nFilters);
+            _pStages->pPool = pFilters[0].getThreadPool();
+            _pStages->oSize = pFilters[0].getSizeROI();
+            // a single stage runs alone
+            if (bPipeline && nFilters > 1)
+            {
+                _pStages->planFused(pFilters, nFilters);
+            }
+            else
+            {
+                _pStages->plan(pFilters, nFilters);
+            }
+        }
+
+        template<typename D>
+        Plan<D>::~Plan() = default;
+
+        template<typename D>
+        void Plan<D>::execute(const D* pSrc, int nSrcStep, D* const* apDst, int nDstStep)
+        {
+            if (_pStages->bFused)
+            {
+                _pStages->executeFused(pSrc, nSrcStep, apDst[0], nDstStep);
+            }
+            else
+            {
+                _pStages->execute(pSrc, nSrcStep, apDst, nDstStep);
+            }
+        }
+
+        template<typename D>
+        size_t Plan<D>::getScratchBytes() const
+        {
+            size_t nBytes = 0;
+            for (const Scratch<D>& rScratch : _pStages->aScratch)
+            {
+                nBytes += rScratch.bytes();
+            }
+            for (const FusedGroup<D>& rGroup : _pStages->aGroups)
+            {
+                for (const std::vector<D>& rWindow : rGroup.aWindows)
+                {
+                    nBytes += rWindow.size() * sizeof(D);
+                }
+                for (const Scratch<D>& rScratch : rGroup.aScratch)
+                {
+                    nBytes += rScratch.bytes();
+                }
+            }
+            return nBytes;
+        }
+
+        template<typename D>
+        void execute(const Parameters* pParameters, int nFilters, const D* pSrc, int nSrcStep, D* const* apDst, int nDstStep)
+        {
+            Plan<D>(pParameters, nFilters, false).execute(pSrc, nSrcStep, apDst, nDstStep);
+        }
+
+        template<typename D>
+        void execute(const Parameters& parameters, const D* pSrc, int nSrcStep, D* pDst, int nDstStep)
+        {
+            execute(&parameters, 1, pSrc, nSrcStep, &pDst, nDstStep);
+        }
+
+        template<typename D>
+        void executeFused(const Parameters* pStages, int nStages, const D* pSrc, int nSrcStep, D* pDst, int nDstStep)
+        {
+            Plan<D>(pStages, nStages, true).execute(pSrc, nSrcStep, &pDst, nDstStep);
+        }
+
+        void getHalo(const std::vector<Parameters>& aParameters, int& nTop, int& nBottom)
+        {
+            nTop = nBottom = 0;
+            for (const Parameters& parameters : aParameters)
+            {
+                int nFilterTop = 0, nFilterBottom = 0;
+                getHalo(parameters, nFilterTop, nFilterBottom);
+                nTop = std::max(nTop, nFilterTop);
+                nBottom = std::max(nBottom, nFilterBottom);
+            }
+        }
+
+        template<typename D>
+        SummedAreaTables<D>::SummedAreaTables(const D* pSrc, int nSrcStep, NppiSize oSize, int nRadius, bool bSquares, ThreadPool* pPool)
+            : _pSrc((const unsigned char*)pSrc)
+            , _nSrcStep(nSrcStep)
+            , _oSize(oSize)
+            , _nRadius(nRadius)
+            , _nStride((size_t)(oSize.width + 2 * nRadius + 1) * 3)
+        {
+            // entry (px, py) of the tables sums the padded samples above and left of it,
+            // row and column 0 are zeros
+            const int nRows = oSize.height + 2 * nRadius;
+            const int nColumns = oSize.width + 2 * nRadius;
+            _aSums.assign(_nStride * (nRows + 1), (tSum)0);
+            if (bSquares)
+            {
+                _aSquares.assign(_nStride * (nRows + 1), (tSum)0);
+            }
+
+            // running sums along each padded row, then down each column
+            auto fRows = [&](int iTask, int nTasks) {
+                for (int py = 1 + nRows * iTask / nTasks; py <= nRows * (iTask + 1) / nTasks; ++py)
+                {
+                    const D* pLine = source(std::clamp(py - 1 - nRadius, 0, oSize.height - 1));
+                    tSum* pSums = &_aSums[_nStride * py];
+                    tSum* pSquares = bSquares ? &_aSquares[_nStride * py] : nullptr;
+                    for (int px = 1; px <= nColumns; ++px)
+                    {
+                        const D* pPixel = pLine + 3 * std::clamp(px - 1 - nRadius, 0, oSize.width - 1);
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            const tSum v = (tSum)pPixel[c];
+                            pSums[3 * px + c] = pSums[3 * (px - 1) + c] + v;
+                            if (pSquares)
+                            {
+                                pSquares[3 * px + c] = pSquares[3 * (px - 1) + c] + v * v;
+                            }
+                        }
+                    }
+                }
+            };
+            auto fColumns = [&](int iTask, int nTasks) {
+                const size_t nBegin = _nStride * iTask / nTasks;
+                const size_t nEnd = _nStride * (iTask + 1) / nTasks;
+                for (int py = 1; py <= nRows; ++py)
+                {
+                    for (size_t k = nBegin; k < nEnd; ++k)
+                    {
+                        _aSums[_nStride * py + k] += _aSums[_nStride * (py - 1) + k];
+                        if (bSquares)
+                        {
+                            _aSquares[_nStride * py + k] += _aSquares[_nStride * (py - 1) + k];
+                        }
+                    }
+                }
+            };
+
+            const int nTasks = pPool ? pPool->size() : 1;
+            if (nTasks > 1)
+            {
+                pPool->parallelFor(nTasks, [&](int iTask) { fRows(iTask, nTasks); });
+                pPool->parallelFor(nTasks, [&](int iTask) { fColumns(iTask, nTasks); });
+            }
+            else
+            {
+                fRows(0, 1);
+                fColumns(0, 1);
+            }
+        }
+
+        template<typename D>
+        void SummedAreaTables<D>::sum(int x, int y, int nWidth, int nHeight, tSum* pSum, tSum* pSquares) const
+        {
+            const size_t nTopLeft = _nStride * (y + _nRadius) + 3 * (size_t)(x + _nRadius);
+            const size_t nTopRight = nTopLeft + 3 * (size_t)nWidth;
+            const size_t nBottomLeft = nTopLeft + _nStride * nHeight;
+            const size_t nBottomRight = nTopRight + _nStride * nHeight;
+            for (int c = 0; c < 3; ++c)
+            {
+                pSum[c] = _aSums[nBottomRight + c] - _aSums[nTopRight + c] - _aSums[nBottomLeft + c] + _aSums[nTopLeft + c];
+            }
+            if (pSquares)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    pSquares[c] = _aSquares[nBottomRight + c] - _aSquares[nTopRight + c] - _aSquares[nBottomLeft + c] + _aSquares[nTopLeft + c];
+                }
+            }
+        }
+
+        template<typename D>
+        void sweep(const SummedAreaTables<D>& rTables, const Parameters* pPoints, int nPoints, D* const* apDst, int nDstStep)
+        {
+            typedef typename SummedAreaTables<D>::tSum tSum;
+            const NppiSize oSize = rTables.size();
+            const NppiSize oMask = pPoints[0].getMaskSize();
+            const NppiPoint oAnchor = pPoints[0].getAnchor();
+            NPP_ASSERT_MSG(oAnchor.x <= rTables.radius() && oAnchor.y <= rTables.radius()
+                && oMask.width - oAnchor.x - 1 <= rTables.radius() && oMask.height - oAnchor.y - 1 <= rTables.radius(),
+                "the sweep mask is larger than the summed-area tables padding");
+            const tSum nCount = (tSum)oMask.width * oMask.height;
+
+            // the same gain as wiener(), noise levels given for samples in [0, 1]
+            std::vector<bool> aWiener(nPoints);
+            std::vector<double> aNoise(3 * nPoints);
+            bool bSquares = false;
+            for (int i = 0; i < nPoints; ++i)
+            {
+                aWiener[i] = pPoints[i].getFilterType() == "wiener";
+                bSquares = bSquares || aWiener[i];
+                for (int c = 0; c < 3; ++c)
+                {
+                    aNoise[3 * i + c] = pPoints[i].getNoise()[c] * SampleTraits<D>::nRange * SampleTraits<D>::nRange;
+                }
+            }
+            NPP_ASSERT_MSG(!bSquares || rTables.hasSquares(), "wiener points need the tables of the squares");
+
+            auto fBand = [&](int nBegin, int nEnd) {
+                tSum aSum[3], aSquares[3];
+                double aMean[3], aVariance[3];
+                for (int y = nBegin; y < nEnd; ++y)
+                {
+                    const D* pSrc = rTables.source(y);
+                    for (int x = 0; x < oSize.width; ++x)
+                    {
+                        rTables.sum(x - oAnchor.x, y - oAnchor.y, oMask.width, oMask.height, aSum, bSquares ? aSquares : nullptr);
+                        if (bSquares)
+                        {
+                            // shared by the noise levels, only the gain differs
+                            for (int c = 0; c < 3; ++c)
+                            {
+                                aMean[c] = (double)aSum[c] / (double)nCount;
+                                aVariance[c] = std::max((double)aSquares[c] / (double)nCount - aMean[c] * aMean[c], 0.0);
+                            }
+                        }
+                        for (int i = 0; i < nPoints; ++i)
+                        {
+                            D* pDst = (D*)((unsigned char*)apDst[i] + (ptrdiff_t)y * nDstStep) + 3 * x;
+                            if (!aWiener[i])
+                            {
+                                pDst[0] = saturate<D>(aSum[0], nCount);
+                                pDst[1] = saturate<D>(aSum[1], nCount);
+                                pDst[2] = saturate<D>(aSum[2], nCount);
+                                continue;
+                            }
+                            for (int c = 0; c < 3; ++c)
+                            {
+                                const double nGain = std::max(aVariance[c] - aNoise[3 * i + c], 0.0) / std::max(aVariance[c], aNoise[3 * i + c]);
+                                pDst[c] = saturate<D>(aMean[c] + nGain * ((double)pSrc[3 * x + c] - aMean[c]));
+                            }
+                        }
+                    }
+                }
+            };
+
+            const int nMinBandRows = 16;
+            ThreadPool* pPool = pPoints[0].getThreadPool();
+            const int nBands = pPool ? std::clamp(oSize.height / nMinBandRows, 1, pPool->size()) : 1;
+            if (nBands > 1)
+            {
+                pPool->parallelFor(nBands, [&](int iBand) {
+                    TRACE_ZONE_INDEX("sweep band", iBand);
+                    fBand((int)((long long)oSize.height * iBand / nBands), (int)((long long)oSize.height * (iBand + 1) / nBands));
+                });
+            }
+            else
+            {
+                fBand(0, oSize.height);
+            }
+        }
+
+        template class SummedAreaTables<Npp8u>;
+        template class SummedAreaTables<Npp16u>;
+        template class SummedAreaTables<Npp32f>;
+        template void sweep<Npp8u>(const SummedAreaTables<Npp8u>&, const Parameters*, int, Npp8u* const*, int);
+        template void sweep<Npp16u>(const SummedAreaTables<Npp16u>&, const Parameters*, int, Npp16u* const*, int);
+        template void sweep<Npp32f>(const SummedAreaTables<Npp32f>&, const Parameters*, int, Npp32f* const*, int);
+        template class Plan<Npp8u>;
+        template class Plan<Npp16u>;
+        template class Plan<Npp32f>;
+        template void executeFused<Npp8u>(const Parameters*, int, const Npp8u*, int, Npp8u*, int);
+        template void executeFused<Npp16u>(const Parameters*, int, const Npp16u*, int, Npp16u*, int);
+        template void executeFused<Npp32f>(const Parameters*, int, const Npp32f*, int, Npp32f*, int);
+        template void execute<Npp8u>(const Parameters*, int, const Npp8u*, int, Npp8u* const*, int);
+        template void execute<Npp16u>(const Parameters*, int, const Npp16u*, int, Npp16u* const*, int);
+        template void execute<Npp32f>(const Parameters*, int, const Npp32f*, int, Npp32f* const*, int);
+        template void execute<Npp8u>(const Parameters&, const Npp8u*, int, Npp8u*, int);
+        template void execute<Npp16u>(const Parameters&, const Npp16u*, int, Npp16u*, int);
+        template void execute<Npp32f>(const Parameters&, const Npp32f*, int, Npp32f*, int);
+
+        void execute(const Parameters& parameters, const npp::ImageCPU_8u_C3& oHostSrc, npp::ImageCPU_8u_C3& oHostDst)
+        {
+            execute(parameters, oHostSrc.data(), (int)oHostSrc.pitch(), oHostDst.data(), (int)oHostDst.pitch());
+        }
+
+        void execute(const Parameters& parameters, const npp::ImageCPU_16u_C3& oHostSrc, npp::ImageCPU_16u_C3& oHostDst)
+        {
+            execute(parameters, oHostSrc.data(), (int)oHostSrc.pitch(), oHostDst.data(), (int)oHostDst.pitch());
+        }
+
+        void execute(const Parameters& parameters, const npp::ImageCPU_32f_C3& oHostSrc, npp::ImageCPU_32f_C3& oHostDst)
+        {
+            execute(parameters, oHostSrc.data(), (int)oHostSrc.pitch(), oHostDst.data(), (int)oHostDst.pitch());
+        }
+
+        template<class I>
+        static void executeImages(const std::vector<Parameters>& aParameters, const I& oHostSrc, std::vector<I>& aHostDst)
+        {
+            std::vector<decltype(aHostDst[0].data())> apDst;
+            for (I& rHostDst : aHostDst)
+            {
+                apDst.push_back(rHostDst.data());
+            }
+            execute(aParameters.data(), (int)aParameters.size(), oHostSrc.data(), (int)oHostSrc.pitch(), apDst.data(), (int)aHostDst[0].pitch());
+        }
+
+        void execute(const std::vector<Parameters>& aParameters, const npp::ImageCPU_8u_C3& oHostSrc, std::vector<npp::ImageCPU_8u_C3>& aHostDst)
+        {
+            executeImages(aParameters, oHostSrc, aHostDst);
+        }
+
+        void execute(const std::vector<Parameters>& aParameters, const npp::ImageCPU_16u_C3& oHostSrc, std::vector<npp::ImageCPU_16u_C3>& aHostDst)
+        {
+            executeImages(aParameters, oHostSrc, aHostDst);
+        }
+
+        void execute(const std::vector<Parameters>& aParameters, const npp::ImageCPU_32f_C3& oHostSrc, std::vector<npp::ImageCPU_32f_C3>& aHostDst)
+        {
+            executeImages(aParameters, oHostSrc, aHostDst);
+        }
+
+        void executeFused(const std::vector<Parameters>& aStages, const npp::ImageCPU_8u_C3& oHostSrc, npp::ImageCPU_8u_C3& oHostDst)
+        {
+            executeFused(aStages.data(), (int)aStages.size(), oHostSrc.data(), (int)oHostSrc.pitch(), oHostDst.data(), (int)oHostDst.pitch());
+        }
+
+        void executeFused(const std::vector<Parameters>& aStages, const npp::ImageCPU_16u_C3& oHostSrc, npp::ImageCPU_16u_C3& oHostDst)
+        {
+            executeFused(aStages.data(), (int)aStages.size(), oHostSrc.data(), (int)oHostSrc.pitch(), oHostDst.data(), (int)oHostDst.pitch());
+        }
+
+        void executeFused(const std::vector<Parameters>& aStages, const npp::ImageCPU_32f_C3& oHostSrc, npp::ImageCPU_32f_C3& oHostDst)
+        {
+            executeFused(aStages.data(), (int)aStages.size(), oHostSrc.data(), (int)oHostSrc.pitch(), oHostDst.data(), (int)oHostDst.pitch());
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "host_info.h"
+#include "stb_image_io.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#define WINDOWS_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HOST_INFO_CPUID
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define HOST_INFO_CPUID
+#endif
+
+namespace
+{
+#ifdef HOST_INFO_CPUID
+    // eax, ebx, ecx and edx of a cpuid leaf, zeros beyond the highest leaf
+    void cpuid(unsigned int nLeaf, unsigned int nSubLeaf, unsigned int* pRegisters)
+    {
+#if defined(_MSC_VER)
+        int aRegisters[4];
+        __cpuid(aRegisters, (int)(nLeaf & 0x80000000));
+        if ((unsigned int)aRegisters[0] < nLeaf)
+        {
+            std::fill(pRegisters, pRegisters + 4, 0u);
+            return;
+        }
+        __cpuidex(aRegisters, (int)nLeaf, (int)nSubLeaf);
+        std::copy(aRegisters, aRegisters + 4, pRegisters);
+#else
+        if (__get_cpuid_max(nLeaf & 0x80000000, nullptr) < nLeaf)
+        {
+            std::fill(pRegisters, pRegisters + 4, 0u);
+            return;
+        }
+        __cpuid_count(nLeaf, nSubLeaf, pRegisters[0], pRegisters[1], pRegisters[2], pRegisters[3]);
+#endif
+    }
+
+    std::string getCpuBrand()
+    {
+        char aBrand[49] = {};
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            cpuid(0x80000002 + i, 0, (unsigned int*)(aBrand + 16 * i));
+        }
+        std::string sBrand = aBrand;
+        sBrand.erase(0, sBrand.find_first_not_of(' '));
+        return sBrand;
+    }
+
+    std::vector<std::string> getIsa()
+    {
+        unsigned int aBasic[4], aExtended[4];
+        cpuid(1, 0, aBasic);
+        cpuid(7, 0, aExtended);
+        const struct
+        {
+            const char* sName;
+            unsigned int nRegister;
+            int nBit;
+        } aFeatures[] = {
+            { "sse2", aBasic[3], 26 },
+            { "sse4.1", aBasic[2], 19 },
+            { "sse4.2", aBasic[2], 20 },
+            { "avx", aBasic[2], 28 },
+            { "fma", aBasic[2], 12 },
+            { "avx2", aExtended[1], 5 },
+            { "avx512f", aExtended[1], 16 },
+            { "avx512bw", aExtended[1], 30 },
+        };
+        std::vector<std::string> aIsa;
+        for (const auto& rFeature : aFeatures)
+        {
+            if (rFeature.nRegister & (1u << rFeature.nBit))
+            {
+                aIsa.push_back(rFeature.sName);
+            }
+        }
+        return aIsa;
+    }
+#endif
+
+    // first line of a small text file, empty when it can't be read
+    std::string readLine(const std::string& rPath)
+    {
+        std::ifstream oFile(rPath);
+        std::string sLine;
+        std::getline(oFile, sLine);
+        return sLine;
+    }
+}
+
+HostInfo getHostInfo()
+{
+    HostInfo oHost;
+    oHost.nThreads = std::thread::hardware_concurrency();
+
+#ifdef HOST_INFO_CPUID
+    oHost.sCpu = getCpuBrand();
+    oHost.aIsa = getIsa();
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+    oHost.aIsa.push_back("neon");
+#endif
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+    oHost.sOperatingSystem = "windows";
+    DWORD nBytes = 0;
+    GetLogicalProcessorInformation(nullptr, &nBytes);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> aInfos(nBytes / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!aInfos.empty() && GetLogicalProcessorInformation(aInfos.data(), &nBytes))
+    {
+        for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& rInfo : aInfos)
+        {
+            if (rInfo.Relationship != RelationCache)
+            {
+                continue;
+            }
+            HostInfo::Cache oCache;
+            oCache.nLevel = rInfo.Cache.Level;
+            oCache.sType = rInfo.Cache.Type == CacheData ? "Data" : rInfo.Cache.Type == CacheInstruction ? "Instruction" : "Unified";
+            oCache.nBytes = rInfo.Cache.Size;
+            // one entry per core or cluster sharing it, the sizes of a level are listed once
+            if (std::none_of(oHost.aCaches.begin(), oHost.aCaches.end(), [&](const HostInfo::Cache& r) { return r.nLevel == oCache.nLevel && r.sType == oCache.sType; }))
+            {
+                oHost.aCaches.push_back(oCache);
+            }
+        }
+    }
+#else
+#if defined(__APPLE__)
+    oHost.sOperatingSystem = "macos";
+#else
+    oHost.sOperatingSystem = "linux";
+#endif
+    // caches of the first cpu, sizes written as 48K or 2048K
+    for (int i = 0; ; ++i)
+    {
+        const std::string sIndex = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/";
+        const std::string sSize = readLine(sIndex + "size");
+        if (sSize.empty())
+        {
+            break;
+        }
+        HostInfo::Cache oCache;
+        oCache.nLevel = atoi(readLine(sIndex + "level").c_str());
+        oCache.sType = readLine(sIndex + "type");
+        oCache.nBytes = strtoull(sSize.c_str(), nullptr, 10) * (sSize.back() == 'M' ? 1024 * 1024 : sSize.back() == 'K' ? 1024 : 1);
+        oHost.aCaches.push_back(oCache);
+    }
+    if (oHost.sCpu.empty())
+    {
+        std::ifstream oCpuInfo("/proc/cpuinfo");
+        for (std::string sLine; std::getline(oCpuInfo, sLine); )
+        {
+            if (sLine.compare(0, 10, "model name") == 0 && sLine.find(':') != std::string::npos)
+            {
+                oHost.sCpu = sLine.substr(sLine.find_first_not_of(' ', sLine.find(':') + 1));
+                break;
+            }
+        }
+    }
+#endif
+
+#if defined(_MSC_VER)
+    oHost.sCompiler = "msvc " + std::to_string(_MSC_VER);
+#elif defined(__clang__)
+    oHost.sCompiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    oHost.sCompiler = "gcc " __VERSION__;
+#endif
+    return oHost;
+}
+
+void writeHostInfoJson(std::ostream& rStream, const HostInfo& rHost)
+{
+    rStream << "{\"cpu\": ";
+    stb::writeJsonString(rStream, rHost.sCpu);
+    rStream << ", \"isa\": [";
+    for (size_t i = 0; i < rHost.aIsa.size(); ++i)
+    {
+        rStream << (i ? ", " : "");
+        stb::writeJsonString(rStream, rHost.aIsa[i]);
+    }
+    rStream << "], \"caches\": [";
+    for (size_t i = 0; i < rHost.aCaches.size(); ++i)
+    {
+        rStream << (i ? ", " : "") << "{\"level\": " << rHost.aCaches[i].nLevel << ", \"type\": ";
+        stb::writeJsonString(rStream, rHost.aCaches[i].sType);
+        rStream << ", \"bytes\": " << rHost.aCaches[i].nBytes << "}";
+    }
+    rStream << "], \"threads\": " << rHost.nThreads << ", \"os\": ";
+    stb::writeJsonString(rStream, rHost.sOperatingSystem);
+    rStream << ", \"compiler\": ";
+    stb::writeJsonString(rStream, rHost.sCompiler);
+    rStream << "}";
+}
\ No newline at end of file
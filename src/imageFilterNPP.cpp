@@ -29,13 +29,30 @@
 #define WINDOWS_LEAN_AND_MEAN
 #define NOMINMAX
 #include <windows.h>
+#include <io.h>
+#include <fcntl.h>
 #pragma warning(disable : 4819)
+#else
+#include <unistd.h>
 #endif
 
 
 #include <vector>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <sstream>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
 
 #include <cuda_runtime.h>
 #include <npp.h>
@@ -48,6 +65,15 @@
 #include "stb_image_io.h"
 #include "parameter_helpers.h"
 #include "filters.h"
+#include "filters_cpu.h"
+#include "filter_plan.h"
+#include "thread_pool.h"
+#include "bounded_queue.h"
+#include "job_server.h"
+#include "shared_image.h"
+#include "result_cache.h"
+#include "stage_timings.h"
+#include "trace.h"
 
 
 bool printfNPPinfo(int argc, char* argv[])
@@ -72,19 +98,1808 @@ bool printfNPPinfo(int argc, char* argv[])
 }
 
 
+// --probe mode: print the header descriptors of the given files as JSON, no pixel is decoded
+int probeFiles(int argc, char* argv[])
+{
+    std::vector<stb::ImageInfo> infos;
+    std::vector<bool> valid;
+    for (const std::string& rFileName : getProbeFilenames(argc, argv))
+    {
+        MappedFile oFile;
+        stb::ImageInfo oInfo;
+        valid.push_back(oFile.open(rFileName) && stb::probeImage(oFile, oInfo));
+        oInfo.sFileName = rFileName;
+        infos.push_back(oInfo);
+    }
+    stb::writeImageInfoJson(std::cout, infos, valid);
+    return std::find(valid.begin(), valid.end(), false) == valid.end() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// "-" output: the encoded image owns the standard output,
+// everything printed to stdout from now on goes to stderr
+void reserveStandardOutput()
+{
+    fflush(stdout);
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+    _setmode(_fileno(stdout), _O_BINARY);
+    stb::setStandardOutput(_fdopen(_dup(_fileno(stdout)), "wb"));
+    _dup2(_fileno(stderr), _fileno(stdout));
+#else
+    stb::setStandardOutput(fdopen(dup(STDOUT_FILENO), "wb"));
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+#endif
+}
+
+
+// Decode the input file mapping or the stdin stream into a pre-sized host image, or generate a --synthetic one
+template<class I>
+void loadInput(const Parameters& parameters, I& rImage)
+{
+    TRACE_ZONE("decode");
+    StageTimings* pTimings = parameters.getStageTimings();
+    stb::IoTimes oTimes;
+    const auto oStart = pTimings ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    if (parameters.isSyntheticInput())
+    {
+        synthetic::generate(parameters.getSyntheticPattern(), rImage.data(), rImage.pitch(), rImage.width(), rImage.height(), parameters.getThreadPool());
+    }
+    else if (parameters.isInputStream())
+    {
+        stb::loadImage(parameters.getInputStream(), rImage, pTimings ? &oTimes : nullptr);
+    }
+    else
+    {
+        stb::loadImage(parameters.getInputFile(), rImage, pTimings ? &oTimes : nullptr);
+    }
+    if (pTimings)
+    {
+        const double nMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oStart).count();
+        pTimings->add(Stage::decode, nMilliseconds - oTimes.nConvertMilliseconds);
+        pTimings->add(Stage::convert, oTimes.nConvertMilliseconds);
+    }
+}
+
+
+// One more image of the run went through its steps, for --timings
+void countImage(const Parameters& parameters)
+{
+    if (StageTimings* pTimings = parameters.getStageTimings())
+    {
+        pTimings->addImage();
+    }
+}
+
+
+// Host and device images kept from one image to the next,
+// reallocated only when the image size changes. Each --filter has its own result
+// images and CUDA stream, the source is decoded and uploaded once for all of them
+struct ImageBuffers
+{
+    npp::ImageCPU_8u_C3 oHostSrc8u;
+    npp::ImageCPU_16u_C3 oHostSrc16u;
+    npp::ImageCPU_32f_C3 oHostSrc32f;
+    npp::ImageNPP_8u_C3 oDeviceSrc;
+    std::vector<npp::ImageCPU_8u_C3> aHostDst8u;
+    std::vector<npp::ImageCPU_16u_C3> aHostDst16u;
+    std::vector<npp::ImageCPU_32f_C3> aHostDst32f;
+    std::vector<npp::ImageNPP_8u_C3> aDeviceDst;
+    // row tiles of a served job filtered on the device, see filterOnDeviceTiled
+    std::vector<npp::ImageNPP_8u_C3> aDeviceTiles;
+    std::vector<cudaStream_t> aStreams;
+    // plans of the settings and sizes filtered with these buffers
+    filters::PlanCache oPlans;
+
+    ImageBuffers() = default;
+    ImageBuffers(const ImageBuffers&) = delete;
+    ImageBuffers& operator=(const ImageBuffers&) = delete;
+
+    ~ImageBuffers()
+    {
+        for (cudaStream_t hStream : aStreams)
+        {
+            cudaStreamDestroy(hStream);
+        }
+    }
+
+    template<class I>
+    static I& resize(I& rImage, int nWidth, int nHeight)
+    {
+        if (rImage.width() != (unsigned int)nWidth || rImage.height() != (unsigned int)nHeight)
+        {
+            I(nWidth, nHeight).swap(rImage);
+        }
+        return rImage;
+    }
+
+    template<class I>
+    static std::vector<I>& resize(std::vector<I>& rImages, size_t nImages, int nWidth, int nHeight)
+    {
+        // UtilNPP images can't be copied, a new set replaces the old one
+        if (rImages.size() != nImages)
+        {
+            std::vector<I>(nImages).swap(rImages);
+        }
+        for (I& rImage : rImages)
+        {
+            resize(rImage, nWidth, nHeight);
+        }
+        return rImages;
+    }
+
+    // Non-blocking streams, one per filter
+    const std::vector<cudaStream_t>& streams(size_t nStreams)
+    {
+        while (aStreams.size() < nStreams)
+        {
+            cudaStream_t hStream;
+            checkCudaErrors(cudaStreamCreateWithFlags(&hStream, cudaStreamNonBlocking));
+            aStreams.push_back(hStream);
+        }
+        return aStreams;
+    }
+};
+
+
+// Parameters of each --filter, sharing the source geometry of parameters
+std::vector<Parameters> getFilterParameters(const Parameters& parameters)
+{
+    std::vector<Parameters> aParameters;
+    for (size_t i = 0; i < parameters.getFilterTypes().size(); ++i)
+    {
+        aParameters.push_back(parameters.forFilter(i));
+    }
+    return aParameters;
+}
+
+
+// Encode the result of every filter, several files are written concurrently
+template<class I>
+void saveResults(const std::vector<Parameters>& aParameters, const std::vector<I>& aHostDst)
+{
+    StageTimings* pTimings = aParameters[0].getStageTimings();
+    auto fSave = [&](int i) {
+        TRACE_ZONE_INDEX("encode", i);
+        stb::IoTimes oTimes;
+        const auto oStart = pTimings ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        stb::saveImage(aParameters[i].getOutputFilename(), aHostDst[i], aParameters[i].getOutputFormat(), aParameters[i].getJpegQuality(),
+            pTimings ? &oTimes : nullptr);
+        if (pTimings)
+        {
+            const double nMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oStart).count();
+            pTimings->add(Stage::encode, nMilliseconds - oTimes.nWriteMilliseconds);
+            pTimings->add(Stage::write, oTimes.nWriteMilliseconds);
+        }
+    };
+    ThreadPool* pPool = aParameters[0].getThreadPool();
+    if (pPool && aParameters.size() > 1)
+    {
+        pPool->parallelFor((int)aParameters.size(), fSave);
+    }
+    else
+    {
+        for (size_t i = 0; i < aParameters.size(); ++i)
+        {
+            fSave((int)i);
+        }
+    }
+}
+
+
+// Time of each --pipeline stage
+void printStageTimings(const Parameters& parameters, const std::vector<double>& aMilliseconds)
+{
+    const std::vector<PipelineStage>& rStages = parameters.getPipeline();
+    double nTotal = 0.0;
+    for (size_t i = 0; i < rStages.size(); ++i)
+    {
+        std::string sStage = rStages[i].sFilterType;
+        if (rStages[i].nMaskSize)
+        {
+            sStage += ":" + std::to_string(rStages[i].nMaskSize);
+        }
+        printf("  stage %zu %-16s %9.3f ms\n", i + 1, sStage.c_str(), aMilliseconds[i]);
+        nTotal += aMilliseconds[i];
+    }
+    printf("  total   %-16s %9.3f ms\n", "", nTotal);
+}
+
+
+// 8 bits images are filtered by NPP unless the cpu backend is selected,
+// high bit depth images keep their precision from decode to encode on the host
+bool isDeviceImage(const Parameters& parameters)
+{
+    const int nBits = parameters.getInputInfo().nBitsPerChannel;
+    return nBits != 16 && nBits != 32 && parameters.getBackend() != "cpu";
+}
+
+
+// Plan of the filters of the opened image, made once for its settings and size
+filters::Plan& getPlan(const Parameters& parameters, ImageBuffers& rBuffers)
+{
+    const int nBits = parameters.getInputInfo().nBitsPerChannel;
+    return rBuffers.oPlans.get(parameters, nBits == 16 || nBits == 32 ? nBits : 8, isDeviceImage(parameters));
+}
+
+
+// Decode the opened input into the host source image of its depth,
+// the probed header gives the image size so the image is allocated before decoding
+void decodeInput(Parameters& parameters, ImageBuffers& rBuffers)
+{
+    const stb::ImageInfo& rInfo = parameters.getInputInfo();
+
+    if (rInfo.nBitsPerChannel == 16)
+    {
+        loadInput(parameters, ImageBuffers::resize(rBuffers.oHostSrc16u, rInfo.nWidth, rInfo.nHeight));
+    }
+    else if (rInfo.nBitsPerChannel == 32)
+    {
+        loadInput(parameters, ImageBuffers::resize(rBuffers.oHostSrc32f, rInfo.nWidth, rInfo.nHeight));
+    }
+    else
+    {
+        loadInput(parameters, ImageBuffers::resize(rBuffers.oHostSrc8u, rInfo.nWidth, rInfo.nHeight));
+    }
+
+    // set input size and ROI size, checked against --roi when the input was opened
+    parameters.setImageSize({ rInfo.nWidth, rInfo.nHeight });
+}
+
+
+// Filter a decoded host image, the result of filter i is aHostDst[i].
+// A --pipeline runs its stages fused by row tiles or, with --no-fusion, stage by stage
+// between two result images used in turn, its result is aHostDst[0]
+template<class I>
+void filterOnHost(const Parameters& parameters, filters::Plan& rPlan, const I& oHostSrc, std::vector<I>& aHostDst)
+{
+    typedef typename I::tData D;
+    const int nWidth = (int)oHostSrc.width();
+    const int nHeight = (int)oHostSrc.height();
+
+    if (!parameters.isPipeline())
+    {
+        // all the filters and their row bands run on the pool together, the results are --roi sized
+        const NppiPoint& rOffset = parameters.getSrcOffset();
+        const NppiSize& rROI = parameters.getSizeROI();
+        ImageBuffers::resize(aHostDst, parameters.getFilterTypes().size(), rROI.width, rROI.height);
+        std::vector<D*> apDst;
+        for (I& rHostDst : aHostDst)
+        {
+            apDst.push_back(rHostDst.data());
+        }
+        rPlan.execute(oHostSrc.data(rOffset.x, rOffset.y), (int)oHostSrc.pitch(), apDst.data(), (int)aHostDst[0].pitch());
+        return;
+    }
+
+    const std::vector<PipelineStage>& rStages = parameters.getPipeline();
+    ImageBuffers::resize(aHostDst, parameters.isFusion() ? 1 : std::min(rStages.size(), (size_t)2), nWidth, nHeight);
+
+    if (parameters.isFusion())
+    {
+        // all the stages in one pass over cache sized row tiles, timed as a whole
+        D* pDst = aHostDst[0].data();
+        const auto oStart = std::chrono::steady_clock::now();
+        rPlan.execute(oHostSrc.data(), (int)oHostSrc.pitch(), &pDst, (int)aHostDst[0].pitch());
+        const double nMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oStart).count();
+        printf("  stages 1-%zu fused %9.3f ms\n", rStages.size(), nMilliseconds);
+        return;
+    }
+
+    std::vector<double> aMilliseconds;
+    const I* pSrc = &oHostSrc;
+    for (size_t i = 0; i < rStages.size(); ++i)
+    {
+        I& rDst = aHostDst[i % 2];
+        const auto oStart = std::chrono::steady_clock::now();
+        rPlan.executeStage(i, pSrc->data(), (int)pSrc->pitch(), rDst.data(), (int)rDst.pitch());
+        aMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oStart).count());
+        pSrc = &rDst;
+    }
+    if (pSrc != &aHostDst[0])
+    {
+        aHostDst[0].swap(aHostDst[1]);
+    }
+    printStageTimings(parameters, aMilliseconds);
+}
+
+
+void filterOnHost(const Parameters& parameters, ImageBuffers& rBuffers)
+{
+    StageTimer oTimer(parameters.getStageTimings(), Stage::filter);
+    TRACE_ZONE("filter");
+    filters::Plan& rPlan = getPlan(parameters, rBuffers);
+    const int nBits = parameters.getInputInfo().nBitsPerChannel;
+    if (nBits == 16)
+    {
+        filterOnHost(parameters, rPlan, rBuffers.oHostSrc16u, rBuffers.aHostDst16u);
+    }
+    else if (nBits == 32)
+    {
+        filterOnHost(parameters, rPlan, rBuffers.oHostSrc32f, rBuffers.aHostDst32f);
+    }
+    else
+    {
+        filterOnHost(parameters, rPlan, rBuffers.oHostSrc8u, rBuffers.aHostDst8u);
+    }
+}
+
+
+// Pixels of a tile of a served job, the scheduler can run urgent jobs between two tiles
+const int nServeTilePixels = 1 << 22;
+
+
+// Filter the ROI of aParameters[0] by tiles of rows, pSrc points to its first pixel and fYield
+// runs between two tiles. Each tile
+// reads the rows around it in the whole source so the result doesn't depend on the tiles
+template<typename D>
+void filterTiles(std::vector<Parameters> aParameters, const D* pSrc, int nSrcStep, const std::vector<D*>& apDst, int nDstStep, const std::function<void()>& fYield)
+{
+    const NppiSize oSize = aParameters[0].getSizeROI();
+    const NppiPoint oOffset = aParameters[0].getSrcOffset();
+    const int nTileRows = std::max(nServeTilePixels / oSize.width, 16);
+    std::vector<D*> apTiles(apDst.size());
+    for (int y = 0; y < oSize.height; y += nTileRows)
+    {
+        if (y)
+        {
+            fYield();
+        }
+        for (Parameters& rParameters : aParameters)
+        {
+            rParameters.setSrcOffset({ oOffset.x, oOffset.y + y });
+            rParameters.setSizeROI({ oSize.width, std::min(nTileRows, oSize.height - y) });
+        }
+        for (size_t i = 0; i < apDst.size(); ++i)
+        {
+            apTiles[i] = (D*)((unsigned char*)apDst[i] + (ptrdiff_t)y * nDstStep);
+        }
+        TRACE_ZONE_INDEX("served tile", y / nTileRows);
+        filters::cpu::execute(aParameters.data(), (int)aParameters.size(), (const D*)((const unsigned char*)pSrc + (ptrdiff_t)y * nSrcStep), nSrcStep, apTiles.data(), nDstStep);
+    }
+}
+
+
+// filterOnHost for a served job by tiles of rows, a --pipeline runs its stages one after the
+// other (the fused tiles compute their intermediate rows at once), each stage by tiles
+template<class I>
+void filterOnHostTiled(const Parameters& parameters, const I& oHostSrc, std::vector<I>& aHostDst, const std::function<void()>& fYield)
+{
+    typedef typename I::tData D;
+    const int nWidth = (int)oHostSrc.width();
+    const int nHeight = (int)oHostSrc.height();
+
+    if (!parameters.isPipeline())
+    {
+        const NppiPoint& rOffset = parameters.getSrcOffset();
+        const NppiSize& rROI = parameters.getSizeROI();
+        ImageBuffers::resize(aHostDst, parameters.getFilterTypes().size(), rROI.width, rROI.height);
+        std::vector<D*> apDst;
+        for (I& rHostDst : aHostDst)
+        {
+            apDst.push_back(rHostDst.data());
+        }
+        filterTiles(getFilterParameters(parameters), oHostSrc.data(rOffset.x, rOffset.y), (int)oHostSrc.pitch(), apDst, (int)aHostDst[0].pitch(), fYield);
+        return;
+    }
+
+    const std::vector<PipelineStage>& rStages = parameters.getPipeline();
+    ImageBuffers::resize(aHostDst, std::min(rStages.size(), (size_t)2), nWidth, nHeight);
+    const I* pSrc = &oHostSrc;
+    for (size_t i = 0; i < rStages.size(); ++i)
+    {
+        I& rDst = aHostDst[i % 2];
+        filterTiles({ parameters.forStage(i) }, pSrc->data(), (int)pSrc->pitch(), { rDst.data() }, (int)rDst.pitch(), fYield);
+        pSrc = &rDst;
+    }
+    if (pSrc != &aHostDst[0])
+    {
+        aHostDst[0].swap(aHostDst[1]);
+    }
+}
+
+
+void filterOnHostTiled(const Parameters& parameters, ImageBuffers& rBuffers, const std::function<void()>& fYield)
+{
+    StageTimer oTimer(parameters.getStageTimings(), Stage::filter);
+    TRACE_ZONE("filter");
+    const int nBits = parameters.getInputInfo().nBitsPerChannel;
+    if (nBits == 16)
+    {
+        filterOnHostTiled(parameters, rBuffers.oHostSrc16u, rBuffers.aHostDst16u, fYield);
+    }
+    else if (nBits == 32)
+    {
+        filterOnHostTiled(parameters, rBuffers.oHostSrc32f, rBuffers.aHostDst32f, fYield);
+    }
+    else
+    {
+        filterOnHostTiled(parameters, rBuffers.oHostSrc8u, rBuffers.aHostDst8u, fYield);
+    }
+}
+
+
+// Copy an 8 bits host image, decoded or shared by a client, to the device source image
+template<class I>
+void uploadInput(const I& oHostSrc, ImageBuffers& rBuffers)
+{
+    npp::ImageNPP_8u_C3& oDeviceSrc = ImageBuffers::resize(rBuffers.oDeviceSrc, oHostSrc.width(), oHostSrc.height());
+    cudaStream_t hStream = rBuffers.streams(1)[0];
+
+    checkCudaErrors(cudaMemcpy2DAsync(oDeviceSrc.data(), oDeviceSrc.pitch(), oHostSrc.data(), oHostSrc.pitch(),
+        oHostSrc.width() * 3 * sizeof(Npp8u), oHostSrc.height(), cudaMemcpyHostToDevice, hStream));
+    checkCudaErrors(cudaStreamSynchronize(hStream));
+}
+
+void uploadInput(const Parameters& parameters, ImageBuffers& rBuffers)
+{
+    StageTimer oTimer(parameters.getStageTimings(), Stage::upload);
+    TRACE_ZONE("upload");
+    uploadInput(rBuffers.oHostSrc8u, rBuffers);
+}
+
+
+// Filter the device source with NPP, the result of filter i is aDeviceDst[i].
+// Each filter is queued on its own stream so the kernels can overlap. A --pipeline queues
+// its stages on one stream between two device images, timed with CUDA events, its result is aDeviceDst[0]
+void filterOnDevice(const Parameters& parameters, ImageBuffers& rBuffers)
+{
+    StageTimer oTimer(parameters.getStageTimings(), Stage::filter);
+    TRACE_ZONE("filter npp");
+    const npp::ImageNPP_8u_C3& oDeviceSrc = rBuffers.oDeviceSrc;
+    const int nWidth = parameters.getSizeROI().width;
+    const int nHeight = parameters.getSizeROI().height;
+    const std::vector<PipelineStage>& rStages = parameters.getPipeline();
+    const size_t nFilters = parameters.isPipeline() ? 1 : parameters.getFilterTypes().size();
+    const size_t nImages = parameters.isPipeline() ? std::min(rStages.size(), (size_t)2) : nFilters;
+
+    std::vector<npp::ImageNPP_8u_C3>& aDeviceDst = ImageBuffers::resize(rBuffers.aDeviceDst, nImages, nWidth, nHeight);
+    const std::vector<cudaStream_t>& aStreams = rBuffers.streams(nFilters);
+
+    filters::Plan& rPlan = getPlan(parameters, rBuffers);
+    NppStreamContext oContext = parameters.getStreamContext();
+    oContext.nStreamFlags = cudaStreamNonBlocking;
+
+    if (!parameters.isPipeline())
+    {
+        for (size_t i = 0; i < nFilters; ++i)
+        {
+            oContext.hStream = aStreams[i];
+            rPlan.execute(i, oContext, oDeviceSrc, aDeviceDst[i]);
+        }
+        for (size_t i = 0; i < nFilters; ++i)
+        {
+            checkCudaErrors(cudaStreamSynchronize(aStreams[i]));
+        }
+        return;
+    }
+
+    cudaStream_t hStream = aStreams[0];
+    oContext.hStream = hStream;
+
+    std::vector<cudaEvent_t> aEvents(rStages.size() + 1);
+    for (cudaEvent_t& hEvent : aEvents)
+    {
+        checkCudaErrors(cudaEventCreate(&hEvent));
+    }
+
+    checkCudaErrors(cudaEventRecord(aEvents[0], hStream));
+    const npp::ImageNPP_8u_C3* pSrc = &oDeviceSrc;
+    for (size_t i = 0; i < rStages.size(); ++i)
+    {
+        rPlan.execute(i, oContext, *pSrc, aDeviceDst[i % 2]);
+        checkCudaErrors(cudaEventRecord(aEvents[i + 1], hStream));
+        pSrc = &aDeviceDst[i % 2];
+    }
+    checkCudaErrors(cudaStreamSynchronize(hStream));
+    if (pSrc != &aDeviceDst[0])
+    {
+        aDeviceDst[0].swap(aDeviceDst[1]);
+    }
+
+    std::vector<double> aMilliseconds;
+    for (size_t i = 0; i < rStages.size(); ++i)
+    {
+        float nMilliseconds = 0.0f;
+        checkCudaErrors(cudaEventElapsedTime(&nMilliseconds, aEvents[i], aEvents[i + 1]));
+        aMilliseconds.push_back(nMilliseconds);
+    }
+    for (cudaEvent_t hEvent : aEvents)
+    {
+        cudaEventDestroy(hEvent);
+    }
+    printStageTimings(parameters, aMilliseconds);
+}
+
+
+// filterOnDevice for a served job by tiles of rows, like filterOnHostTiled: each filter of the tile
+// is launched on its stream with the tile ROI, its result copied to its rows of aDeviceDst. The
+// streams are synchronized before fYield so the jobs run from it have the device to themselves
+void filterOnDeviceTiled(const Parameters& parameters, ImageBuffers& rBuffers, const std::function<void()>& fYield)
+{
+    StageTimer oTimer(parameters.getStageTimings(), Stage::filter);
+    TRACE_ZONE("filter npp");
+    const int nWidth = parameters.getSizeROI().width;
+    const int nHeight = parameters.getSizeROI().height;
+    const int nTileRows = std::max(nServeTilePixels / nWidth, 16);
+
+    // the filters of a list at once, or the stages of a pipeline one after the other
+    std::vector<std::vector<Parameters> > aPasses;
+    if (parameters.isPipeline())
+    {
+        for (size_t i = 0; i < parameters.getPipeline().size(); ++i)
+        {
+            aPasses.push_back({ parameters.forStage(i) });
+        }
+    }
+    else
+    {
+        aPasses.push_back(getFilterParameters(parameters));
+    }
+    const size_t nFilters = aPasses[0].size();
+    const size_t nImages = parameters.isPipeline() ? std::min(aPasses.size(), (size_t)2) : nFilters;
+
+    std::vector<npp::ImageNPP_8u_C3>& aDeviceDst = ImageBuffers::resize(rBuffers.aDeviceDst, nImages, nWidth, nHeight);
+    std::vector<npp::ImageNPP_8u_C3>& aTiles = ImageBuffers::resize(rBuffers.aDeviceTiles, nFilters, nWidth, std::min(nTileRows, nHeight));
+    const std::vector<cudaStream_t>& aStreams = rBuffers.streams(nFilters);
+    NppStreamContext oContext = parameters.getStreamContext();
+    oContext.nStreamFlags = cudaStreamNonBlocking;
+
+    const npp::ImageNPP_8u_C3* pSrc = &rBuffers.oDeviceSrc;
+    for (size_t iPass = 0; iPass < aPasses.size(); ++iPass)
+    {
+        std::vector<Parameters>& rFilters = aPasses[iPass];
+        const NppiPoint oOffset = rFilters[0].getSrcOffset();
+        for (int y = 0; y < nHeight; y += nTileRows)
+        {
+            if (iPass || y)
+            {
+                fYield();
+            }
+            const int nRows = std::min(nTileRows, nHeight - y);
+            TRACE_ZONE_INDEX("served tile", y / nTileRows);
+            for (size_t i = 0; i < nFilters; ++i)
+            {
+                npp::ImageNPP_8u_C3& rDst = aDeviceDst[parameters.isPipeline() ? iPass % 2 : i];
+                oContext.hStream = aStreams[i];
+                rFilters[i].setSrcOffset({ oOffset.x, oOffset.y + y });
+                rFilters[i].setSizeROI({ nWidth, nRows });
+                rFilters[i].setStreamContext(oContext);
+                filters::execute(rFilters[i], *pSrc, aTiles[i]);
+                checkCudaErrors(cudaMemcpy2DAsync(rDst.data(0, y), rDst.pitch(), aTiles[i].data(), aTiles[i].pitch(),
+                    nWidth * 3 * sizeof(Npp8u), nRows, cudaMemcpyDeviceToDevice, aStreams[i]));
+            }
+            for (size_t i = 0; i < nFilters; ++i)
+            {
+                checkCudaErrors(cudaStreamSynchronize(aStreams[i]));
+            }
+        }
+        if (parameters.isPipeline())
+        {
+            pSrc = &aDeviceDst[iPass % 2];
+        }
+    }
+    if (parameters.isPipeline() && pSrc != &aDeviceDst[0])
+    {
+        aDeviceDst[0].swap(aDeviceDst[1]);
+    }
+}
+
+
+// Queue the copy of a device result into a host image of the same size
+template<class I>
+void downloadImage(const npp::ImageNPP_8u_C3& oDeviceDst, I& rHostDst, cudaStream_t hStream)
+{
+    checkCudaErrors(cudaMemcpy2DAsync(rHostDst.data(), rHostDst.pitch(), oDeviceDst.data(), oDeviceDst.pitch(),
+        oDeviceDst.width() * 3 * sizeof(Npp8u), oDeviceDst.height(), cudaMemcpyDeviceToHost, hStream));
+}
+
+
+// Copy the device results into the host results, each on the stream of its filter
+void downloadResults(const Parameters& parameters, ImageBuffers& rBuffers)
+{
+    StageTimer oTimer(parameters.getStageTimings(), Stage::download);
+    TRACE_ZONE("download");
+    const size_t nResults = parameters.getFilterTypes().size();
+    const npp::ImageNPP_8u_C3& oDeviceDst = rBuffers.aDeviceDst[0];
+    std::vector<npp::ImageCPU_8u_C3>& aHostDst = ImageBuffers::resize(rBuffers.aHostDst8u, nResults, oDeviceDst.width(), oDeviceDst.height());
+    const std::vector<cudaStream_t>& aStreams = rBuffers.streams(nResults);
+
+    for (size_t i = 0; i < nResults; ++i)
+    {
+        downloadImage(rBuffers.aDeviceDst[i], aHostDst[i], aStreams[i]);
+    }
+    for (size_t i = 0; i < nResults; ++i)
+    {
+        checkCudaErrors(cudaStreamSynchronize(aStreams[i]));
+    }
+}
+
+
+// Encode the host results, one file per --filter
+void saveOutputs(const Parameters& parameters, const ImageBuffers& rBuffers)
+{
+    const std::vector<Parameters> aParameters = getFilterParameters(parameters);
+    const int nBits = parameters.getInputInfo().nBitsPerChannel;
+    if (nBits == 16)
+    {
+        saveResults(aParameters, rBuffers.aHostDst16u);
+    }
+    else if (nBits == 32)
+    {
+        saveResults(aParameters, rBuffers.aHostDst32f);
+    }
+    else
+    {
+        saveResults(aParameters, rBuffers.aHostDst8u);
+    }
+}
+
+
+void printSaved(const Parameters& parameters, bool bCached = false)
+{
+    for (size_t i = 0; i < parameters.getFilterTypes().size(); ++i)
+    {
+        parameters.getOutput() << "Saved image: " << parameters.forFilter(i).getOutputFilename() << (bCached ? " (cached)" : "") << std::endl;
+    }
+}
+
+
+// --cache-dir: copy the cached results of the opened input to its outputs, true when all of them
+// were cached and the image needs no decoding. rKeys gets the keys of the outputs to store once
+// they are written, it stays empty without a cache or when the input can't be cached
+bool restoreCachedResults(const Parameters& parameters, std::vector<std::string>& rKeys)
+{
+    rKeys.clear();
+    ResultCache* pCache = parameters.getResultCache();
+    if (!pCache)
+    {
+        return false;
+    }
+    rKeys = ResultCache::keys(parameters);
+    for (size_t i = 0; i < rKeys.size(); ++i)
+    {
+        if (!pCache->restore(rKeys[i], parameters.forFilter(i).getOutputFilename()))
+        {
+            return false;
+        }
+    }
+    return !rKeys.empty();
+}
+
+
+void storeCachedResults(const Parameters& parameters, const std::vector<std::string>& rKeys)
+{
+    for (size_t i = 0; i < rKeys.size(); ++i)
+    {
+        parameters.getResultCache()->store(rKeys[i], parameters.forFilter(i).getOutputFilename());
+    }
+}
+
+
+// --stream mode: decode, filter and encode by row strips. Only the strip plus the filter halo
+// rows of the source and one strip of each result are held, whatever the image height.
+// Binary pnm inputs are read strip by strip, other formats can only be decoded whole by stb_image.
+// fYield, when given, runs between two strips
+template<typename D>
+void filterStrips(Parameters& parameters, const std::function<void()>& fYield = nullptr)
+{
+    typedef npp::ImageCPU<D, 3, npp::ImageAllocatorCPU<D, 3> > I;
+    const stb::ImageInfo& rInfo = parameters.getInputInfo();
+    const int nWidth = rInfo.nWidth;
+    const int nHeight = rInfo.nHeight;
+    const int nStripRows = std::min(parameters.getStripRows(), nHeight);
+    std::vector<Parameters> aParameters = getFilterParameters(parameters);
+    const size_t nFilters = aParameters.size();
+    StageTimings* pTimings = parameters.getStageTimings();
+    int nTop = 0, nBottom = 0;
+    filters::cpu::getHalo(aParameters, nTop, nBottom);
+
+    stb::PnmRowReader oReader;
+    const bool bRows = parameters.isInputStream() ? oReader.open(parameters.getInputStream()) : oReader.open(parameters.getInputFile());
+    I oDecoded;
+    if (!bRows)
+    {
+        loadInput(parameters, oDecoded);
+    }
+
+    // rolling window of source rows [nFirst, nFirst + nRows)
+    const int nStep = nWidth * 3 * (int)sizeof(D);
+    const int nCapacity = std::min(nStripRows + nTop + nBottom, nHeight);
+    std::vector<D> oWindow((size_t)nWidth * 3 * nCapacity);
+    std::vector<std::vector<D> > aStrips(nFilters, std::vector<D>((size_t)nWidth * 3 * nStripRows));
+    std::vector<D*> apStrips;
+    int nFirst = 0, nRows = 0;
+
+    std::vector<stb::StripWriter> aWriters(nFilters);
+    for (size_t i = 0; i < nFilters; ++i)
+    {
+        aWriters[i].open(aParameters[i].getOutputFilename(), aParameters[i].getOutputFormat(), nWidth, nHeight, 8 * (int)sizeof(D));
+        apStrips.push_back(aStrips[i].data());
+    }
+
+    for (int y = 0; y < nHeight; y += nStripRows)
+    {
+        TRACE_ZONE_INDEX("strip", y / nStripRows);
+        const int nStrip = std::min(nStripRows, nHeight - y);
+        const int nBegin = std::max(y - nTop, 0);
+        const int nEnd = std::min(y + nStrip + nBottom, nHeight);
+
+        // drop the rows above the halo, read the rows below
+        const int nDrop = nBegin - nFirst;
+        if (nDrop > 0)
+        {
+            memmove(oWindow.data(), oWindow.data() + (size_t)nWidth * 3 * nDrop, (size_t)nStep * (nRows - nDrop));
+            nFirst = nBegin;
+            nRows -= nDrop;
+        }
+        const int nNew = nEnd - (nFirst + nRows);
+        D* pNew = oWindow.data() + (size_t)nWidth * 3 * nRows;
+        {
+            StageTimer oTimer(pTimings, Stage::decode);
+            if (bRows)
+            {
+                oReader.readRows(pNew, nStep, nNew);
+            }
+            else
+            {
+                for (int j = 0; j < nNew; ++j)
+                {
+                    memcpy(pNew + (size_t)nWidth * 3 * j, oDecoded.data(0, nFirst + nRows + j), nStep);
+                }
+            }
+        }
+        nRows += nNew;
+
+        // the window is the source image of this strip, its edges are the image ones
+        // only at the top and bottom of the image so border replication stays exact
+        for (Parameters& rParameters : aParameters)
+        {
+            rParameters.setSrcSize({ nWidth, nRows });
+            rParameters.setSrcOffset({ 0, y - nFirst });
+            rParameters.setSizeROI({ nWidth, nStrip });
+        }
+        {
+            StageTimer oTimer(pTimings, Stage::filter);
+            filters::cpu::execute(aParameters.data(), (int)nFilters, oWindow.data() + (size_t)nWidth * 3 * (y - nFirst), nStep, apStrips.data(), nStep);
+        }
+
+        // the strip writers encode and write the rows as they go
+        {
+            StageTimer oTimer(pTimings, Stage::encode);
+            for (size_t i = 0; i < nFilters; ++i)
+            {
+                aWriters[i].writeRows(apStrips[i], nStep, nStrip);
+            }
+        }
+        if (fYield && y + nStrip < nHeight)
+        {
+            fYield();
+        }
+    }
+
+    for (size_t i = 0; i < nFilters; ++i)
+    {
+        aWriters[i].close();
+        parameters.getOutput() << "Saved image: " << aParameters[i].getOutputFilename() << std::endl;
+    }
+}
+
+
+// Figures of a --sweep result: mean and standard deviation of its samples and PSNR
+// against the source, in sample units (1.0 range for float images)
+struct SweepStatistics
+{
+    double nMean = 0.0;
+    double nDeviation = 0.0;
+    double nPsnr = 0.0;
+};
+
+template<class I>
+SweepStatistics getSweepStatistics(const I& oHostSrc, const I& oHostDst)
+{
+    typedef typename I::tData D;
+    const double nRange = std::is_same_v<D, Npp8u> ? 255.0 : std::is_same_v<D, Npp16u> ? 65535.0 : 1.0;
+    const int nSamples = (int)oHostSrc.width() * 3;
+    double nSum = 0.0, nSquares = 0.0, nError = 0.0;
+    for (unsigned int y = 0; y < oHostSrc.height(); ++y)
+    {
+        const D* pSrc = oHostSrc.data(0, y);
+        const D* pDst = oHostDst.data(0, y);
+        for (int i = 0; i < nSamples; ++i)
+        {
+            const double v = (double)pDst[i];
+            const double e = v - (double)pSrc[i];
+            nSum += v;
+            nSquares += v * v;
+            nError += e * e;
+        }
+    }
+    const double nCount = (double)nSamples * oHostSrc.height();
+    SweepStatistics oStatistics;
+    oStatistics.nMean = nSum / nCount;
+    oStatistics.nDeviation = std::sqrt(std::max(nSquares / nCount - oStatistics.nMean * oStatistics.nMean, 0.0));
+    oStatistics.nPsnr = nError > 0.0 ? 10.0 * std::log10(nRange * nRange * nCount / nError) : INFINITY;
+    return oStatistics;
+}
+
+
+// --sweep: the source is decoded and its summed-area tables built once, then each mask size
+// filters all its box and wiener points in a single pass over the tables. The results of a
+// mask size are encoded before the next one, so only they are held in memory
+template<class I>
+void filterSweep(const Parameters& parameters, const I& oHostSrc)
+{
+    typedef typename I::tData D;
+    auto fMilliseconds = [](std::chrono::steady_clock::time_point oFrom) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oFrom).count();
+    };
+    const int nWidth = (int)oHostSrc.width();
+    const int nHeight = (int)oHostSrc.height();
+    const std::vector<std::string>& rFilterTypes = parameters.getFilterTypes();
+    const std::vector<int>& rMasks = parameters.getSweepMasks();
+    const std::vector<Npp32f>& rNoises = parameters.getSweepNoises();
+    const bool bWiener = std::find(rFilterTypes.begin(), rFilterTypes.end(), "wiener") != rFilterTypes.end();
+
+    auto oStart = std::chrono::steady_clock::now();
+    const int nRadius = *std::max_element(rMasks.begin(), rMasks.end()) / 2;
+    const filters::cpu::SummedAreaTables<D> oTables(oHostSrc.data(), (int)oHostSrc.pitch(), { nWidth, nHeight }, nRadius, bWiener, parameters.getThreadPool());
+    const double nTablesMilliseconds = fMilliseconds(oStart);
+
+    printf("  %-7s %5s %6s %12s %12s %9s\n", "filter", "mask", "noise", "mean", "stddev", "psnr dB");
+    double nFilterMilliseconds = 0.0;
+    size_t nPoints = 0;
+    std::vector<I> aHostDst;
+    for (int nMask : rMasks)
+    {
+        // every filter of the list, wiener once per noise level
+        std::vector<Parameters> aPoints;
+        for (size_t i = 0; i < rFilterTypes.size(); ++i)
+        {
+            if (rFilterTypes[i] != "wiener" || rNoises.empty())
+            {
+                aPoints.push_back(parameters.forSweep(i, nMask, nullptr));
+                continue;
+            }
+            for (Npp32f nNoise : rNoises)
+            {
+                const Npp32f aNoise[3] = { nNoise, nNoise, nNoise };
+                aPoints.push_back(parameters.forSweep(i, nMask, aNoise));
+            }
+        }
+
+        ImageBuffers::resize(aHostDst, aPoints.size(), nWidth, nHeight);
+        std::vector<D*> apDst;
+        for (I& rHostDst : aHostDst)
+        {
+            apDst.push_back(rHostDst.data());
+        }
+        oStart = std::chrono::steady_clock::now();
+        filters::cpu::sweep(oTables, aPoints.data(), (int)aPoints.size(), apDst.data(), (int)aHostDst[0].pitch());
+        nFilterMilliseconds += fMilliseconds(oStart);
+        nPoints += aPoints.size();
+
+        std::vector<SweepStatistics> aStatistics(aPoints.size());
+        parameters.getThreadPool()->parallelFor((int)aPoints.size(), [&](int i) {
+            aStatistics[i] = getSweepStatistics(oHostSrc, aHostDst[i]);
+        });
+        for (size_t i = 0; i < aPoints.size(); ++i)
+        {
+            char aNoise[16] = "-";
+            if (aPoints[i].getFilterType() == "wiener" && !rNoises.empty())
+            {
+                snprintf(aNoise, sizeof(aNoise), "%.3f", aPoints[i].getNoise()[0]);
+            }
+            printf("  %-7s %5d %6s %12.4f %12.4f %9.2f\n", aPoints[i].getFilterType().c_str(), nMask, aNoise,
+                aStatistics[i].nMean, aStatistics[i].nDeviation, aStatistics[i].nPsnr);
+        }
+
+        if (!parameters.isSweepStatistics())
+        {
+            saveResults(aPoints, aHostDst);
+            for (const Parameters& rPoint : aPoints)
+            {
+                parameters.getOutput() << "Saved image: " << rPoint.getOutputFilename() << std::endl;
+            }
+        }
+    }
+    printf("Sweep: %zu points of %dx%d, tables %.3f ms, filters %.3f ms\n", nPoints, nWidth, nHeight, nTablesMilliseconds, nFilterMilliseconds);
+}
+
+
+void filterSweep(Parameters& parameters, ImageBuffers& rBuffers)
+{
+    decodeInput(parameters, rBuffers);
+    const int nBits = parameters.getInputInfo().nBitsPerChannel;
+    if (nBits == 16)
+    {
+        filterSweep(parameters, rBuffers.oHostSrc16u);
+    }
+    else if (nBits == 32)
+    {
+        filterSweep(parameters, rBuffers.oHostSrc32f);
+    }
+    else
+    {
+        filterSweep(parameters, rBuffers.oHostSrc8u);
+    }
+}
+
+
+// Filter the opened input with the path matching its depth and the selected backend.
+// fYield, when given, runs between the strips of --stream
+void filterImage(Parameters& parameters, ImageBuffers& rBuffers, const std::function<void()>& fYield = nullptr)
+{
+    const stb::ImageInfo& rInfo = parameters.getInputInfo();
+
+    std::vector<std::string> aCacheKeys;
+    if (restoreCachedResults(parameters, aCacheKeys))
+    {
+        printSaved(parameters, true);
+        countImage(parameters);
+        return;
+    }
+
+    if (parameters.isStream())
+    {
+        if (rInfo.nBitsPerChannel == 16)
+        {
+            filterStrips<Npp16u>(parameters, fYield);
+        }
+        else
+        {
+            filterStrips<Npp8u>(parameters, fYield);
+        }
+    }
+    else
+    {
+        decodeInput(parameters, rBuffers);
+        if (isDeviceImage(parameters))
+        {
+            uploadInput(parameters, rBuffers);
+            filterOnDevice(parameters, rBuffers);
+            downloadResults(parameters, rBuffers);
+        }
+        else
+        {
+            filterOnHost(parameters, rBuffers);
+        }
+
+        // save images to disk
+        saveOutputs(parameters, rBuffers);
+        printSaved(parameters);
+    }
+    storeCachedResults(parameters, aCacheKeys);
+    countImage(parameters);
+}
+
+
+// Batch mode: every input in one process, device, buffers and threads are set up once.
+// Images are filtered one after the other, --stream batches run here.
+// A file that can't be opened or decoded is reported and skipped
+int filterBatch(Parameters& parameters, ImageBuffers& rBuffers)
+{
+    const std::vector<std::string>& rFiles = parameters.getInputFiles();
+    size_t nFailures = 0;
+    double nMegaPixels = 0.0;
+    const auto oStart = std::chrono::steady_clock::now();
+
+    for (const std::string& rFileName : rFiles)
+    {
+        try
+        {
+            if (parameters.openInput(rFileName) != 0)
+            {
+                ++nFailures;
+                continue;
+            }
+            filterImage(parameters, rBuffers);
+            nMegaPixels += parameters.getInputInfo().pixels() / 1e6;
+        }
+        catch (npp::Exception& rException)
+        {
+            std::cerr << "Skipped " << rFileName << ": " << rException << std::endl;
+            ++nFailures;
+        }
+        catch (std::exception& rException)
+        {
+            std::cerr << "Skipped " << rFileName << ": " << rException.what() << std::endl;
+            ++nFailures;
+        }
+    }
+
+    const double nSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - oStart).count();
+    const size_t nImages = rFiles.size() - nFailures;
+    printf("\nBatch: %zu images, %zu failures in %.3f s, %.1f images/s, %.1f MP/s\n",
+        nImages, nFailures, nSeconds, nSeconds > 0 ? nImages / nSeconds : 0.0, nSeconds > 0 ? nMegaPixels / nSeconds : 0.0);
+
+    return nFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+// One image moving through the batch executor, its buffers are reused by the next images
+struct BatchJob
+{
+    Parameters parameters;
+    // input of the run, or job of a --jobs manifest
+    size_t nIndex = 0;
+    std::string sFileName;
+    ImageBuffers oBuffers;
+    std::vector<std::string> aCacheKeys;
+    bool bFailed = false;
+    // every output was copied from the cache, the other stages have nothing to do
+    bool bCached = false;
+};
+
+
+// Stage of the batch executor: nThreads threads run fRun on every job,
+// their busy time gives the share of the wall time the stage was working
+struct BatchStage
+{
+    const char* sName;
+    int nThreads;
+    std::function<void(BatchJob&)> fRun;
+    std::atomic<long long> nBusyNanoseconds{ 0 };
+
+    BatchStage(const char* sName_, int nThreads_, std::function<void(BatchJob&)> fRun_)
+        : sName(sName_), nThreads(nThreads_), fRun(std::move(fRun_))
+    {
+    }
+};
+
+
+// Batch mode pipelined executor: decode, filter and encode (plus upload and download on the npp
+// backend) run at the same time on their own threads, linked by queues of getQueueDepth() images.
+// The images in flight, and so their buffers, are bounded by the stage threads and the queues.
+// The inputs are those of parameters or, for a --jobs manifest, aManifest with their own settings.
+// A file that can't be opened or decoded is reported and skipped
+int filterBatchPipelined(const Parameters& parameters, const std::vector<Parameters>& aManifest = {})
+{
+    const std::vector<std::string>& rFiles = parameters.getInputFiles();
+    const size_t nInputs = aManifest.empty() ? rFiles.size() : aManifest.size();
+    const bool bDevice = parameters.getBackend() == "npp";
+    std::mutex oOutputMutex;
+    std::atomic<size_t> nNext{ 0 };
+    std::atomic<size_t> nFailures{ 0 };
+    std::atomic<long long> nPixels{ 0 };
+
+    std::deque<BatchStage> aStages;
+    aStages.emplace_back("decode", parameters.getDecodeThreads(), [&](BatchJob& rJob) {
+        int status = 0;
+        {
+            std::lock_guard<std::mutex> oLock(oOutputMutex);
+            rJob.parameters = aManifest.empty() ? parameters : aManifest[rJob.nIndex];
+            status = rJob.parameters.openInput(rJob.sFileName);
+        }
+        if (status != 0)
+        {
+            rJob.bFailed = true;
+            return;
+        }
+        if (restoreCachedResults(rJob.parameters, rJob.aCacheKeys))
+        {
+            rJob.bCached = true;
+            nPixels += (long long)rJob.parameters.getInputInfo().pixels();
+            countImage(rJob.parameters);
+            std::lock_guard<std::mutex> oLock(oOutputMutex);
+            printSaved(rJob.parameters, true);
+            return;
+        }
+        decodeInput(rJob.parameters, rJob.oBuffers);
+    });
+    if (bDevice)
+    {
+        aStages.emplace_back("upload", 1, [](BatchJob& rJob) {
+            if (isDeviceImage(rJob.parameters))
+            {
+                uploadInput(rJob.parameters, rJob.oBuffers);
+            }
+        });
+    }
+    aStages.emplace_back("filter", 1, [](BatchJob& rJob) {
+        if (isDeviceImage(rJob.parameters))
+        {
+            filterOnDevice(rJob.parameters, rJob.oBuffers);
+        }
+        else
+        {
+            filterOnHost(rJob.parameters, rJob.oBuffers);
+        }
+    });
+    if (bDevice)
+    {
+        aStages.emplace_back("download", 1, [](BatchJob& rJob) {
+            if (isDeviceImage(rJob.parameters))
+            {
+                downloadResults(rJob.parameters, rJob.oBuffers);
+            }
+        });
+    }
+    aStages.emplace_back("encode", parameters.getEncodeThreads(), [&](BatchJob& rJob) {
+        saveOutputs(rJob.parameters, rJob.oBuffers);
+        storeCachedResults(rJob.parameters, rJob.aCacheKeys);
+        nPixels += (long long)rJob.parameters.getInputInfo().pixels();
+        countImage(rJob.parameters);
+        std::lock_guard<std::mutex> oLock(oOutputMutex);
+        printSaved(rJob.parameters);
+    });
+
+    // a job per stage thread and per queued image
+    const size_t nStages = aStages.size();
+    size_t nJobs = (size_t)parameters.getQueueDepth() * (nStages - 1);
+    for (const BatchStage& rStage : aStages)
+    {
+        nJobs += rStage.nThreads;
+    }
+    std::vector<BatchJob> aJobs(nJobs);
+    BoundedQueue<BatchJob*> oFree(nJobs);
+    for (BatchJob& rJob : aJobs)
+    {
+        oFree.push(&rJob);
+    }
+    std::vector<std::unique_ptr<BoundedQueue<BatchJob*> > > aQueues;
+    std::vector<std::atomic<int> > aRunning(nStages);
+    for (size_t s = 0; s < nStages; ++s)
+    {
+        aQueues.push_back(std::make_unique<BoundedQueue<BatchJob*> >(parameters.getQueueDepth()));
+        aRunning[s] = aStages[s].nThreads;
+    }
+
+    // the device selected in the main thread is the current one of every stage thread
+    int nDevice = 0;
+    if (bDevice)
+    {
+        checkCudaErrors(cudaGetDevice(&nDevice));
+    }
+
+    auto fStage = [&](size_t s) {
+        if (bDevice)
+        {
+            cudaSetDevice(nDevice);
+        }
+        BatchStage& rStage = aStages[s];
+        TRACE_THREAD(rStage.sName);
+        for (;;)
+        {
+            BatchJob* pJob = nullptr;
+            if (s == 0)
+            {
+                const size_t i = nNext++;
+                if (i >= nInputs || !oFree.pop(pJob))
+                {
+                    break;
+                }
+                pJob->nIndex = i;
+                pJob->sFileName = aManifest.empty() ? rFiles[i] : aManifest[i].getInputFilename();
+                pJob->bFailed = false;
+                pJob->bCached = false;
+            }
+            else if (!aQueues[s - 1]->pop(pJob))
+            {
+                break;
+            }
+
+            if (!pJob->bFailed && !pJob->bCached)
+            {
+                TRACE_ZONE_INDEX("image", (long long)pJob->nIndex);
+                const auto oStart = std::chrono::steady_clock::now();
+                try
+                {
+                    rStage.fRun(*pJob);
+                }
+                catch (npp::Exception& rException)
+                {
+                    std::lock_guard<std::mutex> oLock(oOutputMutex);
+                    std::cerr << "Skipped " << pJob->sFileName << ": " << rException << std::endl;
+                    pJob->bFailed = true;
+                }
+                catch (std::exception& rException)
+                {
+                    std::lock_guard<std::mutex> oLock(oOutputMutex);
+                    std::cerr << "Skipped " << pJob->sFileName << ": " << rException.what() << std::endl;
+                    pJob->bFailed = true;
+                }
+                rStage.nBusyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - oStart).count();
+            }
+
+            if (s + 1 < nStages)
+            {
+                aQueues[s]->push(pJob);
+            }
+            else
+            {
+                nFailures += pJob->bFailed ? 1 : 0;
+                oFree.push(pJob);
+            }
+        }
+        // the last thread of a stage tells the next stage no more job is coming
+        if (--aRunning[s] == 0)
+        {
+            aQueues[s]->close();
+        }
+    };
+
+    const auto oStart = std::chrono::steady_clock::now();
+    std::vector<std::thread> aThreads;
+    for (size_t s = 0; s < nStages; ++s)
+    {
+        for (int i = 0; i < aStages[s].nThreads; ++i)
+        {
+            aThreads.emplace_back(fStage, s);
+        }
+    }
+    for (std::thread& rThread : aThreads)
+    {
+        rThread.join();
+    }
+
+    const double nSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - oStart).count();
+    const size_t nImages = nInputs - nFailures;
+    const double nMegaPixels = nPixels / 1e6;
+    printf("\nBatch: %zu images, %zu failures in %.3f s, %.1f images/s, %.1f MP/s\n",
+        nImages, (size_t)nFailures, nSeconds, nSeconds > 0 ? nImages / nSeconds : 0.0, nSeconds > 0 ? nMegaPixels / nSeconds : 0.0);
+    for (const BatchStage& rStage : aStages)
+    {
+        const double nBusy = rStage.nBusyNanoseconds / 1e9;
+        printf("  %-8s %2d thread%s %8.3f s busy %5.1f %%\n", rStage.sName, rStage.nThreads, rStage.nThreads > 1 ? "s" : " ",
+            nBusy, nSeconds > 0 ? 100.0 * nBusy / (rStage.nThreads * nSeconds) : 0.0);
+    }
+
+    return nFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+// Filter a --shared image from the client source mapping straight into its result mapping.
+// The cpu filters read and write the mappings, the npp backend copies them to and from the device
+template<typename D>
+void filterShared(const Parameters& parameters, ImageBuffers& rBuffers, const ImageView<D, 3>& oSrc, const ImageView<D, 3>& oDst)
+{
+    if constexpr (std::is_same_v<D, Npp8u>)
+    {
+        if (isDeviceImage(parameters))
+        {
+            uploadInput(oSrc, rBuffers);
+            filterOnDevice(parameters, rBuffers);
+            cudaStream_t hStream = rBuffers.streams(1)[0];
+            downloadImage(rBuffers.aDeviceDst[0], oDst, hStream);
+            checkCudaErrors(cudaStreamSynchronize(hStream));
+            return;
+        }
+    }
+
+    filters::Plan& rPlan = getPlan(parameters, rBuffers);
+    D* pDst = oDst.data();
+    if (!parameters.isPipeline() || parameters.isFusion())
+    {
+        rPlan.execute(oSrc.data(), (int)oSrc.pitch(), &pDst, (int)oDst.pitch());
+        return;
+    }
+
+    // stage by stage between the result mapping and a temporary image, used in turn so the last stage writes the result
+    const size_t nStages = rPlan.size();
+    const unsigned int nWidth = oSrc.width();
+    const unsigned int nHeight = oSrc.height();
+    std::vector<D> aTemporary(nStages > 1 ? (size_t)nWidth * 3 * nHeight : 0);
+    const ImageView<D, 3> oTemporary(aTemporary.data(), nWidth, nHeight, nWidth * 3 * sizeof(D));
+    const ImageView<D, 3>* pSrc = &oSrc;
+    for (size_t i = 0; i < nStages; ++i)
+    {
+        const ImageView<D, 3>& rDst = (nStages - 1 - i) % 2 == 0 ? oDst : oTemporary;
+        rPlan.executeStage(i, pSrc->data(), (int)pSrc->pitch(), rDst.data(), (int)rDst.pitch());
+        pSrc = &rDst;
+    }
+}
+
+
+// Map the source and result descriptors of a --shared job with the row pitches given by the
+// client, 0 for packed rows, and filter the source into the result
+template<typename D>
+void filterShared(const Parameters& parameters, ImageBuffers& rBuffers, int nSrcFile, size_t nSrcPitch, int nDstFile, size_t nDstPitch)
+{
+    const stb::ImageInfo& rInfo = parameters.getInputInfo();
+    const size_t nRow = (size_t)rInfo.nWidth * 3 * sizeof(D);
+    nSrcPitch = nSrcPitch ? nSrcPitch : nRow;
+    nDstPitch = nDstPitch ? nDstPitch : nRow;
+    if (nSrcPitch < nRow || nDstPitch < nRow || nSrcPitch % sizeof(D) || nDstPitch % sizeof(D) || nSrcPitch > INT_MAX || nDstPitch > INT_MAX)
+    {
+        throw std::runtime_error("invalid pitch, rows are " + std::to_string(nRow) + " bytes");
+    }
+    if (SharedMemory::isSameObject(nSrcFile, nDstFile))
+    {
+        throw std::runtime_error("the source and the result need their own buffers");
+    }
+
+    SharedMemory oSrcMemory, oDstMemory;
+    if (!oSrcMemory.open(nSrcFile, nSrcPitch * (rInfo.nHeight - 1) + nRow, false))
+    {
+        throw std::runtime_error("can't map the source buffer, too small for the image or not a memfd sealed with F_SEAL_SHRINK");
+    }
+    if (!oDstMemory.open(nDstFile, nDstPitch * (rInfo.nHeight - 1) + nRow, true))
+    {
+        throw std::runtime_error("can't map the result buffer, too small for the image or not a writable memfd sealed with F_SEAL_SHRINK");
+    }
+    filterShared(parameters, rBuffers,
+        ImageView<D, 3>(oSrcMemory.data(), rInfo.nWidth, rInfo.nHeight, (unsigned int)nSrcPitch),
+        ImageView<D, 3>(oDstMemory.data(), rInfo.nWidth, rInfo.nHeight, (unsigned int)nDstPitch));
+}
+
+
+// --name=value arguments of a served job
+std::vector<std::string> getJobArguments(const serve::Job& rJob)
+{
+    std::vector<std::string> aArguments = { "npp-filters" };
+    for (const auto& [sName, sValue] : rJob.aArguments)
+    {
+        aArguments.push_back("--" + sName + (sValue.empty() ? "" : "=" + sValue));
+    }
+    return aArguments;
+}
+
+
+// Jobs of a --jobs manifest: one JSON object per line, blank lines and # comments skipped.
+//   {"input": "a.png", "output": "a_box.png", "filter": "box", "mask": [7, 3], "anchor": [3, 1], "roi": [0, 0, 256, 256]}
+// A line gives the options of one image, the other command line options apply to every job.
+// The jobs are parsed (their headers probed) up front, an invalid line fails the whole manifest.
+// They are then ordered by plan key, filter settings, size and depth, so the jobs of a group
+// run one after the other on the same plans and buffers
+bool getManifestJobs(const std::string& rManifest, const Parameters& base, int argc, char* argv[], std::vector<Parameters>& rJobs)
+{
+    static const char* aFields[] = { "input", "output", "output-dir", "output-format", "jpeg-quality",
+        "filter", "pipeline", "border", "mask", "anchor", "roi", "noise" };
+
+    std::ifstream oManifest(rManifest);
+    if (!oManifest)
+    {
+        std::cout << "npp-filters --jobs can't read <" << rManifest << ">" << std::endl;
+        return false;
+    }
+
+    std::vector<std::pair<std::string, size_t> > aKeys;
+    std::string sLine;
+    for (size_t nLine = 1; std::getline(oManifest, sLine); ++nLine)
+    {
+        const size_t nFirst = sLine.find_first_not_of(" \t\r");
+        if (nFirst == std::string::npos || sLine[nFirst] == '#')
+        {
+            continue;
+        }
+        const std::string sWhere = "npp-filters --jobs " + rManifest + " line " + std::to_string(nLine) + ": ";
+
+        serve::Job oJob;
+        std::string sError;
+        if (!serve::parseJob(sLine, oJob, sError))
+        {
+            std::cout << sWhere << sError << std::endl;
+            return false;
+        }
+        auto fSets = [&oJob](const std::string& sName) {
+            return std::any_of(oJob.aArguments.begin(), oJob.aArguments.end(), [&](const auto& rArgument) { return rArgument.first == sName; });
+        };
+        for (const auto& [sName, sValue] : oJob.aArguments)
+        {
+            if (std::find(std::begin(aFields), std::end(aFields), sName) == std::end(aFields))
+            {
+                std::cout << sWhere << "\"" << sName << "\" can't be set by a job" << std::endl;
+                return false;
+            }
+        }
+        if (oJob.sCommand != "filter" || !fSets("input"))
+        {
+            std::cout << sWhere << "a job needs an input" << std::endl;
+            return false;
+        }
+
+        // the command line options the job doesn't set, a filter list and a pipeline replace each other
+        std::vector<std::string> aArguments = { argv[0] };
+        for (int i = 1; i < argc; ++i)
+        {
+            const char* arg = argv[i] + strspn(argv[i], "-");
+            const std::string sName(arg, strcspn(arg, "="));
+            const bool bFilters = sName == "filter" || sName == "pipeline";
+            if (sName != "jobs" && !fSets(sName) && !(bFilters && (fSets("filter") || fSets("pipeline"))))
+            {
+                aArguments.push_back(argv[i]);
+            }
+        }
+        const std::vector<std::string> aJobArguments = getJobArguments(oJob);
+        aArguments.insert(aArguments.end(), aJobArguments.begin() + 1, aJobArguments.end());
+        std::vector<char*> aArgv;
+        for (std::string& rArgument : aArguments)
+        {
+            aArgv.push_back(rArgument.data());
+        }
+        const int nArgc = (int)aArgv.size();
+
+        const char* input = getCmdLineValue(nArgc, aArgv.data(), "input");
+        if (std::string(input) == "-" || writesToStandardOutput(nArgc, aArgv.data()))
+        {
+            std::cout << sWhere << "jobs read and write files, not the standard streams" << std::endl;
+            return false;
+        }
+        Parameters parameters = base;
+        if (parameters.parseCmdLine(nArgc, aArgv.data()) != 0)
+        {
+            std::cout << sWhere << "invalid job" << std::endl;
+            return false;
+        }
+        if (!parameters.getInputFiles().empty() || parameters.isStream() || parameters.isSweep())
+        {
+            std::cout << sWhere << "a job filters a single image, without --stream or --sweep" << std::endl;
+            return false;
+        }
+
+        // the input is mapped again when its turn comes
+        const int nBits = parameters.getInputInfo().nBitsPerChannel;
+        aKeys.emplace_back(filters::Plan::getKey(parameters, nBits == 16 || nBits == 32 ? nBits : 8, isDeviceImage(parameters)), rJobs.size());
+        parameters.closeInput();
+        rJobs.push_back(std::move(parameters));
+    }
+    if (rJobs.empty())
+    {
+        std::cout << "npp-filters --jobs <" << rManifest << "> has no job" << std::endl;
+        return false;
+    }
+
+    std::stable_sort(aKeys.begin(), aKeys.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::vector<Parameters> aSorted;
+    size_t nGroups = 0;
+    for (size_t i = 0; i < aKeys.size(); ++i)
+    {
+        nGroups += i == 0 || aKeys[i].first != aKeys[i - 1].first ? 1 : 0;
+        aSorted.push_back(std::move(rJobs[aKeys[i].second]));
+    }
+    rJobs.swap(aSorted);
+    printf("Jobs: %zu jobs in %zu groups of the same filters, size and depth\n\n", rJobs.size(), nGroups);
+    return true;
+}
+
+
+// Scheduler cost of a served job: pixels times the cost of its filters. The image size is read
+// from the header of the input or given by a shared job, an unreadable input costs nothing
+double estimateJobCost(const serve::Job& rJob)
+{
+    std::vector<std::string> aArguments = getJobArguments(rJob);
+    std::vector<char*> argv;
+    for (std::string& rArgument : aArguments)
+    {
+        argv.push_back(rArgument.data());
+    }
+    const int argc = (int)argv.size();
+
+    double nPixels = 0.0;
+    if (checkCmdLineFlag(argc, (const char**)argv.data(), "shared"))
+    {
+        const char* width = getCmdLineValue(argc, argv.data(), "width");
+        const char* height = getCmdLineValue(argc, argv.data(), "height");
+        nPixels = width && height ? atof(width) * atof(height) : 0.0;
+    }
+    else if (const char* input = getCmdLineValue(argc, argv.data(), "input"))
+    {
+        MappedFile oFile;
+        stb::ImageInfo oInfo;
+        if (oFile.open(input) && stb::probeImage(oFile, oInfo))
+        {
+            nPixels = (double)oInfo.pixels();
+        }
+    }
+
+    // --pipeline="gauss:5|sharpen" stages or --filter list, an invalid job is reported by its run
+    double nCost = 0.0;
+    const char* pipeline = getCmdLineValue(argc, argv.data(), "pipeline");
+    const char* filter = getCmdLineValue(argc, argv.data(), "filter");
+    std::string sList = pipeline ? pipeline : filter ? filter : "box";
+    const char cSeparator = pipeline ? '|' : ',';
+    for (std::string::size_type begin = 0; begin <= sList.size();)
+    {
+        std::string::size_type end = std::min(sList.find(cSeparator, begin), sList.size());
+        const std::string sStage = sList.substr(begin, end - begin);
+        const std::string::size_type colon = sStage.find(':');
+        nCost += filters::cpu::getCost(sStage.substr(0, colon), colon == std::string::npos ? 0 : atoi(sStage.c_str() + colon + 1));
+        begin = end + 1;
+    }
+    return nPixels * nCost;
+}
+
+
+// --serve job: the job fields are the --name=value arguments of a Parameters sharing the thread
+// pool and device context of the daemon, images go through the daemon buffers.
+// The reply gives the status, the written files and the time of each step.
+// fYield runs the urgent jobs after decoding, between the tiles of large images and before encoding,
+// and between the strips of --stream jobs
+std::string runServedJob(const Parameters& server, const std::string& rBackend, ImageBuffers& rBuffers, const serve::Job& rJob, const std::function<void()>& fYield)
+{
+    TRACE_ZONE("served job");
+    const auto oStart = std::chrono::steady_clock::now();
+    auto fMilliseconds = [](std::chrono::steady_clock::time_point oFrom) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oFrom).count();
+    };
+
+    std::vector<std::string> aArguments = getJobArguments(rJob);
+    // jobs run on the backend the daemon was started with unless they choose one
+    if (std::none_of(rJob.aArguments.begin(), rJob.aArguments.end(), [](const auto& rArgument) { return rArgument.first == "backend"; }))
+    {
+        aArguments.push_back("--backend=" + rBackend);
+    }
+    std::vector<char*> argv;
+    for (std::string& rArgument : aArguments)
+    {
+        argv.push_back(rArgument.data());
+    }
+    const int argc = (int)argv.size();
+
+    // the messages of the job are sent back in the reply
+    std::ostringstream oOutput;
+    Parameters parameters = server;
+    parameters.setOutput(oOutput);
+    std::string sError;
+    double aMilliseconds[4] = { 0.0, 0.0, 0.0, 0.0 };
+    std::vector<std::string> aCacheKeys;
+    bool bCached = false;
+    try
+    {
+        const char* input = getCmdLineValue(argc, argv.data(), "input");
+        const bool bShared = checkCmdLineFlag(argc, (const char**)argv.data(), "shared");
+        if (bShared != !rJob.aFiles.empty() || (bShared && rJob.aFiles.size() != 2))
+        {
+            sError = "a shared job passes two descriptors, its source and its result, other jobs none";
+        }
+        else if (!input && !bShared)
+        {
+            sError = "a job needs an input";
+        }
+        else if ((input && std::string(input) == "-") || writesToStandardOutput(argc, argv.data()))
+        {
+            sError = "served jobs read and write files, not the standard streams";
+        }
+        else if (getCmdLineValue(argc, argv.data(), "input-list") || getCmdLineValue(argc, argv.data(), "input-dir"))
+        {
+            sError = "a job filters a single image";
+        }
+        else if (checkCmdLineFlag(argc, (const char**)argv.data(), "sweep"))
+        {
+            sError = "a job runs a single parameter point, --sweep runs from the command line";
+        }
+        else if (parameters.parseCmdLine(argc, argv.data()) != 0 || !parameters.getInputFiles().empty())
+        {
+            sError = "invalid job";
+        }
+        else if (parameters.isSharedInput())
+        {
+            aMilliseconds[0] = fMilliseconds(oStart);
+
+            const auto oStep = std::chrono::steady_clock::now();
+            const char* pitch = getCmdLineValue(argc, argv.data(), "pitch");
+            const char* outputPitch = getCmdLineValue(argc, argv.data(), "output-pitch");
+            const size_t nSrcPitch = pitch ? (size_t)strtoull(pitch, nullptr, 10) : 0;
+            const size_t nDstPitch = outputPitch ? (size_t)strtoull(outputPitch, nullptr, 10) : 0;
+            const int nBits = parameters.getInputInfo().nBitsPerChannel;
+            if (nBits == 16)
+            {
+                filterShared<Npp16u>(parameters, rBuffers, rJob.aFiles[0], nSrcPitch, rJob.aFiles[1], nDstPitch);
+            }
+            else if (nBits == 32)
+            {
+                filterShared<Npp32f>(parameters, rBuffers, rJob.aFiles[0], nSrcPitch, rJob.aFiles[1], nDstPitch);
+            }
+            else
+            {
+                filterShared<Npp8u>(parameters, rBuffers, rJob.aFiles[0], nSrcPitch, rJob.aFiles[1], nDstPitch);
+            }
+            aMilliseconds[2] = fMilliseconds(oStep);
+        }
+        else if (parameters.isStream())
+        {
+            filterImage(parameters, rBuffers, fYield);
+        }
+        else if (restoreCachedResults(parameters, aCacheKeys))
+        {
+            bCached = true;
+            aMilliseconds[0] = fMilliseconds(oStart);
+        }
+        else
+        {
+            aMilliseconds[0] = fMilliseconds(oStart);
+
+            auto oStep = std::chrono::steady_clock::now();
+            decodeInput(parameters, rBuffers);
+            aMilliseconds[1] = fMilliseconds(oStep);
+            fYield();
+
+            oStep = std::chrono::steady_clock::now();
+            if (isDeviceImage(parameters))
+            {
+                uploadInput(parameters, rBuffers);
+                if (parameters.getInputInfo().pixels() > (size_t)nServeTilePixels)
+                {
+                    filterOnDeviceTiled(parameters, rBuffers, fYield);
+                }
+                else
+                {
+                    filterOnDevice(parameters, rBuffers);
+                }
+                downloadResults(parameters, rBuffers);
+            }
+            else if (parameters.getInputInfo().pixels() > (size_t)nServeTilePixels)
+            {
+                filterOnHostTiled(parameters, rBuffers, fYield);
+            }
+            else
+            {
+                filterOnHost(parameters, rBuffers);
+            }
+            aMilliseconds[2] = fMilliseconds(oStep);
+            fYield();
+
+            oStep = std::chrono::steady_clock::now();
+            saveOutputs(parameters, rBuffers);
+            storeCachedResults(parameters, aCacheKeys);
+            aMilliseconds[3] = fMilliseconds(oStep);
+        }
+    }
+    catch (npp::Exception& rException)
+    {
+        std::ostringstream oError;
+        oError << rException;
+        sError = oError.str();
+    }
+    catch (std::exception& rException)
+    {
+        sError = rException.what();
+    }
+    if (sError.empty() && !parameters.isStream())
+    {
+        countImage(parameters);
+    }
+
+    std::ostringstream oReply;
+    oReply << "{\"status\": \"" << (sError.empty() ? "ok" : "error") << "\"";
+    if (!sError.empty())
+    {
+        oReply << ", \"error\": ";
+        stb::writeJsonString(oReply, sError);
+    }
+    else
+    {
+        // the result of a shared job is in the client buffer
+        oReply << ", \"outputs\": [";
+        for (size_t i = 0; !parameters.isSharedInput() && i < parameters.getFilterTypes().size(); ++i)
+        {
+            oReply << (i ? ", " : "");
+            stb::writeJsonString(oReply, parameters.forFilter(i).getOutputFilename());
+        }
+        oReply << "]" << (bCached ? ", \"cached\": true" : "");
+    }
+    char aTimings[256];
+    snprintf(aTimings, sizeof(aTimings), ", \"timings\": {\"queue_ms\": %.3f, \"parse_ms\": %.3f, \"decode_ms\": %.3f, \"filter_ms\": %.3f, \"encode_ms\": %.3f, \"total_ms\": %.3f}",
+        rJob.nQueueMilliseconds, aMilliseconds[0], aMilliseconds[1], aMilliseconds[2], aMilliseconds[3], fMilliseconds(oStart));
+    oReply << aTimings << ", \"log\": ";
+    stb::writeJsonString(oReply, oOutput.str());
+    oReply << "}";
+    return oReply.str();
+}
+
+
+// End of run statistics: --cache-dir hits and misses, --timings steps, and the --trace file
+void printStatistics(const Parameters& parameters, const char* sTraceFile)
+{
+    if (parameters.getResultCache())
+    {
+        parameters.getResultCache()->printStatistics();
+    }
+    if (parameters.getStageTimings())
+    {
+        parameters.getStageTimings()->printStatistics();
+    }
+    if (sTraceFile && trace::isEnabled())
+    {
+        if (trace::write(sTraceFile))
+        {
+            printf("Trace: %s\n", sTraceFile);
+        }
+        else
+        {
+            printf("Error: Can't write %s\n", sTraceFile);
+        }
+    }
+}
+
+
 int main(int argc, char* argv[])
 {
+    if (checkCmdLineFlag(argc, (const char**)argv, "probe"))
+    {
+        return probeFiles(argc, argv);
+    }
+
+    // --client: send the job given by the other arguments to a --serve daemon
+    if (const char* sSocketPath = getCmdLineValue(argc, argv, "client"))
+    {
+        return serve::client(sSocketPath, serve::buildRequest(argc, argv));
+    }
+
+    if (writesToStandardOutput(argc, argv))
+    {
+        reserveStandardOutput();
+    }
+
     printf("%s Starting...\n\n", argv[0]);
 
+    // --trace: zones of every thread from here to the end of the run
+    const char* sTraceFile = getCmdLineValue(argc, argv, "trace");
+    if (sTraceFile)
+    {
+#ifdef NPP_FILTERS_TRACE
+        trace::enable();
+        TRACE_THREAD("main");
+#else
+        printf("npp-filters was built without NPP_FILTERS_TRACE, --trace is ignored\n");
+#endif
+    }
+
     try
     {
         Parameters parameters;
 
-        findCudaDevice(argc, (const char**)argv);
+        // the cpu backend, the strip streaming and the sweep modes run without any CUDA device
+        if (getBackend(argc, argv) == "npp" && !checkCmdLineFlag(argc, (const char**)argv, "stream")
+            && !checkCmdLineFlag(argc, (const char**)argv, "sweep"))
+        {
+            findCudaDevice(argc, (const char**)argv);
+
+            if (printfNPPinfo(argc, argv) == false)
+            {
+                exit(EXIT_SUCCESS);
+            }
+
+            // device attributes of the NPP calls, each filter gets its own stream
+            NppStreamContext oContext;
+            NPP_CHECK_NPP(nppGetStreamContext(&oContext));
+            parameters.setStreamContext(oContext);
+        }
 
-        if (printfNPPinfo(argc, argv) == false)
+        // --serve: jobs received on a Unix socket share the threads, the device and the buffers set up once
+        if (const char* sSocketPath = getCmdLineValue(argc, argv, "serve"))
         {
-            exit(EXIT_SUCCESS);
+            parameters.setThreadPool(std::make_shared<ThreadPool>(getThreads(argc, argv)));
+            parameters.setResultCache(getResultCache(argc, argv));
+            parameters.setStageTimings(getStageTimings(argc, argv));
+            const std::string sBackend = getBackend(argc, argv);
+            int nExitCode = EXIT_SUCCESS;
+            {
+                // a job run from the yield of another one has its own buffers
+                std::deque<ImageBuffers> aBuffers;
+                size_t nDepth = 0;
+                auto fHandle = [&](const serve::Job& rJob, const std::function<void()>& fYield) {
+                    if (nDepth == aBuffers.size())
+                    {
+                        aBuffers.emplace_back();
+                    }
+                    ++nDepth;
+                    std::string sReply = runServedJob(parameters, sBackend, aBuffers[nDepth - 1], rJob, fYield);
+                    --nDepth;
+                    return sReply;
+                };
+                nExitCode = serve::run(sSocketPath, fHandle, estimateJobCost);
+                // host and device images are freed here
+            }
+            printStatistics(parameters, sTraceFile);
+            exit(nExitCode);
+        }
+
+        // --jobs: a manifest of images each with its own filter settings, run by the batch executor
+        if (const char* sManifest = getCmdLineValue(argc, argv, "jobs"))
+        {
+            parameters.setThreadPool(std::make_shared<ThreadPool>(getThreads(argc, argv)));
+            parameters.setResultCache(getResultCache(argc, argv));
+            parameters.setStageTimings(getStageTimings(argc, argv));
+            std::vector<Parameters> aJobs;
+            int nExitCode = EXIT_FAILURE;
+            if (getManifestJobs(sManifest, parameters, argc, argv, aJobs))
+            {
+                // the command line options are common to the jobs: executor threads, queues and backend
+                nExitCode = filterBatchPipelined(aJobs.front(), aJobs);
+            }
+            printStatistics(parameters, sTraceFile);
+            exit(nExitCode);
         }
 
         // Parse and validate command line parameters
@@ -97,41 +1912,32 @@ int main(int argc, char* argv[])
         {
             exit(EXIT_FAILURE);
         }
+        if (parameters.isSharedInput())
+        {
+            printf("Error: --shared images are sent with their descriptors to a --serve daemon\n");
+            exit(EXIT_FAILURE);
+        }
 
-        // declare a host image object for an 8-bit RGB image
-        npp::ImageCPU_8u_C3 oHostSrc;
-        // load image from disk
-        stb::loadImage(parameters.getInputFilename(), oHostSrc);
-
-        // declare a device image and copy construct from the host image,
-        // i.e. upload host to device
-        npp::ImageNPP_8u_C3 oDeviceSrc(oHostSrc);
-
-        // set input size and ROI size
-        parameters.setSrcSize({ (int)oDeviceSrc.width(), (int)oDeviceSrc.height() });
-        parameters.setSizeROI({ (int)oDeviceSrc.width(), (int)oDeviceSrc.height() });
-
-        // allocate device image for the filtered image
-        npp::ImageNPP_8u_C3 oDeviceDst(oDeviceSrc.width(), oDeviceSrc.height());
-
-        // run filter box
-        filters::execute(parameters, oDeviceSrc, oDeviceDst);
-
-        // declare a host image for the result
-        npp::ImageCPU_8u_C3 oHostDst(oDeviceDst.size());
-
-        // and copy the device result data into it
-        oDeviceDst.copyTo(oHostDst.data(), oHostDst.pitch());
-
-        // save image to disk
-        stb::saveImage(parameters.getOutputFilename(), oHostDst);
-        std::cout << "Saved image: " << parameters.getOutputFilename() << std::endl;
-
-        // free device image
-        nppiFree(oDeviceSrc.data());
-        nppiFree(oDeviceDst.data());
+        int nExitCode = EXIT_SUCCESS;
+        {
+            ImageBuffers oBuffers;
+            if (!parameters.getInputFiles().empty())
+            {
+                nExitCode = parameters.isStream() ? filterBatch(parameters, oBuffers) : filterBatchPipelined(parameters);
+            }
+            else if (parameters.isSweep())
+            {
+                filterSweep(parameters, oBuffers);
+            }
+            else
+            {
+                filterImage(parameters, oBuffers);
+            }
+            // host and device images are freed here
+        }
+        printStatistics(parameters, sTraceFile);
 
-        exit(EXIT_SUCCESS);
+        exit(nExitCode);
     }
     catch (npp::Exception& rException)
     {
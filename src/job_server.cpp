@@ -0,0 +1,786 @@
+#include "job_server.h"
+#include "stb_image_io.h"
+#include "parameter_helpers.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <set>
+#include <chrono>
+#include <condition_variable>
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64))
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace serve
+{
+    namespace
+    {
+        // largest request or reply accepted, jobs carry file names and a few parameters
+        const size_t nMaxMessage = 1 << 20;
+        // descriptors accepted with a message, a shared job passes its source and result
+        const size_t nMaxFiles = 4;
+
+        // Recursive descent over the few JSON forms a job uses
+        class JsonReader
+        {
+            const std::string& _rText;
+            size_t _nPos = 0;
+        public:
+            explicit JsonReader(const std::string& rText) : _rText(rText) {}
+
+            void skipSpace()
+            {
+                while (_nPos < _rText.size() && isspace((unsigned char)_rText[_nPos]))
+                {
+                    ++_nPos;
+                }
+            }
+
+            bool accept(char c)
+            {
+                skipSpace();
+                if (_nPos < _rText.size() && _rText[_nPos] == c)
+                {
+                    ++_nPos;
+                    return true;
+                }
+                return false;
+            }
+
+            bool atEnd()
+            {
+                skipSpace();
+                return _nPos == _rText.size();
+            }
+
+            bool peek(char c)
+            {
+                skipSpace();
+                return _nPos < _rText.size() && _rText[_nPos] == c;
+            }
+
+            bool string(std::string& rValue)
+            {
+                if (!accept('"'))
+                {
+                    return false;
+                }
+                rValue.clear();
+                while (_nPos < _rText.size() && _rText[_nPos] != '"')
+                {
+                    char c = _rText[_nPos++];
+                    if (c != '\\')
+                    {
+                        rValue += c;
+                        continue;
+                    }
+                    if (_nPos == _rText.size())
+                    {
+                        return false;
+                    }
+                    c = _rText[_nPos++];
+                    switch (c)
+                    {
+                    case 'b': rValue += '\b'; break;
+                    case 'f': rValue += '\f'; break;
+                    case 'n': rValue += '\n'; break;
+                    case 'r': rValue += '\r'; break;
+                    case 't': rValue += '\t'; break;
+                    case 'u':
+                    {
+                        if (_nPos + 4 > _rText.size())
+                        {
+                            return false;
+                        }
+                        unsigned int nCode = (unsigned int)strtoul(_rText.substr(_nPos, 4).c_str(), nullptr, 16);
+                        _nPos += 4;
+                        // UTF-8 encoding of a basic multilingual plane code point
+                        if (nCode < 0x80)
+                        {
+                            rValue += (char)nCode;
+                        }
+                        else if (nCode < 0x800)
+                        {
+                            rValue += (char)(0xC0 | (nCode >> 6));
+                            rValue += (char)(0x80 | (nCode & 0x3F));
+                        }
+                        else
+                        {
+                            rValue += (char)(0xE0 | (nCode >> 12));
+                            rValue += (char)(0x80 | ((nCode >> 6) & 0x3F));
+                            rValue += (char)(0x80 | (nCode & 0x3F));
+                        }
+                        break;
+                    }
+                    default: rValue += c; break;
+                    }
+                }
+                return accept('"');
+            }
+
+            // number, true, false or null as written
+            bool literal(std::string& rValue)
+            {
+                skipSpace();
+                size_t nBegin = _nPos;
+                while (_nPos < _rText.size() && (isalnum((unsigned char)_rText[_nPos]) || strchr("+-.", _rText[_nPos])))
+                {
+                    ++_nPos;
+                }
+                rValue = _rText.substr(nBegin, _nPos - nBegin);
+                return !rValue.empty();
+            }
+        };
+
+        // Members of an object as job arguments, true is a flag, false and null are left out,
+        // arrays are joined with commas
+        bool parseMembers(JsonReader& rReader, Job& rJob, bool bTop, std::string& rError)
+        {
+            if (!rReader.accept('{'))
+            {
+                rError = "a job is a JSON object";
+                return false;
+            }
+            if (rReader.accept('}'))
+            {
+                return true;
+            }
+            do
+            {
+                std::string sName, sValue;
+                if (!rReader.string(sName) || !rReader.accept(':'))
+                {
+                    rError = "malformed member name";
+                    return false;
+                }
+                if (rReader.peek('{'))
+                {
+                    if (!bTop || sName != "params")
+                    {
+                        rError = "only \"params\" can be an object";
+                        return false;
+                    }
+                    if (!parseMembers(rReader, rJob, false, rError))
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                if (rReader.accept('['))
+                {
+                    // an array of numbers or strings is a comma separated list: "roi": [0, 0, 256, 256]
+                    std::string sItem;
+                    do
+                    {
+                        if (!(rReader.peek('"') ? rReader.string(sItem) : rReader.literal(sItem)))
+                        {
+                            rError = "malformed array \"" + sName + "\"";
+                            return false;
+                        }
+                        sValue += (sValue.empty() ? "" : ",") + sItem;
+                    } while (rReader.accept(','));
+                    if (!rReader.accept(']'))
+                    {
+                        rError = "malformed array \"" + sName + "\"";
+                        return false;
+                    }
+                    rJob.aArguments.emplace_back(sName, sValue);
+                    continue;
+                }
+                const bool bString = rReader.peek('"');
+                if (!(bString ? rReader.string(sValue) : rReader.literal(sValue)))
+                {
+                    rError = "malformed value of \"" + sName + "\"";
+                    return false;
+                }
+                if (bTop && sName == "command")
+                {
+                    rJob.sCommand = sValue;
+                }
+                else if (bTop && sName == "priority")
+                {
+                    rJob.nPriority = atoi(sValue.c_str());
+                }
+                else if (bTop && sName == "deadline")
+                {
+                    rJob.nDeadline = std::max(atof(sValue.c_str()), 0.0);
+                }
+                else if (bString || (sValue != "false" && sValue != "null"))
+                {
+                    rJob.aArguments.emplace_back(sName, !bString && sValue == "true" ? std::string() : sValue);
+                }
+            } while (rReader.accept(','));
+
+            if (!rReader.accept('}'))
+            {
+                rError = "malformed object";
+                return false;
+            }
+            return true;
+        }
+
+        std::string errorReply(const std::string& rError)
+        {
+            std::ostringstream oReply;
+            oReply << "{\"status\": \"error\", \"error\": ";
+            stb::writeJsonString(oReply, rError);
+            oReply << "}";
+            return oReply.str();
+        }
+
+        // Filter jobs waiting for their turn, in the order given by before(). There is no scheduling
+        // thread: the connection thread of the first job runs it, and the running job runs the
+        // waiting jobs that rank before it from its yields, nested on its own thread
+        class Scheduler
+        {
+            typedef std::chrono::steady_clock Clock;
+
+            struct Pending
+            {
+                Job* pJob = nullptr;
+                double nCost = 0.0;
+                Clock::time_point oArrival;
+                Clock::time_point oDeadline = Clock::time_point::max();
+                unsigned long long nArrival = 0;
+                std::string sReply;
+                bool bDone = false;
+            };
+
+            const JobHandler& _fHandle;
+            std::mutex _oMutex;
+            std::condition_variable _oChanged;
+            std::vector<Pending*> _aWaiting;
+            // the running job and the jobs it yielded to, the last one runs
+            std::vector<Pending*> _aRunning;
+            unsigned long long _nArrivals = 0;
+            // cost and milliseconds from arrival to reply of every job
+            std::vector<std::pair<double, double> > _aLatencies;
+
+            static bool before(const Pending& a, const Pending& b)
+            {
+                if (a.pJob->nPriority != b.pJob->nPriority)
+                {
+                    return a.pJob->nPriority > b.pJob->nPriority;
+                }
+                if (a.oDeadline != b.oDeadline)
+                {
+                    return a.oDeadline < b.oDeadline;
+                }
+                if (a.nCost != b.nCost)
+                {
+                    return a.nCost < b.nCost;
+                }
+                return a.nArrival < b.nArrival;
+            }
+
+            std::vector<Pending*>::iterator next()
+            {
+                return std::min_element(_aWaiting.begin(), _aWaiting.end(), [](const Pending* a, const Pending* b) { return before(*a, *b); });
+            }
+
+            // Run a job taken out of the waiting ones, the lock is held before and after
+            void runLocked(std::unique_lock<std::mutex>& rLock, Pending& rPending)
+            {
+                _aRunning.push_back(&rPending);
+                rLock.unlock();
+
+                const Clock::time_point oStart = Clock::now();
+                rPending.pJob->nQueueMilliseconds = std::chrono::duration<double, std::milli>(oStart - rPending.oArrival).count();
+                if (oStart > rPending.oDeadline)
+                {
+                    rPending.sReply = errorReply("deadline exceeded after " + std::to_string((long long)rPending.pJob->nQueueMilliseconds) + " ms in the queue");
+                }
+                else
+                {
+                    rPending.sReply = _fHandle(*rPending.pJob, [this] { yield(); });
+                }
+                const double nLatency = std::chrono::duration<double, std::milli>(Clock::now() - rPending.oArrival).count();
+
+                rLock.lock();
+                _aRunning.pop_back();
+                _aLatencies.emplace_back(rPending.nCost, nLatency);
+                rPending.bDone = true;
+                _oChanged.notify_all();
+            }
+
+            void yield()
+            {
+                std::unique_lock<std::mutex> oLock(_oMutex);
+                for (;;)
+                {
+                    std::vector<Pending*>::iterator it = next();
+                    if (it == _aWaiting.end() || !before(**it, *_aRunning.back()))
+                    {
+                        return;
+                    }
+                    Pending* pPending = *it;
+                    _aWaiting.erase(it);
+                    runLocked(oLock, *pPending);
+                }
+            }
+
+        public:
+            explicit Scheduler(const JobHandler& fHandle) : _fHandle(fHandle) {}
+
+            // Wait for the turn of rJob, run it and return its reply
+            std::string execute(Job& rJob, double nCost)
+            {
+                Pending oPending;
+                oPending.pJob = &rJob;
+                oPending.nCost = nCost;
+                oPending.oArrival = Clock::now();
+                if (rJob.nDeadline > 0.0)
+                {
+                    oPending.oDeadline = oPending.oArrival + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(rJob.nDeadline));
+                }
+
+                std::unique_lock<std::mutex> oLock(_oMutex);
+                oPending.nArrival = _nArrivals++;
+                _aWaiting.push_back(&oPending);
+                _oChanged.wait(oLock, [&] { return oPending.bDone || (_aRunning.empty() && *next() == &oPending); });
+                if (!oPending.bDone)
+                {
+                    _aWaiting.erase(next());
+                    runLocked(oLock, oPending);
+                }
+                return oPending.sReply;
+            }
+
+            // Latency percentiles of all the jobs and of the cheaper half
+            void printStatistics()
+            {
+                std::lock_guard<std::mutex> oLock(_oMutex);
+                if (_aLatencies.empty())
+                {
+                    return;
+                }
+                auto fPercentile = [](std::vector<double> aValues, double nRank) {
+                    std::sort(aValues.begin(), aValues.end());
+                    return aValues[std::min((size_t)(nRank * aValues.size()), aValues.size() - 1)];
+                };
+                std::vector<std::pair<double, double> > aJobs = _aLatencies;
+                std::sort(aJobs.begin(), aJobs.end());
+                std::vector<double> aAll, aSmall;
+                for (size_t i = 0; i < aJobs.size(); ++i)
+                {
+                    aAll.push_back(aJobs[i].second);
+                    if (i < (aJobs.size() + 1) / 2)
+                    {
+                        aSmall.push_back(aJobs[i].second);
+                    }
+                }
+                printf("Served %zu jobs, latency p50 %.3f ms p99 %.3f ms, cheaper half p50 %.3f ms p99 %.3f ms\n",
+                    aAll.size(), fPercentile(aAll, 0.5), fPercentile(aAll, 0.99), fPercentile(aSmall, 0.5), fPercentile(aSmall, 0.99));
+            }
+        };
+    }
+
+    bool parseJob(const std::string& rJson, Job& rJob, std::string& rError)
+    {
+        rJob = Job();
+        JsonReader oReader(rJson);
+        if (!parseMembers(oReader, rJob, true, rError))
+        {
+            return false;
+        }
+        if (!oReader.atEnd())
+        {
+            rError = "trailing characters after the job";
+            return false;
+        }
+        return true;
+    }
+
+    std::string buildRequest(int argc, char* argv[])
+    {
+        static const char* aFields[] = { "command", "priority", "deadline", "input", "output", "filter", "border" };
+        static const char* aPaths[] = { "input", "output", "input-list", "input-dir", "output-dir" };
+
+        std::ostringstream oFields, oParams;
+        for (int i = 1; i < argc; ++i)
+        {
+            if (argv[i][0] != '-')
+            {
+                continue;
+            }
+            std::string sArgument = argv[i] + strspn(argv[i], "-");
+            std::string::size_type equal = sArgument.find('=');
+            std::string sName = sArgument.substr(0, equal);
+            if (sName == "client")
+            {
+                continue;
+            }
+
+            std::ostringstream& rStream = std::find_if(std::begin(aFields), std::end(aFields),
+                [&](const char* s) { return sName == s; }) != std::end(aFields) ? oFields : oParams;
+            rStream << (rStream.tellp() ? ", " : "");
+            stb::writeJsonString(rStream, sName);
+            rStream << ": ";
+            // --name value as --name=value, a name alone is a flag
+            const bool bNextValue = equal == std::string::npos && i + 1 < argc && takesCmdLineValue(sName) && isCmdLineValue(argv[i + 1]);
+            if (equal == std::string::npos && !bNextValue)
+            {
+                rStream << "true";
+                continue;
+            }
+            std::string sValue = bNextValue ? argv[++i] : sArgument.substr(equal + 1);
+            if (sValue != "-" && std::find_if(std::begin(aPaths), std::end(aPaths),
+                [&](const char* s) { return sName == s; }) != std::end(aPaths))
+            {
+                sValue = std::filesystem::absolute(sValue).string();
+            }
+            stb::writeJsonString(rStream, sValue);
+        }
+
+        std::string sRequest = "{" + oFields.str();
+        if (oParams.tellp())
+        {
+            sRequest += std::string(oFields.tellp() ? ", " : "") + "\"params\": {" + oParams.str() + "}";
+        }
+        return sRequest + "}";
+    }
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+
+    bool readMessage(int, std::string&, std::vector<int>*)
+    {
+        return false;
+    }
+
+    bool writeMessage(int, const std::string&, const std::vector<int>&)
+    {
+        return false;
+    }
+
+    int run(const std::string&, const JobHandler&, const JobEstimator&)
+    {
+        printf("Error: --serve needs Unix domain sockets, not available in this build\n");
+        return EXIT_FAILURE;
+    }
+
+    int client(const std::string&, const std::string&)
+    {
+        printf("Error: --client needs Unix domain sockets, not available in this build\n");
+        return EXIT_FAILURE;
+    }
+
+#else
+
+    namespace
+    {
+        bool readAll(int nSocket, void* pData, size_t nSize)
+        {
+            unsigned char* p = (unsigned char*)pData;
+            while (nSize)
+            {
+                ssize_t n = recv(nSocket, p, nSize, 0);
+                if (n <= 0)
+                {
+                    return false;
+                }
+                p += n;
+                nSize -= (size_t)n;
+            }
+            return true;
+        }
+
+        bool writeAll(int nSocket, const void* pData, size_t nSize)
+        {
+            const unsigned char* p = (const unsigned char*)pData;
+            while (nSize)
+            {
+                ssize_t n = send(nSocket, p, nSize, 0);
+                if (n <= 0)
+                {
+                    return false;
+                }
+                p += n;
+                nSize -= (size_t)n;
+            }
+            return true;
+        }
+
+        bool socketAddress(const std::string& rSocketPath, sockaddr_un& rAddress)
+        {
+            memset(&rAddress, 0, sizeof(rAddress));
+            rAddress.sun_family = AF_UNIX;
+            if (rSocketPath.empty() || rSocketPath.size() >= sizeof(rAddress.sun_path))
+            {
+                printf("Error: invalid socket path %s\n", rSocketPath.c_str());
+                return false;
+            }
+            memcpy(rAddress.sun_path, rSocketPath.c_str(), rSocketPath.size());
+            return true;
+        }
+    }
+
+    bool readMessage(int nSocket, std::string& rMessage, std::vector<int>* pFiles)
+    {
+        // the descriptors come with the first byte of the length, which is received alone
+        unsigned char aLength[4];
+        alignas(cmsghdr) char aControl[CMSG_SPACE(nMaxFiles * sizeof(int))];
+        iovec oVector = { aLength, 1 };
+        msghdr oHeader = {};
+        oHeader.msg_iov = &oVector;
+        oHeader.msg_iovlen = 1;
+        oHeader.msg_control = aControl;
+        oHeader.msg_controllen = sizeof(aControl);
+        ssize_t n = recvmsg(nSocket, &oHeader, MSG_CMSG_CLOEXEC);
+
+        std::vector<int> aFiles;
+        for (cmsghdr* pControl = n > 0 ? CMSG_FIRSTHDR(&oHeader) : nullptr; pControl; pControl = CMSG_NXTHDR(&oHeader, pControl))
+        {
+            if (pControl->cmsg_level == SOL_SOCKET && pControl->cmsg_type == SCM_RIGHTS)
+            {
+                const size_t nFiles = (pControl->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < nFiles; ++i)
+                {
+                    int nFile;
+                    memcpy(&nFile, CMSG_DATA(pControl) + i * sizeof(int), sizeof(int));
+                    aFiles.push_back(nFile);
+                }
+            }
+        }
+        // more descriptors than the control buffer holds were dropped, the message is refused
+        const bool bRead = n > 0 && !(oHeader.msg_flags & MSG_CTRUNC) && readAll(nSocket, aLength + 1, 3);
+        if (!bRead || !pFiles)
+        {
+            for (int nFile : aFiles)
+            {
+                close(nFile);
+            }
+            aFiles.clear();
+        }
+        if (pFiles)
+        {
+            pFiles->swap(aFiles);
+        }
+        if (!bRead)
+        {
+            return false;
+        }
+        const size_t nLength = ((size_t)aLength[0] << 24) | ((size_t)aLength[1] << 16) | ((size_t)aLength[2] << 8) | aLength[3];
+        if (nLength > nMaxMessage)
+        {
+            return false;
+        }
+        rMessage.resize(nLength);
+        return readAll(nSocket, rMessage.data(), nLength);
+    }
+
+    bool writeMessage(int nSocket, const std::string& rMessage, const std::vector<int>& aFiles)
+    {
+        const size_t nLength = rMessage.size();
+        unsigned char aLength[4] = { (unsigned char)(nLength >> 24), (unsigned char)(nLength >> 16), (unsigned char)(nLength >> 8), (unsigned char)nLength };
+        if (aFiles.empty())
+        {
+            return writeAll(nSocket, aLength, 4) && writeAll(nSocket, rMessage.data(), nLength);
+        }
+        if (aFiles.size() > nMaxFiles)
+        {
+            return false;
+        }
+
+        // the descriptors go with the first byte of the length, see readMessage
+        alignas(cmsghdr) char aControl[CMSG_SPACE(nMaxFiles * sizeof(int))] = {};
+        iovec oVector = { aLength, 1 };
+        msghdr oHeader = {};
+        oHeader.msg_iov = &oVector;
+        oHeader.msg_iovlen = 1;
+        oHeader.msg_control = aControl;
+        oHeader.msg_controllen = CMSG_SPACE(aFiles.size() * sizeof(int));
+        cmsghdr* pControl = CMSG_FIRSTHDR(&oHeader);
+        pControl->cmsg_level = SOL_SOCKET;
+        pControl->cmsg_type = SCM_RIGHTS;
+        pControl->cmsg_len = CMSG_LEN(aFiles.size() * sizeof(int));
+        memcpy(CMSG_DATA(pControl), aFiles.data(), aFiles.size() * sizeof(int));
+        return sendmsg(nSocket, &oHeader, 0) == 1 && writeAll(nSocket, aLength + 1, 3) && writeAll(nSocket, rMessage.data(), nLength);
+    }
+
+    int run(const std::string& rSocketPath, const JobHandler& fHandle, const JobEstimator& fEstimate)
+    {
+        sockaddr_un oAddress;
+        if (!socketAddress(rSocketPath, oAddress))
+        {
+            return EXIT_FAILURE;
+        }
+
+        // a client gone before its reply must not kill the daemon
+        signal(SIGPIPE, SIG_IGN);
+
+        int nListen = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(rSocketPath.c_str());
+        if (nListen < 0 || bind(nListen, (const sockaddr*)&oAddress, sizeof(oAddress)) != 0 || listen(nListen, 16) != 0)
+        {
+            printf("Error: can't listen on %s: %s\n", rSocketPath.c_str(), strerror(errno));
+            if (nListen >= 0)
+            {
+                close(nListen);
+            }
+            return EXIT_FAILURE;
+        }
+        std::cout << "npp-filters serving on " << rSocketPath << std::endl;
+
+        Scheduler oScheduler(fHandle);
+        std::mutex oConnectionMutex;
+        // open connections, their threads are detached and signal oConnectionsClosed once removed
+        std::set<int> aConnections;
+        std::condition_variable oConnectionsClosed;
+        std::atomic<bool> bStop{ false };
+
+        auto fConnection = [&](int nSocket) {
+            std::string sRequest;
+            std::vector<int> aFiles;
+            while (!bStop && readMessage(nSocket, sRequest, &aFiles))
+            {
+                Job oJob;
+                std::string sError, sReply;
+                bool bShutdown = false;
+                if (!parseJob(sRequest, oJob, sError))
+                {
+                    sReply = errorReply(sError);
+                }
+                else if (oJob.sCommand == "ping")
+                {
+                    sReply = "{\"status\": \"ok\"}";
+                }
+                else if (oJob.sCommand == "shutdown")
+                {
+                    sReply = "{\"status\": \"ok\"}";
+                    bShutdown = true;
+                }
+                else if (oJob.sCommand == "filter")
+                {
+                    // buffers and devices are shared, one job at a time in the scheduler order
+                    oJob.aFiles = aFiles;
+                    sReply = oScheduler.execute(oJob, fEstimate(oJob));
+                }
+                else
+                {
+                    sReply = errorReply("unknown command " + oJob.sCommand);
+                }
+                // the job has unmapped the shared buffers, the client still holds them
+                for (int nFile : aFiles)
+                {
+                    close(nFile);
+                }
+                aFiles.clear();
+                if (!writeMessage(nSocket, sReply))
+                {
+                    break;
+                }
+                // stop accepting once the shutdown is acknowledged
+                if (bShutdown)
+                {
+                    bStop = true;
+                    ::shutdown(nListen, SHUT_RDWR);
+                    break;
+                }
+            }
+            // descriptors of a request that couldn't be read
+            for (int nFile : aFiles)
+            {
+                close(nFile);
+            }
+            // notified under the lock, run() can't return before the thread is done with its locals
+            std::lock_guard<std::mutex> oLock(oConnectionMutex);
+            aConnections.erase(nSocket);
+            close(nSocket);
+            oConnectionsClosed.notify_all();
+        };
+
+        int nResult = EXIT_SUCCESS;
+        bool bBackingOff = false;
+        while (!bStop)
+        {
+            int nSocket = accept(nListen, nullptr, nullptr);
+            if (nSocket < 0)
+            {
+                // the listening socket is shut down once a shutdown request is acknowledged
+                if (bStop || errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                // out of descriptors or memory for now, the pending connections stay queued until some close
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                {
+                    if (!bBackingOff)
+                    {
+                        printf("Error: can't accept a connection on %s: %s, retrying\n", rSocketPath.c_str(), strerror(errno));
+                    }
+                    bBackingOff = true;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    continue;
+                }
+                printf("Error: can't accept a connection on %s: %s\n", rSocketPath.c_str(), strerror(errno));
+                nResult = EXIT_FAILURE;
+                break;
+            }
+            bBackingOff = false;
+            // a finished connection gives its thread and stack back right away
+            std::lock_guard<std::mutex> oLock(oConnectionMutex);
+            aConnections.insert(nSocket);
+            std::thread(fConnection, nSocket).detach();
+        }
+
+        // wake the connections waiting for a request, then wait for them to close
+        {
+            std::unique_lock<std::mutex> oLock(oConnectionMutex);
+            for (int nSocket : aConnections)
+            {
+                ::shutdown(nSocket, SHUT_RDWR);
+            }
+            oConnectionsClosed.wait(oLock, [&]() { return aConnections.empty(); });
+        }
+        close(nListen);
+        unlink(rSocketPath.c_str());
+        oScheduler.printStatistics();
+        std::cout << "npp-filters stopped serving on " << rSocketPath << std::endl;
+        return nResult;
+    }
+
+    int client(const std::string& rSocketPath, const std::string& rRequest)
+    {
+        sockaddr_un oAddress;
+        if (!socketAddress(rSocketPath, oAddress))
+        {
+            return EXIT_FAILURE;
+        }
+
+        int nSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (nSocket < 0 || connect(nSocket, (const sockaddr*)&oAddress, sizeof(oAddress)) != 0)
+        {
+            printf("Error: can't connect to %s: %s\n", rSocketPath.c_str(), strerror(errno));
+            if (nSocket >= 0)
+            {
+                close(nSocket);
+            }
+            return EXIT_FAILURE;
+        }
+
+        std::string sReply;
+        const bool ok = writeMessage(nSocket, rRequest) && readMessage(nSocket, sReply);
+        close(nSocket);
+        if (!ok)
+        {
+            printf("Error: no reply from %s\n", rSocketPath.c_str());
+            return EXIT_FAILURE;
+        }
+        std::cout << sReply << std::endl;
+        return sReply.rfind("{\"status\": \"ok\"", 0) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "mapped_file.h"
+#include <algorithm>
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#define WINDOWS_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+
+bool MappedFile::open(const std::string& rFileName)
+{
+    close();
+
+    HANDLE hFile = CreateFileA(rFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER nSize;
+    if (!GetFileSizeEx(hFile, &nSize) || nSize.QuadPart == 0)
+    {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == NULL)
+    {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    const void* pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (pData == NULL)
+    {
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return false;
+    }
+
+    _sFileName = rFileName;
+    _pData = static_cast<const unsigned char*>(pData);
+    _nSize = static_cast<size_t>(nSize.QuadPart);
+    _hFile = hFile;
+    _hMapping = hMapping;
+    return true;
+}
+
+void MappedFile::discard(size_t) const
+{
+    // mapped pages of a read only file are reclaimed by the system as needed
+}
+
+void MappedFile::close()
+{
+    if (_pData)
+    {
+        UnmapViewOfFile(_pData);
+        CloseHandle(_hMapping);
+        CloseHandle(_hFile);
+    }
+    _pData = nullptr;
+    _nSize = 0;
+    _hFile = nullptr;
+    _hMapping = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string& rFileName)
+{
+    close();
+
+    int nFile = ::open(rFileName.c_str(), O_RDONLY);
+    if (nFile < 0)
+    {
+        return false;
+    }
+
+    struct stat oStat;
+    if (fstat(nFile, &oStat) != 0 || !S_ISREG(oStat.st_mode) || oStat.st_size == 0)
+    {
+        ::close(nFile);
+        return false;
+    }
+
+    void* pData = mmap(nullptr, static_cast<size_t>(oStat.st_size), PROT_READ, MAP_PRIVATE, nFile, 0);
+    if (pData == MAP_FAILED)
+    {
+        ::close(nFile);
+        return false;
+    }
+
+    // decoders read the file front to back exactly once
+    posix_madvise(pData, static_cast<size_t>(oStat.st_size), POSIX_MADV_SEQUENTIAL);
+
+    _sFileName = rFileName;
+    _pData = static_cast<const unsigned char*>(pData);
+    _nSize = static_cast<size_t>(oStat.st_size);
+    _nFile = nFile;
+    return true;
+}
+
+void MappedFile::discard(size_t nEnd) const
+{
+    const size_t nPage = (size_t)sysconf(_SC_PAGESIZE);
+    nEnd = (std::min(nEnd, _nSize) / nPage) * nPage;
+    if (_pData && nEnd)
+    {
+        // posix_madvise(POSIX_MADV_DONTNEED) is a no-op on glibc, clean private
+        // pages of a read only mapping are simply read again from the file if touched
+        madvise(const_cast<unsigned char*>(_pData), nEnd, MADV_DONTNEED);
+    }
+}
+
+void MappedFile::close()
+{
+    if (_pData)
+    {
+        munmap(const_cast<unsigned char*>(_pData), _nSize);
+        ::close(_nFile);
+    }
+    _pData = nullptr;
+    _nSize = 0;
+    _nFile = -1;
+}
+
+#endif
\ No newline at end of file
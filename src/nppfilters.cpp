@@ -0,0 +1,255 @@
+#include "nppfilters.h"
+#include "parameter_helpers.h"
+#include "filters.h"
+#include "filters_cpu.h"
+#include "filter_plan.h"
+#include "thread_pool.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <new>
+#include <exception>
+#include <climits>
+#include <cuda_runtime.h>
+#include <npp.h>
+#include <ImagesNPP.h>
+#include <Exceptions.h>
+
+struct nppf_context
+{
+    nppf_backend eBackend = NPPF_BACKEND_CPU;
+    std::shared_ptr<ThreadPool> pThreadPool;
+    NppStreamContext oStreamContext = {};
+    cudaStream_t hStream = nullptr;
+};
+
+struct nppf_plan
+{
+    nppf_context* pContext = nullptr;
+    Parameters oParameters;
+    // kernels, tiles and scratch buffers resolved once for the size and depth
+    std::unique_ptr<filters::Plan> pFilters;
+    int nDepth = 8;
+    bool bDevice = false;
+    // npp backend images, allocated once for every execution
+    npp::ImageNPP_8u_C3 oDeviceSrc;
+    npp::ImageNPP_8u_C3 aDeviceDst[2];
+};
+
+namespace
+{
+    // Exceptions of the filters and of the allocations don't cross the C interface
+    template<class F>
+    nppf_status guard(F fCall)
+    {
+        try
+        {
+            return fCall();
+        }
+        catch (const std::bad_alloc&)
+        {
+            return NPPF_ERROR_OUT_OF_MEMORY;
+        }
+        catch (const npp::Exception&)
+        {
+            return NPPF_ERROR_DEVICE;
+        }
+        catch (...)
+        {
+            return NPPF_ERROR_INTERNAL;
+        }
+    }
+
+    nppf_status checkCuda(cudaError_t eError)
+    {
+        return eError == cudaSuccess ? NPPF_SUCCESS : NPPF_ERROR_DEVICE;
+    }
+
+    template<typename D>
+    nppf_status executeOnHost(nppf_plan& rPlan, const void* pSrc, size_t nSrcPitch, void* pDst, size_t nDstPitch)
+    {
+        // a single stage runs alone, a pipeline fused by cache tiles
+        D* pResult = static_cast<D*>(pDst);
+        rPlan.pFilters->execute(static_cast<const D*>(pSrc), (int)nSrcPitch, &pResult, (int)nDstPitch);
+        return NPPF_SUCCESS;
+    }
+
+    nppf_status executeOnDevice(nppf_plan& rPlan, const void* pSrc, size_t nSrcPitch, void* pDst, size_t nDstPitch)
+    {
+        const nppf_context& rContext = *rPlan.pContext;
+        const unsigned int nWidth = rPlan.oDeviceSrc.width();
+        const unsigned int nHeight = rPlan.oDeviceSrc.height();
+
+        nppf_status eStatus = checkCuda(cudaMemcpy2DAsync(rPlan.oDeviceSrc.data(), rPlan.oDeviceSrc.pitch(), pSrc, nSrcPitch,
+            nWidth * 3 * sizeof(Npp8u), nHeight, cudaMemcpyHostToDevice, rContext.hStream));
+        if (eStatus != NPPF_SUCCESS)
+        {
+            return eStatus;
+        }
+
+        // stages between the two device results in turn, queued on the stream of the context
+        const npp::ImageNPP_8u_C3* pStageSrc = &rPlan.oDeviceSrc;
+        for (size_t i = 0; i < rPlan.pFilters->size(); ++i)
+        {
+            rPlan.pFilters->execute(i, rContext.oStreamContext, *pStageSrc, rPlan.aDeviceDst[i % 2]);
+            pStageSrc = &rPlan.aDeviceDst[i % 2];
+        }
+
+        eStatus = checkCuda(cudaMemcpy2DAsync(pDst, nDstPitch, pStageSrc->data(), pStageSrc->pitch(),
+            nWidth * 3 * sizeof(Npp8u), nHeight, cudaMemcpyDeviceToHost, rContext.hStream));
+        if (eStatus != NPPF_SUCCESS)
+        {
+            return eStatus;
+        }
+        return checkCuda(cudaStreamSynchronize(rContext.hStream));
+    }
+}
+
+unsigned int nppf_version(void)
+{
+    return (NPPF_VERSION_MAJOR << 16) | NPPF_VERSION_MINOR;
+}
+
+const char* nppf_status_string(nppf_status eStatus)
+{
+    switch (eStatus)
+    {
+    case NPPF_SUCCESS:
+        return "success";
+    case NPPF_ERROR_INVALID_ARGUMENT:
+        return "invalid argument";
+    case NPPF_ERROR_OUT_OF_MEMORY:
+        return "out of memory";
+    case NPPF_ERROR_DEVICE:
+        return "CUDA device or NPP error";
+    case NPPF_ERROR_INTERNAL:
+        return "internal error";
+    }
+    return "unknown status";
+}
+
+nppf_status nppf_context_create(nppf_backend eBackend, int nThreads, nppf_context** ppContext)
+{
+    if (!ppContext || (eBackend != NPPF_BACKEND_NPP && eBackend != NPPF_BACKEND_CPU) || nThreads < 0)
+    {
+        return NPPF_ERROR_INVALID_ARGUMENT;
+    }
+    *ppContext = nullptr;
+    return guard([&]() {
+        std::unique_ptr<nppf_context> pContext(new nppf_context);
+        pContext->eBackend = eBackend;
+        pContext->pThreadPool = std::make_shared<ThreadPool>(nThreads);
+
+        if (eBackend == NPPF_BACKEND_NPP)
+        {
+            // the current device of the calling thread, each context gets its own stream
+            int nDevices = 0;
+            if (cudaGetDeviceCount(&nDevices) != cudaSuccess || nDevices == 0
+                || nppGetStreamContext(&pContext->oStreamContext) != NPP_SUCCESS
+                || cudaStreamCreateWithFlags(&pContext->hStream, cudaStreamNonBlocking) != cudaSuccess)
+            {
+                return NPPF_ERROR_DEVICE;
+            }
+            pContext->oStreamContext.hStream = pContext->hStream;
+            pContext->oStreamContext.nStreamFlags = cudaStreamNonBlocking;
+        }
+        *ppContext = pContext.release();
+        return NPPF_SUCCESS;
+    });
+}
+
+void nppf_context_destroy(nppf_context* pContext)
+{
+    if (pContext && pContext->hStream)
+    {
+        cudaStreamDestroy(pContext->hStream);
+    }
+    delete pContext;
+}
+
+nppf_status nppf_plan_create(nppf_context* pContext, const char* sFilter, nppf_border eBorder,
+    int nDepth, int nWidth, int nHeight, nppf_plan** ppPlan)
+{
+    if (!pContext || !sFilter || !*sFilter || !ppPlan || (eBorder != NPPF_BORDER_NONE && eBorder != NPPF_BORDER_REPLICATE)
+        || (nDepth != 8 && nDepth != 16 && nDepth != 32) || nWidth <= 0 || nHeight <= 0)
+    {
+        return NPPF_ERROR_INVALID_ARGUMENT;
+    }
+    *ppPlan = nullptr;
+    return guard([&]() {
+        std::unique_ptr<nppf_plan> pPlan(new nppf_plan);
+        pPlan->pContext = pContext;
+        pPlan->nDepth = nDepth;
+
+        // raw pixels of a given size and no file, like a shared memory job.
+        // A single filter is a one stage pipeline, which rejects unknown names and mask sizes
+        pPlan->oParameters.setThreadPool(pContext->pThreadPool);
+        pPlan->oParameters.setStreamContext(pContext->oStreamContext);
+        if (!pPlan->oParameters.setSharedPipeline(sFilter, eBorder == NPPF_BORDER_NONE ? "none" : "replicate",
+            pContext->eBackend == NPPF_BACKEND_NPP ? "npp" : "cpu", nWidth, nHeight, nDepth))
+        {
+            return NPPF_ERROR_INVALID_ARGUMENT;
+        }
+
+        // 8 bits images run on the device unless the cpu backend is selected
+        pPlan->bDevice = nDepth == 8 && pContext->eBackend == NPPF_BACKEND_NPP;
+        pPlan->pFilters.reset(new filters::Plan(pPlan->oParameters, nDepth, pPlan->bDevice));
+        if (pPlan->bDevice)
+        {
+            npp::ImageNPP_8u_C3(nWidth, nHeight).swap(pPlan->oDeviceSrc);
+            npp::ImageNPP_8u_C3(nWidth, nHeight).swap(pPlan->aDeviceDst[0]);
+            if (pPlan->pFilters->size() > 1)
+            {
+                npp::ImageNPP_8u_C3(nWidth, nHeight).swap(pPlan->aDeviceDst[1]);
+            }
+        }
+        *ppPlan = pPlan.release();
+        return NPPF_SUCCESS;
+    });
+}
+
+void nppf_plan_destroy(nppf_plan* pPlan)
+{
+    delete pPlan;
+}
+
+nppf_status nppf_plan_execute(nppf_plan* pPlan, const void* pSrc, size_t nSrcPitch, void* pDst, size_t nDstPitch)
+{
+    if (!pPlan || !pSrc || !pDst)
+    {
+        return NPPF_ERROR_INVALID_ARGUMENT;
+    }
+    const NppiSize& rSize = pPlan->oParameters.getSrcSize();
+    const size_t nSampleSize = pPlan->nDepth / 8;
+    const size_t nRowBytes = (size_t)rSize.width * 3 * nSampleSize;
+    if (nSrcPitch < nRowBytes || nDstPitch < nRowBytes || nSrcPitch % nSampleSize || nDstPitch % nSampleSize
+        || nSrcPitch > INT_MAX || nDstPitch > INT_MAX)
+    {
+        return NPPF_ERROR_INVALID_ARGUMENT;
+    }
+    // the filters read the neighbours of each pixel, the source must stay intact
+    const unsigned char* pSrcBegin = static_cast<const unsigned char*>(pSrc);
+    const unsigned char* pSrcEnd = pSrcBegin + nSrcPitch * (rSize.height - 1) + nRowBytes;
+    const unsigned char* pDstBegin = static_cast<const unsigned char*>(pDst);
+    const unsigned char* pDstEnd = pDstBegin + nDstPitch * (rSize.height - 1) + nRowBytes;
+    if (pSrcBegin < pDstEnd && pDstBegin < pSrcEnd)
+    {
+        return NPPF_ERROR_INVALID_ARGUMENT;
+    }
+
+    return guard([&]() {
+        if (pPlan->bDevice)
+        {
+            return executeOnDevice(*pPlan, pSrc, nSrcPitch, pDst, nDstPitch);
+        }
+        if (pPlan->nDepth == 16)
+        {
+            return executeOnHost<Npp16u>(*pPlan, pSrc, nSrcPitch, pDst, nDstPitch);
+        }
+        if (pPlan->nDepth == 32)
+        {
+            return executeOnHost<Npp32f>(*pPlan, pSrc, nSrcPitch, pDst, nDstPitch);
+        }
+        return executeOnHost<Npp8u>(*pPlan, pSrc, nSrcPitch, pDst, nDstPitch);
+    });
+}
\ No newline at end of file
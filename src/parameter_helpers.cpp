@@ -1,212 +1,996 @@
-#include <iostream>
-#include <vector>
-#include "parameter_helpers.h"
-#include "helper_string.h"
-
-std::string getFilterType(int argc, char* argv[])
-{
-    const std::vector<std::string> filterTypes = {
-    "box",
-    "sobel_h",
-    "sobel_v",
-    "roberts_up",
-    "roberts_down",
-    "laplace",
-    "gauss",
-    "highpass",
-    "lowpass",
-    "sharpen",
-    "wiener",
-    };
-
-    std::string sFilterType = filterTypes[0];
-
-    char* arg = nullptr;
-    if (checkCmdLineFlag(argc, (const char**)argv, "filter"))
-    {
-        getCmdLineArgumentString(argc, (const char**)argv, "filter", &arg);
-    }
-
-    if (arg)
-    {
-        sFilterType = arg;
-    }
-
-    if (std::find(filterTypes.begin(), filterTypes.end(), sFilterType) == filterTypes.end())
-    {
-        sFilterType = filterTypes[0];
-    }
-    return sFilterType;
-}
-
-std::string getBorderType(int argc, char* argv[]/*, const std::string& sFilterType*/)
-{
-    const std::vector<std::string> borderTypes = {
-    "none",
-    //"constant",
-    "replicate",
-    //"wrap",
-    //"mirror",
-    };
-
-    std::string sBorderType = borderTypes[1];
-
-    char* arg = nullptr;
-    if (checkCmdLineFlag(argc, (const char**)argv, "border"))
-    {
-        getCmdLineArgumentString(argc, (const char**)argv, "border", &arg);
-    }
-
-    if (arg)
-    {
-        sBorderType = arg;
-    }
-
-    if (std::find(borderTypes.begin(), borderTypes.end(), sBorderType) == borderTypes.end())
-    {
-        sBorderType = borderTypes[1];
-    }
-
-    return sBorderType;
-
-}
-
-NppiBorderType sBorderTypeToEnum(const std::string& sBorderType)
-{
-    if (sBorderType == "constant")
-    {
-        return NPP_BORDER_CONSTANT;
-    }
-    else if (sBorderType == "replicate")
-    {
-        return NPP_BORDER_REPLICATE;
-    }
-    else if (sBorderType == "wrap")
-    {
-        return NPP_BORDER_WRAP;
-    }
-    else if (sBorderType == "mirror")
-    {
-        return NPP_BORDER_MIRROR;
-    }
-    return NPP_BORDER_NONE;
-}
-
-std::string getInputFileName(int argc, char* argv[])
-{
-    char* arg = nullptr;
-    if (checkCmdLineFlag(argc, (const char**)argv, "input"))
-    {
-        getCmdLineArgumentString(argc, (const char**)argv, "input", &arg);
-    }
-    else
-    {
-        arg = sdkFindFilePath("Lena.png", argv[0]);
-    }
-
-    if (arg)
-    {
-        return arg;
-    }
-    return "Lena.png";
-}
-
-
-int Parameters::parseCmdLine(int argc, char* argv[])
-{
-    // Filter type
-    _sFilterType = ::getFilterType(argc, argv);
-
-    // Border type
-    _sBorderType = ::getBorderType(argc, argv);
-    _eBorderType = ::sBorderTypeToEnum(_sBorderType);
-
-    // check border / filter compatibility
-    if (!isFilterBorderCompatible())
-    {
-        return -1;
-    }
-
-    // input Filename
-    _sInputFile = ::getInputFileName(argc, argv);
-
-    // check if inputname file is valid
-    if (!isValidInputFilename())
-    {
-        return -2;
-    }
-
-    // output Filename
-    _sOutputFile = buildOutputFilename();
-    if (checkCmdLineFlag(argc, (const char**)argv, "output"))
-    {
-        char* outputFilePath;
-        getCmdLineArgumentString(argc, (const char**)argv, "output", &outputFilePath);
-        _sOutputFile = outputFilePath;
-    }
-
-    return 0;
-}
-
-
-void Parameters::setSrcSize(const NppiSize& oSize)
-{
-    _oSrcSize = oSize;
-}
-
-void Parameters::setSizeROI(const NppiSize& oSize)
-{
-    _oSizeROI = oSize;
-}
-
-bool Parameters::isFilterBorderCompatible() const
-{
-    bool compatible = true;
-    if (_sFilterType != "wiener") {
-        if (_sBorderType != "none" && _sBorderType != "replicate") {
-            std::cout << _sFilterType << " filter support none or replicate border mode" << std::endl;
-            compatible = false;
-        }
-    }
-    else {
-        if (_sBorderType != "replicate") {
-            std::cout << _sFilterType << " filter support replicate border mode" << std::endl;
-            compatible = false;
-        }
-    }
-    return compatible;
-}
-
-bool Parameters::isValidInputFilename() const
-{
-    std::ifstream infile(_sInputFile.data(), std::ifstream::in);
-    bool ok = infile.good();
-    if (ok)
-    {
-        std::cout << "npp-filters opened: <" << _sInputFile.data()
-            << "> successfully!" << std::endl;
-    }
-    else
-    {
-        std::cout << "npp-filters unable to open: <" << _sInputFile.data() << ">"
-            << std::endl;
-
-    }
-    infile.close();
-    return ok;
-}
-
-std::string Parameters::buildOutputFilename() const
-{
-    std::string sResultFilename = _sInputFile;
-
-    std::string::size_type dot = sResultFilename.rfind('.');
-
-    if (dot != std::string::npos)
-    {
-        sResultFilename = sResultFilename.substr(0, dot);
-    }
-
-    sResultFilename += "_filter_" + _sFilterType + "_" + _sBorderType + ".png";
-    return sResultFilename;
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include "parameter_helpers.h"
+#include "thread_pool.h"
+#include "result_cache.h"
+#include "stage_timings.h"
+#include "helper_string.h"
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <climits>
+#include <fstream>
+#include <filesystem>
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+// Value of --name=value or --name value, the name must match exactly where getCmdLineArgumentString
+// matches any argument starting with it (--output would match --output-format)
+const char* getCmdLineValue(int argc, char* argv[], const char* name)
+{
+    const char* value = nullptr;
+    const size_t length = strlen(name);
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i] + stringRemoveDelimiter('-', argv[i]);
+        if (STRNCASECMP(arg, name, length))
+        {
+            continue;
+        }
+        if (arg[length] == '=')
+        {
+            value = arg + length + 1;
+        }
+        else if (arg[length] == '\0' && i + 1 < argc && isCmdLineValue(argv[i + 1]))
+        {
+            value = argv[++i];
+        }
+    }
+    return value;
+}
+
+int getCmdLineInt(int argc, char* argv[], const char* name, int nDefault)
+{
+    const char* value = getCmdLineValue(argc, argv, name);
+    return value ? atoi(value) : nDefault;
+}
+
+bool isCmdLineValue(const char* arg)
+{
+    return arg[0] != '-' || !strcmp(arg, "-");
+}
+
+bool takesCmdLineValue(const std::string& rName)
+{
+    static const char* aNames[] = {
+        "anchor", "backend", "border", "cache-dir", "cache-size", "client", "command", "deadline", "decode-threads",
+        "depth", "encode-threads", "filter", "height", "input", "input-dir", "input-list", "jobs", "jpeg-quality",
+        "mask", "max-pixels", "noise", "output", "output-dir", "output-format", "output-pitch", "pipeline", "pitch",
+        "priority", "queue-depth", "roi", "serve", "strip-rows", "sweep", "synthetic", "threads", "timings-json",
+        "trace", "width" };
+    return std::find_if(std::begin(aNames), std::end(aNames), [&](const char* s) { return !STRCASECMP(rName.c_str(), s); }) != std::end(aNames);
+}
+
+std::vector<std::string> getFilterTypes(int argc, char* argv[])
+{
+    const std::vector<std::string>& filterTypes = getFilterNames();
+
+    std::string sFilterList = filterTypes[0];
+
+    const char* arg = getCmdLineValue(argc, argv, "filter");
+    if (arg)
+    {
+        sFilterList = arg;
+    }
+
+    // comma separated list, each filter is run on the same decoded image
+    std::vector<std::string> sFilterTypes = splitList(sFilterList, ',');
+    for (std::string& sFilterType : sFilterTypes)
+    {
+        if (std::find(filterTypes.begin(), filterTypes.end(), sFilterType) == filterTypes.end())
+        {
+            sFilterType = filterTypes[0];
+        }
+    }
+
+    return sFilterTypes;
+}
+
+// --pipeline="gauss:5|sharpen|sobel_h": filters applied one after the other, each with
+// an optional 3 or 5 mask size. Return false on an unknown filter or mask size
+bool getPipeline(int argc, char* argv[], std::vector<PipelineStage>& rStages, std::ostream& rOutput)
+{
+    const std::vector<std::string>& filterTypes = getFilterNames();
+
+    rStages.clear();
+    const char* arg = getCmdLineValue(argc, argv, "pipeline");
+    if (!arg)
+    {
+        return true;
+    }
+
+    const std::string sStage = parsePipeline(arg, rStages);
+    if (sStage.empty())
+    {
+        return true;
+    }
+    const std::string sFilterType = sStage.substr(0, sStage.find(':'));
+    if (std::find(filterTypes.begin(), filterTypes.end(), sFilterType) == filterTypes.end())
+    {
+        rOutput << "npp-filters unknown pipeline filter: <" << sFilterType << ">" << std::endl;
+    }
+    else
+    {
+        rOutput << "npp-filters pipeline mask size must be 3 or 5: <" << sStage << ">" << std::endl;
+    }
+    return false;
+}
+
+// Values of one --sweep dimension: a single value or first..last:step
+template<typename T>
+static bool getSweepRange(const std::string& rRange, T nDefaultStep, std::vector<T>& rValues)
+{
+    rValues.clear();
+    const std::string::size_type dots = rRange.find("..");
+    if (dots == std::string::npos)
+    {
+        char* end = nullptr;
+        const double nValue = strtod(rRange.c_str(), &end);
+        rValues.push_back((T)nValue);
+        return end != rRange.c_str() && *end == 0;
+    }
+
+    const std::string::size_type colon = rRange.find(':', dots);
+    const std::string sFirst = rRange.substr(0, dots);
+    char* end = nullptr;
+    const double nFirst = strtod(sFirst.c_str(), &end);
+    if (sFirst.empty() || *end != 0)
+    {
+        return false;
+    }
+    const std::string sLast = rRange.substr(dots + 2, colon == std::string::npos ? std::string::npos : colon - dots - 2);
+    const double nLast = strtod(sLast.c_str(), &end);
+    if (sLast.empty() || *end != 0)
+    {
+        return false;
+    }
+    double nStep = (double)nDefaultStep;
+    if (colon != std::string::npos)
+    {
+        nStep = strtod(rRange.c_str() + colon + 1, &end);
+        if (*end != 0)
+        {
+            return false;
+        }
+    }
+    if (nStep <= 0.0 || nLast < nFirst)
+    {
+        return false;
+    }
+    // computed from the first value, not accumulated, so 0.1 steps land on the last value
+    const int nValues = (int)std::floor((nLast - nFirst) / nStep + 1e-6) + 1;
+    for (int i = 0; i < nValues; ++i)
+    {
+        rValues.push_back((T)(nFirst + i * nStep));
+    }
+    return true;
+}
+
+// --sweep="mask=3..31:2,noise=0.1..0.9:0.1": grid of box and wiener mask sizes and
+// noise levels, a missing dimension keeps its default. Return false on a malformed range
+bool getSweep(int argc, char* argv[], std::vector<int>& rMasks, std::vector<Npp32f>& rNoises, std::ostream& rOutput)
+{
+    rMasks.clear();
+    rNoises.clear();
+    const char* arg = getCmdLineValue(argc, argv, "sweep");
+    if (!arg)
+    {
+        return true;
+    }
+
+    for (const std::string& sDimension : splitList(arg, ','))
+    {
+        const std::string::size_type equal = sDimension.find('=');
+        const std::string sName = sDimension.substr(0, equal);
+        const std::string sRange = equal == std::string::npos ? "" : sDimension.substr(equal + 1);
+        bool ok = false;
+        if (sName == "mask")
+        {
+            ok = getSweepRange(sRange, 2, rMasks)
+                && std::all_of(rMasks.begin(), rMasks.end(), [](int n) { return n >= 1 && n <= 255; });
+        }
+        else if (sName == "noise")
+        {
+            ok = getSweepRange(sRange, 0.1f, rNoises)
+                && std::all_of(rNoises.begin(), rNoises.end(), [](Npp32f n) { return n >= 0.0f && n <= 1.0f; });
+        }
+        if (!ok)
+        {
+            rOutput << "npp-filters --sweep takes mask=first..last:step (1 to 255) and noise=first..last:step (0 to 1): <" << sDimension << ">" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Numbers of a cSeparator separated list, false unless every item is a number
+static bool getNumbers(const std::string& rList, char cSeparator, std::vector<double>& rNumbers)
+{
+    rNumbers.clear();
+    for (const std::string& sItem : splitList(rList, cSeparator))
+    {
+        char* end = nullptr;
+        rNumbers.push_back(strtod(sItem.c_str(), &end));
+        if (sItem.empty() || *end != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isWhole(double nValue, double nMin, double nMax)
+{
+    return nValue == std::floor(nValue) && nValue >= nMin && nValue <= nMax;
+}
+
+// --mask=5 or --mask=7x3: box and wiener mask of 1 to 255 pixels, the laplace, gauss, highpass
+// and lowpass masks are 3x3 or 5x5. rMask is unchanged without --mask, false when malformed
+bool getMaskSize(int argc, char* argv[], NppiSize& rMask, std::ostream& rOutput)
+{
+    const char* arg = getCmdLineValue(argc, argv, "mask");
+    if (!arg)
+    {
+        return true;
+    }
+    std::vector<double> aSize;
+    if (!getNumbers(arg, strchr(arg, 'x') ? 'x' : ',', aSize) || aSize.size() > 2
+        || !std::all_of(aSize.begin(), aSize.end(), [](double n) { return isWhole(n, 1, 255); }))
+    {
+        rOutput << "npp-filters --mask takes a size or WIDTHxHEIGHT, 1 to 255 pixels: <" << arg << ">" << std::endl;
+        return false;
+    }
+    rMask = { (int)aSize.front(), (int)aSize.back() };
+    return true;
+}
+
+// --anchor=x,y: the mask pixel over the destination pixel, the mask center by default
+bool getAnchor(int argc, char* argv[], const NppiSize& rMask, NppiPoint& rAnchor, std::ostream& rOutput)
+{
+    rAnchor = { rMask.width / 2, rMask.height / 2 };
+    const char* arg = getCmdLineValue(argc, argv, "anchor");
+    if (!arg)
+    {
+        return true;
+    }
+    std::vector<double> aAnchor;
+    if (!getNumbers(arg, ',', aAnchor) || aAnchor.size() != 2
+        || !isWhole(aAnchor[0], 0, rMask.width - 1) || !isWhole(aAnchor[1], 0, rMask.height - 1))
+    {
+        rOutput << "npp-filters --anchor takes x,y inside the " << rMask.width << "x" << rMask.height << " mask: <" << arg << ">" << std::endl;
+        return false;
+    }
+    rAnchor = { (int)aAnchor[0], (int)aAnchor[1] };
+    return true;
+}
+
+// --noise=0.1 or --noise=0.1,0.2,0.3: wiener noise level of all the channels or of each one,
+// relative to the sample range
+bool getNoise(int argc, char* argv[], Npp32f* pNoise, std::ostream& rOutput)
+{
+    const char* arg = getCmdLineValue(argc, argv, "noise");
+    if (!arg)
+    {
+        return true;
+    }
+    std::vector<double> aNoise;
+    if (!getNumbers(arg, ',', aNoise) || (aNoise.size() != 1 && aNoise.size() != 3)
+        || !std::all_of(aNoise.begin(), aNoise.end(), [](double n) { return n >= 0.0 && n <= 1.0; }))
+    {
+        rOutput << "npp-filters --noise takes one level or one per channel, 0 to 1: <" << arg << ">" << std::endl;
+        return false;
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        pNoise[c] = (Npp32f)aNoise[aNoise.size() == 3 ? c : 0];
+    }
+    return true;
+}
+
+// --roi=x,y,width,height: rectangle filtered and saved, rSize stays 0 x 0 (the whole image)
+// without --roi. It is checked against each image once opened
+bool getROI(int argc, char* argv[], NppiPoint& rOffset, NppiSize& rSize, std::ostream& rOutput)
+{
+    rOffset = { 0, 0 };
+    rSize = { 0, 0 };
+    const char* arg = getCmdLineValue(argc, argv, "roi");
+    if (!arg)
+    {
+        return true;
+    }
+    std::vector<double> aROI;
+    if (!getNumbers(arg, ',', aROI) || aROI.size() != 4 || !isWhole(aROI[0], 0, INT_MAX) || !isWhole(aROI[1], 0, INT_MAX)
+        || !isWhole(aROI[2], 1, INT_MAX) || !isWhole(aROI[3], 1, INT_MAX))
+    {
+        rOutput << "npp-filters --roi takes x,y,width,height: <" << arg << ">" << std::endl;
+        return false;
+    }
+    rOffset = { (int)aROI[0], (int)aROI[1] };
+    rSize = { (int)aROI[2], (int)aROI[3] };
+    return true;
+}
+
+std::string getBorderType(int argc, char* argv[]/*, const std::string& sFilterType*/)
+{
+    const std::vector<std::string> borderTypes = {
+    "none",
+    //"constant",
+    "replicate",
+    //"wrap",
+    //"mirror",
+    };
+
+    std::string sBorderType = borderTypes[1];
+
+    const char* arg = getCmdLineValue(argc, argv, "border");
+    if (arg)
+    {
+        sBorderType = arg;
+    }
+
+    if (std::find(borderTypes.begin(), borderTypes.end(), sBorderType) == borderTypes.end())
+    {
+        sBorderType = borderTypes[1];
+    }
+
+    return sBorderType;
+
+}
+
+std::string getInputFileName(int argc, char* argv[])
+{
+    const char* arg = getCmdLineValue(argc, argv, "input");
+    if (!arg)
+    {
+        arg = sdkFindFilePath("Lena.png", argv[0]);
+    }
+
+    if (arg)
+    {
+        return arg;
+    }
+    return "Lena.png";
+}
+
+
+std::vector<std::string> getProbeFilenames(int argc, char* argv[])
+{
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        // the value of a --name value option isn't a file to probe
+        const char* previous = argv[i - 1];
+        const bool bValue = i > 1 && previous[0] == '-' && !strchr(previous, '=') && takesCmdLineValue(previous + stringRemoveDelimiter('-', previous));
+        if (argv[i][0] != '-' && !bValue)
+        {
+            files.push_back(argv[i]);
+        }
+    }
+
+    const char* arg = getCmdLineValue(argc, argv, "input");
+    if (arg && std::find(files.begin(), files.end(), std::string(arg)) == files.end())
+    {
+        files.insert(files.begin(), arg);
+    }
+    return files;
+}
+
+// '*' and '?' wildcards, '*' never matches a path separator
+bool matchWildcard(const char* pattern, const char* name)
+{
+    if (*pattern == '\0')
+    {
+        return *name == '\0';
+    }
+    if (*pattern == '*')
+    {
+        for (const char* p = name; ; ++p)
+        {
+            if (matchWildcard(pattern + 1, p))
+            {
+                return true;
+            }
+            if (*p == '\0' || *p == '/' || *p == '\\')
+            {
+                return false;
+            }
+        }
+    }
+    if (*name != '\0' && (*pattern == '?' || *pattern == *name))
+    {
+        return matchWildcard(pattern + 1, name + 1);
+    }
+    return false;
+}
+
+bool hasImageExtension(const std::filesystem::path& rPath)
+{
+    static const std::vector<std::string> extensions = {
+        ".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif", ".psd", ".hdr", ".pic", ".ppm", ".pgm", ".pnm",
+    };
+    std::string sExtension = rPath.extension().string();
+    std::transform(sExtension.begin(), sExtension.end(), sExtension.begin(),
+        [](unsigned char c) { return (char)tolower(c); });
+    return std::find(extensions.begin(), extensions.end(), sExtension) != extensions.end();
+}
+
+// Regular files of rDirectory whose name matches sPattern, sorted
+void listDirectory(const std::string& rDirectory, const std::string& sPattern, std::vector<std::string>& rFiles)
+{
+    std::vector<std::string> files;
+    std::error_code error;
+    for (const auto& rEntry : std::filesystem::directory_iterator(rDirectory.empty() ? "." : rDirectory, error))
+    {
+        const std::string sName = rEntry.path().filename().string();
+        if (rEntry.is_regular_file(error) && (sPattern.empty() ? hasImageExtension(rEntry.path()) : matchWildcard(sPattern.c_str(), sName.c_str())))
+        {
+            files.push_back(rDirectory.empty() ? sName : (std::filesystem::path(rDirectory) / sName).string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    rFiles.insert(rFiles.end(), files.begin(), files.end());
+}
+
+int getThreads(int argc, char* argv[])
+{
+    const char* arg = getCmdLineValue(argc, argv, "threads");
+    return arg ? std::max(atoi(arg), 1) : 0;
+}
+
+std::shared_ptr<ResultCache> getResultCache(int argc, char* argv[])
+{
+    const char* cacheDir = getCmdLineValue(argc, argv, "cache-dir");
+    if (!cacheDir)
+    {
+        return nullptr;
+    }
+    const char* cacheSize = getCmdLineValue(argc, argv, "cache-size");
+    const size_t nMegaBytes = cacheSize ? (size_t)strtoull(cacheSize, nullptr, 10) : 1024;
+    return std::make_shared<ResultCache>(cacheDir, nMegaBytes << 20);
+}
+
+std::shared_ptr<StageTimings> getStageTimings(int argc, char* argv[])
+{
+    const char* jsonFile = getCmdLineValue(argc, argv, "timings-json");
+    if (jsonFile)
+    {
+        return std::make_shared<StageTimings>(jsonFile);
+    }
+    if (checkCmdLineFlag(argc, (const char**)argv, "timings-json"))
+    {
+        return std::make_shared<StageTimings>("timings.json");
+    }
+    if (checkCmdLineFlag(argc, (const char**)argv, "timings"))
+    {
+        return std::make_shared<StageTimings>("");
+    }
+    return nullptr;
+}
+
+bool getBatchFilenames(int argc, char* argv[], std::vector<std::string>& rFiles, std::ostream& rOutput)
+{
+    rFiles.clear();
+
+    // one file name per line, "-" reads the list from stdin
+    if (const char* list = getCmdLineValue(argc, argv, "input-list"))
+    {
+        std::ifstream oList;
+        std::istream* pList = &std::cin;
+        if (std::string(list) != "-")
+        {
+            oList.open(list);
+            if (!oList)
+            {
+                rOutput << "npp-filters unable to open: <" << list << ">" << std::endl;
+                return false;
+            }
+            pList = &oList;
+        }
+        std::string sLine;
+        while (std::getline(*pList, sLine))
+        {
+            if (!sLine.empty() && sLine.back() == '\r')
+            {
+                sLine.pop_back();
+            }
+            if (!sLine.empty() && sLine[0] != '#')
+            {
+                rFiles.push_back(sLine);
+            }
+        }
+    }
+
+    // every image of a directory
+    if (const char* directory = getCmdLineValue(argc, argv, "input-dir"))
+    {
+        if (!std::filesystem::is_directory(directory))
+        {
+            rOutput << "npp-filters not a directory: <" << directory << ">" << std::endl;
+            return false;
+        }
+        listDirectory(directory, "", rFiles);
+    }
+
+    // wildcards in the file name part of --input
+    const char* input = getCmdLineValue(argc, argv, "input");
+    if (input && strpbrk(input, "*?"))
+    {
+        const std::string sInput = input;
+        const std::string::size_type slash = sInput.find_last_of("/\\");
+        const std::string sDirectory = slash == std::string::npos ? "" : sInput.substr(0, slash);
+        const std::string sPattern = slash == std::string::npos ? sInput : sInput.substr(slash + 1);
+        if (strpbrk(sDirectory.c_str(), "*?"))
+        {
+            rOutput << "npp-filters wildcards are only supported in the file name: <" << input << ">" << std::endl;
+            return false;
+        }
+        listDirectory(sDirectory, sPattern, rFiles);
+        if (rFiles.empty())
+        {
+            rOutput << "npp-filters no file matches: <" << input << ">" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool writesToStandardOutput(int argc, char* argv[])
+{
+    const char* output = getCmdLineValue(argc, argv, "output");
+    if (output)
+    {
+        return std::string(output) == "-";
+    }
+    const char* input = getCmdLineValue(argc, argv, "input");
+    return input && std::string(input) == "-";
+}
+
+std::string getBackend(int argc, char* argv[])
+{
+    const char* arg = getCmdLineValue(argc, argv, "backend");
+    if (arg && std::string(arg) == "cpu")
+    {
+        return "cpu";
+    }
+    return "npp";
+}
+
+size_t getMaxPixels(int argc, char* argv[])
+{
+    const char* arg = getCmdLineValue(argc, argv, "max-pixels");
+    return arg ? (size_t)strtoull(arg, nullptr, 10) : 0;
+}
+
+
+int Parameters::parseCmdLine(int argc, char* argv[])
+{
+    // Filter types, a pipeline is a single chained filter
+    if (!::getPipeline(argc, argv, _aPipeline, getOutput()))
+    {
+        return -2;
+    }
+    if (!_aPipeline.empty() && checkCmdLineFlag(argc, (const char**)argv, "filter"))
+    {
+        getOutput() << "npp-filters --pipeline and --filter can't be used together" << std::endl;
+        return -2;
+    }
+    _bFusion = !checkCmdLineFlag(argc, (const char**)argv, "no-fusion");
+    _aFilterTypes = _aPipeline.empty() ? ::getFilterTypes(argc, argv) : std::vector<std::string>{ getPipelineName() };
+    _sFilterType = _aPipeline.empty() ? _aFilterTypes[0] : _aPipeline[0].sFilterType;
+
+    // Border type
+    _sBorderType = ::getBorderType(argc, argv);
+    _eBorderType = ::sBorderTypeToEnum(_sBorderType);
+
+    // Filter backend
+    _sBackend = ::getBackend(argc, argv);
+
+    // check border / filter compatibility
+    if (!isFilterBorderCompatible(true))
+    {
+        return -1;
+    }
+
+    // mask, anchor and noise of the box and wiener filters, mask size of the fixed mask filters
+    if (!::getMaskSize(argc, argv, _oMaskSize, getOutput()) || !::getAnchor(argc, argv, _oMaskSize, _oAnchor, getOutput()) || !::getNoise(argc, argv, _aNoise, getOutput()))
+    {
+        return -2;
+    }
+    const bool b3x3 = _oMaskSize.width == 3 && _oMaskSize.height == 3;
+    const bool b5x5 = _oMaskSize.width == 5 && _oMaskSize.height == 5;
+    _eNppiMaskSize = b3x3 ? NPP_MASK_SIZE_3_X_3 : NPP_MASK_SIZE_5_X_5;
+    if (!b3x3 && !b5x5)
+    {
+        static const char* aFixedMasks[] = { "laplace", "gauss", "highpass", "lowpass" };
+        for (size_t i = 0; i < (isPipeline() ? _aPipeline.size() : _aFilterTypes.size()); ++i)
+        {
+            const std::string& sFilterType = isPipeline() ? _aPipeline[i].sFilterType : _aFilterTypes[i];
+            if ((!isPipeline() || !_aPipeline[i].nMaskSize) && std::find(std::begin(aFixedMasks), std::end(aFixedMasks), sFilterType) != std::end(aFixedMasks))
+            {
+                getOutput() << "npp-filters " << sFilterType << " masks are 3x3 or 5x5: <" << getCmdLineValue(argc, argv, "mask") << ">" << std::endl;
+                return -2;
+            }
+        }
+    }
+
+    // rectangle of each image filtered and saved
+    if (!::getROI(argc, argv, _oROIOffset, _oROISize, getOutput()))
+    {
+        return -2;
+    }
+    if (hasROI() && (isPipeline() || checkCmdLineFlag(argc, (const char**)argv, "stream")
+        || checkCmdLineFlag(argc, (const char**)argv, "sweep") || checkCmdLineFlag(argc, (const char**)argv, "shared")))
+    {
+        getOutput() << "npp-filters --roi filters a --filter list, without --pipeline, --stream, --sweep or --shared" << std::endl;
+        return -2;
+    }
+
+    _nMaxPixels = ::getMaxPixels(argc, argv);
+
+    // output format: --output-format, else the output extension,
+    // else the input format for the standard output, else png
+    if (const char* outputFormat = getCmdLineValue(argc, argv, "output-format"))
+    {
+        if (!stb::formatFromName(outputFormat, _eOutputFormat))
+        {
+            getOutput() << "npp-filters unsupported output format: <" << outputFormat << ">" << std::endl;
+            return -2;
+        }
+        _bOutputFormat = true;
+    }
+
+    // strip streaming, the cpu kernels filter each strip, only png and pnm are written incrementally
+    _bStream = checkCmdLineFlag(argc, (const char**)argv, "stream");
+    if (_bStream && isPipeline())
+    {
+        getOutput() << "npp-filters --stream filters each strip with a single filter, --pipeline is not supported" << std::endl;
+        return -2;
+    }
+    _nStripRows = std::max(getCmdLineInt(argc, argv, "strip-rows", _nStripRows), 1);
+
+    // jpeg encoder quality
+    _nJpegQuality = std::clamp(getCmdLineInt(argc, argv, "jpeg-quality", _nJpegQuality), 1, 100);
+
+    // cpu filter threads, created once for all the images
+    if (!_pThreadPool)
+    {
+        _pThreadPool = std::make_shared<ThreadPool>(::getThreads(argc, argv));
+    }
+
+    // result cache shared by the images of the run
+    if (!_pResultCache)
+    {
+        _pResultCache = ::getResultCache(argc, argv);
+    }
+
+    // step timings summed over the images of the run
+    if (!_pStageTimings)
+    {
+        _pStageTimings = ::getStageTimings(argc, argv);
+    }
+
+    // batch executor stages
+    _nDecodeThreads = std::max(getCmdLineInt(argc, argv, "decode-threads", _nDecodeThreads), 1);
+    _nEncodeThreads = std::max(getCmdLineInt(argc, argv, "encode-threads", _nEncodeThreads), 1);
+    _nQueueDepth = std::max(getCmdLineInt(argc, argv, "queue-depth", _nQueueDepth), 1);
+
+    if (const char* outputDir = getCmdLineValue(argc, argv, "output-dir"))
+    {
+        _sOutputDir = outputDir;
+    }
+    if (const char* outputFilePath = getCmdLineValue(argc, argv, "output"))
+    {
+        _sOutputArgument = outputFilePath;
+    }
+
+    // grid of mask sizes and noise levels filtered from one decoded image
+    _bSweep = checkCmdLineFlag(argc, (const char**)argv, "sweep");
+    if (_bSweep)
+    {
+        if (!::getSweep(argc, argv, _aSweepMasks, _aSweepNoises, getOutput()))
+        {
+            return -2;
+        }
+        const bool bSweepFilters = std::all_of(_aFilterTypes.begin(), _aFilterTypes.end(),
+            [](const std::string& sFilterType) { return sFilterType == "box" || sFilterType == "wiener"; });
+        if (!bSweepFilters || isPipeline() || _bStream)
+        {
+            getOutput() << "npp-filters --sweep runs a box and wiener --filter list, without --pipeline or --stream" << std::endl;
+            return -2;
+        }
+        if (_aSweepMasks.empty())
+        {
+            _aSweepMasks.push_back(_oMaskSize.width);
+        }
+        _bSweepStatistics = checkCmdLineFlag(argc, (const char**)argv, "sweep-stats");
+    }
+
+    // raw image in the memory of a --serve client
+    if (checkCmdLineFlag(argc, (const char**)argv, "shared"))
+    {
+        return openSharedInput(argc, argv);
+    }
+
+    // image generated in memory instead of an input file
+    if (const char* synthetic = getCmdLineValue(argc, argv, "synthetic"))
+    {
+        return openSyntheticInput(synthetic, argc, argv);
+    }
+
+    // batch of inputs, each one is opened later by openInput()
+    if (!::getBatchFilenames(argc, argv, _aInputFiles, getOutput()))
+    {
+        return -2;
+    }
+    if (!_aInputFiles.empty())
+    {
+        if (_bSweep)
+        {
+            getOutput() << "npp-filters --sweep filters a single --input" << std::endl;
+            return -2;
+        }
+        if (!_sOutputArgument.empty())
+        {
+            getOutput() << "npp-filters --output names a single image, use --output-dir with several inputs" << std::endl;
+            return -2;
+        }
+        return 0;
+    }
+
+    // several filters write one file each, named after the input
+    if (_aFilterTypes.size() > 1 && (!_sOutputArgument.empty() || getInputFileName(argc, argv) == "-"))
+    {
+        getOutput() << "npp-filters several filters need an input file and no --output, use --output-dir" << std::endl;
+        return -2;
+    }
+    if (_bSweep && !_bSweepStatistics && (!_sOutputArgument.empty() || getInputFileName(argc, argv) == "-"))
+    {
+        getOutput() << "npp-filters --sweep writes one file per point named after the input, use --output-dir or --sweep-stats" << std::endl;
+        return -2;
+    }
+
+    // map the input file once, its header is probed and the pixels later decoded from the same mapping
+    return openInput(::getInputFileName(argc, argv));
+}
+
+int Parameters::openInput(const std::string& rFileName)
+{
+    _sInputFile = rFileName;
+    _bSharedInput = false;
+    _bSyntheticInput = false;
+    _pInputFile.reset();
+    _pInputStream.reset();
+    if (!openInputFile())
+    {
+        return -2;
+    }
+    return nameOutputs();
+}
+
+int Parameters::nameOutputs()
+{
+    if (!setImageSize({ _oInputInfo.nWidth, _oInputInfo.nHeight }))
+    {
+        getOutput() << "npp-filters --roi " << _oROIOffset.x << "," << _oROIOffset.y << "," << _oROISize.width << "," << _oROISize.height
+            << " is outside <" << _sInputFile << "> " << _oInputInfo.nWidth << "x" << _oInputInfo.nHeight << std::endl;
+        return -2;
+    }
+
+    // output Filenames, a stdin input is written to stdout by default
+    _aOutputFiles.clear();
+    for (const std::string& sFilterType : _aFilterTypes)
+    {
+        _aOutputFiles.push_back(!_sOutputArgument.empty() ? _sOutputArgument : isInputStream() ? "-" : buildOutputFilename(sFilterType));
+    }
+    _sFilterType = isPipeline() ? _aPipeline[0].sFilterType : _aFilterTypes[0];
+    _sOutputFile = _aOutputFiles[0];
+
+    if (!_bOutputFormat)
+    {
+        _eOutputFormat = stb::ImageFormat::png;
+        if (!stb::formatFromFilename(_sOutputFile, _eOutputFormat) && _sOutputFile == "-")
+        {
+            stb::formatFromName(_oInputInfo.sFormat, _eOutputFormat);
+        }
+    }
+
+    if (_bStream && (_oInputInfo.nBitsPerChannel == 32
+        || (_eOutputFormat != stb::ImageFormat::png && _eOutputFormat != stb::ImageFormat::pnm)))
+    {
+        getOutput() << "npp-filters --stream supports 8 and 16 bits images written to png or pnm" << std::endl;
+        return -2;
+    }
+    return 0;
+}
+
+
+
+Parameters Parameters::forSweep(size_t iFilter, int nMaskSize, const Npp32f* pNoise) const
+{
+    Parameters parameters = forFilter(iFilter);
+    parameters._oMaskSize = { nMaskSize, nMaskSize };
+    parameters._oAnchor = { nMaskSize / 2, nMaskSize / 2 };
+    std::string sPoint = parameters._sFilterType + "_mask" + std::to_string(nMaskSize);
+    if (pNoise)
+    {
+        std::copy(pNoise, pNoise + 3, parameters._aNoise);
+        char aNoise[32];
+        snprintf(aNoise, sizeof(aNoise), "_noise%g", pNoise[0]);
+        sPoint += aNoise;
+    }
+    parameters._sOutputFile = isInputStream() ? "-" : buildOutputFilename(sPoint);
+    return parameters;
+}
+
+bool Parameters::openInputFile()
+{
+    bool ok = true;
+    if (_sInputFile == "-")
+    {
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        _pInputStream = std::make_shared<stb::StreamReader>(stdin, _sInputFile);
+    }
+    else
+    {
+        _pInputFile = std::make_shared<MappedFile>();
+        ok = _pInputFile->open(_sInputFile);
+    }
+    if (ok && !(isInputStream() ? stb::probeImage(*_pInputStream, _oInputInfo) : stb::probeImage(*_pInputFile, _oInputInfo)))
+    {
+        if (!isInputStream() && _pInputFile->size() > stb::nMaxDecodeSize)
+        {
+            getOutput() << "npp-filters <" << _sInputFile.data() << "> is over 2 GiB, only binary pnm (P5/P6) files are read past that size"
+                << std::endl;
+        }
+        else
+        {
+            getOutput() << "npp-filters unsupported image format: <" << _sInputFile.data() << ">"
+                << std::endl;
+        }
+        return false;
+    }
+    // admission control, reject oversized images before any pixel memory is committed
+    if (ok && _nMaxPixels && _oInputInfo.pixels() > _nMaxPixels)
+    {
+        getOutput() << "npp-filters rejected: <" << _sInputFile.data() << "> " << _oInputInfo.nWidth << "x"
+            << _oInputInfo.nHeight << " exceeds " << _nMaxPixels << " pixels" << std::endl;
+        return false;
+    }
+    if (ok)
+    {
+        getOutput() << "npp-filters opened: <" << _sInputFile.data()
+            << "> successfully!" << std::endl;
+    }
+    else
+    {
+        getOutput() << "npp-filters unable to open: <" << _sInputFile.data() << ">"
+            << std::endl;
+
+    }
+    return ok;
+}
+
+int Parameters::openSharedInput(int argc, char* argv[])
+{
+    _bSharedInput = true;
+    _oInputInfo = stb::ImageInfo();
+    _oInputInfo.sFileName = "shared";
+    _oInputInfo.sFormat = "raw";
+    _oInputInfo.nChannels = 3;
+    _oInputInfo.nWidth = getCmdLineInt(argc, argv, "width", 0);
+    _oInputInfo.nHeight = getCmdLineInt(argc, argv, "height", 0);
+    _oInputInfo.nBitsPerChannel = getCmdLineInt(argc, argv, "depth", 8);
+    if (_oInputInfo.nWidth <= 0 || _oInputInfo.nHeight <= 0)
+    {
+        getOutput() << "npp-filters --shared images need a --width and a --height" << std::endl;
+        return -2;
+    }
+    if (_oInputInfo.nBitsPerChannel != 8 && _oInputInfo.nBitsPerChannel != 16 && _oInputInfo.nBitsPerChannel != 32)
+    {
+        getOutput() << "npp-filters --shared images have a --depth of 8, 16 or 32 (float) bits" << std::endl;
+        return -2;
+    }
+    // one result buffer, filtered in memory
+    if (_aFilterTypes.size() > 1 || _bStream)
+    {
+        getOutput() << "npp-filters --shared images are filtered by a single --filter or --pipeline, without --stream" << std::endl;
+        return -2;
+    }
+    if (_nMaxPixels && _oInputInfo.pixels() > _nMaxPixels)
+    {
+        getOutput() << "npp-filters rejected: <shared> " << _oInputInfo.nWidth << "x"
+            << _oInputInfo.nHeight << " exceeds " << _nMaxPixels << " pixels" << std::endl;
+        return -2;
+    }
+
+    _sInputFile = _oInputInfo.sFileName;
+    _sOutputFile.clear();
+    _aOutputFiles.assign(1, _sOutputFile);
+    _oSrcOffset = { 0, 0 };
+    _oSrcSize = { _oInputInfo.nWidth, _oInputInfo.nHeight };
+    _oSizeROI = _oSrcSize;
+    return 0;
+}
+
+int Parameters::openSyntheticInput(const char* sSpec, int argc, char* argv[])
+{
+    synthetic::Spec oSpec;
+    if (!synthetic::parseSpec(sSpec, oSpec))
+    {
+        getOutput() << "npp-filters --synthetic takes WIDTHxHEIGHT:pattern, 1 to " << synthetic::nMaxSize
+            << " pixels wide and high, patterns noise, gradient, checkerboard, constant or natural: <" << sSpec << ">" << std::endl;
+        return -2;
+    }
+    _bSyntheticInput = true;
+    _eSyntheticPattern = oSpec.ePattern;
+    _pInputFile.reset();
+    _pInputStream.reset();
+    _oInputInfo = stb::ImageInfo();
+    _oInputInfo.sFileName = "synthetic_" + std::to_string(oSpec.nWidth) + "x" + std::to_string(oSpec.nHeight) + "_" + synthetic::name(oSpec.ePattern);
+    _oInputInfo.sFormat = "synthetic";
+    _oInputInfo.nChannels = 3;
+    _oInputInfo.nWidth = oSpec.nWidth;
+    _oInputInfo.nHeight = oSpec.nHeight;
+    _oInputInfo.nBitsPerChannel = getCmdLineInt(argc, argv, "depth", 8);
+    if (_oInputInfo.nBitsPerChannel != 8 && _oInputInfo.nBitsPerChannel != 16 && _oInputInfo.nBitsPerChannel != 32)
+    {
+        getOutput() << "npp-filters --synthetic images have a --depth of 8, 16 or 32 (float) bits" << std::endl;
+        return -2;
+    }
+    // generated whole, the strip streaming reads files
+    if (_bStream)
+    {
+        getOutput() << "npp-filters --synthetic images are generated whole, without --stream" << std::endl;
+        return -2;
+    }
+    if (_nMaxPixels && _oInputInfo.pixels() > _nMaxPixels)
+    {
+        getOutput() << "npp-filters rejected: <" << _oInputInfo.sFileName << "> " << _oInputInfo.nWidth << "x"
+            << _oInputInfo.nHeight << " exceeds " << _nMaxPixels << " pixels" << std::endl;
+        return -2;
+    }
+
+    // outputs named after the image, in the current directory or --output-dir
+    _sInputFile = _oInputInfo.sFileName;
+    return nameOutputs();
+}
+
+std::string Parameters::buildOutputFilename(const std::string& sFilterType) const
+{
+    std::string sResultFilename = _sInputFile;
+    std::string sExtension = ".png";
+
+    std::string::size_type dot = sResultFilename.rfind('.');
+
+    if (dot != std::string::npos)
+    {
+        // keep the input extension when there is an encoder for it
+        stb::ImageFormat eFormat;
+        if (stb::formatFromFilename(sResultFilename, eFormat))
+        {
+            sExtension = sResultFilename.substr(dot);
+        }
+        sResultFilename = sResultFilename.substr(0, dot);
+    }
+
+    sResultFilename += "_filter_" + sFilterType + "_" + _sBorderType + sExtension;
+
+    // --output-dir keeps the file name only
+    if (!_sOutputDir.empty())
+    {
+        std::string::size_type slash = sResultFilename.find_last_of("/\\");
+        if (slash != std::string::npos)
+        {
+            sResultFilename = sResultFilename.substr(slash + 1);
+        }
+        sResultFilename = _sOutputDir + "/" + sResultFilename;
+    }
+    return sResultFilename;
 }
\ No newline at end of file
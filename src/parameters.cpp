@@ -0,0 +1,223 @@
+// Parameters without files: the filter names, the pipeline stages and the members the filters read.
+// libnppfilters builds on these alone, the command line, inputs and outputs are in parameter_helpers.cpp
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include "parameter_helpers.h"
+
+const std::vector<std::string>& getFilterNames()
+{
+    static const std::vector<std::string> filterTypes = {
+    "box",
+    "sobel_h",
+    "sobel_v",
+    "roberts_up",
+    "roberts_down",
+    "laplace",
+    "gauss",
+    "highpass",
+    "lowpass",
+    "sharpen",
+    "wiener",
+    };
+    return filterTypes;
+}
+
+// Items of a cSeparator separated list, empty items included
+std::vector<std::string> splitList(const std::string& rList, char cSeparator)
+{
+    std::vector<std::string> items;
+    std::string::size_type begin = 0;
+    do
+    {
+        std::string::size_type end = rList.find(cSeparator, begin);
+        items.push_back(rList.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+        begin = end == std::string::npos ? end : end + 1;
+    } while (begin != std::string::npos);
+    return items;
+}
+
+// Stages of a "gauss:5|sharpen|sobel_h" pipeline, each with an optional 3 or 5 mask size.
+// Return the first stage naming an unknown filter or mask size, empty when all are valid
+std::string parsePipeline(const std::string& rList, std::vector<PipelineStage>& rStages)
+{
+    const std::vector<std::string>& filterTypes = getFilterNames();
+
+    rStages.clear();
+    for (const std::string& sStage : splitList(rList, '|'))
+    {
+        PipelineStage oStage;
+        std::string::size_type colon = sStage.find(':');
+        oStage.sFilterType = sStage.substr(0, colon);
+        if (std::find(filterTypes.begin(), filterTypes.end(), oStage.sFilterType) == filterTypes.end())
+        {
+            return sStage;
+        }
+        if (colon != std::string::npos)
+        {
+            oStage.nMaskSize = atoi(sStage.c_str() + colon + 1);
+            if (oStage.nMaskSize != 3 && oStage.nMaskSize != 5)
+            {
+                return sStage;
+            }
+        }
+        rStages.push_back(oStage);
+    }
+    return std::string();
+}
+
+NppiBorderType sBorderTypeToEnum(const std::string& sBorderType)
+{
+    if (sBorderType == "constant")
+    {
+        return NPP_BORDER_CONSTANT;
+    }
+    else if (sBorderType == "replicate")
+    {
+        return NPP_BORDER_REPLICATE;
+    }
+    else if (sBorderType == "wrap")
+    {
+        return NPP_BORDER_WRAP;
+    }
+    else if (sBorderType == "mirror")
+    {
+        return NPP_BORDER_MIRROR;
+    }
+    return NPP_BORDER_NONE;
+}
+
+void Parameters::closeInput()
+{
+    _pInputFile.reset();
+    _pInputStream.reset();
+}
+
+Parameters Parameters::forFilter(size_t iFilter) const
+{
+    Parameters parameters = *this;
+    parameters._sFilterType = _aFilterTypes[iFilter];
+    parameters._sOutputFile = _aOutputFiles[iFilter];
+    return parameters;
+}
+
+Parameters Parameters::forStage(size_t iStage) const
+{
+    Parameters parameters = *this;
+    const PipelineStage& rStage = _aPipeline[iStage];
+    parameters._sFilterType = rStage.sFilterType;
+    if (rStage.nMaskSize)
+    {
+        parameters._oMaskSize = { rStage.nMaskSize, rStage.nMaskSize };
+        parameters._oAnchor = { rStage.nMaskSize / 2, rStage.nMaskSize / 2 };
+        parameters._eNppiMaskSize = rStage.nMaskSize == 3 ? NPP_MASK_SIZE_3_X_3 : NPP_MASK_SIZE_5_X_5;
+    }
+    return parameters;
+}
+
+std::string Parameters::getPipelineName() const
+{
+    std::string sName;
+    for (const PipelineStage& rStage : _aPipeline)
+    {
+        sName += (sName.empty() ? "" : "-") + rStage.sFilterType;
+        if (rStage.nMaskSize)
+        {
+            sName += std::to_string(rStage.nMaskSize);
+        }
+    }
+    return sName;
+}
+
+bool Parameters::setImageSize(const NppiSize& oSize)
+{
+    _oSrcSize = oSize;
+    _oSrcOffset = _oROIOffset;
+    _oSizeROI = hasROI() ? _oROISize : oSize;
+    return (long long)_oSrcOffset.x + _oSizeROI.width <= oSize.width && (long long)_oSrcOffset.y + _oSizeROI.height <= oSize.height;
+}
+
+void Parameters::setSrcSize(const NppiSize& oSize)
+{
+    _oSrcSize = oSize;
+}
+
+void Parameters::setSizeROI(const NppiSize& oSize)
+{
+    _oSizeROI = oSize;
+}
+
+void Parameters::setSrcOffset(const NppiPoint& oOffset)
+{
+    _oSrcOffset = oOffset;
+}
+
+void Parameters::setStreamContext(const NppStreamContext& oContext)
+{
+    _oStreamContext = oContext;
+}
+
+bool Parameters::isFilterBorderCompatible(bool bVerbose) const
+{
+    bool compatible = true;
+    std::vector<std::string> sFilterTypes = _aFilterTypes;
+    if (isPipeline()) {
+        sFilterTypes.clear();
+        for (const PipelineStage& rStage : _aPipeline) {
+            sFilterTypes.push_back(rStage.sFilterType);
+        }
+    }
+    for (const std::string& sFilterType : sFilterTypes) {
+        if (sFilterType != "wiener") {
+            if (_sBorderType != "none" && _sBorderType != "replicate") {
+                if (bVerbose)
+                {
+                    getOutput() << sFilterType << " filter support none or replicate border mode" << std::endl;
+                }
+                compatible = false;
+            }
+        }
+        else {
+            if (_sBorderType != "replicate") {
+                if (bVerbose)
+                {
+                    getOutput() << sFilterType << " filter support replicate border mode" << std::endl;
+                }
+                compatible = false;
+            }
+        }
+    }
+    return compatible;
+}
+
+bool Parameters::setSharedPipeline(const std::string& rPipeline, const std::string& rBorderType, const std::string& rBackend,
+    int nWidth, int nHeight, int nBitsPerChannel)
+{
+    if (!parsePipeline(rPipeline, _aPipeline).empty() || (rBorderType != "none" && rBorderType != "replicate"))
+    {
+        return false;
+    }
+    _aFilterTypes = { getPipelineName() };
+    _sFilterType = _aPipeline[0].sFilterType;
+    _sBorderType = rBorderType;
+    _eBorderType = sBorderTypeToEnum(_sBorderType);
+    _sBackend = rBackend;
+    if (!isFilterBorderCompatible(false) || nWidth <= 0 || nHeight <= 0
+        || (nBitsPerChannel != 8 && nBitsPerChannel != 16 && nBitsPerChannel != 32))
+    {
+        return false;
+    }
+
+    _bSharedInput = true;
+    _oInputInfo = stb::ImageInfo();
+    _oInputInfo.sFileName = "shared";
+    _oInputInfo.sFormat = "raw";
+    _oInputInfo.nChannels = 3;
+    _oInputInfo.nWidth = nWidth;
+    _oInputInfo.nHeight = nHeight;
+    _oInputInfo.nBitsPerChannel = nBitsPerChannel;
+    _sInputFile = _oInputInfo.sFileName;
+    _sOutputFile.clear();
+    _aOutputFiles.assign(1, _sOutputFile);
+    return setImageSize({ nWidth, nHeight });
+}
\ No newline at end of file
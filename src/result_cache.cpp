@@ -0,0 +1,264 @@
+#include "result_cache.h"
+#include "parameter_helpers.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const uint64_t nPrime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t nPrime2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t nPrime3 = 0x165667B19E3779F9ULL;
+    const uint64_t nPrime4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t nPrime5 = 0x27D4EB2F165667C5ULL;
+
+    // bumped when the filters change their results, old entries are then never hit
+    const char* sCacheVersion = "npp-filters-cache-1";
+
+    uint64_t rotate(uint64_t n, int nBits)
+    {
+        return (n << nBits) | (n >> (64 - nBits));
+    }
+
+    uint64_t read64(const unsigned char* p)
+    {
+        uint64_t n;
+        memcpy(&n, p, sizeof(n));
+        return n;
+    }
+
+    uint64_t mix(uint64_t nAccumulator, uint64_t nInput)
+    {
+        return rotate(nAccumulator + nInput * nPrime2, 31) * nPrime1;
+    }
+
+    uint64_t merge(uint64_t nAccumulator, uint64_t nLane)
+    {
+        return (nAccumulator ^ mix(0, nLane)) * nPrime1 + nPrime4;
+    }
+
+    std::string toHex(uint64_t n)
+    {
+        char aHex[17];
+        snprintf(aHex, sizeof(aHex), "%016llx", (unsigned long long)n);
+        return aHex;
+    }
+
+    long long now()
+    {
+        return (long long)fs::file_time_type::clock::now().time_since_epoch().count();
+    }
+}
+
+ResultCache::ResultCache(const std::string& rDirectory, size_t nMaxBytes)
+    : _sDirectory(rDirectory), _nMaxBytes(nMaxBytes)
+{
+    std::error_code oError;
+    fs::create_directories(_sDirectory, oError);
+    for (fs::directory_iterator it(_sDirectory, oError), end; !oError && it != end; it.increment(oError))
+    {
+        if (!it->is_regular_file(oError))
+        {
+            continue;
+        }
+        const std::string sName = it->path().filename().string();
+        // copy of an interrupted run
+        if (sName.find(".tmp") != std::string::npos)
+        {
+            fs::remove(it->path(), oError);
+            continue;
+        }
+        Entry oEntry;
+        oEntry.nSize = (size_t)it->file_size(oError);
+        oEntry.nLastUse = (long long)it->last_write_time(oError).time_since_epoch().count();
+        _nBytes += oEntry.nSize;
+        _aEntries[sName] = oEntry;
+    }
+    evict();
+}
+
+uint64_t ResultCache::hash(const void* pData, size_t nSize, uint64_t nSeed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(pData);
+    const unsigned char* pEnd = p + nSize;
+    uint64_t nHash;
+
+    if (nSize >= 32)
+    {
+        uint64_t aLanes[4] = { nSeed + nPrime1 + nPrime2, nSeed + nPrime2, nSeed, nSeed - nPrime1 };
+        for (; p + 32 <= pEnd; p += 32)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                aLanes[i] = mix(aLanes[i], read64(p + 8 * i));
+            }
+        }
+        nHash = rotate(aLanes[0], 1) + rotate(aLanes[1], 7) + rotate(aLanes[2], 12) + rotate(aLanes[3], 18);
+        for (int i = 0; i < 4; ++i)
+        {
+            nHash = merge(nHash, aLanes[i]);
+        }
+    }
+    else
+    {
+        nHash = nSeed + nPrime5;
+    }
+    nHash += (uint64_t)nSize;
+
+    for (; p + 8 <= pEnd; p += 8)
+    {
+        nHash = rotate(nHash ^ mix(0, read64(p)), 27) * nPrime1 + nPrime4;
+    }
+    for (; p < pEnd; ++p)
+    {
+        nHash = rotate(nHash ^ (*p * nPrime5), 11) * nPrime1;
+    }
+
+    // final avalanche
+    nHash ^= nHash >> 33;
+    nHash *= nPrime2;
+    nHash ^= nHash >> 29;
+    nHash *= nPrime3;
+    nHash ^= nHash >> 32;
+    return nHash;
+}
+
+std::vector<std::string> ResultCache::keys(const Parameters& parameters)
+{
+    std::vector<std::string> aKeys;
+    if (parameters.isInputStream() || parameters.isSharedInput() || parameters.isSyntheticInput())
+    {
+        return aKeys;
+    }
+    const MappedFile& rFile = parameters.getInputFile();
+    const std::string sInput = toHex(hash(rFile.data(), rFile.size()));
+
+    for (size_t i = 0; i < parameters.getFilterTypes().size(); ++i)
+    {
+        const Parameters oFilter = parameters.forFilter(i);
+        if (oFilter.getOutputFilename() == "-")
+        {
+            return std::vector<std::string>();
+        }
+
+        // every setting the encoded result depends on
+        const NppiSize& rMask = oFilter.getMaskSize();
+        const NppiPoint& rAnchor = oFilter.getAnchor();
+        const Npp32f* pNoise = oFilter.getNoise();
+        const NppiPoint& rOffset = oFilter.getSrcOffset();
+        const NppiSize& rROI = oFilter.getSizeROI();
+        char aSettings[256];
+        snprintf(aSettings, sizeof(aSettings), "|%d|%dx%d|%d,%d|%.9g,%.9g,%.9g|%d,%d,%dx%d|%d|%d|",
+            (int)oFilter.getBorderType(), rMask.width, rMask.height, rAnchor.x, rAnchor.y,
+            pNoise[0], pNoise[1], pNoise[2], rOffset.x, rOffset.y, rROI.width, rROI.height,
+            (int)oFilter.getOutputFormat(), oFilter.getJpegQuality());
+        const std::string sSettings = std::string(sCacheVersion) + "|" + parameters.getFilterTypes()[i]
+            + aSettings + oFilter.getBackend();
+        aKeys.push_back(sInput + toHex(hash(sSettings.data(), sSettings.size())));
+    }
+    return aKeys;
+}
+
+std::string ResultCache::path(const std::string& rKey) const
+{
+    return (fs::path(_sDirectory) / rKey).string();
+}
+
+bool ResultCache::restore(const std::string& rKey, const std::string& rOutputFile)
+{
+    {
+        std::lock_guard<std::mutex> oLock(_oMutex);
+        std::map<std::string, Entry>::iterator it = _aEntries.find(rKey);
+        if (it == _aEntries.end())
+        {
+            ++_nMisses;
+            return false;
+        }
+        it->second.nLastUse = now();
+    }
+
+    // a copy, not a link: rewriting the output in place would change the cached result
+    std::error_code oError;
+    fs::copy_file(path(rKey), rOutputFile, fs::copy_options::overwrite_existing, oError);
+    if (!oError)
+    {
+        fs::last_write_time(path(rKey), fs::file_time_type::clock::now(), oError);
+    }
+
+    std::lock_guard<std::mutex> oLock(_oMutex);
+    if (oError)
+    {
+        // removed behind our back
+        std::map<std::string, Entry>::iterator it = _aEntries.find(rKey);
+        if (it != _aEntries.end() && !fs::exists(path(rKey)))
+        {
+            _nBytes -= it->second.nSize;
+            _aEntries.erase(it);
+        }
+        ++_nMisses;
+        return false;
+    }
+    ++_nHits;
+    return true;
+}
+
+void ResultCache::store(const std::string& rKey, const std::string& rOutputFile)
+{
+    // copied under a name of its own then renamed, readers never see a partial entry
+    const std::string sTemporary = path(rKey) + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::error_code oError;
+    fs::copy_file(rOutputFile, sTemporary, fs::copy_options::overwrite_existing, oError);
+    const size_t nSize = oError ? 0 : (size_t)fs::file_size(sTemporary, oError);
+    if (!oError)
+    {
+        fs::rename(sTemporary, path(rKey), oError);
+    }
+    if (oError)
+    {
+        fs::remove(sTemporary, oError);
+        return;
+    }
+
+    std::lock_guard<std::mutex> oLock(_oMutex);
+    Entry& rEntry = _aEntries[rKey];
+    _nBytes += nSize - rEntry.nSize;
+    rEntry.nSize = nSize;
+    rEntry.nLastUse = now();
+    ++_nStores;
+    evict();
+}
+
+void ResultCache::evict()
+{
+    if (_nBytes <= _nMaxBytes)
+    {
+        return;
+    }
+    std::vector<std::pair<long long, std::string> > aUses;
+    for (const auto& [sKey, rEntry] : _aEntries)
+    {
+        aUses.emplace_back(rEntry.nLastUse, sKey);
+    }
+    std::sort(aUses.begin(), aUses.end());
+    for (size_t i = 0; i < aUses.size() && _nBytes > _nMaxBytes; ++i)
+    {
+        std::error_code oError;
+        fs::remove(path(aUses[i].second), oError);
+        _nBytes -= _aEntries[aUses[i].second].nSize;
+        _aEntries.erase(aUses[i].second);
+        ++_nEvictions;
+    }
+}
+
+void ResultCache::printStatistics() const
+{
+    std::lock_guard<std::mutex> oLock(_oMutex);
+    const size_t nLookups = _nHits + _nMisses;
+    printf("Cache: %zu hits, %zu misses, %.1f %% hit rate, %zu stored, %zu evicted, %.1f MB in %zu entries\n",
+        _nHits, _nMisses, nLookups ? 100.0 * _nHits / nLookups : 0.0, _nStores, _nEvictions, _nBytes / 1e6, _aEntries.size());
+}
\ No newline at end of file
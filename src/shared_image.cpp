@@ -0,0 +1,82 @@
+#include "shared_image.h"
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64))
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+SharedMemory::~SharedMemory()
+{
+    close();
+}
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+
+bool SharedMemory::open(int, size_t, bool)
+{
+    // descriptors are only passed over Unix domain sockets
+    return false;
+}
+
+void SharedMemory::close()
+{
+    _pData = nullptr;
+    _nSize = 0;
+}
+
+bool SharedMemory::isSameObject(int, int)
+{
+    return false;
+}
+
+#else
+
+bool SharedMemory::open(int nFile, size_t nSize, bool bWritable)
+{
+    close();
+
+    struct stat oStat;
+    if (nSize == 0 || fstat(nFile, &oStat) != 0 || (size_t)oStat.st_size < nSize)
+    {
+        return false;
+    }
+#ifdef F_GET_SEALS
+    // the client truncating the object under the mapping would kill the daemon with SIGBUS
+    const int nSeals = fcntl(nFile, F_GET_SEALS);
+    if (nSeals < 0 || !(nSeals & F_SEAL_SHRINK))
+    {
+        return false;
+    }
+#endif
+
+    // MAP_SHARED: the results are written to the client pages, no copy on either side
+    void* pData = mmap(nullptr, nSize, bWritable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, nFile, 0);
+    if (pData == MAP_FAILED)
+    {
+        return false;
+    }
+
+    _pData = static_cast<unsigned char*>(pData);
+    _nSize = nSize;
+    return true;
+}
+
+bool SharedMemory::isSameObject(int nFile1, int nFile2)
+{
+    struct stat oStat1, oStat2;
+    return fstat(nFile1, &oStat1) == 0 && fstat(nFile2, &oStat2) == 0
+        && oStat1.st_dev == oStat2.st_dev && oStat1.st_ino == oStat2.st_ino;
+}
+
+void SharedMemory::close()
+{
+    if (_pData)
+    {
+        munmap(_pData, _nSize);
+    }
+    _pData = nullptr;
+    _nSize = 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "stage_timings.h"
+#include "stb_image_io.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+StageTimings::StageTimings(const std::string& rJsonFile)
+    : _oStart(std::chrono::steady_clock::now()), _sJsonFile(rJsonFile)
+{
+}
+
+const char* StageTimings::name(Stage eStage)
+{
+    switch (eStage)
+    {
+    case Stage::decode:
+        return "decode";
+    case Stage::convert:
+        return "convert";
+    case Stage::upload:
+        return "upload";
+    case Stage::filter:
+        return "filter";
+    case Stage::download:
+        return "download";
+    case Stage::encode:
+        return "encode";
+    case Stage::write:
+        return "write";
+    }
+    return "";
+}
+
+void StageTimings::add(Stage eStage, double nMilliseconds)
+{
+    std::lock_guard<std::mutex> oLock(_oMutex);
+    Step& rStep = _aSteps[(int)eStage];
+    rStep.nMin = rStep.nCount ? std::min(rStep.nMin, nMilliseconds) : nMilliseconds;
+    rStep.nMax = rStep.nCount ? std::max(rStep.nMax, nMilliseconds) : nMilliseconds;
+    rStep.nTotal += nMilliseconds;
+    ++rStep.nCount;
+}
+
+void StageTimings::addImage()
+{
+    std::lock_guard<std::mutex> oLock(_oMutex);
+    ++_nImages;
+}
+
+void StageTimings::printStatistics() const
+{
+    std::lock_guard<std::mutex> oLock(_oMutex);
+    const double nWall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _oStart).count();
+    double nSum = 0.0;
+    for (const Step& rStep : _aSteps)
+    {
+        nSum += rStep.nTotal;
+    }
+
+    // the steps of the batch executor overlap, their sum can exceed the wall time
+    printf("\nTimings: %zu image%s, %.3f ms wall time\n", _nImages, _nImages == 1 ? "" : "s", nWall);
+    printf("  %-9s %7s %12s %10s %10s %10s %7s\n", "stage", "count", "total ms", "mean ms", "min ms", "max ms", "share");
+    for (int i = 0; i < nSteps; ++i)
+    {
+        const Step& rStep = _aSteps[i];
+        if (!rStep.nCount)
+        {
+            continue;
+        }
+        printf("  %-9s %7zu %12.3f %10.3f %10.3f %10.3f %6.1f%%\n", name((Stage)i), rStep.nCount, rStep.nTotal,
+            rStep.nTotal / rStep.nCount, rStep.nMin, rStep.nMax, nSum > 0 ? 100.0 * rStep.nTotal / nSum : 0.0);
+    }
+    printf("  %-9s %7s %12.3f\n", "total", "", nSum);
+
+    if (!_sJsonFile.empty())
+    {
+        std::ofstream oFile(_sJsonFile);
+        writeJson(oFile);
+        if (!oFile)
+        {
+            printf("Error: Can't write %s\n", _sJsonFile.c_str());
+        }
+    }
+}
+
+void StageTimings::writeJson(std::ostream& rStream) const
+{
+    const double nWall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _oStart).count();
+    rStream << "{\n  \"images\": " << _nImages << ",\n  \"wall_ms\": " << nWall << ",\n  \"stages\": [";
+    bool bFirst = true;
+    for (int i = 0; i < nSteps; ++i)
+    {
+        const Step& rStep = _aSteps[i];
+        if (!rStep.nCount)
+        {
+            continue;
+        }
+        rStream << (bFirst ? "\n" : ",\n") << "    {\"stage\": ";
+        stb::writeJsonString(rStream, name((Stage)i));
+        rStream << ", \"count\": " << rStep.nCount << ", \"total_ms\": " << rStep.nTotal << ", \"mean_ms\": " << rStep.nTotal / rStep.nCount
+            << ", \"min_ms\": " << rStep.nMin << ", \"max_ms\": " << rStep.nMax << "}";
+        bFirst = false;
+    }
+    rStream << (bFirst ? "]\n}" : "\n  ]\n}") << std::endl;
+}
\ No newline at end of file
@@ -1,114 +1,1350 @@
-#include "stb_image_io.h"
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image/stb_image.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image/stb_image_write.h"
-
-namespace stb
-{
-    void copy_8u_C1_to_8u_C3(const uint8_t* img, npp::ImageCPU_8u_C3& oImage)
-    {
-        Npp8u* pDstLine = oImage.data();
-        const unsigned int nDstPitch = oImage.pitch();
-        const uint8_t* pSrcLine = img;
-        const unsigned int nSrcPitch = oImage.width();
-
-        for (size_t iLine = 0; iLine < oImage.height(); ++iLine)
-        {
-            npp::Pixel<Npp8u, 4>* pDstPixels = (npp::Pixel<Npp8u, 4>*)pDstLine;
-            for (size_t iPixel = 0; iPixel < oImage.width(); ++iPixel)
-            {
-                pDstPixels[iPixel].x = pSrcLine[iPixel];
-                pDstPixels[iPixel].y = pSrcLine[iPixel];
-                pDstPixels[iPixel].z = pSrcLine[iPixel];
-            }
-            pSrcLine += nSrcPitch;
-            pDstLine += nDstPitch;
-        }
-    }
-
-    void copy_8u_C3_to_8u_C3(const uint8_t* img, npp::ImageCPU_8u_C3& oImage)
-    {
-        Npp8u* pDstLine = oImage.data();
-        const unsigned int nDstPitch = oImage.pitch();
-        const uint8_t* pSrcLine = img;
-        const unsigned int nSrcPitch = oImage.width() * 3;
-        if (nSrcPitch == nDstPitch)
-        {
-            memcpy(pDstLine, pSrcLine, nSrcPitch * oImage.height());
-        }
-        else
-        {
-            for (size_t iLine = 0; iLine < oImage.height(); ++iLine)
-            {
-                memcpy(pDstLine, pSrcLine, nSrcPitch);
-                pSrcLine += nSrcPitch;
-                pDstLine += nDstPitch;
-            }
-        }
-    }
-
-    void copy_8u_C4_to_8u_C3(const uint8_t* img, npp::ImageCPU_8u_C3& oImage)
-    {
-        Npp8u* pDstLine = oImage.data();
-        const unsigned int nDstPitch = oImage.pitch();
-        const uint8_t* pSrcLine = img;
-        const unsigned int nSrcPitch = oImage.width() * 4;
-
-        for (size_t iLine = 0; iLine < oImage.height(); ++iLine)
-        {
-            const  npp::Pixel<Npp8u, 4>* pSrcPixels = (npp::Pixel<Npp8u, 4>*)pSrcLine;
-            npp::Pixel<Npp8u, 3>* pDstPixels = (npp::Pixel<Npp8u, 3>*)pDstLine;
-            for (size_t iPixel = 0; iPixel < oImage.width(); ++iPixel)
-            {
-                pDstPixels[iPixel].x = pSrcPixels[iPixel].x;
-                pDstPixels[iPixel].y = pSrcPixels[iPixel].y;
-                pDstPixels[iPixel].z = pSrcPixels[iPixel].z;
-            }
-            pSrcLine += nSrcPitch;
-            pDstLine += nDstPitch;
-        }
-    }
-
-
-    void loadImage(const std::string& rFileName, npp::ImageCPU_8u_C3& rImage)
-    {
-        int width = 0, height = 0, channels = 0;
-        uint8_t* img = stbi_load(rFileName.c_str(), &width, &height, &channels, 0);
-        if (img == NULL)
-        {
-            printf("Error: Can't load %s image\n", rFileName.c_str());
-            throw npp::Exception("std::loadImage failed (stbi_load return null)");
-        }
-        if (channels != 1 && channels != 3 && channels != 4) {
-            stbi_image_free(img);
-            printf("Error: %s must be an 8, 24 or 32 bits image\n", rFileName.c_str());
-            throw npp::Exception("std::loadImage failed (invalid pixel format)");
-        }
-
-        npp::ImageCPU_8u_C3 oImage(width, height);
-
-        switch (channels) {
-        case 1:
-            copy_8u_C1_to_8u_C3(img, oImage);
-            break;
-        case 3:
-            copy_8u_C3_to_8u_C3(img, oImage);
-            break;
-        case 4:
-            copy_8u_C4_to_8u_C3(img, oImage);
-            break;
-        };
-
-        // swap the user given image with our result image, effecively
-        // moving our newly loaded image data into the user provided shell
-        oImage.swap(rImage);
-        stbi_image_free(img);
-    }
-
-    void saveImage(const std::string& rFileName, const npp::ImageCPU_8u_C3& rImage)
-    {
-        stbi_write_png(rFileName.c_str(), rImage.width(), rImage.height(), 3, rImage.data(), rImage.pitch());
-    }
+#include "stb_image_io.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <functional>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image/stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image/stb_image_write.h"
+
+namespace stb
+{
+    template<typename D, class A>
+    void copy_C1_to_C3(const D* img, npp::ImageCPU<D, 3, A>& oImage)
+    {
+        unsigned char* pDstLine = (unsigned char*)oImage.data();
+        const unsigned int nDstPitch = oImage.pitch();
+        const D* pSrcLine = img;
+        const unsigned int nSrcPitch = oImage.width();
+
+        for (size_t iLine = 0; iLine < oImage.height(); ++iLine)
+        {
+            npp::Pixel<D, 3>* pDstPixels = (npp::Pixel<D, 3>*)pDstLine;
+            for (size_t iPixel = 0; iPixel < oImage.width(); ++iPixel)
+            {
+                pDstPixels[iPixel].x = pSrcLine[iPixel];
+                pDstPixels[iPixel].y = pSrcLine[iPixel];
+                pDstPixels[iPixel].z = pSrcLine[iPixel];
+            }
+            pSrcLine += nSrcPitch;
+            pDstLine += nDstPitch;
+        }
+    }
+
+    template<typename D, class A>
+    void copy_C3_to_C3(const D* img, npp::ImageCPU<D, 3, A>& oImage)
+    {
+        unsigned char* pDstLine = (unsigned char*)oImage.data();
+        const unsigned int nDstPitch = oImage.pitch();
+        const unsigned char* pSrcLine = (const unsigned char*)img;
+        const unsigned int nSrcPitch = oImage.width() * 3 * sizeof(D);
+        if (nSrcPitch == nDstPitch)
+        {
+            memcpy(pDstLine, pSrcLine, (size_t)nSrcPitch * oImage.height());
+        }
+        else
+        {
+            for (size_t iLine = 0; iLine < oImage.height(); ++iLine)
+            {
+                memcpy(pDstLine, pSrcLine, nSrcPitch);
+                pSrcLine += nSrcPitch;
+                pDstLine += nDstPitch;
+            }
+        }
+    }
+
+    template<typename D, class A>
+    void copy_C4_to_C3(const D* img, npp::ImageCPU<D, 3, A>& oImage)
+    {
+        unsigned char* pDstLine = (unsigned char*)oImage.data();
+        const unsigned int nDstPitch = oImage.pitch();
+        const D* pSrcLine = img;
+        const unsigned int nSrcPitch = oImage.width() * 4;
+
+        for (size_t iLine = 0; iLine < oImage.height(); ++iLine)
+        {
+            const  npp::Pixel<D, 4>* pSrcPixels = (npp::Pixel<D, 4>*)pSrcLine;
+            npp::Pixel<D, 3>* pDstPixels = (npp::Pixel<D, 3>*)pDstLine;
+            for (size_t iPixel = 0; iPixel < oImage.width(); ++iPixel)
+            {
+                pDstPixels[iPixel].x = pSrcPixels[iPixel].x;
+                pDstPixels[iPixel].y = pSrcPixels[iPixel].y;
+                pDstPixels[iPixel].z = pSrcPixels[iPixel].z;
+            }
+            pSrcLine += nSrcPitch;
+            pDstLine += nDstPitch;
+        }
+    }
+
+    std::string sniffFormat(const unsigned char* pData, size_t nSize)
+    {
+        auto startsWith = [&](const char* sMagic) {
+            size_t n = strlen(sMagic);
+            return nSize >= n && memcmp(pData, sMagic, n) == 0;
+        };
+        if (startsWith("\x89PNG")) return "png";
+        if (startsWith("\xFF\xD8")) return "jpeg";
+        if (startsWith("BM")) return "bmp";
+        if (startsWith("GIF8")) return "gif";
+        if (startsWith("8BPS")) return "psd";
+        if (startsWith("#?RADIANCE") || startsWith("#?RGBE")) return "hdr";
+        if (startsWith("P5") || startsWith("P6")) return "pnm";
+        if (startsWith("\x53\x80\xF6\x34")) return "pic";
+        return "tga";
+    }
+
+    // P5/P6 header: magic, width, height and maxval separated by blanks or comments,
+    // then a single blank before the raster
+    bool pnmHeader(const std::function<int()>& nextByte, int& rWidth, int& rHeight, int& rChannels, int& rMaxValue)
+    {
+        if (nextByte() != 'P')
+        {
+            return false;
+        }
+        const int nMagic = nextByte();
+        if (nMagic != '5' && nMagic != '6')
+        {
+            return false;
+        }
+        rChannels = nMagic == '6' ? 3 : 1;
+
+        int* aFields[3] = { &rWidth, &rHeight, &rMaxValue };
+        int c = nextByte();
+        for (int* pField : aFields)
+        {
+            while (c == '#' || isspace(c))
+            {
+                if (c == '#')
+                {
+                    while (c != '\n' && c != '\r' && c != -1)
+                    {
+                        c = nextByte();
+                    }
+                }
+                c = nextByte();
+            }
+            if (!isdigit(c))
+            {
+                return false;
+            }
+            *pField = 0;
+            while (isdigit(c))
+            {
+                *pField = *pField * 10 + (c - '0');
+                c = nextByte();
+            }
+        }
+        return isspace(c) && rWidth > 0 && rHeight > 0 && rMaxValue > 0 && rMaxValue < 65536;
+    }
+
+    bool probeImage(const MappedFile& rFile, ImageInfo& rInfo)
+    {
+        rInfo = ImageInfo();
+        rInfo.sFileName = rFile.fileName();
+        rInfo.nFileSize = rFile.size();
+        if (!rFile.isOpen())
+        {
+            return false;
+        }
+
+        if (rFile.size() > nMaxDecodeSize)
+        {
+            size_t nOffset = 0;
+            int nMaxValue = 0;
+            auto fNextByte = [&]() { return nOffset < rFile.size() ? (int)rFile.data()[nOffset++] : -1; };
+            if (sniffFormat(rFile.data(), rFile.size()) != "pnm" || !pnmHeader(fNextByte, rInfo.nWidth, rInfo.nHeight, rInfo.nChannels, nMaxValue))
+            {
+                return false;
+            }
+            rInfo.sFormat = "pnm";
+            rInfo.nBitsPerChannel = nMaxValue > 255 ? 16 : 8;
+            return true;
+        }
+
+        const int nSize = (int)rFile.size();
+        if (!stbi_info_from_memory(rFile.data(), nSize, &rInfo.nWidth, &rInfo.nHeight, &rInfo.nChannels))
+        {
+            return false;
+        }
+        rInfo.sFormat = sniffFormat(rFile.data(), rFile.size());
+        rInfo.nBitsPerChannel = stbi_is_hdr_from_memory(rFile.data(), nSize) ? 32
+            : stbi_is_16_bit_from_memory(rFile.data(), nSize) ? 16 : 8;
+        return true;
+    }
+
+    int StreamReader::read(char* pData, int nSize)
+    {
+        int nRead = 0;
+        if (_nPosition < _oRecord.size())
+        {
+            nRead = (int)std::min((size_t)nSize, _oRecord.size() - _nPosition);
+            memcpy(pData, &_oRecord[_nPosition], nRead);
+        }
+        if (nRead < nSize)
+        {
+            const size_t nFresh = fread(pData + nRead, 1, (size_t)(nSize - nRead), _pFile);
+            if (_bRecording)
+            {
+                _oRecord.insert(_oRecord.end(), (unsigned char*)pData + nRead, (unsigned char*)pData + nRead + nFresh);
+            }
+            nRead += (int)nFresh;
+        }
+        _nPosition += nRead;
+        return nRead;
+    }
+
+    void StreamReader::skip(int nSize)
+    {
+        // pipes can't seek, read and drop
+        char aScratch[4096];
+        while (nSize > 0)
+        {
+            const int nRead = read(aScratch, std::min(nSize, (int)sizeof(aScratch)));
+            if (nRead <= 0)
+            {
+                break;
+            }
+            nSize -= nRead;
+        }
+    }
+
+    bool StreamReader::eof()
+    {
+        if (_nPosition < _oRecord.size())
+        {
+            return false;
+        }
+        const int c = fgetc(_pFile);
+        if (c == EOF)
+        {
+            return true;
+        }
+        ungetc(c, _pFile);
+        return false;
+    }
+
+    int readStream(void* user, char* data, int size)
+    {
+        return ((StreamReader*)user)->read(data, size);
+    }
+
+    void skipStream(void* user, int n)
+    {
+        ((StreamReader*)user)->skip(n);
+    }
+
+    int eofStream(void* user)
+    {
+        return ((StreamReader*)user)->eof() ? 1 : 0;
+    }
+
+    const stbi_io_callbacks oStreamCallbacks = { readStream, skipStream, eofStream };
+
+    bool probeImage(StreamReader& rStream, ImageInfo& rInfo)
+    {
+        rInfo = ImageInfo();
+        rInfo.sFileName = rStream.fileName();
+
+        // each stbi call parses the stream from its first byte
+        rStream.rewind();
+        if (!stbi_info_from_callbacks(&oStreamCallbacks, &rStream, &rInfo.nWidth, &rInfo.nHeight, &rInfo.nChannels))
+        {
+            return false;
+        }
+        rStream.rewind();
+        const bool bHdr = stbi_is_hdr_from_callbacks(&oStreamCallbacks, &rStream) != 0;
+        rStream.rewind();
+        const bool b16 = stbi_is_16_bit_from_callbacks(&oStreamCallbacks, &rStream) != 0;
+
+        rInfo.sFormat = sniffFormat(rStream.header().data(), rStream.header().size());
+        rInfo.nBitsPerChannel = bHdr ? 32 : b16 ? 16 : 8;
+        return true;
+    }
+
+    void writeJsonString(std::ostream& rStream, const std::string& rString)
+    {
+        rStream << '"';
+        for (unsigned char c : rString)
+        {
+            if (c == '"' || c == '\\')
+            {
+                rStream << '\\' << c;
+            }
+            else if (c < 0x20)
+            {
+                char aEscape[8];
+                snprintf(aEscape, sizeof(aEscape), "\\u%04x", c);
+                rStream << aEscape;
+            }
+            else
+            {
+                rStream << c;
+            }
+        }
+        rStream << '"';
+    }
+
+    void writeImageInfoJson(std::ostream& rStream, const std::vector<ImageInfo>& rInfos, const std::vector<bool>& rValid)
+    {
+        rStream << "[";
+        for (size_t i = 0; i < rInfos.size(); ++i)
+        {
+            const ImageInfo& rInfo = rInfos[i];
+            rStream << (i ? ",\n  " : "\n  ") << "{\"file\": ";
+            writeJsonString(rStream, rInfo.sFileName);
+            if (!rValid[i])
+            {
+                rStream << ", \"error\": \"" << (!rInfo.nFileSize ? "unable to open" : rInfo.nFileSize > nMaxDecodeSize
+                    ? "over 2 GiB and not a binary pnm" : "unsupported image format") << "\"}";
+                continue;
+            }
+            rStream << ", \"format\": \"" << rInfo.sFormat << "\""
+                << ", \"file_size\": " << rInfo.nFileSize
+                << ", \"width\": " << rInfo.nWidth
+                << ", \"height\": " << rInfo.nHeight
+                << ", \"channels\": " << rInfo.nChannels
+                << ", \"bits_per_channel\": " << rInfo.nBitsPerChannel
+                << "}";
+        }
+        rStream << (rInfos.empty() ? "]" : "\n]") << std::endl;
+    }
+
+    void loadImage(const std::string& rFileName, npp::ImageCPU_8u_C3& rImage)
+    {
+        MappedFile oFile;
+        if (!oFile.open(rFileName))
+        {
+            printf("Error: Can't open %s image\n", rFileName.c_str());
+            throw npp::Exception("std::loadImage failed (unable to map file)");
+        }
+        loadImage(oFile, rImage);
+    }
+
+    // Length of a mapped file for the stbi_*_from_memory decoders
+    inline int decodeSize(const MappedFile& rFile)
+    {
+        if (rFile.size() > nMaxDecodeSize)
+        {
+            printf("Error: %s is over 2 GiB, larger than stb_image decodes, --stream reads binary pnm files of any size\n", rFile.fileName().c_str());
+            throw npp::Exception("std::loadImage failed (file over 2 GiB)");
+        }
+        return (int)rFile.size();
+    }
+
+    // stb_image decoders returning D samples for each image depth
+    inline Npp8u* decode(const MappedFile& rFile, int* x, int* y, int* comp, Npp8u*)
+    {
+        return stbi_load_from_memory(rFile.data(), decodeSize(rFile), x, y, comp, 0);
+    }
+
+    inline Npp16u* decode(const MappedFile& rFile, int* x, int* y, int* comp, Npp16u*)
+    {
+        return stbi_load_16_from_memory(rFile.data(), decodeSize(rFile), x, y, comp, 0);
+    }
+
+    inline Npp32f* decode(const MappedFile& rFile, int* x, int* y, int* comp, Npp32f*)
+    {
+        return stbi_loadf_from_memory(rFile.data(), decodeSize(rFile), x, y, comp, 0);
+    }
+
+    inline Npp8u* decode(StreamReader& rStream, int* x, int* y, int* comp, Npp8u*)
+    {
+        rStream.rewind();
+        return stbi_load_from_callbacks(&oStreamCallbacks, &rStream, x, y, comp, 0);
+    }
+
+    inline Npp16u* decode(StreamReader& rStream, int* x, int* y, int* comp, Npp16u*)
+    {
+        rStream.rewind();
+        return stbi_load_16_from_callbacks(&oStreamCallbacks, &rStream, x, y, comp, 0);
+    }
+
+    inline Npp32f* decode(StreamReader& rStream, int* x, int* y, int* comp, Npp32f*)
+    {
+        rStream.rewind();
+        return stbi_loadf_from_callbacks(&oStreamCallbacks, &rStream, x, y, comp, 0);
+    }
+
+    inline std::string sourceFormat(const MappedFile& rFile)
+    {
+        return sniffFormat(rFile.data(), rFile.size());
+    }
+
+    inline std::string sourceFormat(const StreamReader& rStream)
+    {
+        return sniffFormat(rStream.header().data(), rStream.header().size());
+    }
+
+    template<class S, typename D, class A>
+    void decodeImage(S& rSource, npp::ImageCPU<D, 3, A>& rImage, IoTimes* pTimes)
+    {
+        int width = 0, height = 0, channels = 0;
+        D* img = decode(rSource, &width, &height, &channels, (D*)nullptr);
+        if (img == NULL)
+        {
+            printf("Error: Can't load %s image\n", rSource.fileName().c_str());
+            throw npp::Exception("std::loadImage failed (stbi_load return null)");
+        }
+        const auto oConvert = pTimes ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+        // stb_image copies the big endian samples of 16 bits pnm files without swapping them
+        const Npp16u nOne = 1;
+        if (sizeof(D) == 2 && *(const Npp8u*)&nOne == 1 && sourceFormat(rSource) == "pnm")
+        {
+            Npp16u* pSamples = (Npp16u*)img;
+            for (size_t i = 0; i < (size_t)width * height * channels; ++i)
+            {
+                pSamples[i] = (Npp16u)((pSamples[i] << 8) | (pSamples[i] >> 8));
+            }
+        }
+        if (channels != 1 && channels != 3 && channels != 4) {
+            stbi_image_free(img);
+            printf("Error: %s must be a 1, 3 or 4 channels image\n", rSource.fileName().c_str());
+            throw npp::Exception("std::loadImage failed (invalid pixel format)");
+        }
+
+        // decode into the caller's buffer when it was pre-sized, allocate otherwise
+        npp::ImageCPU<D, 3, A> oImage;
+        const bool bPreSized = rImage.width() == (unsigned int)width && rImage.height() == (unsigned int)height;
+        if (!bPreSized)
+        {
+            npp::ImageCPU<D, 3, A>(width, height).swap(oImage);
+        }
+        npp::ImageCPU<D, 3, A>& rTarget = bPreSized ? rImage : oImage;
+
+        switch (channels) {
+        case 1:
+            copy_C1_to_C3(img, rTarget);
+            break;
+        case 3:
+            copy_C3_to_C3(img, rTarget);
+            break;
+        case 4:
+            copy_C4_to_C3(img, rTarget);
+            break;
+        };
+
+        if (!bPreSized)
+        {
+            // swap the user given image with our result image, effecively
+            // moving our newly loaded image data into the user provided shell
+            oImage.swap(rImage);
+        }
+        stbi_image_free(img);
+        if (pTimes)
+        {
+            pTimes->nConvertMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oConvert).count();
+        }
+    }
+
+    void loadImage(const MappedFile& rFile, npp::ImageCPU_8u_C3& rImage, IoTimes* pTimes)
+    {
+        decodeImage(rFile, rImage, pTimes);
+    }
+
+    void loadImage(const MappedFile& rFile, npp::ImageCPU_16u_C3& rImage, IoTimes* pTimes)
+    {
+        decodeImage(rFile, rImage, pTimes);
+    }
+
+    void loadImage(const MappedFile& rFile, npp::ImageCPU_32f_C3& rImage, IoTimes* pTimes)
+    {
+        decodeImage(rFile, rImage, pTimes);
+    }
+
+    void loadImage(StreamReader& rStream, npp::ImageCPU_8u_C3& rImage, IoTimes* pTimes)
+    {
+        rStream.stopRecording();
+        decodeImage(rStream, rImage, pTimes);
+    }
+
+    void loadImage(StreamReader& rStream, npp::ImageCPU_16u_C3& rImage, IoTimes* pTimes)
+    {
+        rStream.stopRecording();
+        decodeImage(rStream, rImage, pTimes);
+    }
+
+    void loadImage(StreamReader& rStream, npp::ImageCPU_32f_C3& rImage, IoTimes* pTimes)
+    {
+        rStream.stopRecording();
+        decodeImage(rStream, rImage, pTimes);
+    }
+
+    bool formatFromFilename(const std::string& rFileName, ImageFormat& rFormat)
+    {
+        std::string::size_type dot = rFileName.rfind('.');
+        if (dot == std::string::npos || rFileName.find_first_of("/\\", dot) != std::string::npos)
+        {
+            return false;
+        }
+        return formatFromName(rFileName.substr(dot + 1), rFormat);
+    }
+
+    bool formatFromName(const std::string& rName, ImageFormat& rFormat)
+    {
+        std::string sName = rName;
+        std::transform(sName.begin(), sName.end(), sName.begin(),
+            [](unsigned char c) { return (char)tolower(c); });
+
+        if (sName == "png")
+        {
+            rFormat = ImageFormat::png;
+        }
+        else if (sName == "jpg" || sName == "jpeg")
+        {
+            rFormat = ImageFormat::jpeg;
+        }
+        else if (sName == "bmp")
+        {
+            rFormat = ImageFormat::bmp;
+        }
+        else if (sName == "tga")
+        {
+            rFormat = ImageFormat::tga;
+        }
+        else if (sName == "hdr")
+        {
+            rFormat = ImageFormat::hdr;
+        }
+        else if (sName == "ppm" || sName == "pnm")
+        {
+            rFormat = ImageFormat::pnm;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // stbi_write_func sink writing to a FILE*, remembering short writes
+    struct FileSink
+    {
+        FILE* pFile;
+        bool bFailed;
+        // time of the writes, the encoders call writeToFile as they go
+        IoTimes* pTimes = nullptr;
+    };
+
+    void writeToFile(void* context, void* data, int size)
+    {
+        FileSink* pSink = (FileSink*)context;
+        const auto oStart = pSink->pTimes ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        if (fwrite(data, 1, (size_t)size, pSink->pFile) != (size_t)size)
+        {
+            pSink->bFailed = true;
+        }
+        if (pSink->pTimes)
+        {
+            pSink->pTimes->nWriteMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oStart).count();
+        }
+    }
+
+    // Binary PPM, 8 or 16 bits big endian samples
+    template<typename D>
+    int writePnm(stbi_write_func* func, void* context, int w, int h, const D* data, int stride_in_bytes)
+    {
+        char aHeader[64];
+        int nHeader = snprintf(aHeader, sizeof(aHeader), "P6\n%d %d\n%d\n", w, h, sizeof(D) == 1 ? 255 : 65535);
+        func(context, aHeader, nHeader);
+
+        std::vector<unsigned char> oLine((size_t)w * 3 * sizeof(D));
+        for (int y = 0; y < h; ++y)
+        {
+            const D* pSrc = (const D*)((const unsigned char*)data + (size_t)y * stride_in_bytes);
+            if (sizeof(D) == 1)
+            {
+                memcpy(oLine.data(), pSrc, oLine.size());
+            }
+            else
+            {
+                for (int i = 0; i < w * 3; ++i)
+                {
+                    oLine[2 * i] = (unsigned char)(pSrc[i] >> 8);
+                    oLine[2 * i + 1] = (unsigned char)(pSrc[i] & 0xff);
+                }
+            }
+            func(context, oLine.data(), (int)oLine.size());
+        }
+        return 1;
+    }
+
+    // 16 bits RGB PNG, stb_image_write only encodes 8 bits samples
+    // so the scanlines are built here and compressed with its zlib encoder
+    int writePng16(stbi_write_func* func, void* context, int w, int h, const Npp16u* data, int stride_in_bytes)
+    {
+        const size_t nLine = (size_t)w * 6 + 1;
+        // stbi_zlib_compress takes an int length, --stream writes larger PNGs strip by strip
+        if (nLine * h > (size_t)INT_MAX)
+        {
+            printf("Error: %dx%d is too large for a 16 bits PNG, use --stream\n", w, h);
+            return 0;
+        }
+        std::vector<unsigned char> oRaw(nLine * h);
+        for (int y = 0; y < h; ++y)
+        {
+            const Npp16u* pSrc = (const Npp16u*)((const unsigned char*)data + (size_t)y * stride_in_bytes);
+            unsigned char* pDst = &oRaw[nLine * y];
+            *pDst++ = 0; // filter type none
+            for (int i = 0; i < w * 3; ++i)
+            {
+                *pDst++ = (unsigned char)(pSrc[i] >> 8);
+                *pDst++ = (unsigned char)(pSrc[i] & 0xff);
+            }
+        }
+
+        int nCompressed = 0;
+        unsigned char* pCompressed = stbi_zlib_compress(oRaw.data(), (int)oRaw.size(), &nCompressed, stbi_write_png_compression_level);
+        if (!pCompressed)
+        {
+            return 0;
+        }
+
+        auto writeChunk = [&](const char* sTag, const unsigned char* pData, int nData) {
+            std::vector<unsigned char> oChunk(12 + (size_t)nData);
+            unsigned char* o = oChunk.data();
+            stbiw__wp32(o, nData);
+            stbiw__wptag(o, sTag);
+            if (nData)
+            {
+                memcpy(o, pData, nData);
+            }
+            o += nData;
+            unsigned int crc = stbiw__crc32(oChunk.data() + 4, nData + 4);
+            stbiw__wp32(o, crc);
+            func(context, oChunk.data(), (int)oChunk.size());
+        };
+
+        static const unsigned char aSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        func(context, (void*)aSignature, 8);
+
+        unsigned char aHeader[13];
+        unsigned char* o = aHeader;
+        stbiw__wp32(o, w);
+        stbiw__wp32(o, h);
+        *o++ = 16; // bit depth
+        *o++ = 2;  // truecolor
+        *o++ = 0;  // deflate
+        *o++ = 0;  // adaptive filtering
+        *o++ = 0;  // no interlace
+        writeChunk("IHDR", aHeader, 13);
+        writeChunk("IDAT", pCompressed, nCompressed);
+        writeChunk("IEND", nullptr, 0);
+        STBIW_FREE(pCompressed);
+        return 1;
+    }
+
+    // Sample conversions used when the output format can't hold the image depth
+    inline Npp8u toSample(Npp16u v, Npp8u*) { return (Npp8u)((v * 255u + 32767u) / 65535u); }
+    inline Npp8u toSample(Npp32f v, Npp8u*) { return (Npp8u)(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f); }
+    inline Npp16u toSample(Npp32f v, Npp16u*) { return (Npp16u)(std::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f); }
+    inline Npp32f toSample(Npp8u v, Npp32f*) { return v / 255.0f; }
+    inline Npp32f toSample(Npp16u v, Npp32f*) { return v / 65535.0f; }
+
+    // Tightly packed copy of an image, converted to DD samples
+    template<typename DD, typename D, class A>
+    std::vector<DD> convertImage(const npp::ImageCPU<D, 3, A>& rImage)
+    {
+        const size_t nLine = (size_t)rImage.width() * 3;
+        std::vector<DD> oPacked(nLine * rImage.height());
+        for (unsigned int iLine = 0; iLine < rImage.height(); ++iLine)
+        {
+            const D* pSrc = rImage.data(0, iLine);
+            DD* pDst = &oPacked[nLine * iLine];
+            for (size_t i = 0; i < nLine; ++i)
+            {
+                pDst[i] = toSample(pSrc[i], (DD*)nullptr);
+            }
+        }
+        return oPacked;
+    }
+
+    // Tightly packed copy, only made when the image is padded
+    template<typename D, class A>
+    const D* packedPixels(const npp::ImageCPU<D, 3, A>& rImage, std::vector<D>& rPacked)
+    {
+        const unsigned int nTightPitch = rImage.width() * 3 * sizeof(D);
+        if (rImage.pitch() == nTightPitch)
+        {
+            return rImage.data();
+        }
+        rPacked.resize((size_t)rImage.width() * 3 * rImage.height());
+        for (unsigned int iLine = 0; iLine < rImage.height(); ++iLine)
+        {
+            memcpy(&rPacked[(size_t)iLine * rImage.width() * 3], rImage.data(0, iLine), nTightPitch);
+        }
+        return rPacked.data();
+    }
+
+    int encode(stbi_write_func* func, void* context, const npp::ImageCPU_8u_C3& rImage, ImageFormat eFormat, int nJpegQuality)
+    {
+        const int nWidth = (int)rImage.width();
+        const int nHeight = (int)rImage.height();
+
+        // only the png and pnm encoders take a stride, repack padded images for the other ones
+        std::vector<Npp8u> oPacked;
+        switch (eFormat) {
+        case ImageFormat::png:
+            return stbi_write_png_to_func(func, context, nWidth, nHeight, 3, rImage.data(), rImage.pitch());
+        case ImageFormat::pnm:
+            return writePnm(func, context, nWidth, nHeight, rImage.data(), rImage.pitch());
+        case ImageFormat::jpeg:
+            return stbi_write_jpg_to_func(func, context, nWidth, nHeight, 3, packedPixels(rImage, oPacked), nJpegQuality);
+        case ImageFormat::bmp:
+            return stbi_write_bmp_to_func(func, context, nWidth, nHeight, 3, packedPixels(rImage, oPacked));
+        case ImageFormat::tga:
+            return stbi_write_tga_to_func(func, context, nWidth, nHeight, 3, packedPixels(rImage, oPacked));
+        case ImageFormat::hdr:
+            return stbi_write_hdr_to_func(func, context, nWidth, nHeight, 3, convertImage<Npp32f>(rImage).data());
+        };
+        return 0;
+    }
+
+    int encode(stbi_write_func* func, void* context, const npp::ImageCPU_16u_C3& rImage, ImageFormat eFormat, int nJpegQuality)
+    {
+        const int nWidth = (int)rImage.width();
+        const int nHeight = (int)rImage.height();
+
+        switch (eFormat) {
+        case ImageFormat::png:
+            return writePng16(func, context, nWidth, nHeight, rImage.data(), rImage.pitch());
+        case ImageFormat::pnm:
+            return writePnm(func, context, nWidth, nHeight, rImage.data(), rImage.pitch());
+        case ImageFormat::hdr:
+            return stbi_write_hdr_to_func(func, context, nWidth, nHeight, 3, convertImage<Npp32f>(rImage).data());
+        default:
+            break;
+        };
+
+        // 8 bits only encoders
+        std::vector<Npp8u> oImage8u = convertImage<Npp8u>(rImage);
+        switch (eFormat) {
+        case ImageFormat::jpeg:
+            return stbi_write_jpg_to_func(func, context, nWidth, nHeight, 3, oImage8u.data(), nJpegQuality);
+        case ImageFormat::bmp:
+            return stbi_write_bmp_to_func(func, context, nWidth, nHeight, 3, oImage8u.data());
+        case ImageFormat::tga:
+            return stbi_write_tga_to_func(func, context, nWidth, nHeight, 3, oImage8u.data());
+        default:
+            break;
+        };
+        return 0;
+    }
+
+    int encode(stbi_write_func* func, void* context, const npp::ImageCPU_32f_C3& rImage, ImageFormat eFormat, int nJpegQuality)
+    {
+        const int nWidth = (int)rImage.width();
+        const int nHeight = (int)rImage.height();
+
+        std::vector<Npp32f> oPacked;
+        switch (eFormat) {
+        case ImageFormat::hdr:
+            return stbi_write_hdr_to_func(func, context, nWidth, nHeight, 3, packedPixels(rImage, oPacked));
+        case ImageFormat::png:
+            return writePng16(func, context, nWidth, nHeight, convertImage<Npp16u>(rImage).data(), nWidth * 6);
+        case ImageFormat::pnm:
+            return writePnm(func, context, nWidth, nHeight, convertImage<Npp16u>(rImage).data(), nWidth * 6);
+        default:
+            break;
+        };
+
+        // 8 bits only encoders
+        std::vector<Npp8u> oImage8u = convertImage<Npp8u>(rImage);
+        switch (eFormat) {
+        case ImageFormat::jpeg:
+            return stbi_write_jpg_to_func(func, context, nWidth, nHeight, 3, oImage8u.data(), nJpegQuality);
+        case ImageFormat::bmp:
+            return stbi_write_bmp_to_func(func, context, nWidth, nHeight, 3, oImage8u.data());
+        case ImageFormat::tga:
+            return stbi_write_tga_to_func(func, context, nWidth, nHeight, 3, oImage8u.data());
+        default:
+            break;
+        };
+        return 0;
+    }
+
+    FILE* pStandardOutput = nullptr;
+
+    void setStandardOutput(FILE* pFile)
+    {
+        pStandardOutput = pFile;
+    }
+
+    // "-" is the standard output, flushed but left open by closeOutput
+    FILE* openOutput(const std::string& rFileName)
+    {
+        if (rFileName == "-")
+        {
+            return pStandardOutput ? pStandardOutput : stdout;
+        }
+        return fopen(rFileName.c_str(), "wb");
+    }
+
+    bool closeOutput(const std::string& rFileName, FILE* pFile)
+    {
+        return (rFileName == "-" ? fflush(pFile) : fclose(pFile)) == 0;
+    }
+
+    template<class I>
+    void saveImageFile(const std::string& rFileName, const I& rImage, ImageFormat eFormat, int nJpegQuality, IoTimes* pTimes)
+    {
+        FileSink oSink = { openOutput(rFileName), false, pTimes };
+        int ok = 0;
+        if (oSink.pFile)
+        {
+            ok = encode(writeToFile, &oSink, rImage, eFormat, nJpegQuality);
+            const auto oClose = pTimes ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            ok = closeOutput(rFileName, oSink.pFile) && ok && !oSink.bFailed;
+            if (pTimes)
+            {
+                pTimes->nWriteMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oClose).count();
+            }
+        }
+
+        if (!ok)
+        {
+            printf("Error: Can't save %s image\n", rFileName.c_str());
+            throw npp::Exception("std::saveImage failed (stbi_write returned 0)");
+        }
+    }
+
+    void saveImage(const std::string& rFileName, const npp::ImageCPU_8u_C3& rImage, ImageFormat eFormat, int nJpegQuality, IoTimes* pTimes)
+    {
+        saveImageFile(rFileName, rImage, eFormat, nJpegQuality, pTimes);
+    }
+
+    void saveImage(const std::string& rFileName, const npp::ImageCPU_16u_C3& rImage, ImageFormat eFormat, int nJpegQuality, IoTimes* pTimes)
+    {
+        saveImageFile(rFileName, rImage, eFormat, nJpegQuality, pTimes);
+    }
+
+    void saveImage(const std::string& rFileName, const npp::ImageCPU_32f_C3& rImage, ImageFormat eFormat, int nJpegQuality, IoTimes* pTimes)
+    {
+        saveImageFile(rFileName, rImage, eFormat, nJpegQuality, pTimes);
+    }
+
+    void saveImage(const std::string& rFileName, const npp::ImageCPU_8u_C3& rImage)
+    {
+        ImageFormat eFormat = ImageFormat::png;
+        formatFromFilename(rFileName, eFormat);
+        saveImage(rFileName, rImage, eFormat);
+    }
+
+    int PnmRowReader::nextByte()
+    {
+        if (_pStream)
+        {
+            char c;
+            return _pStream->read(&c, 1) == 1 ? (unsigned char)c : -1;
+        }
+        return _nOffset < _pFile->size() ? _pFile->data()[_nOffset++] : -1;
+    }
+
+    bool PnmRowReader::readHeader()
+    {
+        int nHeight = 0, nMaxValue = 0;
+        if (!pnmHeader([this]() { return nextByte(); }, _nWidth, nHeight, _nChannels, nMaxValue))
+        {
+            return false;
+        }
+        _nBytes = nMaxValue > 255 ? 2 : 1;
+        _oLine.resize((size_t)_nWidth * _nChannels * _nBytes);
+        return true;
+    }
+
+    bool PnmRowReader::open(const MappedFile& rFile)
+    {
+        _pFile = &rFile;
+        _pStream = nullptr;
+        _nOffset = 0;
+        return readHeader();
+    }
+
+    bool PnmRowReader::open(StreamReader& rStream)
+    {
+        _pFile = nullptr;
+        _pStream = &rStream;
+        // the header was read by the probe, replay it and read the raster once
+        rStream.stopRecording();
+        rStream.rewind();
+        return readHeader();
+    }
+
+    void PnmRowReader::readLine()
+    {
+        bool ok;
+        if (_pStream)
+        {
+            ok = _pStream->read((char*)_oLine.data(), (int)_oLine.size()) == (int)_oLine.size();
+        }
+        else
+        {
+            ok = _nOffset + _oLine.size() <= _pFile->size();
+            if (ok)
+            {
+                memcpy(_oLine.data(), _pFile->data() + _nOffset, _oLine.size());
+                _nOffset += _oLine.size();
+                _pFile->discard(_nOffset);
+            }
+        }
+        if (!ok)
+        {
+            printf("Error: %s is truncated\n", (_pStream ? _pStream->fileName() : _pFile->fileName()).c_str());
+            throw npp::Exception("stb::PnmRowReader failed (unexpected end of file)");
+        }
+    }
+
+    // big endian file samples to D, rescaled when the file depth differs
+    template<typename D>
+    void readPnmRows(const std::vector<unsigned char>& rLine, int nWidth, int nChannels, int nBytes,
+        D* pRows, int nStep, int nRows, const std::function<void()>& readLine)
+    {
+        for (int y = 0; y < nRows; ++y)
+        {
+            readLine();
+            D* pDst = (D*)((unsigned char*)pRows + (ptrdiff_t)y * nStep);
+            for (int x = 0; x < nWidth; ++x)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    const unsigned char* pSample = &rLine[((size_t)x * nChannels + (nChannels == 3 ? c : 0)) * nBytes];
+                    unsigned int v = nBytes == 2 ? (pSample[0] << 8) | pSample[1] : pSample[0];
+                    if (sizeof(D) == 1 && nBytes == 2)
+                    {
+                        v >>= 8;
+                    }
+                    else if (sizeof(D) == 2 && nBytes == 1)
+                    {
+                        v *= 257;
+                    }
+                    pDst[3 * x + c] = (D)v;
+                }
+            }
+        }
+    }
+
+    void PnmRowReader::readRows(Npp8u* pRows, int nStep, int nRows)
+    {
+        readPnmRows(_oLine, _nWidth, _nChannels, _nBytes, pRows, nStep, nRows, [this]() { readLine(); });
+    }
+
+    void PnmRowReader::readRows(Npp16u* pRows, int nStep, int nRows)
+    {
+        readPnmRows(_oLine, _nWidth, _nChannels, _nBytes, pRows, nStep, nRows, [this]() { readLine(); });
+    }
+
+    // zlib stream made of a single fixed Huffman deflate block, fed piecewise.
+    // Matches are searched in a 32K window of the previous input with hash chains,
+    // completed bytes are available in oOutput after every write()
+    class DeflateStream
+    {
+        static const int nWindow = 32768;
+        static const int nHashSize = 1 << 15;
+        static const int nMaxChain = 64;
+
+        std::vector<unsigned char> _oHistory;    // window followed by the pending input
+        size_t _nBase = 0;                       // stream position of _oHistory[0]
+        std::vector<long long> _aHead;
+        std::vector<long long> _aPrev;
+        unsigned int _nBitBuffer = 0;
+        int _nBitCount = 0;
+        unsigned int _nAdlerA = 1;
+        unsigned int _nAdlerB = 0;
+
+        void bits(unsigned int nValue, int nCount)
+        {
+            _nBitBuffer |= nValue << _nBitCount;
+            _nBitCount += nCount;
+            while (_nBitCount >= 8)
+            {
+                oOutput.push_back((unsigned char)(_nBitBuffer & 0xff));
+                _nBitBuffer >>= 8;
+                _nBitCount -= 8;
+            }
+        }
+
+        // Huffman codes are stored most significant bit first
+        void code(int nCode, int nCount)
+        {
+            bits((unsigned int)stbiw__zlib_bitrev(nCode, nCount), nCount);
+        }
+
+        void symbol(int nSymbol)
+        {
+            if (nSymbol <= 143)
+            {
+                code(0x30 + nSymbol, 8);
+            }
+            else if (nSymbol <= 255)
+            {
+                code(0x190 + nSymbol - 144, 9);
+            }
+            else if (nSymbol <= 279)
+            {
+                code(nSymbol - 256, 7);
+            }
+            else
+            {
+                code(0xc0 + nSymbol - 280, 8);
+            }
+        }
+
+        void match(int nLength, int nDistance)
+        {
+            static const unsigned short aLengthBase[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258,259 };
+            static const unsigned char aLengthBits[] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+            static const unsigned short aDistanceBase[] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577,32768 };
+            static const unsigned char aDistanceBits[] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+            int j = 0;
+            while (nLength >= aLengthBase[j + 1])
+            {
+                ++j;
+            }
+            symbol(257 + j);
+            bits(nLength - aLengthBase[j], aLengthBits[j]);
+
+            j = 0;
+            while (j < 29 && nDistance >= aDistanceBase[j + 1])
+            {
+                ++j;
+            }
+            code(j, 5);
+            bits(nDistance - aDistanceBase[j], aDistanceBits[j]);
+        }
+
+        static unsigned int hash(const unsigned char* p)
+        {
+            return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> 17;
+        }
+
+        void insert(size_t i)
+        {
+            const unsigned int h = hash(&_oHistory[i]);
+            const long long nPosition = (long long)(_nBase + i);
+            _aPrev[nPosition & (nWindow - 1)] = _aHead[h];
+            _aHead[h] = nPosition;
+        }
+
+    public:
+        std::vector<unsigned char> oOutput;
+
+        DeflateStream() : _aHead(nHashSize, -1), _aPrev(nWindow, -1)
+        {
+            oOutput = { 0x78, 0x01 };
+            bits(1, 1); // final block
+            bits(1, 2); // fixed Huffman codes
+        }
+
+        void write(const unsigned char* pData, size_t nSize)
+        {
+            for (size_t i = 0; i < nSize; ++i)
+            {
+                _nAdlerA = (_nAdlerA + pData[i]) % 65521;
+                _nAdlerB = (_nAdlerB + _nAdlerA) % 65521;
+            }
+
+            size_t i = _oHistory.size();
+            _oHistory.insert(_oHistory.end(), pData, pData + nSize);
+            const size_t nEnd = _oHistory.size();
+
+            while (i < nEnd)
+            {
+                int nBestLength = 0;
+                long long nBestDistance = 0;
+                if (i + 3 <= nEnd)
+                {
+                    const long long nPosition = (long long)(_nBase + i);
+                    const int nMaxLength = (int)std::min<size_t>(258, nEnd - i);
+                    long long nCandidate = _aHead[hash(&_oHistory[i])];
+                    for (int nChain = 0; nChain < nMaxChain && nCandidate >= (long long)_nBase && nPosition - nCandidate <= nWindow; ++nChain)
+                    {
+                        const unsigned char* pCandidate = &_oHistory[(size_t)(nCandidate - (long long)_nBase)];
+                        int nLength = 0;
+                        while (nLength < nMaxLength && pCandidate[nLength] == _oHistory[i + nLength])
+                        {
+                            ++nLength;
+                        }
+                        if (nLength > nBestLength)
+                        {
+                            nBestLength = nLength;
+                            nBestDistance = nPosition - nCandidate;
+                            if (nLength == nMaxLength)
+                            {
+                                break;
+                            }
+                        }
+                        const long long nNext = _aPrev[nCandidate & (nWindow - 1)];
+                        if (nNext >= nCandidate)
+                        {
+                            break;
+                        }
+                        nCandidate = nNext;
+                    }
+                    insert(i);
+                }
+
+                if (nBestLength >= 3)
+                {
+                    match(nBestLength, (int)nBestDistance);
+                    for (int k = 1; k < nBestLength; ++k)
+                    {
+                        if (i + k + 3 <= nEnd)
+                        {
+                            insert(i + k);
+                        }
+                    }
+                    i += nBestLength;
+                }
+                else
+                {
+                    symbol(_oHistory[i]);
+                    ++i;
+                }
+            }
+
+            // keep the window only
+            if (_oHistory.size() > (size_t)nWindow)
+            {
+                const size_t nDrop = _oHistory.size() - nWindow;
+                _oHistory.erase(_oHistory.begin(), _oHistory.begin() + nDrop);
+                _nBase += nDrop;
+            }
+        }
+
+        void finish()
+        {
+            symbol(256); // end of block
+            if (_nBitCount)
+            {
+                bits(0, 8 - _nBitCount);
+            }
+            const unsigned int nAdler = (_nAdlerB << 16) | _nAdlerA;
+            oOutput.push_back((unsigned char)(nAdler >> 24));
+            oOutput.push_back((unsigned char)(nAdler >> 16));
+            oOutput.push_back((unsigned char)(nAdler >> 8));
+            oOutput.push_back((unsigned char)nAdler);
+        }
+    };
+
+    // PNG scanline filter (none, sub, up, average, paeth) of one line of nBytes
+    void filterPngLine(int nType, const unsigned char* pLine, const unsigned char* pPrevious, int nBytes, int nPixelBytes, unsigned char* pDst)
+    {
+        for (int i = 0; i < nBytes; ++i)
+        {
+            const int a = i >= nPixelBytes ? pLine[i - nPixelBytes] : 0;
+            const int b = pPrevious[i];
+            const int c = i >= nPixelBytes ? pPrevious[i - nPixelBytes] : 0;
+            int nPredictor = 0;
+            switch (nType) {
+            case 1: nPredictor = a; break;
+            case 2: nPredictor = b; break;
+            case 3: nPredictor = (a + b) >> 1; break;
+            case 4: nPredictor = stbiw__paeth(a, b, c); break;
+            }
+            pDst[i] = (unsigned char)(pLine[i] - nPredictor);
+        }
+    }
+
+    struct StripWriter::State
+    {
+        std::string sFileName;
+        FileSink oSink = { nullptr, false };
+        ImageFormat eFormat = ImageFormat::png;
+        int nWidth = 0;
+        int nHeight = 0;
+        int nBytes = 1;
+        int nRows = 0;
+
+        // png only
+        DeflateStream oDeflate;
+        std::vector<unsigned char> oLine;
+        std::vector<unsigned char> oPrevious;
+        std::vector<unsigned char> oFiltered;
+        std::vector<unsigned char> oStrip;
+
+        void write(const void* pData, size_t nSize)
+        {
+            writeToFile(&oSink, (void*)pData, (int)nSize);
+        }
+
+        void writeChunk(const char* sTag, const unsigned char* pData, size_t nData)
+        {
+            std::vector<unsigned char> oChunk(12 + nData);
+            unsigned char* o = oChunk.data();
+            stbiw__wp32(o, (unsigned int)nData);
+            stbiw__wptag(o, sTag);
+            if (nData)
+            {
+                memcpy(o, pData, nData);
+            }
+            o += nData;
+            unsigned int crc = stbiw__crc32(oChunk.data() + 4, (int)nData + 4);
+            stbiw__wp32(o, crc);
+            write(oChunk.data(), oChunk.size());
+        }
+
+        // one IDAT chunk per strip with the deflate bytes completed so far
+        void flushDeflate()
+        {
+            if (!oDeflate.oOutput.empty())
+            {
+                writeChunk("IDAT", oDeflate.oOutput.data(), oDeflate.oOutput.size());
+                oDeflate.oOutput.clear();
+            }
+        }
+
+        template<typename D>
+        void writeRows(const D* pRows, int nStep, int nCount)
+        {
+            const size_t nLineBytes = (size_t)nWidth * 3 * nBytes;
+            for (int y = 0; y < nCount; ++y)
+            {
+                // big endian samples
+                const D* pSrc = (const D*)((const unsigned char*)pRows + (ptrdiff_t)y * nStep);
+                for (int i = 0; i < nWidth * 3; ++i)
+                {
+                    if (nBytes == 2)
+                    {
+                        oLine[2 * i] = (unsigned char)(pSrc[i] >> 8);
+                        oLine[2 * i + 1] = (unsigned char)(pSrc[i] & 0xff);
+                    }
+                    else
+                    {
+                        oLine[i] = (unsigned char)pSrc[i];
+                    }
+                }
+
+                if (eFormat == ImageFormat::pnm)
+                {
+                    write(oLine.data(), nLineBytes);
+                    continue;
+                }
+
+                // pick the filter with the smallest sum of absolute values, as stb_image_write does
+                int nBestType = 0;
+                long long nBestScore = -1;
+                for (int nType = 0; nType < 5; ++nType)
+                {
+                    filterPngLine(nType, oLine.data(), oPrevious.data(), (int)nLineBytes, 3 * nBytes, oFiltered.data());
+                    long long nScore = 0;
+                    for (size_t i = 0; i < nLineBytes; ++i)
+                    {
+                        nScore += abs((signed char)oFiltered[i]);
+                    }
+                    if (nBestScore < 0 || nScore < nBestScore)
+                    {
+                        nBestScore = nScore;
+                        nBestType = nType;
+                    }
+                }
+                filterPngLine(nBestType, oLine.data(), oPrevious.data(), (int)nLineBytes, 3 * nBytes, oFiltered.data());
+                oStrip.push_back((unsigned char)nBestType);
+                oStrip.insert(oStrip.end(), oFiltered.begin(), oFiltered.begin() + nLineBytes);
+                oLine.swap(oPrevious);
+            }
+            nRows += nCount;
+
+            if (eFormat == ImageFormat::png)
+            {
+                oDeflate.write(oStrip.data(), oStrip.size());
+                oStrip.clear();
+                flushDeflate();
+            }
+        }
+    };
+
+    StripWriter::StripWriter() = default;
+
+    StripWriter::~StripWriter()
+    {
+        if (_pState && _pState->oSink.pFile)
+        {
+            closeOutput(_pState->sFileName, _pState->oSink.pFile);
+        }
+    }
+
+    void StripWriter::open(const std::string& rFileName, ImageFormat eFormat, int nWidth, int nHeight, int nBitsPerChannel)
+    {
+        if (eFormat != ImageFormat::png && eFormat != ImageFormat::pnm)
+        {
+            printf("Error: %s, only png and pnm images can be written by strips\n", rFileName.c_str());
+            throw npp::Exception("stb::StripWriter failed (unsupported format)");
+        }
+
+        _pState = std::make_unique<State>();
+        State& s = *_pState;
+        s.sFileName = rFileName;
+        s.eFormat = eFormat;
+        s.nWidth = nWidth;
+        s.nHeight = nHeight;
+        s.nBytes = nBitsPerChannel > 8 ? 2 : 1;
+        s.oSink.pFile = openOutput(rFileName);
+        if (!s.oSink.pFile)
+        {
+            printf("Error: Can't save %s image\n", rFileName.c_str());
+            throw npp::Exception("stb::StripWriter failed (unable to open file)");
+        }
+
+        const size_t nLineBytes = (size_t)nWidth * 3 * s.nBytes;
+        s.oLine.resize(nLineBytes);
+        if (eFormat == ImageFormat::pnm)
+        {
+            char aHeader[64];
+            int nHeader = snprintf(aHeader, sizeof(aHeader), "P6\n%d %d\n%d\n", nWidth, nHeight, s.nBytes == 1 ? 255 : 65535);
+            s.write(aHeader, (size_t)nHeader);
+            return;
+        }
+
+        // the line above the first one is zero for the png filters
+        s.oPrevious.assign(nLineBytes, 0);
+        s.oFiltered.resize(nLineBytes);
+
+        static const unsigned char aSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        s.write(aSignature, 8);
+
+        unsigned char aHeader[13];
+        unsigned char* o = aHeader;
+        stbiw__wp32(o, nWidth);
+        stbiw__wp32(o, nHeight);
+        *o++ = (unsigned char)(8 * s.nBytes); // bit depth
+        *o++ = 2;  // truecolor
+        *o++ = 0;  // deflate
+        *o++ = 0;  // adaptive filtering
+        *o++ = 0;  // no interlace
+        s.writeChunk("IHDR", aHeader, 13);
+    }
+
+    void StripWriter::writeRows(const Npp8u* pRows, int nStep, int nRows)
+    {
+        _pState->writeRows(pRows, nStep, nRows);
+    }
+
+    void StripWriter::writeRows(const Npp16u* pRows, int nStep, int nRows)
+    {
+        _pState->writeRows(pRows, nStep, nRows);
+    }
+
+    void StripWriter::close()
+    {
+        State& s = *_pState;
+        if (s.eFormat == ImageFormat::png)
+        {
+            s.oDeflate.finish();
+            s.flushDeflate();
+            s.writeChunk("IEND", nullptr, 0);
+        }
+
+        // the file is closed even when rows are missing
+        const bool bClosed = closeOutput(s.sFileName, s.oSink.pFile);
+        s.oSink.pFile = nullptr;
+        const bool ok = bClosed && s.nRows == s.nHeight && !s.oSink.bFailed;
+        if (!ok)
+        {
+            printf("Error: Can't save %s image\n", s.sFileName.c_str());
+            throw npp::Exception("stb::StripWriter failed (write error)");
+        }
+    }
 } // namespace stb
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include "synthetic_image.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdlib>
+#include <type_traits>
+#include <vector>
+
+namespace synthetic {
+
+    namespace
+    {
+        // Integer hash with good avalanche, the random value of a lattice point or a sample
+        inline uint32_t mix(uint32_t n)
+        {
+            n ^= n >> 16;
+            n *= 0x7FEB352Du;
+            n ^= n >> 15;
+            n *= 0x846CA68Bu;
+            n ^= n >> 16;
+            return n;
+        }
+
+        inline uint32_t hash(uint32_t x, uint32_t y, uint32_t nSeed)
+        {
+            return mix(x ^ mix(y ^ mix(nSeed)));
+        }
+
+        inline float unit(uint32_t n)
+        {
+            return (float)(n >> 8) * (1.0f / (1 << 24));
+        }
+
+        // [0, 1] to the sample range
+        template<typename D>
+        inline D toSample(float nValue)
+        {
+            nValue = std::clamp(nValue, 0.0f, 1.0f);
+            if constexpr (std::is_same_v<D, Npp32f>)
+            {
+                return nValue;
+            }
+            else if constexpr (std::is_same_v<D, Npp16u>)
+            {
+                return (D)(nValue * 65535.0f + 0.5f);
+            }
+            else
+            {
+                return (D)(nValue * 255.0f + 0.5f);
+            }
+        }
+
+        // Random bits straight to a sample, uniform over every value of the integer samples
+        template<typename D>
+        inline D bitsToSample(uint32_t n)
+        {
+            if constexpr (std::is_same_v<D, Npp32f>)
+            {
+                return unit(n);
+            }
+            else
+            {
+                return (D)(n >> (32 - 8 * sizeof(D)));
+            }
+        }
+
+        // Sum of value noise octaves of row y, cells of 2^nFirstOctave to 2^nOctaves pixels. The amplitude
+        // of each octave proportional to its cell size gives the 1/f amplitude spectrum of natural images.
+        // Lattice values are hashed once per cell, the smoothstep weights once per octave
+        const int nOctaves = 9;
+
+        void naturalRow(int y, int nWidth, uint32_t nSeed, int nFirstOctave, std::vector<float>& rRow, std::vector<float>& rWeights)
+        {
+            rRow.assign(nWidth, 0.0f);
+            float nTotal = 0.0f;
+            for (int k = nFirstOctave; k <= nOctaves; ++k)
+            {
+                const int nCell = 1 << k;
+                const float nAmplitude = (float)nCell;
+                const uint32_t nOctaveSeed = nSeed * 31u + (uint32_t)k;
+                const uint32_t cy = (uint32_t)(y >> k);
+                float ty = (float)(y & (nCell - 1)) / nCell;
+                ty = ty * ty * (3.0f - 2.0f * ty);
+
+                rWeights.resize(nCell);
+                for (int i = 0; i < nCell; ++i)
+                {
+                    const float tx = (float)i / nCell;
+                    rWeights[i] = tx * tx * (3.0f - 2.0f * tx);
+                }
+
+                auto fColumn = [&](uint32_t cx) {
+                    const float nTop = unit(hash(cx, cy, nOctaveSeed));
+                    const float nBottom = unit(hash(cx, cy + 1, nOctaveSeed));
+                    return nTop + (nBottom - nTop) * ty;
+                };
+                float nLeft = fColumn(0);
+                for (int x0 = 0; x0 < nWidth; x0 += nCell)
+                {
+                    const float nRight = fColumn((uint32_t)(x0 >> k) + 1);
+                    const int nEnd = std::min(x0 + nCell, nWidth);
+                    const float nBase = nAmplitude * nLeft;
+                    const float nSlope = nAmplitude * (nRight - nLeft);
+                    for (int x = x0; x < nEnd; ++x)
+                    {
+                        rRow[x] += nBase + nSlope * rWeights[x - x0];
+                    }
+                    nLeft = nRight;
+                }
+                nTotal += nAmplitude;
+            }
+            // octaves average out around 0.5, stretched to use most of the range
+            for (float& rValue : rRow)
+            {
+                rValue = 0.5f + 2.5f * (rValue / nTotal - 0.5f);
+            }
+        }
+
+        template<typename D>
+        void generateRows(Pattern ePattern, D* pData, int nStep, int nWidth, int nBegin, int nEnd, int nHeight, uint32_t nSeed)
+        {
+            std::vector<float> aLuminance, aChroma[3], aWeights;
+            for (int y = nBegin; y < nEnd; ++y)
+            {
+                D* pRow = (D*)((unsigned char*)pData + (ptrdiff_t)y * nStep);
+                switch (ePattern)
+                {
+                case Pattern::noise:
+                    for (int i = 0; i < nWidth * 3; ++i)
+                    {
+                        pRow[i] = bitsToSample<D>(hash((uint32_t)i, (uint32_t)y, nSeed));
+                    }
+                    break;
+                case Pattern::gradient:
+                {
+                    const float nY = nHeight > 1 ? (float)y / (nHeight - 1) : 0.0f;
+                    for (int x = 0; x < nWidth; ++x)
+                    {
+                        const float nX = nWidth > 1 ? (float)x / (nWidth - 1) : 0.0f;
+                        pRow[3 * x] = toSample<D>(nX);
+                        pRow[3 * x + 1] = toSample<D>(nY);
+                        pRow[3 * x + 2] = toSample<D>(0.5f * (nX + nY));
+                    }
+                    break;
+                }
+                case Pattern::checkerboard:
+                    for (int x = 0; x < nWidth; ++x)
+                    {
+                        const D nSample = toSample<D>((x / nSquareSize + y / nSquareSize) % 2 ? 1.0f : 0.0f);
+                        pRow[3 * x] = pRow[3 * x + 1] = pRow[3 * x + 2] = nSample;
+                    }
+                    break;
+                case Pattern::constant:
+                    std::fill(pRow, pRow + (size_t)nWidth * 3, toSample<D>(0.5f));
+                    break;
+                case Pattern::natural:
+                    // a shared luminance and a weaker coarse field per channel, for colours that vary slowly
+                    naturalRow(y, nWidth, nSeed, 1, aLuminance, aWeights);
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        naturalRow(y, nWidth, nSeed + 1 + c, 6, aChroma[c], aWeights);
+                    }
+                    for (int x = 0; x < nWidth; ++x)
+                    {
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            pRow[3 * x + c] = toSample<D>(0.75f * aLuminance[x] + 0.25f * aChroma[c][x]);
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+
+        template<typename D>
+        void generateImage(Pattern ePattern, D* pData, int nStep, int nWidth, int nHeight, ThreadPool* pPool, uint32_t nSeed)
+        {
+            TRACE_ZONE("synthetic");
+            const int nMinBandRows = 16;
+            const int nBands = pPool ? std::clamp(nHeight / nMinBandRows, 1, pPool->size()) : 1;
+            auto fBand = [&](int iBand) {
+                generateRows(ePattern, pData, nStep, nWidth, (int)((long long)nHeight * iBand / nBands), (int)((long long)nHeight * (iBand + 1) / nBands), nHeight, nSeed);
+            };
+            if (nBands > 1)
+            {
+                pPool->parallelFor(nBands, fBand);
+            }
+            else
+            {
+                fBand(0);
+            }
+        }
+    }
+
+    bool parseSpec(const std::string& rText, Spec& rSpec)
+    {
+        const std::string::size_type nColon = rText.find(':');
+        const std::string sSize = rText.substr(0, nColon);
+        const std::string sPattern = nColon == std::string::npos ? "noise" : rText.substr(nColon + 1);
+
+        const std::string::size_type nCross = sSize.find('x');
+        if (nCross == std::string::npos)
+        {
+            return false;
+        }
+        char* end = nullptr;
+        const long nWidth = strtol(sSize.c_str(), &end, 10);
+        if (end != sSize.c_str() + nCross)
+        {
+            return false;
+        }
+        const long nHeight = strtol(sSize.c_str() + nCross + 1, &end, 10);
+        if (*end != 0 || nCross + 1 == sSize.size() || nWidth < 1 || nHeight < 1 || nWidth > nMaxSize || nHeight > nMaxSize)
+        {
+            return false;
+        }
+        rSpec.nWidth = (int)nWidth;
+        rSpec.nHeight = (int)nHeight;
+
+        for (Pattern ePattern : { Pattern::noise, Pattern::gradient, Pattern::checkerboard, Pattern::constant, Pattern::natural })
+        {
+            if (sPattern == name(ePattern))
+            {
+                rSpec.ePattern = ePattern;
+                return true;
+            }
+        }
+        if (sPattern == "1/f")
+        {
+            rSpec.ePattern = Pattern::natural;
+            return true;
+        }
+        return false;
+    }
+
+    const char* name(Pattern ePattern)
+    {
+        switch (ePattern)
+        {
+        case Pattern::noise:
+            return "noise";
+        case Pattern::gradient:
+            return "gradient";
+        case Pattern::checkerboard:
+            return "checkerboard";
+        case Pattern::constant:
+            return "constant";
+        case Pattern::natural:
+            return "natural";
+        }
+        return "";
+    }
+
+    void generate(Pattern ePattern, Npp8u* pData, int nStep, int nWidth, int nHeight, ThreadPool* pPool, uint32_t nSeed)
+    {
+        generateImage(ePattern, pData, nStep, nWidth, nHeight, pPool, nSeed);
+    }
+
+    void generate(Pattern ePattern, Npp16u* pData, int nStep, int nWidth, int nHeight, ThreadPool* pPool, uint32_t nSeed)
+    {
+        generateImage(ePattern, pData, nStep, nWidth, nHeight, pPool, nSeed);
+    }
+
+    void generate(Pattern ePattern, Npp32f* pData, int nStep, int nWidth, int nHeight, ThreadPool* pPool, uint32_t nSeed)
+    {
+        generateImage(ePattern, pData, nStep, nWidth, nHeight, pPool, nSeed);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <string>
+
+namespace
+{
+    // set in the pool workers, nested parallelFor calls run inline
+    thread_local bool bInsideTask = false;
+}
+
+ThreadPool::ThreadPool(int nThreads)
+{
+    if (nThreads <= 0)
+    {
+        nThreads = (int)std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (int i = 1; i < nThreads; ++i)
+    {
+        _aWorkers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> oLock(_oMutex);
+        _bStop = true;
+    }
+    _oWake.notify_all();
+    for (std::thread& rWorker : _aWorkers)
+    {
+        rWorker.join();
+    }
+}
+
+void ThreadPool::runTasks()
+{
+    const bool bWasInside = bInsideTask;
+    bInsideTask = true;
+    for (int i = _nNext++; i < _nTasks; i = _nNext++)
+    {
+        try
+        {
+            (*_pTask)(i);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> oLock(_oMutex);
+            if (!_pError)
+            {
+                _pError = std::current_exception();
+            }
+        }
+    }
+    bInsideTask = bWasInside;
+}
+
+void ThreadPool::work(int nWorker)
+{
+    TRACE_THREAD("worker " + std::to_string(nWorker));
+    unsigned long long nSeen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> oLock(_oMutex);
+            _oWake.wait(oLock, [&] { return _bStop || _nGeneration != nSeen; });
+            if (_bStop)
+            {
+                return;
+            }
+            nSeen = _nGeneration;
+        }
+
+        runTasks();
+
+        std::lock_guard<std::mutex> oLock(_oMutex);
+        if (--_nActive == 0)
+        {
+            _oDone.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(int nTasks, const std::function<void(int)>& fTask)
+{
+    std::unique_lock<std::mutex> oCall(_oCallMutex, std::defer_lock);
+    if (nTasks <= 1 || _aWorkers.empty() || bInsideTask || !oCall.try_lock())
+    {
+        for (int i = 0; i < nTasks; ++i)
+        {
+            fTask(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> oLock(_oMutex);
+        _pTask = &fTask;
+        _nTasks = nTasks;
+        _nNext = 0;
+        _nActive = (int)_aWorkers.size();
+        _pError = nullptr;
+        ++_nGeneration;
+    }
+    _oWake.notify_all();
+
+    runTasks();
+
+    std::exception_ptr pError;
+    {
+        std::unique_lock<std::mutex> oLock(_oMutex);
+        _oDone.wait(oLock, [&] { return _nActive == 0; });
+        _pTask = nullptr;
+        pError = _pError;
+    }
+    if (pError)
+    {
+        std::rethrow_exception(pError);
+    }
+}
\ No newline at end of file
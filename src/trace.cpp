@@ -0,0 +1,170 @@
+#include "trace.h"
+#include "stb_image_io.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+
+namespace trace {
+
+    std::atomic<bool> bEnabled{ false };
+
+    namespace
+    {
+        struct Event
+        {
+            const char* sName;
+            long long nIndex;
+            uint64_t nBegin;
+            uint64_t nEnd;
+        };
+
+        // Zones of one thread: only the thread writes, nCount is published after each event
+        struct ThreadBuffer
+        {
+            unsigned int nThread = 0;
+            std::string sName;
+            std::vector<Event> aEvents;
+            std::atomic<uint64_t> nCount{ 0 };
+            bool bFinished = false;
+        };
+
+        // buffers outlive their threads, the zones of finished threads are written too
+        std::mutex oBuffersMutex;
+        std::vector<std::unique_ptr<ThreadBuffer> > aBuffers;
+        unsigned int nThreads = 0;
+        uint64_t nStart = 0;
+
+        // Buffer of the calling thread, handed back when the thread ends
+        struct ThreadOwner
+        {
+            ThreadBuffer* pBuffer = nullptr;
+
+            ~ThreadOwner()
+            {
+                if (pBuffer)
+                {
+                    std::lock_guard<std::mutex> oLock(oBuffersMutex);
+                    pBuffer->bFinished = true;
+                }
+            }
+        };
+
+        thread_local ThreadOwner oThreadOwner;
+        thread_local std::string sThreadName;
+
+        ThreadBuffer& threadBuffer()
+        {
+            if (!oThreadOwner.pBuffer)
+            {
+                std::lock_guard<std::mutex> oLock(oBuffersMutex);
+                const size_t nFinished = std::count_if(aBuffers.begin(), aBuffers.end(),
+                    [](const std::unique_ptr<ThreadBuffer>& pBuffer) { return pBuffer->bFinished; });
+                std::unique_ptr<ThreadBuffer> pBuffer;
+                if (nFinished >= nFinishedThreads)
+                {
+                    // the zones of the oldest finished thread make room for this one
+                    auto iOldest = std::find_if(aBuffers.begin(), aBuffers.end(),
+                        [](const std::unique_ptr<ThreadBuffer>& pBuffer) { return pBuffer->bFinished; });
+                    pBuffer = std::move(*iOldest);
+                    aBuffers.erase(iOldest);
+                    pBuffer->nCount.store(0, std::memory_order_relaxed);
+                    pBuffer->bFinished = false;
+                }
+                else
+                {
+                    pBuffer.reset(new ThreadBuffer);
+                    pBuffer->aEvents.resize(nZonesPerThread);
+                }
+                pBuffer->nThread = ++nThreads;
+                pBuffer->sName = sThreadName.empty() ? "thread " + std::to_string(pBuffer->nThread) : sThreadName;
+                oThreadOwner.pBuffer = pBuffer.get();
+                aBuffers.push_back(std::move(pBuffer));
+            }
+            return *oThreadOwner.pBuffer;
+        }
+    }
+
+    void enable()
+    {
+        nStart = now();
+        bEnabled = true;
+    }
+
+    void setThreadName(const std::string& rName)
+    {
+        sThreadName = rName;
+        if (oThreadOwner.pBuffer)
+        {
+            std::lock_guard<std::mutex> oLock(oBuffersMutex);
+            oThreadOwner.pBuffer->sName = rName;
+        }
+    }
+
+    uint64_t now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(const char* sName, long long nIndex, uint64_t nBegin, uint64_t nEnd)
+    {
+        ThreadBuffer& rBuffer = threadBuffer();
+        const uint64_t nCount = rBuffer.nCount.load(std::memory_order_relaxed);
+        rBuffer.aEvents[nCount % nZonesPerThread] = { sName, nIndex, nBegin, nEnd };
+        rBuffer.nCount.store(nCount + 1, std::memory_order_release);
+    }
+
+    bool write(const std::string& rFileName)
+    {
+        std::ofstream oFile(rFileName);
+        if (!oFile)
+        {
+            return false;
+        }
+
+        char aNumbers[128];
+        bool bFirst = true;
+        oFile << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        std::lock_guard<std::mutex> oLock(oBuffersMutex);
+        for (const std::unique_ptr<ThreadBuffer>& pBuffer : aBuffers)
+        {
+            oFile << (bFirst ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << pBuffer->nThread << ", \"args\": {\"name\": ";
+            stb::writeJsonString(oFile, pBuffer->sName);
+            oFile << "}}";
+            bFirst = false;
+
+            // complete events in microseconds since enable(), the last nZonesPerThread zones of the thread
+            const uint64_t nCount = pBuffer->nCount.load(std::memory_order_acquire);
+            for (uint64_t i = nCount > nZonesPerThread ? nCount - nZonesPerThread : 0; i < nCount; ++i)
+            {
+                const Event& rEvent = pBuffer->aEvents[i % nZonesPerThread];
+                if (rEvent.nBegin < nStart)
+                {
+                    continue;
+                }
+                oFile << ",\n{\"name\": ";
+                stb::writeJsonString(oFile, rEvent.sName);
+                snprintf(aNumbers, sizeof(aNumbers), ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+                    pBuffer->nThread, (rEvent.nBegin - nStart) / 1e3, (rEvent.nEnd - rEvent.nBegin) / 1e3);
+                oFile << aNumbers;
+                if (rEvent.nIndex >= 0)
+                {
+                    oFile << ", \"args\": {\"index\": " << rEvent.nIndex << "}";
+                }
+                oFile << "}";
+            }
+        }
+        oFile << "\n]}" << std::endl;
+
+        // the zones of the finished threads are in the file, nothing records there anymore
+        if (oFile)
+        {
+            aBuffers.erase(std::remove_if(aBuffers.begin(), aBuffers.end(),
+                [](const std::unique_ptr<ThreadBuffer>& pBuffer) { return pBuffer->bFinished; }), aBuffers.end());
+        }
+        return (bool)oFile;
+    }
+}
\ No newline at end of file